@@ -0,0 +1,42 @@
+#include "Allocator.h"
+
+// replacement global new and delete for DEBUG_ALLOCATIONS, see Allocator.h
+
+#ifdef DEBUG_ALLOCATIONS
+
+static __thread uint64_t heapAllocations = 0;
+
+void * operator new( size_t bytes )
+{
+    heapAllocations++;
+    void * p = malloc( bytes ? bytes : 1 );
+    if ( !p )
+        throw std::bad_alloc();
+    return p;
+}
+
+void * operator new[]( size_t bytes )
+{
+    heapAllocations++;
+    void * p = malloc( bytes ? bytes : 1 );
+    if ( !p )
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete( void * p ) throw()
+{
+    free( p );
+}
+
+void operator delete[]( void * p ) throw()
+{
+    free( p );
+}
+
+uint64_t GetHeapAllocations()
+{
+    return heapAllocations;
+}
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include "Config.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <new>
+
+/*
+    Linear arena allocator.
+
+    One block is allocated up front and handed out in order. Individual
+    allocations are never freed, the whole arena is reset or freed at once.
+    Each table on the host gets its own arena, so a table's memory is one
+    contiguous block that is never shared with another table.
+
+    An arena can also be carved out of another arena. The world does this
+    for its per-step scratch: temporaries are allocated from the scratch
+    arena during the step and the whole thing is reset at the end, which
+    is just setting the offset back to zero.
+*/
+
+class Arena
+{
+public:
+
+    Arena()
+    {
+        memory = NULL;
+        size = 0;
+        offset = 0;
+        owner = false;
+    }
+
+    ~Arena()
+    {
+        Free();
+    }
+
+    void Initialize( size_t bytes )
+    {
+        Free();
+        memory = new uint8_t[bytes];
+        size = bytes;
+        offset = 0;
+        owner = true;
+    }
+
+    bool Initialize( Arena & parent, size_t bytes )
+    {
+        Free();
+        memory = (uint8_t*) parent.Allocate( bytes );
+        if ( !memory )
+            return false;
+        size = bytes;
+        offset = 0;
+        owner = false;
+        return true;
+    }
+
+    void Free()
+    {
+        if ( owner )
+            delete [] memory;
+        memory = NULL;
+        size = 0;
+        offset = 0;
+        owner = false;
+    }
+
+    void * Allocate( size_t bytes, size_t alignment = 16 )
+    {
+        assert( memory );
+        assert( ( alignment & ( alignment - 1 ) ) == 0 );
+
+        const uintptr_t base = (uintptr_t) memory;
+        const uintptr_t aligned = ( base + offset + alignment - 1 ) & ~( (uintptr_t) alignment - 1 );
+        const size_t start = aligned - base;
+
+        assert( start + bytes <= size );
+        if ( start + bytes > size )
+            return NULL;
+
+        offset = start + bytes;
+
+        return memory + start;
+    }
+
+    void Reset()
+    {
+        offset = 0;
+    }
+
+    size_t GetSize() const { return size; }
+
+    size_t GetUsed() const { return offset; }
+
+private:
+
+    Arena( const Arena & other );
+    Arena & operator = ( const Arena & other );
+
+    uint8_t * memory;
+    size_t size;
+    size_t offset;
+    bool owner;
+};
+
+// IMPORTANT: only for types that don't need their destructor called. arenas never run destructors
+
+template <typename T> T * AllocateArray( Arena & arena, int count, size_t alignment = 16 )
+{
+    T * array = (T*) arena.Allocate( sizeof( T ) * count, alignment );
+    if ( !array )
+        return NULL;
+    for ( int i = 0; i < count; ++i )
+        new ( array + i ) T();
+    return array;
+}
+
+// bytes needed for an array allocated with "AllocateArray", including worst case alignment padding
+
+template <typename T> size_t GetArraySize( int count, size_t alignment = 16 )
+{
+    return sizeof( T ) * count + alignment - 1;
+}
+
+/*
+    Heap allocation tracking.
+
+    With DEBUG_ALLOCATIONS defined in Config.h, global new and delete are
+    replaced with versions that count allocations per thread. Code that
+    must not allocate puts a "HeapAllocationCheck" on the stack, which
+    asserts that the count did not change by the time it goes out of scope.
+    The world does this for every step.
+
+    The replacement operators live in Allocator.cpp, so every program
+    must link it. Without DEBUG_ALLOCATIONS it is empty.
+*/
+
+#ifdef DEBUG_ALLOCATIONS
+
+uint64_t GetHeapAllocations();
+
+#else
+
+inline uint64_t GetHeapAllocations()
+{
+    return 0;
+}
+
+#endif
+
+struct HeapAllocationCheck
+{
+    HeapAllocationCheck()
+    {
+        start = GetHeapAllocations();
+    }
+
+    ~HeapAllocationCheck()
+    {
+        assert( GetHeapAllocations() == start );
+    }
+
+    uint64_t start;
+};
+
+#endif
@@ -0,0 +1,1434 @@
+/*
+    Benchmarks for virtual go
+    Copyright (c) 2005-2013, Glenn Fiedler. All rights reserved.
+*/
+
+#include "Common.h"
+#include "Stone.h"
+#include "Platform.h"
+#include "Biconvex.h"
+#include "CollisionDetection.h"
+#include "World.h"
+#include "GJK.h"
+#include "Host.h"
+#include "Snapshot.h"
+#include "Replication.h"
+#include "Loopback.h"
+#include "Interpolation.h"
+#include "Priority.h"
+#include "Determinism.h"
+#include "Rollback.h"
+#include "Trajectory.h"
+#include "Capture.h"
+#include "VideoStream.h"
+#include <vector>
+
+using namespace platform;
+
+const int NumStones = 1024;
+const int NumIterations = 1000;
+
+// --------------------------------------------------------------------------
+
+/*
+    The previous rigid body transform: two full 4x4 matrices, with the
+    inverse rebuilt each update. Kept here only as a reference to measure
+    the compact "RigidBodyTransform" against.
+*/
+
+struct MatrixTransform
+{
+    mat4f localToWorld, worldToLocal;
+
+    void Initialize( const vec3f & position, const quat4f & orientation )
+    {
+        mat4f rotation;
+        orientation.toMatrix( rotation );
+        localToWorld = rotation;
+        localToWorld.value.w = simd4f_create( position.x(), position.y(), position.z(), 1 );
+        worldToLocal = transpose( rotation );
+        const vec4f & translation = localToWorld.value.w;
+        worldToLocal.value.w = simd4f_create( -dot( localToWorld.value.x, translation ),
+                                              -dot( localToWorld.value.y, translation ),
+                                              -dot( localToWorld.value.z, translation ),
+                                              1.0f );
+    }
+};
+
+struct BenchmarkStone
+{
+    vec3f position;
+    quat4f orientation;
+};
+
+static void InitializeBenchmarkStones( const Board & board, const Biconvex & biconvex, BenchmarkStone * stones, int numStones )
+{
+    srand( 0 );
+
+    const float w = board.GetWidth() / 2;
+    const float h = board.GetHeight() / 2;
+    const float t = board.GetThickness();
+
+    for ( int i = 0; i < numStones; ++i )
+    {
+        stones[i].position = vec3f( random_float( -w, w ),
+                                    random_float( -h, h ),
+                                    t + random_float( 0, biconvex.GetHeight() * 0.5f ) );
+
+        stones[i].orientation = quat4f::axisRotation( random_float( 0, 2*pi ),
+                                                      normalize( vec3f( random_float( 0.1f, 1 ),
+                                                                        random_float( 0.1f, 1 ),
+                                                                        random_float( 0.1f, 1 ) ) ) );
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/*
+    Transform benchmark. This is the transform work done per stone in the
+    narrow phase vs. the primary surface: build the transform, bring the board
+    plane into local space, find the closest features then transform the
+    stone point, normal and board point back to world space.
+*/
+
+static float TransformKernel_Matrix( const Biconvex & biconvex, const BenchmarkStone * stones, MatrixTransform * transforms, int numStones, float t )
+{
+    float sum = 0.0f;
+
+    for ( int i = 0; i < numStones; ++i )
+        transforms[i].Initialize( stones[i].position, stones[i].orientation );
+
+    for ( int i = 0; i < numStones; ++i )
+    {
+        const MatrixTransform & transform = transforms[i];
+
+        vec4f plane = TransformPlane( transform.worldToLocal, vec4f(0,0,1,t) );
+
+        vec3f local_stonePoint, local_stoneNormal, local_boardPoint;
+        ClosestFeaturesBiconvexPlane_LocalSpace( vec3f( plane.x(), plane.y(), plane.z() ), plane.w(),
+                                                 biconvex, local_stonePoint, local_stoneNormal, local_boardPoint );
+
+        vec3f stonePoint = TransformPoint( transform.localToWorld, local_stonePoint );
+        vec3f stoneNormal = TransformVector( transform.localToWorld, local_stoneNormal );
+        vec3f boardPoint = TransformPoint( transform.localToWorld, local_boardPoint );
+
+        sum += stonePoint.z() + stoneNormal.z() + boardPoint.x();
+    }
+
+    return sum;
+}
+
+static float TransformKernel_Compact( const Biconvex & biconvex, const BenchmarkStone * stones, RigidBodyTransform * transforms, int numStones, float t )
+{
+    float sum = 0.0f;
+
+    for ( int i = 0; i < numStones; ++i )
+        transforms[i].Initialize( stones[i].position, stones[i].orientation );
+
+    for ( int i = 0; i < numStones; ++i )
+    {
+        const RigidBodyTransform & transform = transforms[i];
+
+        vec4f plane = TransformPlaneWorldToLocal( transform, vec4f(0,0,1,t) );
+
+        vec3f local_stonePoint, local_stoneNormal, local_boardPoint;
+        ClosestFeaturesBiconvexPlane_LocalSpace( vec3f( plane.x(), plane.y(), plane.z() ), plane.w(),
+                                                 biconvex, local_stonePoint, local_stoneNormal, local_boardPoint );
+
+        vec3f stonePoint = TransformPointLocalToWorld( transform, local_stonePoint );
+        vec3f stoneNormal = TransformVectorLocalToWorld( transform, local_stoneNormal );
+        vec3f boardPoint = TransformPointLocalToWorld( transform, local_boardPoint );
+
+        sum += stonePoint.z() + stoneNormal.z() + boardPoint.x();
+    }
+
+    return sum;
+}
+
+static void BenchmarkTransform( const Board & board, const Biconvex & biconvex, const BenchmarkStone * stones )
+{
+    printf( "transform:\n" );
+
+    MatrixTransform * matrixTransforms = new MatrixTransform[NumStones];
+    RigidBodyTransform * compactTransforms = new RigidBodyTransform[NumStones];
+
+    const float t = board.GetThickness();
+
+    Timer timer;
+    float sum = 0.0f;
+
+    timer.reset();
+    for ( int i = 0; i < NumIterations; ++i )
+        sum += TransformKernel_Matrix( biconvex, stones, matrixTransforms, NumStones, t );
+    const float matrixTime = timer.time();
+
+    timer.reset();
+    for ( int i = 0; i < NumIterations; ++i )
+        sum -= TransformKernel_Compact( biconvex, stones, compactTransforms, NumStones, t );
+    const float compactTime = timer.time();
+
+    const float scale = 1000000000.0f / ( NumIterations * NumStones );
+
+    printf( "    mat4f x 2:  %4d bytes, %6.2f ns/stone\n", (int) sizeof( MatrixTransform ), matrixTime * scale );
+    printf( "    compact:    %4d bytes, %6.2f ns/stone\n", (int) sizeof( RigidBodyTransform ), compactTime * scale );
+    printf( "    (checksum delta %f)\n", sum );
+
+    delete [] matrixTransforms;
+    delete [] compactTransforms;
+}
+
+// --------------------------------------------------------------------------
+
+/*
+    Collision benchmark. Full stone vs. board collision per stone
+    including the transform update, as done each iteration in the demos.
+*/
+
+static void BenchmarkCollision( const Board & board, const Biconvex & biconvex, const BenchmarkStone * stones )
+{
+    printf( "collision:\n" );
+
+    RigidBody * rigidBodies = new RigidBody[NumStones];
+
+    Timer timer;
+    int numContacts = 0;
+
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        for ( int j = 0; j < NumStones; ++j )
+        {
+            RigidBody & rigidBody = rigidBodies[j];
+            rigidBody.position = stones[j].position;
+            rigidBody.orientation = stones[j].orientation;
+            rigidBody.UpdateTransform();
+
+            StaticContact contact;
+            if ( StoneBoardCollision( biconvex, board, rigidBody, contact ) )
+                numContacts++;
+        }
+    }
+
+    const float time = timer.time();
+
+    printf( "    stone vs. board: %6.2f ns/stone (%d contacts per iteration)\n",
+        time * 1000000000.0f / ( NumIterations * NumStones ), numContacts / NumIterations );
+
+    delete [] rigidBodies;
+}
+
+// --------------------------------------------------------------------------
+
+/*
+    Support benchmark. Support interval of every stone along one axis,
+    one stone at a time vs. four and eight stones per packet.
+*/
+
+static void BenchmarkSupport( const Biconvex & biconvex, const BenchmarkStone * stones )
+{
+    printf( "support:\n" );
+
+    vec3f * positions = new vec3f[NumStones];
+    vec3f * ups = new vec3f[NumStones];
+    float * s1 = new float[NumStones];
+    float * s2 = new float[NumStones];
+
+    for ( int i = 0; i < NumStones; ++i )
+    {
+        RigidBodyTransform transform;
+        transform.Initialize( stones[i].position, stones[i].orientation );
+        positions[i] = stones[i].position;
+        transform.GetUp( ups[i] );
+    }
+
+    const vec3f axis = normalize( vec3f(1,2,3) );
+
+    Timer timer;
+
+    timer.reset();
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        for ( int j = 0; j < NumStones; ++j )
+            BiconvexSupport_WorldSpace( biconvex, positions[j], ups[j], axis, s1[j], s2[j] );
+    }
+    const float scalarTime = timer.time();
+
+    timer.reset();
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        for ( int j = 0; j < NumStones; j += 4 )
+        {
+            simd4f t1, t2;
+            BiconvexSupport_WorldSpace( biconvex, vec3x4f( positions + j ), vec3x4f( ups + j ), axis, t1, t2 );
+            simd4f_ustore4( t1, s1 + j );
+            simd4f_ustore4( t2, s2 + j );
+        }
+    }
+    const float packet4Time = timer.time();
+
+    timer.reset();
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        for ( int j = 0; j < NumStones; j += 8 )
+        {
+            simd8f t1, t2;
+            BiconvexSupport_WorldSpace( biconvex, vec3x8f( positions + j ), vec3x8f( ups + j ), axis, t1, t2 );
+            simd8f_ustore8( t1, s1 + j );
+            simd8f_ustore8( t2, s2 + j );
+        }
+    }
+    const float packet8Time = timer.time();
+
+    const float scale = 1000000000.0f / ( NumIterations * NumStones );
+
+    printf( "    scalar:     %6.2f ns/stone\n", scalarTime * scale );
+    printf( "    x4:         %6.2f ns/stone\n", packet4Time * scale );
+    printf( "    x8:         %6.2f ns/stone (%s)\n", packet8Time * scale, VECTORIAL_SIMD8_TYPE );
+
+    delete [] positions;
+    delete [] ups;
+    delete [] s1;
+    delete [] s2;
+}
+
+// --------------------------------------------------------------------------
+
+/*
+    Batch benchmark. Stone vs. board collision over every stone, one call
+    per stone vs. the batched pass: classify into region buckets, run the
+    primary surface as a packet kernel then the edges and corners scalar.
+*/
+
+static void BenchmarkBatch( const Board & board, const Biconvex & biconvex, const BenchmarkStone * stones )
+{
+    printf( "batch:\n" );
+
+    RigidBody * rigidBodies = new RigidBody[NumStones];
+    int * primary = new int[NumStones];
+    int * tail = new int[NumStones];
+    StaticContact * contacts = new StaticContact[NumStones];
+
+    for ( int i = 0; i < NumStones; ++i )
+    {
+        rigidBodies[i].position = stones[i].position;
+        rigidBodies[i].orientation = stones[i].orientation;
+        rigidBodies[i].UpdateTransform();
+    }
+
+    Timer timer;
+
+    int numScalarContacts = 0;
+    timer.reset();
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        int numContacts = 0;
+        for ( int j = 0; j < NumStones; ++j )
+        {
+            if ( StoneBoardCollision( biconvex, board, rigidBodies[j], contacts[numContacts] ) )
+                numContacts++;
+        }
+        numScalarContacts += numContacts;
+    }
+    const float scalarTime = timer.time();
+
+    int numBatchContacts = 0;
+    timer.reset();
+    for ( int i = 0; i < NumIterations; ++i )
+        numBatchContacts += StoneBoardCollision_Batch( biconvex, board, rigidBodies, NumStones, primary, tail, contacts );
+    const float batchTime = timer.time();
+
+    int numPrimary, numTail;
+    ClassifyStoneBoardRegions( board, biconvex.GetBoundingSphereRadius(), rigidBodies, NumStones, primary, numPrimary, tail, numTail );
+
+    const float scale = 1000000000.0f / ( NumIterations * NumStones );
+
+    printf( "    per stone:  %6.2f ns/stone (%d contacts per iteration)\n", scalarTime * scale, numScalarContacts / NumIterations );
+    printf( "    batch:      %6.2f ns/stone (%d contacts per iteration)\n", batchTime * scale, numBatchContacts / NumIterations );
+    printf( "    (%d primary, %d edge or corner, %d rejected)\n", numPrimary, numTail, NumStones - numPrimary - numTail );
+
+    delete [] rigidBodies;
+    delete [] primary;
+    delete [] tail;
+    delete [] contacts;
+}
+
+// --------------------------------------------------------------------------
+
+/*
+    SAT benchmark. Biconvex vs. biconvex separating axis test over the
+    candidate pairs of a crowded board, one pair at a time vs. the batch
+    testing eight pairs per packet.
+*/
+
+static void BenchmarkSAT( const Biconvex & biconvex, const BenchmarkStone * stones )
+{
+    printf( "sat:\n" );
+
+    vec3f * positions = new vec3f[NumStones];
+    vec3f * ups = new vec3f[NumStones];
+
+    for ( int i = 0; i < NumStones; ++i )
+    {
+        RigidBodyTransform transform;
+        transform.Initialize( stones[i].position, stones[i].orientation );
+        positions[i] = stones[i].position;
+        transform.GetUp( ups[i] );
+    }
+
+    // candidate pairs: bounding spheres overlap, as out of a broadphase
+
+    const float radius = biconvex.GetBoundingSphereRadius();
+
+    std::vector<BiconvexPair> pairs;
+    for ( int i = 0; i < NumStones; ++i )
+    {
+        for ( int j = i + 1; j < NumStones; ++j )
+        {
+            if ( length_squared( positions[j] - positions[i] ) < 4 * radius * radius )
+            {
+                BiconvexPair pair;
+                pair.a = i;
+                pair.b = j;
+                pairs.push_back( pair );
+            }
+        }
+    }
+
+    const int numPairs = (int) pairs.size();
+    int * hits = new int[numPairs];
+
+    Timer timer;
+
+    int numScalarHits = 0;
+    timer.reset();
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        for ( int j = 0; j < numPairs; ++j )
+        {
+            const BiconvexPair & pair = pairs[j];
+            if ( Biconvex_SAT( biconvex, positions[pair.a], positions[pair.b], ups[pair.a], ups[pair.b] ) )
+                numScalarHits++;
+        }
+    }
+    const float scalarTime = timer.time();
+
+    int numBatchHits = 0;
+    timer.reset();
+    for ( int i = 0; i < NumIterations; ++i )
+        numBatchHits += Biconvex_SAT_Batch( biconvex, positions, ups, &pairs[0], numPairs, hits );
+    const float batchTime = timer.time();
+
+    const float scale = 1000000000.0f / ( NumIterations * numPairs );
+
+    printf( "    %d candidate pairs\n", numPairs );
+    printf( "    per pair:   %6.2f ns/pair (%d hits per iteration)\n", scalarTime * scale, numScalarHits / NumIterations );
+    printf( "    x8 batch:   %6.2f ns/pair (%d hits per iteration, %s)\n", batchTime * scale, numBatchHits / NumIterations, VECTORIAL_SIMD8_TYPE );
+
+    delete [] positions;
+    delete [] ups;
+    delete [] hits;
+}
+
+// --------------------------------------------------------------------------
+
+/*
+    SDF benchmark. Signed distance and gradient for points around a stone,
+    one point at a time vs. the batched evaluation.
+*/
+
+static void BenchmarkSDF( const Biconvex & biconvex )
+{
+    printf( "sdf:\n" );
+
+    vec3f * points = new vec3f[NumStones];
+    vec3f * gradient = new vec3f[NumStones];
+    float * distance = new float[NumStones];
+
+    srand( 0 );
+
+    const float r = biconvex.GetBoundingSphereRadius() * 1.5f;
+    for ( int i = 0; i < NumStones; ++i )
+        points[i] = vec3f( random_float( -r, r ), random_float( -r, r ), random_float( -r, r ) );
+
+    Timer timer;
+
+    timer.reset();
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        for ( int j = 0; j < NumStones; ++j )
+            distance[j] = BiconvexSignedDistance_LocalSpace( points[j], biconvex, gradient[j] );
+    }
+    const float scalarTime = timer.time();
+
+    timer.reset();
+    for ( int i = 0; i < NumIterations; ++i )
+        BiconvexSignedDistance_LocalSpace( biconvex, points, NumStones, distance, gradient );
+    const float batchTime = timer.time();
+
+    const float scale = 1000000000.0f / ( NumIterations * NumStones );
+
+    printf( "    scalar:     %6.2f ns/point\n", scalarTime * scale );
+    printf( "    batch:      %6.2f ns/point (%s)\n", batchTime * scale, VECTORIAL_SIMD8_TYPE );
+
+    delete [] points;
+    delete [] gradient;
+    delete [] distance;
+}
+
+// --------------------------------------------------------------------------
+
+/*
+    GJK benchmark. Distance (or EPA penetration) between neighbouring
+    stones, cold vs. warm started from the previous iteration's simplex.
+    The stones don't move so this is the best case for coherence.
+*/
+
+static void BenchmarkGJK( const Biconvex & biconvex, const BenchmarkStone * stones )
+{
+    printf( "gjk:\n" );
+
+    RigidBodyTransform * transforms = new RigidBodyTransform[NumStones];
+    GJKCache * caches = new GJKCache[NumStones];
+
+    for ( int i = 0; i < NumStones; ++i )
+        transforms[i].Initialize( stones[i].position, stones[i].orientation );
+
+    const int numPairs = NumStones - 1;
+    const int iterations = NumIterations / 10;
+
+    Timer timer;
+
+    int coldIterations = 0;
+    int numIntersecting = 0;
+    timer.reset();
+    for ( int i = 0; i < iterations; ++i )
+    {
+        for ( int j = 0; j < numPairs; ++j )
+        {
+            GJKResult result;
+            if ( GJKDistance( BiconvexShape( biconvex, transforms[j] ), BiconvexShape( biconvex, transforms[j+1] ), result ) )
+                numIntersecting++;
+            coldIterations += result.iterations;
+        }
+    }
+    const float coldTime = timer.time();
+
+    int warmIterations = 0;
+    timer.reset();
+    for ( int i = 0; i < iterations; ++i )
+    {
+        for ( int j = 0; j < numPairs; ++j )
+        {
+            GJKResult result;
+            GJKDistance( BiconvexShape( biconvex, transforms[j] ), BiconvexShape( biconvex, transforms[j+1] ), result, &caches[j] );
+            warmIterations += result.iterations;
+        }
+    }
+    const float warmTime = timer.time();
+
+    const float scale = 1000000000.0f / ( iterations * numPairs );
+
+    printf( "    %d pairs, %d intersecting\n", numPairs, numIntersecting / iterations );
+    printf( "    cold:       %6.2f ns/pair (%.2f iterations)\n", coldTime * scale, coldIterations / float( iterations * numPairs ) );
+    printf( "    warm:       %6.2f ns/pair (%.2f iterations)\n", warmTime * scale, warmIterations / float( iterations * numPairs ) );
+
+    delete [] transforms;
+    delete [] caches;
+}
+
+// --------------------------------------------------------------------------
+
+/*
+    Host benchmark. Many tables on one host, first with stones dropping
+    onto every table, then with one table in sixteen active and the rest
+    empty. Reports how many active tables one core can keep at 60Hz.
+*/
+
+static void DropStones( World & world, int count )
+{
+    const float w = world.GetBoard().GetWidth() * 0.5f;
+    for ( int i = 0; i < count; ++i )
+    {
+        const vec3f position( random_float( -w, w ), random_float( -w, w ), random_float( 2, 10 ) );
+        const vec3f axis = normalize( vec3f( random_float( -1, 1 ), random_float( -1, 1 ), 1 ) );
+        world.AddStone( position, quat4f::axisRotation( random_float( 0, 2 * pi ), axis ) );
+    }
+}
+
+static void BenchmarkHost()
+{
+    printf( "host:\n" );
+
+    const int numStones = 32;
+    const int numTicks = 60;
+
+    HostParams params;
+    params.numTables = 256;
+    params.maxStonesPerTable = numStones * 2;
+
+    Host host;
+    host.Initialize( params );
+
+    for ( int i = 0; i < host.GetNumTables(); ++i )
+        DropStones( host.GetWorld( i ), numStones );
+
+    for ( int i = 0; i < numTicks; ++i )
+        host.Tick();
+
+    const HostStats busy = host.GetStats();
+
+    // same host again with stones dropping on one table in sixteen
+
+    host.Initialize( params );
+
+    for ( int i = 0; i < host.GetNumTables(); i += 16 )
+        DropStones( host.GetWorld( i ), numStones );
+
+    for ( int i = 0; i < numTicks; ++i )
+        host.Tick();
+
+    const HostStats quiet = host.GetStats();
+
+    printf( "    %d tables, %d stones each, %d workers\n", params.numTables, numStones, params.numWorkers );
+    printf( "    all active:     %6.2f ms/tick, %.1f%% ticks over budget, %6.1f us/table, %6.1f tables/core\n",
+        busy.tickTime * 1000.0 / busy.ticks, 100.0 * busy.ticksOverBudget / busy.ticks,
+        busy.stepTime * 1000000.0 / busy.tablesStepped, busy.GetTablesPerCore( params.tickRate ) );
+    printf( "    1 in 16 active: %6.2f ms/tick, %.1f%% ticks over budget, %6.1f us/table, %d tables idle per tick\n",
+        quiet.tickTime * 1000.0 / quiet.ticks, 100.0 * quiet.ticksOverBudget / quiet.ticks,
+        quiet.stepTime * 1000000.0 / max( 1.0f, float( quiet.tablesStepped ) ), int( quiet.tablesIdle / quiet.ticks ) );
+}
+
+// --------------------------------------------------------------------------
+
+/*
+    Snapshot benchmark. A full 19x19 board of stones, measured while the
+    stones are still dropping and again once they have all gone to sleep.
+*/
+
+static void BenchmarkSnapshot()
+{
+    printf( "snapshot:\n" );
+
+    const int numStones = MaxSnapshotStones;
+    const int iterations = NumIterations;
+
+    Arena arena;
+    arena.Initialize( World::GetMemoryRequired( numStones ) );
+
+    World world;
+    world.Initialize( arena, 19, STONE_SIZE_40, numStones );
+    DropStones( world, numStones );
+
+    SnapshotParams params;
+    params.Initialize( world.GetBoard() );
+
+    static Snapshot snapshot, received;
+    static uint8_t buffer[16*1024];
+
+    const char * labels[] = { "moving:  ", "sleeping:" };
+
+    for ( int pass = 0; pass < 2; ++pass )
+    {
+        if ( pass == 0 )
+        {
+            for ( int i = 0; i < 10; ++i )
+                world.Step( 1.0f / 60.0f );
+        }
+        else
+        {
+            while ( world.IsAwake() )
+                world.Step( 1.0f / 60.0f );
+        }
+
+        Timer timer;
+
+        int bytes = 0;
+        timer.reset();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            CaptureSnapshot( params, world, uint16_t( i ), snapshot );
+            BitWriter writer( buffer, sizeof( buffer ) );
+            WriteSnapshot( writer, params, snapshot );
+            writer.FlushBits();
+            bytes = writer.GetBytesWritten();
+        }
+        const float encodeTime = timer.time();
+
+        timer.reset();
+        for ( int i = 0; i < iterations; ++i )
+        {
+            BitReader reader( buffer, bytes );
+            ReadSnapshot( reader, params, received );
+            for ( int j = 0; j < received.numStones; ++j )
+            {
+                RigidBody rigidBody;
+                DequantizeStone( params, received.stones[j], rigidBody );
+            }
+        }
+        const float decodeTime = timer.time();
+
+        const float scale = 1000000000.0f / ( iterations * numStones );
+
+        printf( "    %s %5d bytes, %5.2f bytes/stone, %6.1f kbytes/sec at 60Hz, encode %6.2f ns/stone, decode %6.2f ns/stone\n",
+            labels[pass], bytes, bytes / float( numStones ), bytes * 60 / 1000.0f, encodeTime * scale, decodeTime * scale );
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/*
+    Delta benchmark. Records a session of a game in progress: a board
+    half full of stones at rest, with a new stone placed every third of
+    a second. Each frame is then encoded in full and as a delta against
+    the snapshot from 100ms earlier, as if that was the last one acked.
+*/
+
+static void BenchmarkDelta()
+{
+    printf( "delta:\n" );
+
+    const int numFrames = 600;
+    const int initialStones = 180;
+    const int placeInterval = 20;
+    const int ackDelay = 6;
+    const int maxStones = initialStones + numFrames / placeInterval;
+
+    Arena arena;
+    arena.Initialize( World::GetMemoryRequired( maxStones ) );
+
+    World world;
+    world.Initialize( arena, 19, STONE_SIZE_40, maxStones );
+
+    SnapshotParams params;
+    params.Initialize( world.GetBoard() );
+
+    const Board & board = world.GetBoard();
+    const float height = world.GetBiconvex().GetHeight() * 0.5f;
+
+    int point = 0;
+    for ( ; point < initialStones; ++point )
+        world.AddStone( board.GetPointPosition( 1 + ( point * 7 ) % 19, 1 + point / 19 ) + vec3f( 0, 0, height ), quat4f::identity() );
+
+    while ( world.IsAwake() )
+        world.Step( 1.0f / 60.0f );
+
+    Snapshot * session = new Snapshot[numFrames];
+
+    for ( int i = 0; i < numFrames; ++i )
+    {
+        if ( ( i % placeInterval ) == 0 )
+        {
+            const vec3f position = board.GetPointPosition( 1 + ( point * 7 ) % 19, 1 + point / 19 ) + vec3f( 0, 0, 3 );
+            world.AddStone( position, quat4f::axisRotation( 0.3f, vec3f(1,0,0) ) );
+            point++;
+        }
+
+        world.Step( 1.0f / 60.0f );
+
+        CaptureSnapshot( params, world, uint16_t( i ), session[i] );
+    }
+
+    static uint8_t buffer[16*1024];
+    static Snapshot received;
+
+    Timer timer;
+
+    uint64_t fullBits = 0;
+    uint64_t deltaBits = 0;
+    uint64_t stones = 0;
+    float fullEncode = 0, fullDecode = 0, deltaEncode = 0, deltaDecode = 0;
+
+    for ( int i = ackDelay; i < numFrames; ++i )
+    {
+        const Snapshot & snapshot = session[i];
+        const Snapshot & baseline = session[i-ackDelay];
+
+        stones += snapshot.numStones;
+
+        timer.reset();
+        BitWriter fullWriter( buffer, sizeof( buffer ) );
+        WriteSnapshot( fullWriter, params, snapshot );
+        fullWriter.FlushBits();
+        fullEncode += timer.time();
+        fullBits += fullWriter.GetBitsWritten();
+
+        timer.reset();
+        BitReader fullReader( buffer, fullWriter.GetBytesWritten() );
+        ReadSnapshot( fullReader, params, received );
+        fullDecode += timer.time();
+
+        timer.reset();
+        BitWriter deltaWriter( buffer, sizeof( buffer ) );
+        WriteSnapshotDelta( deltaWriter, params, snapshot, baseline );
+        deltaWriter.FlushBits();
+        deltaEncode += timer.time();
+        deltaBits += deltaWriter.GetBitsWritten();
+
+        timer.reset();
+        BitReader deltaReader( buffer, deltaWriter.GetBytesWritten() );
+        ReadSnapshotDelta( deltaReader, params, baseline, received );
+        deltaDecode += timer.time();
+    }
+
+    const float frames = float( numFrames - ackDelay );
+    const float scale = 1000000000.0f / stones;
+
+    printf( "    %d frames, %d to %d stones, baseline %d frames behind\n", numFrames, initialStones, world.GetNumBodies(), ackDelay );
+    printf( "    full:   %6.2f bits/stone, %6.1f kbytes/sec at 60Hz, encode %6.2f ns/stone, decode %6.2f ns/stone\n",
+        fullBits / float( stones ), fullBits / 8 / frames * 60 / 1000, fullEncode * scale, fullDecode * scale );
+    printf( "    delta:  %6.2f bits/stone, %6.1f kbytes/sec at 60Hz, encode %6.2f ns/stone, decode %6.2f ns/stone\n",
+        deltaBits / float( stones ), deltaBits / 8 / frames * 60 / 1000, deltaEncode * scale, deltaDecode * scale );
+
+    delete [] session;
+}
+
+// --------------------------------------------------------------------------
+
+/*
+    Loopback benchmark. One server and sixteen clients in process, with
+    stones dropping onto the server board. Run under a perfect network
+    and under a bad one, reporting bandwidth each way, per packet stats
+    and how far behind the server the clients are.
+*/
+
+static void BenchmarkLoopback()
+{
+    printf( "loopback:\n" );
+
+    const int numTicks = 60 * 10;
+
+    for ( int pass = 0; pass < 2; ++pass )
+    {
+        LoopbackParams params;
+        params.numClients = 16;
+        params.maxStones = 128;
+        params.snapshotRate = 30;
+
+        if ( pass == 1 )
+        {
+            params.networkParams.latency = 0.1f;
+            params.networkParams.jitter = 0.02f;
+            params.networkParams.packetLoss = 5.0f;
+            params.networkParams.duplicates = 1.0f;
+        }
+
+        Loopback loopback;
+        loopback.Initialize( params );
+
+        // a handful of stones dropped every second, so there is always something moving
+
+        Timer timer;
+        for ( int i = 0; i < numTicks; ++i )
+        {
+            if ( ( i % 60 ) == 0 )
+                DropStones( loopback.GetServer(), 8 );
+            loopback.Update();
+        }
+        const float time = timer.time();
+
+        const NetworkStats & server = loopback.GetSimulator().GetStats( 0 );
+        const NetworkStats & client = loopback.GetSimulator().GetStats( 1 );
+        const LoopbackStats & stats = loopback.GetStats();
+
+        printf( "    %s: %d clients, %d stones, %d snapshots/sec\n",
+            pass == 0 ? "perfect network" : "100ms +/- 20ms, 5% loss, 1% duplicates",
+            params.numClients, loopback.GetServer().GetNumBodies(), params.snapshotRate );
+        printf( "        server to clients %7.1f kbytes/sec, clients to server %5.1f kbytes/sec, %6.2f ms/tick\n",
+            loopback.GetServerBytesPerSecond() / 1000, loopback.GetClientBytesPerSecond() / 1000, time * 1000 / numTicks );
+        printf( "        %d packets sent, %d lost, %d duplicated, %.1f bytes/packet, latency %.1f ms avg %.1f ms max\n",
+            int( server.packetsSent ), int( server.packetsLost ), int( server.packetsDuplicated ),
+            server.bytesSent / float( server.packetsSent ), client.GetAverageLatency() * 1000, client.maxLatency * 1000 );
+        printf( "        staleness %.1f ms avg %.1f ms max, %d snapshots applied, %d rejected\n",
+            stats.GetAverageStaleness() * 1000, stats.maxStaleness * 1000, int( stats.snapshotsApplied ), int( stats.snapshotsRejected ) );
+    }
+}
+
+static void BenchmarkInterpolation()
+{
+    printf( "interpolation:\n" );
+
+    const int numTicks = 60 * 10;
+    const int snapshotRates[] = { 60, 20, 10 };
+
+    for ( int pass = 0; pass < 3; ++pass )
+    {
+        LoopbackParams params;
+        params.numClients = 4;
+        params.maxStones = 128;
+        params.snapshotRate = snapshotRates[pass];
+        params.networkParams.latency = 0.05f;
+        params.networkParams.jitter = 0.02f;
+        params.networkParams.packetLoss = 5.0f;
+        params.jitterParams.maxStones = 128;
+        params.jitterParams.playoutDelay = 1.0f / params.snapshotRate + 0.05f;
+
+        Loopback loopback;
+        loopback.Initialize( params );
+
+        InterpolatedStone stones[128];
+
+        // every client interpolates once per server tick, as if rendering at 60fps
+
+        double interpolateTime = 0.0;
+        uint64_t stonesInterpolated = 0;
+
+        for ( int i = 0; i < numTicks; ++i )
+        {
+            if ( ( i % 60 ) == 0 )
+                DropStones( loopback.GetServer(), 8 );
+
+            loopback.Update();
+
+            Timer timer;
+            for ( int j = 0; j < params.numClients; ++j )
+                stonesInterpolated += loopback.InterpolateClient( j, stones );
+            interpolateTime += timer.time();
+        }
+
+        uint64_t interpolated = 0;
+        uint64_t extrapolated = 0;
+        uint64_t held = 0;
+        for ( int j = 0; j < params.numClients; ++j )
+        {
+            const JitterBufferStats & stats = loopback.GetJitterBuffer( j ).GetStats();
+            interpolated += stats.framesInterpolated;
+            extrapolated += stats.framesExtrapolated;
+            held += stats.framesHeld;
+        }
+        const float frames = float( interpolated + extrapolated + held );
+
+        printf( "    %d snapshots/sec, %.0fms playout delay: %7.1f kbytes/sec per client\n",
+            params.snapshotRate, params.jitterParams.playoutDelay * 1000, loopback.GetServerBytesPerSecond() / params.numClients / 1000 );
+        printf( "        %5.1f%% interpolated, %4.1f%% extrapolated, %4.1f%% held, %5.1f ns per stone\n",
+            interpolated * 100 / frames, extrapolated * 100 / frames, held * 100 / frames,
+            stonesInterpolated ? float( interpolateTime * 1000000000.0 / stonesInterpolated ) : 0.0f );
+    }
+}
+
+static void BenchmarkPriority()
+{
+    printf( "priority:\n" );
+
+    const int numTicks = 60 * 10;
+    const int budgets[] = { 0, 1200, 400 };
+
+    for ( int pass = 0; pass < 3; ++pass )
+    {
+        LoopbackParams params;
+        params.numClients = 4;
+        params.maxStones = 128;
+        params.snapshotRate = 30;
+        params.networkParams.latency = 0.05f;
+        params.networkParams.packetLoss = 5.0f;
+        params.priorityUpdates = budgets[pass] > 0;
+        params.priorityParams.maxBytes = budgets[pass] > 0 ? budgets[pass] : 256;
+
+        Loopback loopback;
+        loopback.Initialize( params );
+
+        // a bowl spill: 96 stones all moving at once, then settling
+
+        srand( 1 );
+        DropStones( loopback.GetServer(), 96 );
+
+        double totalError = 0.0;
+        float maxError = 0.0f;
+        uint64_t samples = 0;
+
+        for ( int i = 0; i < numTicks; ++i )
+        {
+            loopback.Update();
+
+            // position error of the first client's view against the server, for every stone it has
+
+            const World & server = loopback.GetServer();
+            const World & client = loopback.GetClient( 0 );
+            const int numStones = client.GetNumBodies() < server.GetNumBodies() ? client.GetNumBodies() : server.GetNumBodies();
+            for ( int j = 0; j < numStones; ++j )
+            {
+                const float error = length( server.GetBody( j ).position - client.GetBody( j ).position );
+                totalError += error;
+                if ( error > maxError )
+                    maxError = error;
+                samples++;
+            }
+        }
+
+        const NetworkStats & stats = loopback.GetSimulator().GetStats( 0 );
+
+        if ( pass == 0 )
+            printf( "    delta snapshots:\n" );
+        else
+            printf( "    state updates, %d byte budget:\n", budgets[pass] );
+
+        printf( "        %6.1f kbytes/sec per client, %6.1f bytes/packet, error %.2f cm avg %.2f cm max\n",
+            loopback.GetServerBytesPerSecond() / params.numClients / 1000, stats.bytesSent / float( stats.packetsSent ),
+            samples ? float( totalError / samples ) : 0.0f, maxError );
+    }
+}
+
+static void BenchmarkChecksum()
+{
+    printf( "checksum:\n" );
+
+    const int numStones = 19 * 19;
+    const int numFrames = 10000;
+
+    Arena arena;
+    arena.Initialize( World::GetMemoryRequired( numStones ) );
+
+    World world;
+    world.Initialize( arena, 19, STONE_SIZE_40, numStones );
+    DropStones( world, numStones );
+    world.Step( 1.0f / 60.0f );
+
+    const RigidBody * rigidBodies = &world.GetBody( 0 );
+
+    // the old byte at a time hash over the same primary state, for comparison
+
+    uint32_t oldHash = 0;
+    Timer timer;
+    for ( int i = 0; i < numFrames; ++i )
+    {
+        for ( int j = 0; j < numStones; ++j )
+        {
+            const RigidBody & rigidBody = rigidBodies[j];
+            const float state[] =
+            {
+                rigidBody.position.x(), rigidBody.position.y(), rigidBody.position.z(),
+                rigidBody.orientation.x, rigidBody.orientation.y, rigidBody.orientation.z, rigidBody.orientation.w,
+                rigidBody.linearMomentum.x(), rigidBody.linearMomentum.y(), rigidBody.linearMomentum.z(),
+                rigidBody.angularMomentum.x(), rigidBody.angularMomentum.y(), rigidBody.angularMomentum.z(),
+                rigidBody.active ? 1.0f : 0.0f
+            };
+            oldHash = hash( (const uint8_t*) state, sizeof( state ), oldHash );
+        }
+    }
+    const float oldTime = timer.time();
+
+    static uint32_t bodyHashes[numStones];
+    uint64_t newHash = 0;
+    timer.reset();
+    for ( int i = 0; i < numFrames; ++i )
+        newHash += HashBodies( rigidBodies, numStones, bodyHashes ) + bodyHashes[i % numStones];
+    const float newTime = timer.time();
+
+    printf( "    %d stones: hash %.1f ns per stone, hash64 with per stone hashes %.1f ns per stone (%x %x)\n",
+        numStones, oldTime * 1000000000.0f / ( numFrames * numStones ), newTime * 1000000000.0f / ( numFrames * numStones ),
+        oldHash, uint32_t( newHash ) );
+}
+
+static void BenchmarkRollback()
+{
+    printf( "rollback:\n" );
+
+    const int numStones = 64;
+    const int maxFrames = 64;
+    const int rewindFrames = 30;
+    const int numRewinds = 100;
+    const float dt = 1.0f / 60.0f;
+
+    Arena arena;
+    arena.Initialize( World::GetMemoryRequired( numStones ) );
+
+    World world;
+    world.Initialize( arena, 19, STONE_SIZE_40, numStones );
+    DropStones( world, numStones );
+
+    RollbackBuffer rollback;
+    rollback.Initialize( maxFrames, numStones );
+
+    // save cost while the stones fall, then once they have settled
+
+    int64_t frame = 0;
+    double awakeTime = 0.0;
+    int awakeFrames = 0;
+    Timer timer;
+    while ( world.IsAwake() && frame < 60 * 60 )
+    {
+        timer.reset();
+        rollback.SaveFrame( frame++, world );
+        awakeTime += timer.time();
+        awakeFrames++;
+        world.Step( dt );
+    }
+
+    timer.reset();
+    for ( int i = 0; i < 10000; ++i )
+        rollback.SaveFrame( frame++, world );
+    const double sleepingTime = timer.time();
+
+    printf( "    %d stones: save %.2f us per frame awake, %.2f us per frame asleep, %d copies held for %d frames\n",
+        numStones, awakeTime * 1000000.0 / awakeFrames, sleepingTime * 1000000.0 / 10000, rollback.GetNumCopies(), maxFrames );
+
+    // drop a fresh set of stones, then repeatedly rewind while they fall and simulate back to the present
+
+    Arena fallingArena;
+    fallingArena.Initialize( World::GetMemoryRequired( numStones ) );
+
+    World falling;
+    falling.Initialize( fallingArena, 19, STONE_SIZE_40, numStones );
+    DropStones( falling, numStones );
+
+    rollback.Reset();
+
+    frame = 0;
+    for ( int i = 0; i < maxFrames; ++i )
+    {
+        rollback.SaveFrame( frame++, falling );
+        falling.Step( dt );
+    }
+
+    double rewindTime = 0.0;
+    double simulateTime = 0.0;
+    for ( int i = 0; i < numRewinds; ++i )
+    {
+        timer.reset();
+        rollback.Rewind( frame - rewindFrames, falling );
+        rewindTime += timer.time();
+
+        timer.reset();
+        falling.Step( dt );
+        for ( int64_t j = frame - rewindFrames + 1; j < frame; ++j )
+        {
+            rollback.SaveFrame( j, falling );
+            falling.Step( dt );
+        }
+        simulateTime += timer.time();
+    }
+
+    printf( "    rewind %d frames: %.2f us, re-simulate %.1f frames per ms (%d awake)\n",
+        rewindFrames, rewindTime * 1000000.0 / numRewinds, numRewinds * rewindFrames / ( simulateTime * 1000.0 ), falling.GetNumActive() );
+}
+
+static void BenchmarkTrajectory()
+{
+    printf( "trajectory:\n" );
+
+    const int numStones = 64;
+    const int numFrames = 1200;
+    const int keyframeInterval = 60;
+    const int numSeeks = 1000;
+    const float dt = 1.0f / 60.0f;
+    const char filename[] = "benchmark_trajectory.bin";
+
+    Arena arena;
+    arena.Initialize( World::GetMemoryRequired( numStones ) );
+
+    World world;
+    world.Initialize( arena, 19, STONE_SIZE_40, numStones );
+    DropStones( world, numStones );
+
+    TrajectoryWriter writer;
+    if ( !writer.Open( filename, numStones, keyframeInterval ) )
+    {
+        printf( "    failed to open %s\n", filename );
+        return;
+    }
+
+    double stepTime = 0.0;
+    double writeTime = 0.0;
+    Timer timer;
+    for ( int i = 0; i < numFrames; ++i )
+    {
+        timer.reset();
+        world.Step( dt );
+        stepTime += timer.time();
+
+        timer.reset();
+        writer.Write( world );
+        writeTime += timer.time();
+    }
+    writer.Close();
+
+    printf( "    %d stones, %d frames: write %.2f us per frame, %.1f bytes per frame (%d keyframed)\n",
+        numStones, numFrames, writeTime * 1000000.0 / numFrames, double( writer.GetBytesWritten() ) / numFrames, numStones * TrajectoryBodyBytes );
+
+    TrajectoryReader reader;
+    if ( !reader.Open( filename ) )
+    {
+        printf( "    failed to read %s\n", filename );
+        return;
+    }
+
+    static TrajectoryBody bodies[numStones];
+
+    // random access against simulating from the start, which on average goes through half the frames
+
+    int total = 0;
+    timer.reset();
+    for ( int i = 0; i < numSeeks; ++i )
+        total += reader.ReadFrame( ( i * 7919 ) % numFrames, bodies );
+    const double seekTime = timer.time();
+
+    printf( "    seek %.2f us, %.1f frames decoded per seek, simulating to the same frame %.0f us (%d)\n",
+        seekTime * 1000000.0 / numSeeks, double( reader.GetFramesDecoded() ) / numSeeks,
+        stepTime * 1000000.0 * 0.5, total );
+
+    reader.Close();
+    remove( filename );
+}
+
+static void BenchmarkCapture()
+{
+    printf( "capture:\n" );
+
+    const int width = 1280;
+    const int height = 720;
+    const int numFrames = 120;
+    const char format[] = "benchmark_frame-%05d.tga";
+
+    // synthetic frames: a flat background with a square moving across it, like a stone over the board
+
+    uint8_t * pixels = new uint8_t[width * height * 3];
+
+    struct Frames
+    {
+        static void Fill( uint8_t * pixels, int width, int height, int frame )
+        {
+            for ( int y = 0; y < height; ++y )
+            {
+                for ( int x = 0; x < width; ++x )
+                {
+                    uint8_t * p = pixels + ( y * width + x ) * 3;
+                    const bool square = x >= frame * 8 && x < frame * 8 + 64 && y >= 300 && y < 364;
+                    p[0] = square ? 240 : 40 + y / 16;
+                    p[1] = square ? 240 : 90;
+                    p[2] = square ? 240 : 160;
+                }
+            }
+        }
+    };
+
+    // writing on the render thread, as video mode did
+
+    double syncTime = 0.0;
+    Timer timer;
+    for ( int i = 0; i < numFrames; ++i )
+    {
+        Frames::Fill( pixels, width, height, i );
+        char filename[256];
+        snprintf( filename, sizeof( filename ), format, i );
+        timer.reset();
+        WriteTGA( filename, width, height, pixels );
+        syncTime += timer.time();
+    }
+
+    // through the pipeline. the render thread only pays for the copy, unless the writers fall behind
+
+    TGACaptureSink sink( format );
+
+    CaptureParams params;
+    params.width = width;
+    params.height = height;
+    params.numBuffers = 8;
+    params.numWriters = 4;
+
+    CapturePipeline pipeline;
+    pipeline.Initialize( params, &sink );
+
+    double captureTime = 0.0;
+    for ( int i = 0; i < numFrames; ++i )
+    {
+        Frames::Fill( pixels, width, height, i );
+        timer.reset();
+        pipeline.Capture( i, pixels );
+        captureTime += timer.time();
+    }
+    pipeline.Shutdown();
+
+    const CaptureStats & stats = pipeline.GetStats();
+
+    printf( "    %dx%d: write on render thread %.2f ms per frame\n", width, height, syncTime * 1000.0 / numFrames );
+    printf( "    pipeline with %d writers: %.2f ms per frame on render thread, %d stalls (%.1f ms), %d written\n",
+        params.numWriters, captureTime * 1000.0 / numFrames, (int) stats.stalls, stats.stallTime * 1000.0, (int) stats.framesWritten );
+
+    for ( int i = 0; i < numFrames; ++i )
+    {
+        char filename[256];
+        snprintf( filename, sizeof( filename ), format, i );
+        remove( filename );
+    }
+
+    delete [] pixels;
+}
+
+static void FillStreamFrame( uint8_t * pixels, int width, int height, int frame )
+{
+    // the board with a stone moving over it, plus a little noise so rle can't collapse whole rows
+
+    for ( int y = 0; y < height; ++y )
+    {
+        for ( int x = 0; x < width; ++x )
+        {
+            uint8_t * p = pixels + ( y * width + x ) * 3;
+            const bool stone = x >= frame * 8 && x < frame * 8 + 64 && y >= 300 && y < 364;
+            const int noise = ( ( x * 7 + y * 13 ) % 61 ) == 0 ? 20 : 0;
+            p[0] = uint8_t( stone ? 240 : 40 + y / 16 + noise );
+            p[1] = uint8_t( stone ? 240 : 90 );
+            p[2] = uint8_t( stone ? 240 : 160 );
+        }
+    }
+}
+
+static void BenchmarkStream()
+{
+    printf( "stream:\n" );
+
+    const int width = 1280;
+    const int height = 720;
+    const int numFrames = 120;
+    const char format[] = "benchmark_frame-%05d.tga";
+    const char filename[] = "benchmark_video";
+
+    uint8_t * pixels = new uint8_t[width * height * 3];
+
+    // one TGA per frame against every frame into one file, each through the capture pipeline.
+    // timed until the last frame is on its way to disk
+
+    const char * names[] = { "tga files", "y4m", "raw", "rle", "delta" };
+
+    for ( int pass = 0; pass < 5; ++pass )
+    {
+        TGACaptureSink tgaSink( format );
+        VideoStreamSink streamSink;
+
+        CaptureSink * sink = &tgaSink;
+        if ( pass > 0 )
+        {
+            VideoStreamParams streamParams;
+            streamParams.format = VideoStreamFormat( pass - 1 );
+            streamParams.width = width;
+            streamParams.height = height;
+            streamParams.dropCache = true;
+            streamSink.Open( filename, streamParams );
+            sink = &streamSink;
+        }
+
+        CaptureParams params;
+        params.width = width;
+        params.height = height;
+        params.numBuffers = 8;
+        params.numWriters = 4;
+
+        CapturePipeline pipeline;
+        pipeline.Initialize( params, sink );
+
+        double time = 0.0;
+        for ( int i = 0; i < numFrames; ++i )
+        {
+            FillStreamFrame( pixels, width, height, i );
+            Timer timer;
+            pipeline.Capture( i, pixels );
+            time += timer.time();
+        }
+
+        Timer timer;
+        pipeline.Shutdown();
+        streamSink.Close();
+        time += timer.time();
+
+        // size on disk
+
+        uint64_t bytes = 0;
+        for ( int i = 0; i < ( pass == 0 ? numFrames : 1 ); ++i )
+        {
+            char frameFilename[256];
+            snprintf( frameFilename, sizeof( frameFilename ), format, i );
+            FILE * file = fopen( pass == 0 ? frameFilename : filename, "rb" );
+            if ( file )
+            {
+                fseek( file, 0, SEEK_END );
+                bytes += ftell( file );
+                fclose( file );
+            }
+            remove( pass == 0 ? frameFilename : filename );
+        }
+
+        printf( "    %-9s: %.2f ms per frame, %.1f MB, %d stalls",
+            names[pass], time * 1000.0 / numFrames, bytes / ( 1024.0 * 1024.0 ), (int) pipeline.GetStats().stalls );
+
+        const FrameDeltaStats & deltaStats = streamSink.GetDeltaStats();
+        if ( deltaStats.tilesCompared )
+            printf( ", %.1f%% of tiles changed", deltaStats.tilesChanged * 100.0 / deltaStats.tilesCompared );
+
+        printf( "\n" );
+    }
+
+    delete [] pixels;
+}
+
+// --------------------------------------------------------------------------
+
+int main( int argc, char * argv[] )
+{
+    printf( "[benchmark]\n" );
+
+    const char * name = argc > 1 ? argv[1] : NULL;
+
+    Stone stone;
+    stone.Initialize( STONE_SIZE_40 );
+
+    Board board;
+    board.Initialize( 9 );
+
+    BenchmarkStone * stones = new BenchmarkStone[NumStones];
+    InitializeBenchmarkStones( board, stone.biconvex, stones, NumStones );
+
+    if ( !name || strcmp( name, "transform" ) == 0 )
+        BenchmarkTransform( board, stone.biconvex, stones );
+
+    if ( !name || strcmp( name, "collision" ) == 0 )
+        BenchmarkCollision( board, stone.biconvex, stones );
+
+    if ( !name || strcmp( name, "support" ) == 0 )
+        BenchmarkSupport( stone.biconvex, stones );
+
+    if ( !name || strcmp( name, "batch" ) == 0 )
+        BenchmarkBatch( board, stone.biconvex, stones );
+
+    if ( !name || strcmp( name, "sat" ) == 0 )
+        BenchmarkSAT( stone.biconvex, stones );
+
+    if ( !name || strcmp( name, "sdf" ) == 0 )
+        BenchmarkSDF( stone.biconvex );
+
+    if ( !name || strcmp( name, "gjk" ) == 0 )
+        BenchmarkGJK( stone.biconvex, stones );
+
+    if ( !name || strcmp( name, "host" ) == 0 )
+        BenchmarkHost();
+
+    if ( !name || strcmp( name, "snapshot" ) == 0 )
+        BenchmarkSnapshot();
+
+    if ( !name || strcmp( name, "delta" ) == 0 )
+        BenchmarkDelta();
+
+    if ( !name || strcmp( name, "loopback" ) == 0 )
+        BenchmarkLoopback();
+
+    if ( !name || strcmp( name, "interpolation" ) == 0 )
+        BenchmarkInterpolation();
+
+    if ( !name || strcmp( name, "priority" ) == 0 )
+        BenchmarkPriority();
+
+    if ( !name || strcmp( name, "checksum" ) == 0 )
+        BenchmarkChecksum();
+
+    if ( !name || strcmp( name, "rollback" ) == 0 )
+        BenchmarkRollback();
+
+    if ( !name || strcmp( name, "trajectory" ) == 0 )
+        BenchmarkTrajectory();
+
+    if ( !name || strcmp( name, "capture" ) == 0 )
+        BenchmarkCapture();
+
+    if ( !name || strcmp( name, "stream" ) == 0 )
+        BenchmarkStream();
+
+    delete [] stones;
+
+    return 0;
+}
@@ -32,7 +32,9 @@ public:
         sphereRadius = ( width*width + height*height ) / ( 4 * height );
         sphereRadiusSquared = sphereRadius * sphereRadius;
         sphereOffset = sphereRadius - height/2;
-        sphereDot = dot( vec3f(1,0,0), normalize( vec3f( width/2, sphereOffset, 0 ) ) );
+        // IMPORTANT: the sphere normal at the circle edge is ( circleRadius, sphereOffset ) / sphereRadius
+        // in the profile, so the sphere surface applies when |dot(axis,up)| >= sphereOffset / sphereRadius
+        sphereDot = dot( vec3f(0,1,0), normalize( vec3f( width/2, sphereOffset, 0 ) ) );
 
         circleRadius = width / 2;
 
@@ -192,6 +194,195 @@ inline vec3f GetNearestPointOnBiconvexSurface_LocalSpace( vec3f point,
     return a;
 }
 
+/*
+    Signed distance function for the biconvex solid, including the bevel.
+
+    The solid is rotationally symmetric about z and mirror symmetric about
+    z = 0, so we work in the 2D profile ( r, |z| ) with r = length( x, y ).
+    The profile is an arc of the bottom sphere, centered at ( 0, -sphereOffset ),
+    joined to an arc of the bevel torus tube, centered at ( torusMajorRadius, 0 ).
+
+    The tube is tangent to the sphere at the start of the bevel, so its center
+    lies on the line from the sphere center through the bevel start point.
+    Points on the axis side of that line are nearest the sphere arc, the rest
+    are nearest the tube. Without a bevel the tube has zero radius and this
+    is the exact distance to the circle edge.
+
+    Returns the distance, negative inside. The gradient is the unit outward
+    normal at the nearest surface point, so "point - gradient * distance" is
+    the nearest point on the surface.
+*/
+
+inline float BiconvexSignedDistance_LocalSpace( vec3f point,
+                                                const Biconvex & biconvex,
+                                                vec3f & gradient )
+{
+    const float sphereOffset = biconvex.GetSphereOffset();
+    const float torusMajorRadius = biconvex.GetBevelTorusMajorRadius();
+    const float torusMinorRadius = biconvex.GetBevelTorusMinorRadius();
+
+    const float x = point.x();
+    const float y = point.y();
+    const float r = sqrt( x*x + y*y );
+    const float z = fabs( point.z() );
+
+    float distance, gradient_r, gradient_z;
+
+    if ( biconvex.GetBevelCircleRadius() * ( z + sphereOffset ) - ( biconvex.GetBevel()/2 + sphereOffset ) * r >= 0 )
+    {
+        // sphere surface
+        const float length = sqrt( r*r + ( z + sphereOffset ) * ( z + sphereOffset ) );
+        distance = length - biconvex.GetSphereRadius();
+        gradient_r = r / length;
+        gradient_z = ( z + sphereOffset ) / length;
+    }
+    else
+    {
+        // bevel torus (circle edge if there is no bevel)
+        const float dr = r - torusMajorRadius;
+        const float length = sqrt( dr*dr + z*z );
+        distance = length - torusMinorRadius;
+        if ( length > 0.000001f )
+        {
+            gradient_r = dr / length;
+            gradient_z = z / length;
+        }
+        else
+        {
+            gradient_r = 1;
+            gradient_z = 0;
+        }
+    }
+
+    const float inverse_r = r > 0.000001f ? 1.0f / r : 0.0f;
+
+    gradient = vec3f( gradient_r * x * inverse_r,
+                      gradient_r * y * inverse_r,
+                      point.z() < 0 ? -gradient_z : gradient_z );
+
+    return distance;
+}
+
+inline float BiconvexSignedDistance_LocalSpace( vec3f point, const Biconvex & biconvex )
+{
+    vec3f gradient;
+    return BiconvexSignedDistance_LocalSpace( point, biconvex, gradient );
+}
+
+inline bool BiconvexPointPenetration_LocalSpace( vec3f point,
+                                                 const Biconvex & biconvex,
+                                                 float & depth,
+                                                 vec3f & normal )
+{
+    const float distance = BiconvexSignedDistance_LocalSpace( point, biconvex, normal );
+    depth = -distance;
+    return distance < 0;
+}
+
+/*
+    Packet versions of "BiconvexSignedDistance_LocalSpace". Both profile
+    cases are evaluated and selected per lane.
+*/
+
+inline void BiconvexSignedDistance_LocalSpace( const vec3x4f & point,
+                                               const Biconvex & biconvex,
+                                               simd4f & distance,
+                                               vec3x4f & gradient )
+{
+    const simd4f zero = simd4f_zero();
+    const simd4f epsilon = simd4f_splat( 0.000001f );
+    const simd4f sphereOffset = simd4f_splat( biconvex.GetSphereOffset() );
+    const simd4f torusMajorRadius = simd4f_splat( biconvex.GetBevelTorusMajorRadius() );
+
+    const simd4f r = simd4f_sqrt( simd4f_add( simd4f_mul( point.x, point.x ), simd4f_mul( point.y, point.y ) ) );
+    const simd4f z = simd4f_abs( point.z );
+
+    const simd4f sphere_z = simd4f_add( z, sphereOffset );
+    const simd4f sphere = simd4f_cmple( simd4f_mul( simd4f_splat( biconvex.GetBevel()/2 + biconvex.GetSphereOffset() ), r ),
+                                        simd4f_mul( simd4f_splat( biconvex.GetBevelCircleRadius() ), sphere_z ) );
+
+    const simd4f torus_r = simd4f_sub( r, torusMajorRadius );
+
+    const simd4f profile_r = simd4f_select( sphere, r, torus_r );
+    const simd4f profile_z = simd4f_select( sphere, sphere_z, z );
+    const simd4f radius = simd4f_select( sphere, simd4f_splat( biconvex.GetSphereRadius() ), simd4f_splat( biconvex.GetBevelTorusMinorRadius() ) );
+
+    const simd4f length = simd4f_sqrt( simd4f_add( simd4f_mul( profile_r, profile_r ), simd4f_mul( profile_z, profile_z ) ) );
+
+    distance = simd4f_sub( length, radius );
+
+    const simd4f degenerate = simd4f_cmplt( length, epsilon );
+    const simd4f inverse_length = simd4f_div( simd4f_splat( 1.0f ), simd4f_max( length, epsilon ) );
+    const simd4f gradient_r = simd4f_select( degenerate, simd4f_splat( 1.0f ), simd4f_mul( profile_r, inverse_length ) );
+    const simd4f gradient_z = simd4f_select( degenerate, zero, simd4f_mul( profile_z, inverse_length ) );
+
+    const simd4f scale_r = simd4f_select( simd4f_cmplt( r, epsilon ), zero, simd4f_div( gradient_r, simd4f_max( r, epsilon ) ) );
+
+    gradient.x = simd4f_mul( point.x, scale_r );
+    gradient.y = simd4f_mul( point.y, scale_r );
+    gradient.z = simd4f_select( simd4f_cmplt( point.z, zero ), simd4f_sub( zero, gradient_z ), gradient_z );
+}
+
+inline void BiconvexSignedDistance_LocalSpace( const vec3x8f & point,
+                                               const Biconvex & biconvex,
+                                               simd8f & distance,
+                                               vec3x8f & gradient )
+{
+    const simd8f zero = simd8f_zero();
+    const simd8f epsilon = simd8f_splat( 0.000001f );
+    const simd8f sphereOffset = simd8f_splat( biconvex.GetSphereOffset() );
+    const simd8f torusMajorRadius = simd8f_splat( biconvex.GetBevelTorusMajorRadius() );
+
+    const simd8f r = simd8f_sqrt( simd8f_add( simd8f_mul( point.x, point.x ), simd8f_mul( point.y, point.y ) ) );
+    const simd8f z = simd8f_abs( point.z );
+
+    const simd8f sphere_z = simd8f_add( z, sphereOffset );
+    const simd8f sphere = simd8f_cmple( simd8f_mul( simd8f_splat( biconvex.GetBevel()/2 + biconvex.GetSphereOffset() ), r ),
+                                        simd8f_mul( simd8f_splat( biconvex.GetBevelCircleRadius() ), sphere_z ) );
+
+    const simd8f torus_r = simd8f_sub( r, torusMajorRadius );
+
+    const simd8f profile_r = simd8f_select( sphere, r, torus_r );
+    const simd8f profile_z = simd8f_select( sphere, sphere_z, z );
+    const simd8f radius = simd8f_select( sphere, simd8f_splat( biconvex.GetSphereRadius() ), simd8f_splat( biconvex.GetBevelTorusMinorRadius() ) );
+
+    const simd8f length = simd8f_sqrt( simd8f_add( simd8f_mul( profile_r, profile_r ), simd8f_mul( profile_z, profile_z ) ) );
+
+    distance = simd8f_sub( length, radius );
+
+    const simd8f degenerate = simd8f_cmplt( length, epsilon );
+    const simd8f inverse_length = simd8f_div( simd8f_splat( 1.0f ), simd8f_max( length, epsilon ) );
+    const simd8f gradient_r = simd8f_select( degenerate, simd8f_splat( 1.0f ), simd8f_mul( profile_r, inverse_length ) );
+    const simd8f gradient_z = simd8f_select( degenerate, zero, simd8f_mul( profile_z, inverse_length ) );
+
+    const simd8f scale_r = simd8f_select( simd8f_cmplt( r, epsilon ), zero, simd8f_div( gradient_r, simd8f_max( r, epsilon ) ) );
+
+    gradient.x = simd8f_mul( point.x, scale_r );
+    gradient.y = simd8f_mul( point.y, scale_r );
+    gradient.z = simd8f_select( simd8f_cmplt( point.z, zero ), simd8f_sub( zero, gradient_z ), gradient_z );
+}
+
+inline void BiconvexSignedDistance_LocalSpace( const Biconvex & biconvex,
+                                               const vec3f * points,
+                                               int numPoints,
+                                               float * distance,
+                                               vec3f * gradient )
+{
+    int i = 0;
+
+    for ( ; i + 8 <= numPoints; i += 8 )
+    {
+        simd8f packet_distance;
+        vec3x8f packet_gradient;
+        BiconvexSignedDistance_LocalSpace( vec3x8f( points + i ), biconvex, packet_distance, packet_gradient );
+        simd8f_ustore8( packet_distance, distance + i );
+        packet_gradient.store( gradient + i );
+    }
+
+    for ( ; i < numPoints; ++i )
+        distance[i] = BiconvexSignedDistance_LocalSpace( points[i], biconvex, gradient[i] );
+}
+
 inline void BiconvexSupport_LocalSpace( const Biconvex & biconvex, 
                                         vec3f axis, 
                                         float & s1, 
@@ -220,6 +411,30 @@ inline void BiconvexSupport_LocalSpace( const Biconvex & biconvex,
     }
 }
 
+inline vec3f BiconvexSupportPoint_LocalSpace( const Biconvex & biconvex, vec3f axis )
+{
+    // the point on the biconvex furthest along axis. this is the point whose
+    // projection gives "s2" in "BiconvexSupport_LocalSpace". axis need not be
+    // unit length, but it is normalized exactly so the point is on the surface
+
+    axis *= 1.0f / sqrt( length_squared( axis ) );
+
+    if ( fabs( axis.z() ) < biconvex.GetSphereDot() )
+    {
+        // circle edge
+        const float x = axis.x();
+        const float y = axis.y();
+        const float scale = biconvex.GetCircleRadius() / sqrt( x*x + y*y );
+        return vec3f( x * scale, y * scale, 0 );
+    }
+    else
+    {
+        // sphere surface. the top of the biconvex is the bottom sphere and vice versa
+        vec3f sphereCenter( 0, 0, axis.z() > 0 ? -biconvex.GetSphereOffset() : +biconvex.GetSphereOffset() );
+        return sphereCenter + axis * biconvex.GetSphereRadius();
+    }
+}
+
 inline void BiconvexSupport_WorldSpace( const Biconvex & biconvex, 
                                         vec3f biconvexCenter,
                                         vec3f biconvexUp,
@@ -254,6 +469,102 @@ inline void BiconvexSupport_WorldSpace( const Biconvex & biconvex,
     }
 }
 
+/*
+    Packet versions of "BiconvexSupport_WorldSpace". Each lane has its own
+    center, up and axis, so this gives the support of four stones along one
+    axis, or of one stone along four axes when the shared inputs are splat.
+
+    Both cases of the scalar version are a half extent about the projected
+    center, so we evaluate both and select per lane instead of branching:
+
+        circle edge:    r = circleRadius * sqrt( 1 - d*d )
+        sphere span:    r = sphereRadius - sphereOffset * |d|
+
+    where d = dot( axis, up ) and axis is unit length.
+*/
+
+inline void BiconvexSupport_WorldSpace( const Biconvex & biconvex,
+                                        const vec3x4f & biconvexCenter,
+                                        const vec3x4f & biconvexUp,
+                                        const vec3x4f & axis,
+                                        simd4f & s1,
+                                        simd4f & s2 )
+{
+    const simd4f center_t = dot( biconvexCenter, axis );
+    const simd4f d = simd4f_abs( dot( biconvexUp, axis ) );
+
+    const simd4f sin_squared = simd4f_max( simd4f_zero(), simd4f_sub( simd4f_splat( 1.0f ), simd4f_mul( d, d ) ) );
+    const simd4f circle_t = simd4f_mul( simd4f_splat( biconvex.GetCircleRadius() ), simd4f_sqrt( sin_squared ) );
+    const simd4f sphere_t = simd4f_sub( simd4f_splat( biconvex.GetSphereRadius() ), simd4f_mul( simd4f_splat( biconvex.GetSphereOffset() ), d ) );
+
+    const simd4f radius_t = simd4f_select( simd4f_cmplt( d, simd4f_splat( biconvex.GetSphereDot() ) ), circle_t, sphere_t );
+
+    s1 = simd4f_sub( center_t, radius_t );
+    s2 = simd4f_add( center_t, radius_t );
+}
+
+inline void BiconvexSupport_WorldSpace( const Biconvex & biconvex,
+                                        const vec3x4f & biconvexCenter,
+                                        const vec3x4f & biconvexUp,
+                                        vec3f axis,
+                                        simd4f & s1,
+                                        simd4f & s2 )
+{
+    BiconvexSupport_WorldSpace( biconvex, biconvexCenter, biconvexUp, vec3x4f( axis ), s1, s2 );
+}
+
+inline void BiconvexSupport_WorldSpace( const Biconvex & biconvex,
+                                        vec3f biconvexCenter,
+                                        vec3f biconvexUp,
+                                        const vec3x4f & axis,
+                                        simd4f & s1,
+                                        simd4f & s2 )
+{
+    BiconvexSupport_WorldSpace( biconvex, vec3x4f( biconvexCenter ), vec3x4f( biconvexUp ), axis, s1, s2 );
+}
+
+// eight wide versions of the above
+
+inline void BiconvexSupport_WorldSpace( const Biconvex & biconvex,
+                                        const vec3x8f & biconvexCenter,
+                                        const vec3x8f & biconvexUp,
+                                        const vec3x8f & axis,
+                                        simd8f & s1,
+                                        simd8f & s2 )
+{
+    const simd8f center_t = dot( biconvexCenter, axis );
+    const simd8f d = simd8f_abs( dot( biconvexUp, axis ) );
+
+    const simd8f sin_squared = simd8f_max( simd8f_zero(), simd8f_sub( simd8f_splat( 1.0f ), simd8f_mul( d, d ) ) );
+    const simd8f circle_t = simd8f_mul( simd8f_splat( biconvex.GetCircleRadius() ), simd8f_sqrt( sin_squared ) );
+    const simd8f sphere_t = simd8f_sub( simd8f_splat( biconvex.GetSphereRadius() ), simd8f_mul( simd8f_splat( biconvex.GetSphereOffset() ), d ) );
+
+    const simd8f radius_t = simd8f_select( simd8f_cmplt( d, simd8f_splat( biconvex.GetSphereDot() ) ), circle_t, sphere_t );
+
+    s1 = simd8f_sub( center_t, radius_t );
+    s2 = simd8f_add( center_t, radius_t );
+}
+
+inline void BiconvexSupport_WorldSpace( const Biconvex & biconvex,
+                                        const vec3x8f & biconvexCenter,
+                                        const vec3x8f & biconvexUp,
+                                        vec3f axis,
+                                        simd8f & s1,
+                                        simd8f & s2 )
+{
+    BiconvexSupport_WorldSpace( biconvex, biconvexCenter, biconvexUp, vec3x8f( axis ), s1, s2 );
+}
+
+inline void BiconvexSupport_WorldSpace( const Biconvex & biconvex,
+                                        vec3f biconvexCenter,
+                                        vec3f biconvexUp,
+                                        const vec3x8f & axis,
+                                        simd8f & s1,
+                                        simd8f & s2 )
+{
+    BiconvexSupport_WorldSpace( biconvex, vec3x8f( biconvexCenter ), vec3x8f( biconvexUp ), axis, s1, s2 );
+}
+
 struct NearestPoint
 {
     vec3f biconvexPoint;
@@ -429,12 +740,195 @@ bool Biconvex_SAT( const Biconvex & biconvex,
     vec3f bottom_b = position_b - up_b * sphereOffset;
 
     TEST_BICONVEX_AXIS( "primary", normalize( position_b - position_a ) );
-    TEST_BICONVEX_AXIS( "top_a|top_b", normalize( top_b - top_a ) );
-    TEST_BICONVEX_AXIS( "top_a|bottom_b", normalize( bottom_b - top_a ) );
-    TEST_BICONVEX_AXIS( "bottom_a|top_b", normalize( top_b - bottom_a ) );
-    TEST_BICONVEX_AXIS( "bottom_b|top_a", normalize( bottom_b - bottom_a ) );
+
+    // the four axes between sphere centers are tested together
+
+    const vec3x4f axes = normalize( vec3x4f( top_b - top_a,             // top_a|top_b
+                                             bottom_b - top_a,          // top_a|bottom_b
+                                             top_b - bottom_a,          // bottom_a|top_b
+                                             bottom_b - bottom_a ) );   // bottom_b|top_a
+
+    simd4f s1, s2, t1, t2;
+    BiconvexSupport_WorldSpace( biconvex, position_a, up_a, axes, s1, s2 );
+    BiconvexSupport_WorldSpace( biconvex, position_b, up_b, axes, t1, t2 );
+
+    float separation[4];
+    simd4f_ustore4( simd4f_max( simd4f_sub( t1, s2 ), simd4f_sub( s1, t2 ) ), separation );
+
+    for ( int i = 0; i < 4; ++i )
+    {
+        if ( separation[i] > epsilon )
+            return false;
+    }
 
     return true;
 }
 
+/*
+    Packet versions of "Biconvex_SAT".
+
+    Tests four or eight stone pairs at once. Every lane evaluates all five
+    axes, and a lane drops out once any axis separates it. The packet
+    returns early only when every lane is separated, which is the common
+    case for near-miss pairs out of the broadphase.
+
+    Returns a bitmask with bit i set if pair i is intersecting.
+*/
+
+inline simd4f BiconvexSeparatedOnAxis( const Biconvex & biconvex,
+                                       const vec3x4f & position_a,
+                                       const vec3x4f & position_b,
+                                       const vec3x4f & up_a,
+                                       const vec3x4f & up_b,
+                                       const vec3x4f & axis,
+                                       simd4f epsilon )
+{
+    simd4f s1, s2, t1, t2;
+    BiconvexSupport_WorldSpace( biconvex, position_a, up_a, axis, s1, s2 );
+    BiconvexSupport_WorldSpace( biconvex, position_b, up_b, axis, t1, t2 );
+    return simd4f_cmplt( epsilon, simd4f_max( simd4f_sub( t1, s2 ), simd4f_sub( s1, t2 ) ) );
+}
+
+inline int Biconvex_SAT( const Biconvex & biconvex,
+                         const vec3x4f & position_a,
+                         const vec3x4f & position_b,
+                         const vec3x4f & up_a,
+                         const vec3x4f & up_b,
+                         float epsilon = 0.001f )
+{
+    const simd4f e = simd4f_splat( epsilon );
+    const simd4f sphereOffset = simd4f_splat( biconvex.GetSphereOffset() );
+
+    const vec3x4f top_a = position_a + up_a * sphereOffset;
+    const vec3x4f top_b = position_b + up_b * sphereOffset;
+
+    const vec3x4f bottom_a = position_a - up_a * sphereOffset;
+    const vec3x4f bottom_b = position_b - up_b * sphereOffset;
+
+    simd4f separated = BiconvexSeparatedOnAxis( biconvex, position_a, position_b, up_a, up_b, normalize( position_b - position_a ), e );
+    if ( simd4f_movemask( separated ) == 0xF )
+        return 0;
+
+    separated = simd4f_or( separated, BiconvexSeparatedOnAxis( biconvex, position_a, position_b, up_a, up_b, normalize( top_b - top_a ), e ) );
+    if ( simd4f_movemask( separated ) == 0xF )
+        return 0;
+
+    separated = simd4f_or( separated, BiconvexSeparatedOnAxis( biconvex, position_a, position_b, up_a, up_b, normalize( bottom_b - top_a ), e ) );
+    if ( simd4f_movemask( separated ) == 0xF )
+        return 0;
+
+    separated = simd4f_or( separated, BiconvexSeparatedOnAxis( biconvex, position_a, position_b, up_a, up_b, normalize( top_b - bottom_a ), e ) );
+    if ( simd4f_movemask( separated ) == 0xF )
+        return 0;
+
+    separated = simd4f_or( separated, BiconvexSeparatedOnAxis( biconvex, position_a, position_b, up_a, up_b, normalize( bottom_b - bottom_a ), e ) );
+
+    return ~simd4f_movemask( separated ) & 0xF;
+}
+
+// eight wide versions of the above
+
+inline simd8f BiconvexSeparatedOnAxis( const Biconvex & biconvex,
+                                       const vec3x8f & position_a,
+                                       const vec3x8f & position_b,
+                                       const vec3x8f & up_a,
+                                       const vec3x8f & up_b,
+                                       const vec3x8f & axis,
+                                       simd8f epsilon )
+{
+    simd8f s1, s2, t1, t2;
+    BiconvexSupport_WorldSpace( biconvex, position_a, up_a, axis, s1, s2 );
+    BiconvexSupport_WorldSpace( biconvex, position_b, up_b, axis, t1, t2 );
+    return simd8f_cmplt( epsilon, simd8f_max( simd8f_sub( t1, s2 ), simd8f_sub( s1, t2 ) ) );
+}
+
+inline int Biconvex_SAT( const Biconvex & biconvex,
+                         const vec3x8f & position_a,
+                         const vec3x8f & position_b,
+                         const vec3x8f & up_a,
+                         const vec3x8f & up_b,
+                         float epsilon = 0.001f )
+{
+    const simd8f e = simd8f_splat( epsilon );
+    const simd8f sphereOffset = simd8f_splat( biconvex.GetSphereOffset() );
+
+    const vec3x8f top_a = position_a + up_a * sphereOffset;
+    const vec3x8f top_b = position_b + up_b * sphereOffset;
+
+    const vec3x8f bottom_a = position_a - up_a * sphereOffset;
+    const vec3x8f bottom_b = position_b - up_b * sphereOffset;
+
+    simd8f separated = BiconvexSeparatedOnAxis( biconvex, position_a, position_b, up_a, up_b, normalize( position_b - position_a ), e );
+    if ( simd8f_movemask( separated ) == 0xFF )
+        return 0;
+
+    separated = simd8f_or( separated, BiconvexSeparatedOnAxis( biconvex, position_a, position_b, up_a, up_b, normalize( top_b - top_a ), e ) );
+    if ( simd8f_movemask( separated ) == 0xFF )
+        return 0;
+
+    separated = simd8f_or( separated, BiconvexSeparatedOnAxis( biconvex, position_a, position_b, up_a, up_b, normalize( bottom_b - top_a ), e ) );
+    if ( simd8f_movemask( separated ) == 0xFF )
+        return 0;
+
+    separated = simd8f_or( separated, BiconvexSeparatedOnAxis( biconvex, position_a, position_b, up_a, up_b, normalize( top_b - bottom_a ), e ) );
+    if ( simd8f_movemask( separated ) == 0xFF )
+        return 0;
+
+    separated = simd8f_or( separated, BiconvexSeparatedOnAxis( biconvex, position_a, position_b, up_a, up_b, normalize( bottom_b - bottom_a ), e ) );
+
+    return ~simd8f_movemask( separated ) & 0xFF;
+}
+
+/*
+    Biconvex SAT over a list of candidate pairs from the broadphase,
+    eight pairs per packet. Each pair indexes into the position and up
+    arrays. Writes the index of each intersecting pair to "hits", in
+    order, and returns the number of hits.
+*/
+
+struct BiconvexPair
+{
+    int a;
+    int b;
+};
+
+inline int Biconvex_SAT_Batch( const Biconvex & biconvex,
+                               const vec3f * position,
+                               const vec3f * up,
+                               const BiconvexPair * pairs,
+                               int numPairs,
+                               int * hits,
+                               float epsilon = 0.001f )
+{
+    int numHits = 0;
+
+    for ( int i = 0; i < numPairs; i += 8 )
+    {
+        const int n = numPairs - i < 8 ? numPairs - i : 8;
+
+        vec3f position_a[8], position_b[8], up_a[8], up_b[8];
+        for ( int j = 0; j < 8; ++j )
+        {
+            const BiconvexPair & pair = pairs[ i + ( j < n ? j : n - 1 ) ];
+            position_a[j] = position[pair.a];
+            position_b[j] = position[pair.b];
+            up_a[j] = up[pair.a];
+            up_b[j] = up[pair.b];
+        }
+
+        const int intersecting = Biconvex_SAT( biconvex,
+                                               vec3x8f( position_a ), vec3x8f( position_b ),
+                                               vec3x8f( up_a ), vec3x8f( up_b ),
+                                               epsilon ) & ( ( 1 << n ) - 1 );
+
+        for ( int j = 0; j < n; ++j )
+        {
+            if ( intersecting & ( 1 << j ) )
+                hits[numHits++] = i + j;
+        }
+    }
+
+    return numHits;
+}
+
 #endif
@@ -0,0 +1,179 @@
+#ifndef BIT_PACKER_H
+#define BIT_PACKER_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+    Bit packer.
+
+    Writes and reads values of any width from 1 to 32 bits with no padding
+    between them. Bits accumulate in a 64 bit scratch and go out to memory
+    a 32 bit word at a time, so the cost per value is a shift and an or.
+
+    IMPORTANT: words are copied to and from memory in host byte order, so
+    both ends must be little endian (x86 and ARM as we run them). The
+    writer buffer must be a multiple of four bytes. The reader takes any
+    size, so a packet can be trimmed to "GetBytesWritten".
+*/
+
+inline int BitsRequired( uint32_t maximum )
+{
+    // bits needed to store any value in [0,maximum]
+
+    int bits = 0;
+    while ( bits < 32 && ( maximum >> bits ) != 0 )
+        bits++;
+    return bits;
+}
+
+class BitWriter
+{
+public:
+
+    BitWriter( void * data, int bytes )
+    {
+        assert( data );
+        assert( ( bytes % 4 ) == 0 );
+        this->data = (uint8_t*) data;
+        numWords = bytes / 4;
+        scratch = 0;
+        scratchBits = 0;
+        wordIndex = 0;
+        bitsWritten = 0;
+        overflow = false;
+    }
+
+    void WriteBits( uint32_t value, int bits )
+    {
+        assert( bits > 0 && bits <= 32 );
+        assert( bits == 32 || value < ( 1u << bits ) );
+
+        if ( bitsWritten + bits > numWords * 32 )
+        {
+            overflow = true;
+            return;
+        }
+
+        scratch |= uint64_t( value ) << scratchBits;
+        scratchBits += bits;
+        bitsWritten += bits;
+
+        if ( scratchBits >= 32 )
+        {
+            const uint32_t word = uint32_t( scratch );
+            memcpy( data + wordIndex * 4, &word, 4 );
+            wordIndex++;
+            scratch >>= 32;
+            scratchBits -= 32;
+        }
+    }
+
+    void WriteBool( bool value )
+    {
+        WriteBits( value ? 1 : 0, 1 );
+    }
+
+    // call once after the last write, otherwise up to 31 bits are left in scratch
+
+    void FlushBits()
+    {
+        if ( scratchBits > 0 )
+        {
+            const uint32_t word = uint32_t( scratch );
+            memcpy( data + wordIndex * 4, &word, 4 );
+            wordIndex++;
+            scratch = 0;
+            scratchBits = 0;
+        }
+    }
+
+    int GetBitsWritten() const { return bitsWritten; }
+
+    int GetBytesWritten() const { return ( bitsWritten + 7 ) / 8; }
+
+    int GetBitsAvailable() const { return numWords * 32 - bitsWritten; }
+
+    bool IsOverflow() const { return overflow; }
+
+private:
+
+    uint8_t * data;
+    uint64_t scratch;
+    int scratchBits;
+    int numWords;
+    int wordIndex;
+    int bitsWritten;
+    bool overflow;
+};
+
+class BitReader
+{
+public:
+
+    BitReader( const void * data, int bytes )
+    {
+        assert( data );
+        this->data = (const uint8_t*) data;
+        numBytes = bytes;
+        scratch = 0;
+        scratchBits = 0;
+        wordIndex = 0;
+        bitsRead = 0;
+        overflow = false;
+    }
+
+    // reading past the end returns zeros and sets the overflow flag
+
+    uint32_t ReadBits( int bits )
+    {
+        assert( bits > 0 && bits <= 32 );
+
+        if ( bitsRead + bits > numBytes * 8 )
+        {
+            overflow = true;
+            return 0;
+        }
+
+        bitsRead += bits;
+
+        if ( scratchBits < bits )
+        {
+            uint32_t word = 0;
+            const int offset = wordIndex * 4;
+            memcpy( &word, data + offset, numBytes - offset < 4 ? numBytes - offset : 4 );
+            scratch |= uint64_t( word ) << scratchBits;
+            scratchBits += 32;
+            wordIndex++;
+        }
+
+        const uint32_t value = uint32_t( scratch & ( ( uint64_t(1) << bits ) - 1 ) );
+        scratch >>= bits;
+        scratchBits -= bits;
+        return value;
+    }
+
+    bool ReadBool()
+    {
+        return ReadBits( 1 ) != 0;
+    }
+
+    int GetBitsRead() const { return bitsRead; }
+
+    int GetBitsRemaining() const { return numBytes * 8 - bitsRead; }
+
+    bool IsOverflow() const { return overflow; }
+
+private:
+
+    const uint8_t * data;
+    uint64_t scratch;
+    int scratchBits;
+    int numBytes;
+    int wordIndex;
+    int bitsRead;
+    bool overflow;
+};
+
+#endif
@@ -119,7 +119,7 @@ public:
         by = halfHeight;
     }
 
-    vec3f GetPointPosition( int row, int column )
+    vec3f GetPointPosition( int row, int column ) const
     {
         assert( row >= 1 );
         assert( column >= 1 );
@@ -0,0 +1,256 @@
+#ifndef BODY_POOL_H
+#define BODY_POOL_H
+
+#include "RigidBody.h"
+#include "Allocator.h"
+
+/*
+    Body handles.
+
+    A handle names a body by slot and generation. The slot never moves
+    while the body is alive, and its generation is bumped each time the
+    body in it is destroyed, so a handle to a destroyed body can never
+    alias a new body that reuses the slot. Handles are plain values with
+    no pointers in them, so they are safe to pass between threads and to
+    store in snapshots.
+*/
+
+struct BodyHandle
+{
+    BodyHandle()
+    {
+        slot = -1;
+        generation = 0;
+    }
+
+    bool operator == ( const BodyHandle & other ) const
+    {
+        return slot == other.slot && generation == other.generation;
+    }
+
+    bool operator != ( const BodyHandle & other ) const
+    {
+        return !( *this == other );
+    }
+
+    int slot;
+    uint32_t generation;
+};
+
+/*
+    Body pool.
+
+    Live bodies are kept dense at the front of one array, so passes over
+    every body (integration, batched collision, snapshots) walk memory in
+    order with no holes. Destroying a body moves the last body into its
+    place, and the slot table is updated so handles to the moved body stay
+    valid. Dense indices are only stable until the next destroy, handles
+    are stable for the life of the body.
+*/
+
+class BodyPool
+{
+public:
+
+    BodyPool()
+    {
+        bodies = NULL;
+        denseToSlot = NULL;
+        slotToDense = NULL;
+        generations = NULL;
+        freeSlots = NULL;
+        capacity = 0;
+        numBodies = 0;
+        numFreeSlots = 0;
+        layoutVersion = 0;
+    }
+
+    static size_t GetMemoryRequired( int capacity )
+    {
+        return GetArraySize<RigidBody>( capacity ) + GetArraySize<int>( capacity ) * 3 + GetArraySize<uint32_t>( capacity );
+    }
+
+    bool Initialize( Arena & arena, int poolCapacity )
+    {
+        assert( poolCapacity > 0 );
+
+        bodies = AllocateArray<RigidBody>( arena, poolCapacity );
+        denseToSlot = AllocateArray<int>( arena, poolCapacity );
+        slotToDense = AllocateArray<int>( arena, poolCapacity );
+        generations = AllocateArray<uint32_t>( arena, poolCapacity );
+        freeSlots = AllocateArray<int>( arena, poolCapacity );
+        if ( !bodies || !denseToSlot || !slotToDense || !generations || !freeSlots )
+            return false;
+
+        capacity = poolCapacity;
+
+        for ( int i = 0; i < capacity; ++i )
+            generations[i] = 1;
+
+        Clear();
+
+        return true;
+    }
+
+    void Clear()
+    {
+        // IMPORTANT: generations are kept, so handles from before the clear stay invalid
+
+        numBodies = 0;
+        numFreeSlots = capacity;
+        for ( int i = 0; i < capacity; ++i )
+        {
+            freeSlots[i] = capacity - 1 - i;
+            slotToDense[i] = -1;
+        }
+        layoutVersion++;
+    }
+
+    BodyHandle Create()
+    {
+        BodyHandle handle;
+        if ( numFreeSlots == 0 )
+            return handle;
+
+        const int slot = freeSlots[--numFreeSlots];
+        const int index = numBodies++;
+
+        bodies[index] = RigidBody();
+        denseToSlot[index] = slot;
+        slotToDense[slot] = index;
+
+        handle.slot = slot;
+        handle.generation = generations[slot];
+
+        layoutVersion++;
+
+        return handle;
+    }
+
+    void Destroy( BodyHandle handle )
+    {
+        const int index = GetIndex( handle );
+        assert( index >= 0 );
+        if ( index < 0 )
+            return;
+
+        const int last = --numBodies;
+        if ( index != last )
+        {
+            bodies[index] = bodies[last];
+            denseToSlot[index] = denseToSlot[last];
+            slotToDense[denseToSlot[index]] = index;
+        }
+
+        slotToDense[handle.slot] = -1;
+        generations[handle.slot]++;
+        freeSlots[numFreeSlots++] = handle.slot;
+
+        layoutVersion++;
+    }
+
+    // dense index of the body, or -1 if the handle is stale
+
+    int GetIndex( BodyHandle handle ) const
+    {
+        if ( handle.slot < 0 || handle.slot >= capacity || generations[handle.slot] != handle.generation )
+            return -1;
+        return slotToDense[handle.slot];
+    }
+
+    BodyHandle GetHandle( int index ) const
+    {
+        assert( index >= 0 && index < numBodies );
+        BodyHandle handle;
+        handle.slot = denseToSlot[index];
+        handle.generation = generations[handle.slot];
+        return handle;
+    }
+
+    bool IsValid( BodyHandle handle ) const
+    {
+        return GetIndex( handle ) >= 0;
+    }
+
+    RigidBody * Get( BodyHandle handle )
+    {
+        const int index = GetIndex( handle );
+        return index >= 0 ? &bodies[index] : NULL;
+    }
+
+    const RigidBody * Get( BodyHandle handle ) const
+    {
+        const int index = GetIndex( handle );
+        return index >= 0 ? &bodies[index] : NULL;
+    }
+
+    RigidBody * GetBodies() { return bodies; }
+
+    const RigidBody * GetBodies() const { return bodies; }
+
+    int GetNumBodies() const { return numBodies; }
+
+    int GetCapacity() const { return capacity; }
+
+    /*
+        The layout is everything but the bodies: the slot tables, the free
+        list and the body count. Saving it along with the bodies and
+        restoring both later puts the pool back exactly as it was, handles
+        included (see Rollback.h).
+
+        The layout version changes whenever the layout does, restores
+        included, so a saved copy can be reused for as long as the version
+        matches. It never goes backwards.
+    */
+
+    static size_t GetLayoutSize( int capacity )
+    {
+        return sizeof( int ) * 2 + sizeof( int ) * capacity * 3 + sizeof( uint32_t ) * capacity;
+    }
+
+    void SaveLayout( uint8_t * data ) const
+    {
+        memcpy( data, &numBodies, sizeof( int ) );                          data += sizeof( int );
+        memcpy( data, &numFreeSlots, sizeof( int ) );                       data += sizeof( int );
+        memcpy( data, denseToSlot, sizeof( int ) * capacity );              data += sizeof( int ) * capacity;
+        memcpy( data, slotToDense, sizeof( int ) * capacity );              data += sizeof( int ) * capacity;
+        memcpy( data, freeSlots, sizeof( int ) * capacity );                data += sizeof( int ) * capacity;
+        memcpy( data, generations, sizeof( uint32_t ) * capacity );
+    }
+
+    // IMPORTANT: bodies past the restored count are left as they were. restore them separately
+
+    void RestoreLayout( const uint8_t * data )
+    {
+        memcpy( &numBodies, data, sizeof( int ) );                          data += sizeof( int );
+        memcpy( &numFreeSlots, data, sizeof( int ) );                       data += sizeof( int );
+        memcpy( denseToSlot, data, sizeof( int ) * capacity );              data += sizeof( int ) * capacity;
+        memcpy( slotToDense, data, sizeof( int ) * capacity );              data += sizeof( int ) * capacity;
+        memcpy( freeSlots, data, sizeof( int ) * capacity );                data += sizeof( int ) * capacity;
+        memcpy( generations, data, sizeof( uint32_t ) * capacity );
+
+        assert( numBodies >= 0 && numBodies <= capacity );
+        assert( numBodies + numFreeSlots == capacity );
+
+        layoutVersion++;
+    }
+
+    uint32_t GetLayoutVersion() const { return layoutVersion; }
+
+private:
+
+    BodyPool( const BodyPool & other );
+    BodyPool & operator = ( const BodyPool & other );
+
+    RigidBody * bodies;
+    int * denseToSlot;
+    int * slotToDense;
+    uint32_t * generations;
+    int * freeSlots;
+    int capacity;
+    int numBodies;
+    int numFreeSlots;
+    uint32_t layoutVersion;
+};
+
+#endif
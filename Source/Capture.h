@@ -0,0 +1,500 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "Config.h"
+#include "Common.h"
+#include "Platform.h"
+
+/*
+    Video capture.
+
+    In video mode every frame is read back and written out as an image.
+    Doing the write on the render thread stalls the frame on compression
+    and disk, so the frame rate of the capture depends on how busy the
+    disk is.
+
+    Instead the render thread copies each frame it reads back into one of
+    a ring of capture buffers and moves on. Writer threads sleep on a
+    semaphore that is signalled once per filled buffer, take the buffer
+    off a lock free queue, hand it to a "CaptureSink" to encode and write,
+    and put it back on a second queue of free buffers.
+
+    When the disk can't keep up every buffer ends up waiting to be
+    written. By default the render thread then waits for a buffer to come
+    free, so no frame is lost and the capture just runs slower. With
+    "dropWhenFull" the frame is dropped instead and the render thread
+    never waits. Either way it is counted in the stats.
+
+    Writers always run on their own threads ("StartThread"), even with
+    MULTITHREADED off in Config.h. That setting is about how the
+    simulation steps; writing video is file io and must never hold up
+    the render thread.
+
+    Nothing here touches OpenGL, so the whole pipeline can be driven with
+    synthetic frames (see UnitTest.cpp and Benchmark.cpp).
+*/
+
+struct CaptureParams
+{
+    CaptureParams()
+    {
+        width = 0;
+        height = 0;
+        numBuffers = 8;
+        numWriters = 2;
+        dropWhenFull = false;
+    }
+
+    int width;
+    int height;
+    int numBuffers;                 // frames that can be waiting to be written at once
+    int numWriters;
+    bool dropWhenFull;              // drop frames rather than wait when every buffer is waiting to be written
+};
+
+struct CaptureStats
+{
+    CaptureStats()
+    {
+        framesSubmitted = 0;
+        framesWritten = 0;
+        framesDropped = 0;
+        writeErrors = 0;
+        stalls = 0;
+        stallTime = 0.0;
+    }
+
+    uint64_t framesSubmitted;
+    uint64_t framesWritten;
+    uint64_t framesDropped;
+    uint64_t writeErrors;
+    uint64_t stalls;                // times the render thread had to wait for a free buffer
+    double stallTime;               // seconds spent waiting
+};
+
+// 24 bit pixels, bottom row first, as glReadPixels gives them with GL_BGR
+
+struct CaptureFrame
+{
+    int frame;
+    int sequence;                   // order frames were submitted in, 0, 1, 2... with no gaps for dropped frames
+    int width;
+    int height;
+    uint8_t * pixels;
+};
+
+// IMPORTANT: "WriteFrame" is called from every writer thread at once, with frames in any order.
+// a sink writing to one stream must put them back in order by sequence (see VideoStream.h)
+
+class CaptureSink
+{
+public:
+
+    virtual ~CaptureSink() {}
+
+    // called by the pipeline before its writers start, so per writer state can be allocated up front
+
+    virtual void Start( int /*numWriters*/ ) {}
+
+    virtual bool WriteFrame( const CaptureFrame & frame ) = 0;
+};
+
+// one RLE compressed TGA per frame, named by frame number, eg. "output/frame-%05d.tga"
+
+class TGACaptureSink : public CaptureSink
+{
+public:
+
+    // "crop" rows are left off the top and the bottom of every frame
+
+    TGACaptureSink( const char * format, int crop = 0 ) : format( format ), crop( crop ) {}
+
+    virtual bool WriteFrame( const CaptureFrame & frame )
+    {
+        assert( frame.height > crop * 2 );
+        char filename[1024];
+        snprintf( filename, sizeof( filename ), format, frame.frame );
+        return WriteTGA( filename, frame.width, frame.height - crop * 2, frame.pixels + frame.width * 3 * crop );
+    }
+
+private:
+
+    const char * format;
+    int crop;
+};
+
+// ----------------------------------------------------------------
+
+/*
+    Bounded queue of ints, safe for any number of threads pushing and
+    popping at once without locks. Each slot has a sequence number that
+    says whether it is ready to be written or read for the current lap
+    around the ring, so pushers and poppers only contend on their own
+    position counter.
+*/
+
+class CaptureQueue
+{
+public:
+
+    CaptureQueue()
+    {
+        slots = NULL;
+        mask = 0;
+        pushPosition = 0;
+        popPosition = 0;
+    }
+
+    ~CaptureQueue()
+    {
+        Free();
+    }
+
+    // capacity is rounded up to a power of two
+
+    void Initialize( int capacity )
+    {
+        assert( capacity > 0 );
+
+        Free();
+
+        int size = 1;
+        while ( size < capacity )
+            size *= 2;
+
+        slots = new Slot[size];
+        for ( int i = 0; i < size; ++i )
+            slots[i].sequence = i;
+        mask = size - 1;
+        pushPosition = 0;
+        popPosition = 0;
+    }
+
+    void Free()
+    {
+        delete [] slots;
+        slots = NULL;
+        mask = 0;
+    }
+
+    bool Push( int value )
+    {
+        while ( true )
+        {
+            const uint32_t position = platform::AtomicLoad( &pushPosition );
+            Slot & slot = slots[position & mask];
+            const int32_t difference = int32_t( platform::AtomicLoad( &slot.sequence ) - position );
+            if ( difference < 0 )
+                return false;
+            if ( difference == 0 && platform::AtomicCompareExchange( &pushPosition, position, position + 1 ) )
+            {
+                slot.value = value;
+                platform::AtomicStore( &slot.sequence, position + 1 );
+                return true;
+            }
+        }
+    }
+
+    bool Pop( int & value )
+    {
+        while ( true )
+        {
+            const uint32_t position = platform::AtomicLoad( &popPosition );
+            Slot & slot = slots[position & mask];
+            const int32_t difference = int32_t( platform::AtomicLoad( &slot.sequence ) - ( position + 1 ) );
+            if ( difference < 0 )
+                return false;
+            if ( difference == 0 && platform::AtomicCompareExchange( &popPosition, position, position + 1 ) )
+            {
+                value = slot.value;
+                platform::AtomicStore( &slot.sequence, position + mask + 1 );
+                return true;
+            }
+        }
+    }
+
+private:
+
+    CaptureQueue( const CaptureQueue & other );
+    CaptureQueue & operator = ( const CaptureQueue & other );
+
+    struct Slot
+    {
+        uint32_t sequence;
+        int value;
+    };
+
+    Slot * slots;
+    uint32_t mask;
+    uint32_t pushPosition;
+    uint32_t popPosition;
+};
+
+// ----------------------------------------------------------------
+
+class CapturePipeline;
+
+class CaptureWriter : public platform::WorkerThread
+{
+public:
+
+    CaptureWriter()
+    {
+        pipeline = NULL;
+    }
+
+    CapturePipeline * pipeline;
+
+protected:
+
+    virtual void Run();
+};
+
+class CapturePipeline
+{
+public:
+
+    CapturePipeline()
+    {
+        sink = NULL;
+        buffers = NULL;
+        frames = NULL;
+        sequences = NULL;
+        nextSequence = 0;
+        filled = NULL;
+        writers = NULL;
+        bufferSize = 0;
+        running = false;
+    }
+
+    ~CapturePipeline()
+    {
+        Shutdown();
+    }
+
+    bool Initialize( const CaptureParams & captureParams, CaptureSink * captureSink )
+    {
+        assert( captureParams.width > 0 && captureParams.height > 0 );
+        assert( captureParams.numBuffers > 0 );
+        assert( captureParams.numWriters > 0 );
+        assert( captureSink );
+
+        Shutdown();
+
+        params = captureParams;
+        sink = captureSink;
+        bufferSize = size_t( params.width ) * params.height * 3;
+        buffers = new uint8_t[bufferSize * params.numBuffers];
+        frames = new int[params.numBuffers];
+        sequences = new int[params.numBuffers];
+        nextSequence = 0;
+
+        // IMPORTANT: a new semaphore each time, so no signal left over from a writer that never started carries over
+
+        filled = new platform::Semaphore();
+
+        freeBuffers.Initialize( params.numBuffers );
+        filledBuffers.Initialize( params.numBuffers );
+        for ( int i = 0; i < params.numBuffers; ++i )
+            freeBuffers.Push( i );
+
+        stats = CaptureStats();
+        running = true;
+
+        sink->Start( params.numWriters );
+
+        writers = new CaptureWriter[params.numWriters];
+        for ( int i = 0; i < params.numWriters; ++i )
+        {
+            writers[i].pipeline = this;
+            if ( !writers[i].StartThread() )
+            {
+                Shutdown();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // writes out every frame still waiting, then stops the writers
+
+    void Shutdown()
+    {
+        if ( !running )
+            return;
+
+        // IMPORTANT: one extra signal per writer. a writer that wakes to an empty queue stops,
+        // and that can only happen once every buffer submitted before this has been taken
+
+        if ( writers )
+        {
+            for ( int i = 0; i < params.numWriters; ++i )
+                filled->Signal();
+            for ( int i = 0; i < params.numWriters; ++i )
+                writers[i].Join();
+        }
+
+        delete filled;
+        delete [] writers;
+        delete [] buffers;
+        delete [] frames;
+        delete [] sequences;
+        filled = NULL;
+        writers = NULL;
+        buffers = NULL;
+        frames = NULL;
+        sequences = NULL;
+        freeBuffers.Free();
+        filledBuffers.Free();
+        running = false;
+    }
+
+    // a buffer to read the next frame into, or -1 if every buffer is waiting to be
+    // written and "dropWhenFull" is set. otherwise waits for one to come free
+
+    int AcquireBuffer()
+    {
+        assert( running );
+
+        int index;
+        if ( freeBuffers.Pop( index ) )
+            return index;
+
+        if ( params.dropWhenFull )
+        {
+            stats.framesDropped++;
+            return -1;
+        }
+
+        platform::Timer timer;
+        stats.stalls++;
+        while ( !freeBuffers.Pop( index ) )
+            platform::wait_seconds( 0.0005f );
+        stats.stallTime += timer.time();
+
+        return index;
+    }
+
+    uint8_t * GetBuffer( int index )
+    {
+        assert( index >= 0 && index < params.numBuffers );
+        return buffers + bufferSize * index;
+    }
+
+    // queues the buffer to be written as this frame. the buffer belongs to the pipeline again after this
+
+    void SubmitBuffer( int index, int frame )
+    {
+        assert( running );
+        assert( index >= 0 && index < params.numBuffers );
+
+        frames[index] = frame;
+        sequences[index] = nextSequence++;
+        stats.framesSubmitted++;
+
+        const bool queued = filledBuffers.Push( index );
+        assert( queued );
+        (void) queued;
+
+        filled->Signal();
+    }
+
+    // copies the frame and queues it. returns false if it was dropped
+
+    bool Capture( int frame, const uint8_t * pixels )
+    {
+        const int index = AcquireBuffer();
+        if ( index < 0 )
+            return false;
+        memcpy( GetBuffer( index ), pixels, bufferSize );
+        SubmitBuffer( index, frame );
+        return true;
+    }
+
+    bool IsRunning() const { return running; }
+
+    const CaptureParams & GetParams() const { return params; }
+
+    // written and error counts are updated by the writers as they go, so they are read atomically into a copy.
+    // the rest belong to the thread that submits frames
+
+    CaptureStats GetStats() const
+    {
+        CaptureStats copy;
+        copy.framesSubmitted = stats.framesSubmitted;
+        copy.framesWritten = platform::AtomicLoad( &stats.framesWritten );
+        copy.framesDropped = stats.framesDropped;
+        copy.writeErrors = platform::AtomicLoad( &stats.writeErrors );
+        copy.stalls = stats.stalls;
+        copy.stallTime = stats.stallTime;
+        return copy;
+    }
+
+protected:
+
+    friend class CaptureWriter;
+
+    // waits for a filled buffer and writes it. returns false once the pipeline is shutting down and nothing is left
+
+    bool WriteNext()
+    {
+        filled->Wait();
+        int index;
+        if ( !filledBuffers.Pop( index ) )
+            return false;
+        WriteBuffer( index );
+        return true;
+    }
+
+private:
+
+    CapturePipeline( const CapturePipeline & other );
+    CapturePipeline & operator = ( const CapturePipeline & other );
+
+    void WriteBuffer( int index )
+    {
+        CaptureFrame frame;
+        frame.frame = frames[index];
+        frame.sequence = sequences[index];
+        frame.width = params.width;
+        frame.height = params.height;
+        frame.pixels = GetBuffer( index );
+
+        if ( sink->WriteFrame( frame ) )
+            platform::AtomicAdd( &stats.framesWritten, uint64_t( 1 ) );
+        else
+            platform::AtomicAdd( &stats.writeErrors, uint64_t( 1 ) );
+
+        const bool freed = freeBuffers.Push( index );
+        assert( freed );
+        (void) freed;
+    }
+
+    CaptureParams params;
+    CaptureStats stats;
+    CaptureSink * sink;
+
+    size_t bufferSize;
+    uint8_t * buffers;
+    int * frames;                   // frame number of each buffer while it waits to be written
+    int * sequences;
+    int nextSequence;
+
+    CaptureQueue freeBuffers;
+    CaptureQueue filledBuffers;
+
+    platform::Semaphore * filled;   // signalled once per buffer pushed onto "filledBuffers", and once per writer to stop
+
+    CaptureWriter * writers;
+    bool running;
+};
+
+inline void CaptureWriter::Run()
+{
+    bool writing = true;
+    while ( writing )
+        writing = pipeline->WriteNext();
+}
+
+#endif
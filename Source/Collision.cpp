@@ -11,6 +11,11 @@
 #include "CollisionDetection.h"
 #include "CollisionResponse.h"
 #include "Intersection.h"
+#include "Determinism.h"
+#include "InputRecording.h"
+#include "Trajectory.h"
+#include "Capture.h"
+#include "VideoStream.h"
 
 using namespace platform;
 
@@ -73,6 +78,21 @@ Stone stoneSizes[STONE_SIZE_NumValues];
 bool collided = false;
 StaticContact boardContact;
 
+// IMPORTANT: random stones come from our own generator, not rand(), so playback drops the same stones
+
+DeterministicRandom randomGenerator;
+
+quat4f RandomOrientation()
+{
+    // IMPORTANT: one random number per statement. the order function arguments are evaluated in is up to the compiler
+
+    const float angle = randomGenerator.GetFloat( 0, 2*pi );
+    const float x = randomGenerator.GetFloat( 0.1f, 1 );
+    const float y = randomGenerator.GetFloat( 0.1f, 1 );
+    const float z = randomGenerator.GetFloat( 0.1f, 1 );
+    return quat4f::axisRotation( angle, vec3f( x, y, z ) );
+}
+
 void RandomStone( const Biconvex & biconvex, RigidBody & rigidBody, Mode mode )
 {
     const float x = scrollX;
@@ -103,12 +123,12 @@ void RandomStone( const Biconvex & biconvex, RigidBody & rigidBody, Mode mode )
     }
     else if ( stoneDropType == STONE_DROP_RandomNoSpin )
     {
-        rigidBody.orientation = quat4f::axisRotation( random_float(0,2*pi), vec3f( random_float(0.1f,1), random_float(0.1f,1), random_float(0.1f,1) ) );
+        rigidBody.orientation = RandomOrientation();
         rigidBody.angularMomentum = vec3f(0,0,0);
     }
     else if ( stoneDropType == STONE_DROP_RandomWithSpin )
     {
-        rigidBody.orientation = quat4f::axisRotation( random_float(0,2*pi), vec3f( random_float(0.1f,1), random_float(0.1f,1), random_float(0.1f,1) ) );
+        rigidBody.orientation = RandomOrientation();
     }
 
     if ( mode < LinearCollisionResponse )
@@ -125,8 +145,7 @@ void SelectStoneSize( int newStoneSize )
     stone.rigidBody.mass = stoneSizes[size].rigidBody.mass;
     stone.rigidBody.inverseMass = stoneSizes[size].rigidBody.inverseMass;
     stone.rigidBody.inertia = stoneSizes[size].rigidBody.inertia;
-    stone.rigidBody.inertiaTensor = stoneSizes[size].rigidBody.inertiaTensor;
-    stone.rigidBody.inverseInertiaTensor = stoneSizes[size].rigidBody.inverseInertiaTensor;
+    stone.rigidBody.inverseInertia = stoneSizes[size].rigidBody.inverseInertia;
 }
 
 void RestoreDefaults()
@@ -171,6 +190,8 @@ int main( int argc, char * argv[] )
 {   
     bool playback = false;
     bool video = false;
+    bool stream = false;
+    VideoStreamFormat streamFormat = VIDEO_STREAM_Y4M;
 
     for ( int i = 1; i < argc; ++i )
     {
@@ -184,8 +205,24 @@ int main( int argc, char * argv[] )
             printf( "video\n" );
             video = true;
         }
+        else if ( GetVideoStreamFormat( argv[i], streamFormat ) )
+        {
+            printf( "video (%s)\n", argv[i] );
+            video = true;
+            stream = true;
+        }
     }
 
+    // headless there is no one at the keyboard, so recording would only overwrite the inputs with a quit
+
+    #ifdef HEADLESS
+    if ( !playback )
+    {
+        printf( "headless only plays back recorded inputs. run with \"playback\"\n" );
+        return 1;
+    }
+    #endif
+
     printf( "[collision demo]\n" );
 
     // initialize stones
@@ -219,6 +256,14 @@ int main( int argc, char * argv[] )
 
     HideMouseCursor();
 
+    // upload meshes once, see Render.h
+
+    MeshBuffer meshBuffer[STONE_SIZE_NumValues];
+    for ( int i = 0; i < STONE_SIZE_NumValues; ++i )
+        meshBuffer[i].Upload( mesh[i] );
+
+    BoardBuffer boardBuffer;
+
     // setup opengl
 
     glEnable( GL_LINE_SMOOTH );
@@ -275,32 +320,89 @@ int main( int argc, char * argv[] )
 
     CheckOpenGLError( "after opengl setup" );
 
-    // create pixel buffer objects
-    GLuint pboId;
+    // create 2 pixel buffer objects, so each frame is read back while the one before is copied out
+    const int NumPBOs = 2;
+    GLuint pboIds[NumPBOs];
     int index = 0;
     const int dataSize = displayWidth * displayHeight * 3;
     if ( video )
     {
-        glGenBuffersARB( 1, &pboId );
-        glBindBufferARB( GL_PIXEL_UNPACK_BUFFER_ARB, pboId );
-        glBufferDataARB( GL_PIXEL_UNPACK_BUFFER_ARB, dataSize, 0, GL_STREAM_DRAW_ARB );
+        glGenBuffersARB( NumPBOs, pboIds );
+        for ( int i = 0; i < NumPBOs; ++i )
+        {
+            glBindBufferARB( GL_PIXEL_UNPACK_BUFFER_ARB, pboIds[i] );
+            glBufferDataARB( GL_PIXEL_UNPACK_BUFFER_ARB, dataSize, 0, GL_STREAM_DRAW_ARB );
+        }
         glBindBufferARB( GL_PIXEL_UNPACK_BUFFER_ARB, 0 );
     }
 
+    // frames read back go to writer threads to be compressed and written, see Capture.h.
+    // one TGA per frame, or with "y4m", "raw", "rle" or "delta" every frame in one file, see VideoStream.h
+
+    #ifdef LETTERBOX
+    const int crop = 40;
+    #else
+    const int crop = 0;
+    #endif
+    TGACaptureSink tgaSink( "output/frame-%05d.tga", crop );
+    VideoStreamSink streamSink;
+    CapturePipeline capture;
+    if ( video )
+    {
+        CaptureSink * captureSink = &tgaSink;
+        if ( stream )
+        {
+            char filename[256];
+            snprintf( filename, sizeof( filename ), "output/video.%s", GetVideoStreamExtension( streamFormat ) );
+            VideoStreamParams streamParams;
+            streamParams.format = streamFormat;
+            streamParams.width = displayWidth;
+            streamParams.height = displayHeight;
+            streamParams.crop = crop;
+            if ( !streamSink.Open( filename, streamParams ) )
+            {
+                printf( "failed to open %s\n", filename );
+                return 1;
+            }
+            captureSink = &streamSink;
+        }
+        CaptureParams captureParams;
+        captureParams.width = displayWidth;
+        captureParams.height = displayHeight;
+        if ( !capture.Initialize( captureParams, captureSink ) )
+        {
+            printf( "failed to start video capture\n" );
+            return 1;
+        }
+    }
+
     // record input to a file
     // read it back in playback mode for recording video
-    FILE * inputFile = fopen( "output/recordedInputs", playback ? "rb" : "wb" );
-    if ( !inputFile )
+    InputRecorder inputRecorder;
+    InputPlayback inputPlayback;
+    if ( playback ? !inputPlayback.Open( "output/recordedInputs" ) : !inputRecorder.Open( "output/recordedInputs" ) )
     {
         printf( "failed to open input file\n" );
         return 1;
     }
 
+    // checksum the stone every frame while recording, and check it matches in playback
+
+    ChecksumLog checksums;
+    if ( !checksums.Open( "output/recordedChecksums", playback, 1 ) )
+        printf( "failed to open checksum file, determinism will not be checked\n" );
+
+    // and record where the stone is every frame, to look at afterwards without simulating again
+
+    TrajectoryWriter trajectory;
+    if ( !playback && !trajectory.Open( "output/recordedTrajectory", 1 ) )
+        printf( "failed to open trajectory file\n" );
+
     CheckOpenGLError( "after pbos" );
 
     bool quit = false;
 
-    srand( 10 );
+    randomGenerator.Seed( 10 );
 
     const float normal_dt = 1.0f / 60.0f;
     const float slowmo_dt = normal_dt * 0.1f;
@@ -335,13 +437,11 @@ int main( int argc, char * argv[] )
         if ( !playback )
         {
             input = platform::Input::Sample();
-            fwrite( &input, sizeof( platform::Input ), 1, inputFile );
-            fflush( inputFile );
+            inputRecorder.Write( input );
         }
         else
         {
-            const int size = sizeof( platform::Input );
-            if ( !fread( &input, size, 1, inputFile ) )
+            if ( !inputPlayback.Read( input ) )
                 quit = true;
         }
 
@@ -765,11 +865,11 @@ int main( int argc, char * argv[] )
                 if ( mode == PushOutWithContact )
                     stone.rigidBody.linearMomentum = vec3f(0,0,0);
                 else if ( mode == LinearCollisionResponse )
-                    ApplyLinearCollisionImpulse( boardContact, board_e );
+                    ApplyLinearCollisionImpulse( stone.rigidBody, boardContact, board_e );
                 else if ( mode == AngularCollisionResponse )
-                    ApplyCollisionImpulseWithFriction( boardContact, board_e, 0.0f );
+                    ApplyCollisionImpulseWithFriction( stone.rigidBody, boardContact, board_e, 0.0f );
                 else if ( mode >= CollisionResponseWithFriction )
-                    ApplyCollisionImpulseWithFriction( boardContact, board_e, board_u );
+                    ApplyCollisionImpulseWithFriction( stone.rigidBody, boardContact, board_e, board_u );
                 // todo
                 // stone.rigidBody.Update();
                 collided = true;
@@ -786,11 +886,11 @@ int main( int argc, char * argv[] )
                 if ( StonePlaneCollision( stone.biconvex, vec4f(0,0,1,0), stone.rigidBody, floorContact ) )
                 {
                     if ( mode == LinearCollisionResponse )
-                        ApplyLinearCollisionImpulse( floorContact, floor_e );
+                        ApplyLinearCollisionImpulse( stone.rigidBody, floorContact, floor_e );
                     else if ( mode == AngularCollisionResponse )
-                        ApplyCollisionImpulseWithFriction( floorContact, floor_e, 0.0f );
+                        ApplyCollisionImpulseWithFriction( stone.rigidBody, floorContact, floor_e, 0.0f );
                     else if ( mode >= CollisionResponseWithFriction )
-                        ApplyCollisionImpulseWithFriction( floorContact, floor_e, floor_u );
+                        ApplyCollisionImpulseWithFriction( stone.rigidBody, floorContact, floor_e, floor_u );
                     // todo
                     //stone.rigidBody.Update();
                     collided = true;
@@ -835,6 +935,12 @@ int main( int argc, char * argv[] )
             }
         }
 
+        if ( checksums.IsOpen() && !checksums.Update( &stone.rigidBody, 1 ) && checksums.GetDivergedFrame() == frame )
+            printf( "playback diverged on frame %d, body %d\n", (int) checksums.GetDivergedFrame(), checksums.GetDivergedBody() );
+
+        if ( trajectory.IsOpen() )
+            trajectory.Write( &stone.rigidBody, 1 );
+
         // setup lights for board
 
         glEnable( GL_LIGHT0 );
@@ -854,7 +960,7 @@ int main( int argc, char * argv[] )
     
             glDisable( GL_CULL_FACE );
     
-            RenderBoard( board );
+            RenderBoard( boardBuffer, board );
     
             glEnable( GL_CULL_FACE );
         }
@@ -911,7 +1017,7 @@ int main( int argc, char * argv[] )
 
             glDisable( GL_DEPTH_TEST );
 
-            RenderBoard( board );
+            RenderBoard( boardBuffer, board );
 
             // render grid
 
@@ -950,9 +1056,10 @@ int main( int argc, char * argv[] )
 
         // todo
         /*
-        RigidBodyTransform biconvexTransform( stone.rigidBody.position, stone.rigidBody.orientation );
+        mat4f localToWorld;
+        stone.rigidBody.transform.GetLocalToWorldMatrix( localToWorld );
         float opengl_transform[16];
-        biconvexTransform.localToWorld.store( opengl_transform );
+        localToWorld.store( opengl_transform );
         glMultMatrixf( opengl_transform );
         */
 
@@ -984,7 +1091,7 @@ int main( int argc, char * argv[] )
         glMaterialfv( GL_FRONT, GL_SPECULAR, mat_specular );
         glMaterialfv( GL_FRONT, GL_SHININESS, mat_shininess );
 
-        RenderMesh( mesh[size] );
+        RenderMesh( meshBuffer[size] );
 
         glPopMatrix();
 
@@ -1010,28 +1117,31 @@ int main( int argc, char * argv[] )
 
         if ( video )
         {
-            // set the target framebuffer to read
+            // "index" is used to read pixels from framebuffer to a PBO
+            // "prevIndex" is the PBO read last frame, mapped now it has had a frame to finish
+            index = ( index + 1 ) % NumPBOs;
+            int prevIndex = ( index + NumPBOs - 1 ) % NumPBOs;
+
+            // set the target framebuffer to read. headless there is only the offscreen one, already bound
+            #ifndef HEADLESS
             glReadBuffer( GL_FRONT );
+            #endif
 
             // read pixels from framebuffer to PBO
             // glReadPixels() should return immediately.
-            glBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, pboId );
+            glBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, pboIds[index] );
             glReadPixels( 0, 0, displayWidth, displayHeight, GL_BGR, GL_UNSIGNED_BYTE, 0 );
-
-            // map the PBO to process its data by CPU
-            glBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, pboId );
-            GLubyte * ptr = (GLubyte*) glMapBufferARB( GL_PIXEL_PACK_BUFFER_ARB,
-                                                       GL_READ_ONLY_ARB );
-            if ( ptr )
+            if ( frame > 0 )
             {
-                char filename[256];
-                snprintf( filename, sizeof(filename), "output/frame-%05d.tga", frame );
-                #ifdef LETTERBOX
-                WriteTGA( filename, displayWidth, displayHeight - 80, ptr + displayWidth * 3 * 40 );
-                #else
-                WriteTGA( filename, displayWidth, displayHeight, ptr );
-                #endif
-                glUnmapBufferARB( GL_PIXEL_PACK_BUFFER_ARB );
+                // map the PBO to process its data by CPU
+                glBindBufferARB( GL_PIXEL_PACK_BUFFER_ARB, pboIds[prevIndex] );
+                GLubyte * ptr = (GLubyte*) glMapBufferARB( GL_PIXEL_PACK_BUFFER_ARB,
+                                                           GL_READ_ONLY_ARB );
+                if ( ptr )
+                {
+                    capture.Capture( frame - 1, ptr );
+                    glUnmapBufferARB( GL_PIXEL_PACK_BUFFER_ARB );
+                }
             }
 
             // back to conventional pixel operation
@@ -1049,6 +1159,10 @@ int main( int argc, char * argv[] )
         CheckOpenGLError( "frame end" );
     }
 
+    for ( int i = 0; i < STONE_SIZE_NumValues; ++i )
+        meshBuffer[i].Free();
+    boardBuffer.Free();
+
     CloseDisplay();
 
     return 0;
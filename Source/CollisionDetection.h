@@ -8,9 +8,12 @@
 
 // --------------------------------------------------------------------------
 
+// IMPORTANT: contacts name bodies by their index in the array the collision was run over,
+// never by pointer, so they stay meaningful when bodies are moved. single body functions use 0
+
 struct StaticContact
 {
-    RigidBody * rigidBody;
+    int body;
     vec3f point;
     vec3f normal;
     float depth;
@@ -18,8 +21,8 @@ struct StaticContact
 
 struct DynamicContact
 {
-    RigidBody * a;
-    RigidBody * b;
+    int a;
+    int b;
     vec3f point;
     vec3f normal;
 };
@@ -80,7 +83,7 @@ inline bool ClosestFeaturePrimarySurface( const Board & board,
     const float h = board.GetHeight() / 2;
     const float t = board.GetThickness();
 
-    vec4f plane = TransformPlane( biconvexTransform.worldToLocal, vec4f(0,0,1,t) );
+    vec4f plane = TransformPlaneWorldToLocal( biconvexTransform, vec4f(0,0,1,t) );
 
     vec3f local_stonePoint;
     vec3f local_stoneNormal;
@@ -92,9 +95,9 @@ inline bool ClosestFeaturePrimarySurface( const Board & board,
                                              local_stoneNormal,
                                              local_boardPoint );
 
-    stonePoint = TransformPoint( biconvexTransform.localToWorld, local_stonePoint );
-    stoneNormal = TransformVector( biconvexTransform.localToWorld, local_stoneNormal );
-    boardPoint = TransformPoint( biconvexTransform.localToWorld, local_boardPoint );
+    stonePoint = TransformPointLocalToWorld( biconvexTransform, local_stonePoint );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_stoneNormal );
+    boardPoint = TransformPointLocalToWorld( biconvexTransform, local_boardPoint );
     boardNormal = vec3f(0,0,1);
 
     const float x = boardPoint.x();
@@ -115,7 +118,7 @@ inline bool ClosestFeatureLeftSide( const Board & board,
     const float h = board.GetHeight() / 2;
     const float t = board.GetThickness();
 
-    vec4f plane = TransformPlane( biconvexTransform.worldToLocal, vec4f(-1,0,0,w) );
+    vec4f plane = TransformPlaneWorldToLocal( biconvexTransform, vec4f(-1,0,0,w) );
 
     vec3f local_stonePoint;
     vec3f local_stoneNormal;
@@ -127,9 +130,9 @@ inline bool ClosestFeatureLeftSide( const Board & board,
                                              local_stoneNormal,
                                              local_boardPoint );
 
-    stonePoint = TransformPoint( biconvexTransform.localToWorld, local_stonePoint );
-    stoneNormal = TransformVector( biconvexTransform.localToWorld, local_stoneNormal );
-    boardPoint = TransformPoint( biconvexTransform.localToWorld, local_boardPoint );
+    stonePoint = TransformPointLocalToWorld( biconvexTransform, local_stonePoint );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_stoneNormal );
+    boardPoint = TransformPointLocalToWorld( biconvexTransform, local_boardPoint );
     boardNormal = vec3f(-1,0,0);
 
     const float y = boardPoint.y();
@@ -172,12 +175,12 @@ inline bool ClosestFeatureLeftEdge( const Board & board,
     assert( dx < 0.001f );
     assert( dz < 0.001f );
 
-    vec3f local_point = transformPoint( biconvexTransform.worldToLocal, stonePoint );
+    vec3f local_point = TransformPointWorldToLocal( biconvexTransform, stonePoint );
     vec3f local_normal;
 
     GetBiconvexSurfaceNormalAtPoint_LocalSpace( local_point, biconvex, local_normal );
 
-    stoneNormal = transformVector( biconvexTransform.localToWorld, local_normal );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_normal );
 
     boardNormal = -stoneNormal;
 
@@ -196,7 +199,7 @@ inline bool ClosestFeatureRightSide( const Board & board,
     const float h = board.GetHeight() / 2;
     const float t = board.GetThickness();
 
-    vec4f plane = TransformPlane( biconvexTransform.worldToLocal, vec4f(1,0,0,w) );
+    vec4f plane = TransformPlaneWorldToLocal( biconvexTransform, vec4f(1,0,0,w) );
 
     vec3f local_stonePoint;
     vec3f local_stoneNormal;
@@ -208,9 +211,9 @@ inline bool ClosestFeatureRightSide( const Board & board,
                                              local_stoneNormal,
                                              local_boardPoint );
 
-    stonePoint = TransformPoint( biconvexTransform.localToWorld, local_stonePoint );
-    stoneNormal = TransformVector( biconvexTransform.localToWorld, local_stoneNormal );
-    boardPoint = TransformPoint( biconvexTransform.localToWorld, local_boardPoint );
+    stonePoint = TransformPointLocalToWorld( biconvexTransform, local_stonePoint );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_stoneNormal );
+    boardPoint = TransformPointLocalToWorld( biconvexTransform, local_boardPoint );
     boardNormal = vec3f(1,0,0);
 
     const float y = boardPoint.y();
@@ -253,12 +256,12 @@ inline bool ClosestFeatureRightEdge( const Board & board,
     assert( dx < 0.001f );
     assert( dz < 0.001f );
 
-    vec3f local_point = transformPoint( biconvexTransform.worldToLocal, stonePoint );
+    vec3f local_point = TransformPointWorldToLocal( biconvexTransform, stonePoint );
     vec3f local_normal;
 
     GetBiconvexSurfaceNormalAtPoint_LocalSpace( local_point, biconvex, local_normal );
 
-    stoneNormal = transformVector( biconvexTransform.localToWorld, local_normal );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_normal );
 
     boardNormal = -stoneNormal;
 
@@ -277,7 +280,7 @@ inline bool ClosestFeatureTopSide( const Board & board,
     const float h = board.GetHeight() / 2;
     const float t = board.GetThickness();
 
-    vec4f plane = TransformPlane( biconvexTransform.worldToLocal, vec4f(0,1,0,h) );
+    vec4f plane = TransformPlaneWorldToLocal( biconvexTransform, vec4f(0,1,0,h) );
 
     vec3f local_stonePoint;
     vec3f local_stoneNormal;
@@ -289,9 +292,9 @@ inline bool ClosestFeatureTopSide( const Board & board,
                                              local_stoneNormal,
                                              local_boardPoint );
 
-    stonePoint = TransformPoint( biconvexTransform.localToWorld, local_stonePoint );
-    stoneNormal = TransformVector( biconvexTransform.localToWorld, local_stoneNormal );
-    boardPoint = TransformPoint( biconvexTransform.localToWorld, local_boardPoint );
+    stonePoint = TransformPointLocalToWorld( biconvexTransform, local_stonePoint );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_stoneNormal );
+    boardPoint = TransformPointLocalToWorld( biconvexTransform, local_boardPoint );
     boardNormal = vec3f(0,1,0);
 
     const float x = boardPoint.x();
@@ -334,12 +337,12 @@ inline bool ClosestFeatureTopEdge( const Board & board,
     assert( dy < 0.001f );
     assert( dz < 0.001f );
 
-    vec3f local_point = transformPoint( biconvexTransform.worldToLocal, stonePoint );
+    vec3f local_point = TransformPointWorldToLocal( biconvexTransform, stonePoint );
     vec3f local_normal;
 
     GetBiconvexSurfaceNormalAtPoint_LocalSpace( local_point, biconvex, local_normal );
 
-    stoneNormal = transformVector( biconvexTransform.localToWorld, local_normal );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_normal );
 
     boardNormal = -stoneNormal;
 
@@ -358,7 +361,7 @@ inline bool ClosestFeatureBottomSide( const Board & board,
     const float h = board.GetHeight() / 2;
     const float t = board.GetThickness();
 
-    vec4f plane = TransformPlane( biconvexTransform.worldToLocal, vec4f(0,-1,0,h) );
+    vec4f plane = TransformPlaneWorldToLocal( biconvexTransform, vec4f(0,-1,0,h) );
 
     vec3f local_stonePoint;
     vec3f local_stoneNormal;
@@ -370,9 +373,9 @@ inline bool ClosestFeatureBottomSide( const Board & board,
                                              local_stoneNormal,
                                              local_boardPoint );
 
-    stonePoint = TransformPoint( biconvexTransform.localToWorld, local_stonePoint );
-    stoneNormal = TransformVector( biconvexTransform.localToWorld, local_stoneNormal );
-    boardPoint = TransformPoint( biconvexTransform.localToWorld, local_boardPoint );
+    stonePoint = TransformPointLocalToWorld( biconvexTransform, local_stonePoint );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_stoneNormal );
+    boardPoint = TransformPointLocalToWorld( biconvexTransform, local_boardPoint );
     boardNormal = vec3f(0,-1,0);
 
     const float x = boardPoint.x();
@@ -415,12 +418,12 @@ inline bool ClosestFeatureBottomEdge( const Board & board,
     assert( dy < 0.001f );
     assert( dz < 0.001f );
 
-    vec3f local_point = transformPoint( biconvexTransform.worldToLocal, stonePoint );
+    vec3f local_point = TransformPointWorldToLocal( biconvexTransform, stonePoint );
     vec3f local_normal;
 
     GetBiconvexSurfaceNormalAtPoint_LocalSpace( local_point, biconvex, local_normal );
 
-    stoneNormal = transformVector( biconvexTransform.localToWorld, local_normal );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_normal );
 
     boardNormal = -stoneNormal;
 
@@ -461,12 +464,12 @@ inline bool ClosestFeatureBottomLeftEdge( const Board & board,
     assert( dx < 0.001f );
     assert( dy < 0.001f );
 
-    vec3f local_point = transformPoint( biconvexTransform.worldToLocal, stonePoint );
+    vec3f local_point = TransformPointWorldToLocal( biconvexTransform, stonePoint );
     vec3f local_normal;
 
     GetBiconvexSurfaceNormalAtPoint_LocalSpace( local_point, biconvex, local_normal );
 
-    stoneNormal = transformVector( biconvexTransform.localToWorld, local_normal );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_normal );
 
     boardNormal = -stoneNormal;
 
@@ -507,12 +510,12 @@ inline bool ClosestFeatureBottomRightEdge( const Board & board,
     assert( dx < 0.001f );
     assert( dy < 0.001f );
 
-    vec3f local_point = transformPoint( biconvexTransform.worldToLocal, stonePoint );
+    vec3f local_point = TransformPointWorldToLocal( biconvexTransform, stonePoint );
     vec3f local_normal;
 
     GetBiconvexSurfaceNormalAtPoint_LocalSpace( local_point, biconvex, local_normal );
 
-    stoneNormal = transformVector( biconvexTransform.localToWorld, local_normal );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_normal );
 
     boardNormal = -stoneNormal;
 
@@ -553,12 +556,12 @@ inline bool ClosestFeatureTopLeftEdge( const Board & board,
     assert( dx < 0.001f );
     assert( dy < 0.001f );
 
-    vec3f local_point = transformPoint( biconvexTransform.worldToLocal, stonePoint );
+    vec3f local_point = TransformPointWorldToLocal( biconvexTransform, stonePoint );
     vec3f local_normal;
 
     GetBiconvexSurfaceNormalAtPoint_LocalSpace( local_point, biconvex, local_normal );
 
-    stoneNormal = transformVector( biconvexTransform.localToWorld, local_normal );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_normal );
 
     boardNormal = -stoneNormal;
 
@@ -599,12 +602,12 @@ inline bool ClosestFeatureTopRightEdge( const Board & board,
     assert( dx < 0.001f );
     assert( dy < 0.001f );
 
-    vec3f local_point = transformPoint( biconvexTransform.worldToLocal, stonePoint );
+    vec3f local_point = TransformPointWorldToLocal( biconvexTransform, stonePoint );
     vec3f local_normal;
 
     GetBiconvexSurfaceNormalAtPoint_LocalSpace( local_point, biconvex, local_normal );
 
-    stoneNormal = transformVector( biconvexTransform.localToWorld, local_normal );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_normal );
 
     boardNormal = -stoneNormal;
 
@@ -620,16 +623,17 @@ inline void ClosestFeatureCorner( const Board & board,
                                   vec3f & boardPoint,
                                   vec3f & boardNormal )
 {
-    vec3f local_corner_point = transformPoint( biconvexTransform.worldToLocal, cornerPoint );
+    vec3f local_corner_point = TransformPointWorldToLocal( biconvexTransform, cornerPoint );
 
-    vec3f local_biconvex_point = 
-        GetNearestPointOnBiconvexSurface_LocalSpace( local_corner_point, biconvex );
+    // one signed distance call gives both the nearest point and its normal
 
     vec3f local_normal;
-    GetBiconvexSurfaceNormalAtPoint_LocalSpace( local_biconvex_point, biconvex, local_normal );
+    const float distance = BiconvexSignedDistance_LocalSpace( local_corner_point, biconvex, local_normal );
+
+    vec3f local_biconvex_point = local_corner_point - local_normal * distance;
 
-    stonePoint = transformPoint( biconvexTransform.localToWorld, local_biconvex_point );
-    stoneNormal = transformVector( biconvexTransform.localToWorld, local_normal );
+    stonePoint = TransformPointLocalToWorld( biconvexTransform, local_biconvex_point );
+    stoneNormal = TransformVectorLocalToWorld( biconvexTransform, local_normal );
 
     boardNormal = -stoneNormal;
     boardPoint = cornerPoint;
@@ -824,7 +828,7 @@ bool StoneBoardCollision( const Biconvex & biconvex,
     ClosestFeaturesStoneBoard( board, biconvex, rigidBody.position, transform,
                                stonePoint, stoneNormal, boardPoint, boardNormal );
 
-    contact.rigidBody = &rigidBody;
+    contact.body = 0;
     contact.point = boardPoint;
     contact.normal = boardNormal;
     contact.depth = depth;
@@ -858,7 +862,7 @@ bool StonePlaneCollision( const Biconvex & biconvex,
 
     rigidBody.position += planeNormal * depth;
 
-    vec4f local_plane = TransformPlane( transform.worldToLocal, plane );
+    vec4f local_plane = TransformPlaneWorldToLocal( transform, plane );
 
     vec3f local_stonePoint;
     vec3f local_stoneNormal;
@@ -871,8 +875,8 @@ bool StonePlaneCollision( const Biconvex & biconvex,
                                              local_stoneNormal,
                                              local_floorPoint );
 
-    contact.rigidBody = &rigidBody;
-    contact.point = TransformPoint( transform.localToWorld, local_floorPoint );
+    contact.body = 0;
+    contact.point = TransformPointLocalToWorld( transform, local_floorPoint );
     contact.normal = planeNormal;
     contact.depth = depth;
 
@@ -881,4 +885,196 @@ bool StonePlaneCollision( const Biconvex & biconvex,
 
 // -----------------------------------------------------------------------
 
+// -----------------------------------------------------------------------
+
+/*
+    Batched stone vs. board collision.
+
+    Stones are classified four at a time with SIMD compares, mirroring
+    "DetermineStoneBoardRegion", into the primary surface bucket or the
+    edge and corner bucket. The primary bucket covers nearly every stone
+    away from the board edges and runs as a packet kernel writing into a
+    contiguous contact array. Edges and corners are rare and go through
+    the scalar "StoneBoardCollision" as the tail.
+
+    IMPORTANT: all stones in the batch must share the same biconvex and
+    have an up to date transform.
+*/
+
+inline void ClassifyStoneBoardRegions( const Board & board,
+                                       float radius,
+                                       const RigidBody * rigidBodies,
+                                       int numRigidBodies,
+                                       int * primary,
+                                       int & numPrimary,
+                                       int * tail,
+                                       int & numTail )
+{
+    const float w = board.GetHalfWidth();
+    const float h = board.GetHalfHeight();
+    const float t = board.GetThickness();
+    const float r = radius;
+
+    const simd4f left = simd4f_splat( -w + r );
+    const simd4f right = simd4f_splat( w - r );
+    const simd4f top = simd4f_splat( h - r );
+    const simd4f bottom = simd4f_splat( -h + r );
+
+    const simd4f min_x = simd4f_splat( -w - r );
+    const simd4f max_x = simd4f_splat( w + r );
+    const simd4f min_y = simd4f_splat( -h - r );
+    const simd4f max_y = simd4f_splat( h + r );
+    const simd4f max_z = simd4f_splat( t + r );
+
+    numPrimary = 0;
+    numTail = 0;
+
+    for ( int i = 0; i < numRigidBodies; i += 4 )
+    {
+        const int n = numRigidBodies - i < 4 ? numRigidBodies - i : 4;
+
+        vec3f position[4];
+        int active = 0;
+        for ( int j = 0; j < 4; ++j )
+        {
+            const RigidBody & rigidBody = rigidBodies[ i + ( j < n ? j : n - 1 ) ];
+            position[j] = rigidBody.position;
+            if ( j < n && rigidBody.active )
+                active |= 1 << j;
+        }
+
+        const vec3x4f p( position );
+
+        const int edges = simd4f_movemask( simd4f_or( simd4f_or( simd4f_cmple( p.x, left ), simd4f_cmple( right, p.x ) ),
+                                                      simd4f_or( simd4f_cmple( top, p.y ), simd4f_cmple( p.y, bottom ) ) ) );
+
+        const int reject = simd4f_movemask( simd4f_or( simd4f_or( simd4f_cmplt( max_z, p.z ), simd4f_cmplt( p.x, min_x ) ),
+                                                       simd4f_or( simd4f_or( simd4f_cmplt( max_x, p.x ), simd4f_cmplt( p.y, min_y ) ),
+                                                                  simd4f_cmplt( max_y, p.y ) ) ) );
+
+        const int candidates = active & ~reject;
+
+        for ( int j = 0; j < n; ++j )
+        {
+            if ( ( candidates & ( 1 << j ) ) == 0 )
+                continue;
+
+            if ( edges & ( 1 << j ) )
+                tail[numTail++] = i + j;
+            else
+                primary[numPrimary++] = i + j;
+        }
+    }
+}
+
+inline int StoneBoardCollision_Primary( const Biconvex & biconvex,
+                                        const Board & board,
+                                        RigidBody * rigidBodies,
+                                        const int * indices,
+                                        int numIndices,
+                                        StaticContact * contacts,
+                                        bool pushOut = false )
+{
+    // the primary surface is the plane z = t, so in world space the support
+    // along the board normal and the closest feature reduce to the stone up
+    // vector: see "BiconvexSupport_WorldSpace" and "ClosestFeaturePrimarySurface"
+
+    const float t = board.GetThickness();
+
+    const simd4f zero = simd4f_zero();
+    const simd4f one = simd4f_splat( 1.0f );
+    const simd4f thickness = simd4f_splat( t );
+    const simd4f sphereRadius = simd4f_splat( biconvex.GetSphereRadius() );
+    const simd4f sphereOffset = simd4f_splat( biconvex.GetSphereOffset() );
+    const simd4f circleRadius = simd4f_splat( biconvex.GetCircleRadius() );
+    const simd4f sphereDot = simd4f_splat( biconvex.GetSphereDot() );
+    const simd4f epsilon = simd4f_splat( 0.000001f );
+
+    int numContacts = 0;
+
+    for ( int i = 0; i < numIndices; i += 4 )
+    {
+        const int n = numIndices - i < 4 ? numIndices - i : 4;
+
+        RigidBody * rigidBody[4];
+        vec3f position[4];
+        vec3f up[4];
+        for ( int j = 0; j < 4; ++j )
+        {
+            rigidBody[j] = &rigidBodies[ indices[ i + ( j < n ? j : n - 1 ) ] ];
+            position[j] = rigidBody[j]->position;
+            rigidBody[j]->transform.GetUp( up[j] );
+        }
+
+        const vec3x4f p( position );
+        const vec3x4f u( up );
+
+        // support along the board normal
+
+        const simd4f d = simd4f_abs( u.z );
+        const simd4f sin_d = simd4f_sqrt( simd4f_max( zero, simd4f_sub( one, simd4f_mul( d, d ) ) ) );
+        const simd4f circle = simd4f_cmplt( d, sphereDot );
+        const simd4f radius_t = simd4f_select( circle, simd4f_mul( circleRadius, sin_d ), simd4f_sub( sphereRadius, simd4f_mul( sphereOffset, d ) ) );
+        const simd4f depth = simd4f_sub( thickness, simd4f_sub( p.z, radius_t ) );
+
+        const int colliding = simd4f_movemask( simd4f_cmple( zero, depth ) ) & ( ( 1 << n ) - 1 );
+        if ( !colliding )
+            continue;
+
+        // closest feature: lowest point of the sphere surface facing the board,
+        // or the lowest point on the circle edge. the board point is below it
+
+        const simd4f signedOffset = simd4f_select( simd4f_cmplt( u.z, zero ), simd4f_sub( zero, sphereOffset ), sphereOffset );
+        const simd4f edgeOffset = simd4f_div( simd4f_mul( u.z, circleRadius ), simd4f_max( sin_d, epsilon ) );
+        const simd4f offset = simd4f_select( circle, edgeOffset, signedOffset );
+
+        float point_x[4], point_y[4], contact_depth[4];
+        simd4f_ustore4( simd4f_add( p.x, simd4f_mul( u.x, offset ) ), point_x );
+        simd4f_ustore4( simd4f_add( p.y, simd4f_mul( u.y, offset ) ), point_y );
+        simd4f_ustore4( depth, contact_depth );
+
+        for ( int j = 0; j < n; ++j )
+        {
+            if ( ( colliding & ( 1 << j ) ) == 0 )
+                continue;
+
+            if ( pushOut )
+                rigidBody[j]->position += vec3f( 0, 0, contact_depth[j] );
+
+            StaticContact & contact = contacts[numContacts++];
+            contact.body = indices[ i + j ];
+            contact.point = vec3f( point_x[j], point_y[j], t );
+            contact.normal = vec3f( 0, 0, 1 );
+            contact.depth = contact_depth[j];
+        }
+    }
+
+    return numContacts;
+}
+
+inline int StoneBoardCollision_Batch( const Biconvex & biconvex,
+                                      const Board & board,
+                                      RigidBody * rigidBodies,
+                                      int numRigidBodies,
+                                      int * primary,
+                                      int * tail,
+                                      StaticContact * contacts,
+                                      bool pushOut = false )
+{
+    // IMPORTANT: primary, tail and contacts must have room for numRigidBodies entries
+
+    int numPrimary, numTail;
+    ClassifyStoneBoardRegions( board, biconvex.GetBoundingSphereRadius(), rigidBodies, numRigidBodies, primary, numPrimary, tail, numTail );
+
+    int numContacts = StoneBoardCollision_Primary( biconvex, board, rigidBodies, primary, numPrimary, contacts, pushOut );
+
+    for ( int i = 0; i < numTail; ++i )
+    {
+        if ( StoneBoardCollision( biconvex, board, rigidBodies[tail[i]], contacts[numContacts], pushOut ) )
+            contacts[numContacts++].body = tail[i];
+    }
+
+    return numContacts;
+}
+
 #endif
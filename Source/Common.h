@@ -4,10 +4,15 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
 #include "vectorial/vec2f.h"
 #include "vectorial/vec3f.h"
 #include "vectorial/vec4f.h"
 #include "vectorial/mat4f.h"
+#include "vectorial/vec3x4f.h"
+#include "vectorial/vec3x8f.h"
+#include "vectorial/quat4x4f.h"
+#include "vectorial/quat4x8f.h"
 
 using namespace vectorial;
 
@@ -32,6 +37,48 @@ uint32_t hash( const uint8_t * data, uint32_t length, uint32_t hash = 0 )
     return hash;
 } 
 
+// 64 bit hash that takes eight bytes a step (MurmurHash64A). much faster than "hash"
+// on anything bigger than a few bytes, and every input bit affects every output bit
+
+inline uint64_t hash64( const void * data, size_t length, uint64_t seed = 0 )
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+
+    uint64_t h = seed ^ ( length * m );
+
+    const uint8_t * p = (const uint8_t*) data;
+    const uint8_t * end = p + ( length & ~size_t(7) );
+
+    while ( p != end )
+    {
+        uint64_t k;
+        memcpy( &k, p, 8 );
+        p += 8;
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    const int tail = length & 7;
+    if ( tail )
+    {
+        for ( int i = tail - 1; i >= 0; --i )
+            h ^= uint64_t( p[i] ) << ( i * 8 );
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
 inline float random_float( float min, float max )
 {
     assert( max > min );
@@ -265,6 +312,47 @@ inline quat4f operator * ( float s, const quat4f & q )
     return result;
 }
 
+inline float dot( const quat4f & q1, const quat4f & q2 )
+{
+    return q1.x*q2.x + q1.y*q2.y + q1.z*q2.z + q1.w*q2.w;
+}
+
+// spherical linear interpolation from q1 at t = 0 to q2 at t = 1, along the shorter arc
+
+inline quat4f slerp( const quat4f & q1, const quat4f & q2, float t )
+{
+    // IMPORTANT: q and -q are the same rotation. flip q2 into the same hemisphere as q1
+    // or the interpolation goes the long way round
+
+    float cosTheta = dot( q1, q2 );
+    const float sign = cosTheta < 0.0f ? -1.0f : 1.0f;
+    cosTheta *= sign;
+
+    float s1, s2;
+    if ( cosTheta > 0.9995f )
+    {
+        // nearly parallel. sin(theta) goes to zero, so lerp and normalize instead
+        s1 = 1.0f - t;
+        s2 = t;
+    }
+    else
+    {
+        const float theta = acos( cosTheta );
+        const float inverseSinTheta = 1.0f / sin( theta );
+        s1 = sin( ( 1.0f - t ) * theta ) * inverseSinTheta;
+        s2 = sin( t * theta ) * inverseSinTheta;
+    }
+
+    s2 *= sign;
+
+    quat4f result;
+    result.x = q1.x * s1 + q2.x * s2;
+    result.y = q1.y * s1 + q2.y * s2;
+    result.z = q1.z * s1 + q2.z * s2;
+    result.w = q1.w * s1 + q2.w * s2;
+    return normalize( result );
+}
+
 inline vec3f TransformPoint( mat4f matrix, vec3f point )
 {
     return transformPoint( matrix, point );
@@ -289,7 +377,7 @@ inline vec4f TransformPlane( mat4f matrix, vec4f plane )
     /*
     // IMPORTANT: to transform a plane (nx,ny,nz,d) by a matrix multiply it by the inverse of the transpose
     // http://www.opengl.org/discussion_boards/showthread.php/159564-Clever-way-to-transform-plane-by-matrix
-    mat4f m = RigidBodyInverse( transpose( matrix ) ) );
+    mat4f m = inverse( transpose( matrix ) ) );
     return m * plane;
     */
 }
@@ -299,39 +387,30 @@ inline float DecayFactor( float factor, float deltaTime, float ideal_fps = 60 )
     return pow( factor, ideal_fps * deltaTime );
 }
 
-inline bool WriteTGA( const char filename[], int width, int height, uint8_t * ptr )
+// RLE compressed 24 bit TGA pixel data. packets never span lines, as the format asks
+
+inline size_t GetMaxTGARLEBytes( int width, int height )
 {
-    FILE * file = fopen( filename, "wb" );
-    if ( !file )
-        return false;
+    // worst case is pairs of pixels that each end on a repeat, eg. ABBCCD. that is raw packets of two, 7 bytes for every 2 pixels
+    return size_t( height ) * ( width * 4 + 1 );
+}
 
-    putc( 0, file );
-    putc( 0, file );
-    putc( 10, file );                        /* compressed RGB */
-    putc( 0, file ); putc( 0, file );
-    putc( 0, file ); putc( 0, file );
-    putc( 0, file );
-    putc( 0, file ); putc( 0, file );           /* X origin */
-    putc( 0, file ); putc( 0, file );           /* y origin */
-    putc( ( width & 0x00FF ),file );
-    putc( ( width & 0xFF00 ) >> 8,file );
-    putc( ( height & 0x00FF ), file );
-    putc( ( height & 0xFF00 ) >> 8, file );
-    putc( 24, file );                         /* 24 bit bitmap */
-    putc( 0, file );
+inline size_t EncodeTGARLE( int width, int height, const uint8_t * ptr, uint8_t * output )
+{
+    uint8_t * out = output;
 
     for ( int y = 0; y < height; ++y )
     {
-        uint8_t * line = ptr + width * 3 * y;
-        uint8_t * end_of_line = line + width * 3;
-        uint8_t * pixel = line;
+        const uint8_t * line = ptr + width * 3 * y;
+        const uint8_t * end_of_line = line + width * 3;
+        const uint8_t * pixel = line;
         while ( true )
         {
             if ( pixel >= end_of_line )
                 break;
 
-            uint8_t * start = pixel;
-            uint8_t * finish = pixel + 128 * 3;
+            const uint8_t * start = pixel;
+            const uint8_t * finish = pixel + 128 * 3;
             if ( finish > end_of_line )
                 finish = end_of_line;
             uint32_t previous = ( pixel[0] << 16 ) | ( pixel[1] << 8 ) | pixel[2];
@@ -352,10 +431,10 @@ inline bool WriteTGA( const char filename[], int width, int height, uint8_t * pt
             if ( counter > 1 )
             {
                 assert( counter <= 128 );
-                putc( uint8_t( counter - 1 ) | 128, file );
-                putc( start[0], file );
-                putc( start[1], file );
-                putc( start[2], file );
+                *out++ = uint8_t( counter - 1 ) | 128;
+                *out++ = start[0];
+                *out++ = start[1];
+                *out++ = start[2];
                 continue;
             }
 
@@ -372,14 +451,91 @@ inline bool WriteTGA( const char filename[], int width, int height, uint8_t * pt
             }
             assert( counter >= 1 );
             assert( counter <= 128 );
-            putc( uint8_t( counter - 1 ), file );
-            fwrite( start, counter * 3, 1, file );
+            *out++ = uint8_t( counter - 1 );
+            memcpy( out, start, counter * 3 );
+            out += counter * 3;
         }
     }
 
-    fclose( file );
+    assert( size_t( out - output ) <= GetMaxTGARLEBytes( width, height ) );
 
-    return true;
+    return out - output;
+}
+
+// returns false if the data is short, runs past the image, or leaves some of it unfilled
+
+inline bool DecodeTGARLE( const uint8_t * data, size_t bytes, int width, int height, uint8_t * ptr )
+{
+    const uint8_t * in = data;
+    const uint8_t * end = data + bytes;
+    uint8_t * out = ptr;
+    uint8_t * out_end = ptr + width * height * 3;
+
+    while ( out < out_end )
+    {
+        if ( in >= end )
+            return false;
+
+        const uint8_t header = *in++;
+        const int counter = ( header & 127 ) + 1;
+        if ( out + counter * 3 > out_end )
+            return false;
+
+        if ( header & 128 )
+        {
+            if ( in + 3 > end )
+                return false;
+            for ( int i = 0; i < counter; ++i )
+            {
+                out[0] = in[0];
+                out[1] = in[1];
+                out[2] = in[2];
+                out += 3;
+            }
+            in += 3;
+        }
+        else
+        {
+            if ( in + counter * 3 > end )
+                return false;
+            memcpy( out, in, counter * 3 );
+            in += counter * 3;
+            out += counter * 3;
+        }
+    }
+
+    return in == end;
+}
+
+inline bool WriteTGA( const char filename[], int width, int height, uint8_t * ptr )
+{
+    FILE * file = fopen( filename, "wb" );
+    if ( !file )
+        return false;
+
+    const uint8_t header[] =
+    {
+        0, 0,
+        10,                                     /* compressed RGB */
+        0, 0, 0, 0, 0,
+        0, 0,                                   /* X origin */
+        0, 0,                                   /* y origin */
+        uint8_t( width & 0x00FF ), uint8_t( ( width & 0xFF00 ) >> 8 ),
+        uint8_t( height & 0x00FF ), uint8_t( ( height & 0xFF00 ) >> 8 ),
+        24,                                     /* 24 bit bitmap */
+        0
+    };
+
+    // encode the whole image first, then write it in one go
+
+    uint8_t * data = new uint8_t[GetMaxTGARLEBytes( width, height )];
+    const size_t bytes = EncodeTGARLE( width, height, ptr, data );
+
+    const bool ok = fwrite( header, sizeof( header ), 1, file ) == 1 && fwrite( data, bytes, 1, file ) == 1;
+
+    delete [] data;
+
+    return fclose( file ) == 0 && ok;
 }
 
 struct Frustum
@@ -473,37 +629,121 @@ inline void AngularVelocityToSpin( const quat4f & orientation, vec3f angularVelo
     spin = 0.5f * quat4f( 0, angularVelocity.x(), angularVelocity.y(), angularVelocity.z() ) * orientation;
 }
 
-inline void RigidBodyInverse( const mat4f & matrix, const mat4f & transposeRotation, mat4f & inverse )
+struct RigidBodyTransform
 {
-    // http://graphics.stanford.edu/courses/cs248-98-fall/Final/q4.html
-    inverse = transposeRotation;
-    const vec4f & translation = matrix.value.w;
-    inverse.value.w = simd4f_create( -dot( matrix.value.x, translation ),
-                                     -dot( matrix.value.y, translation ),
-                                     -dot( matrix.value.z, translation ),
-                                     1.0f );
-}
+    // IMPORTANT: compact 3x4 affine transform. the rotation is stored as its three
+    // columns (the local axes expressed in world space) plus the position. we never
+    // store the world -> local matrix, the transpose of the rotation is implicit in
+    // the "WorldToLocal" functions below. this is 64 bytes vs. 128 for two mat4f.
 
-struct RigidBodyTransform
-{    
-    mat4f localToWorld, worldToLocal;
+    vec3f axisX, axisY, axisZ;
+    vec3f position;
+
+    void Initialize( const vec3f & position, const quat4f & orientation )
+    {
+        const float tx  = 2.0f * orientation.x;
+        const float ty  = 2.0f * orientation.y;
+        const float tz  = 2.0f * orientation.z;
+        const float twx = tx * orientation.w;
+        const float twy = ty * orientation.w;
+        const float twz = tz * orientation.w;
+        const float txx = tx * orientation.x;
+        const float txy = ty * orientation.x;
+        const float txz = tz * orientation.x;
+        const float tyy = ty * orientation.y;
+        const float tyz = tz * orientation.y;
+        const float tzz = tz * orientation.z;
+
+        axisX = vec3f( 1.0f - ( tyy + tzz ), txy + twz, txz - twy );
+        axisY = vec3f( txy - twz, 1.0f - ( txx + tzz ), tyz + twx );
+        axisZ = vec3f( txz + twy, tyz - twx, 1.0f - ( txx + tyy ) );
+
+        this->position = position;
+    }
 
-    void Initialize( const vec3f & position, const mat4f & rotation, const mat4f & inverseRotation )
+    void Initialize( const vec3f & position, const mat4f & rotation )
     {
-        localToWorld = rotation;
-        localToWorld.value.w = simd4f_create( position.x(), position.y(), position.z(), 1 );
-        RigidBodyInverse( localToWorld, inverseRotation, worldToLocal );
+        axisX = vec3f( rotation.value.x );
+        axisY = vec3f( rotation.value.y );
+        axisZ = vec3f( rotation.value.z );
+        this->position = position;
     }
 
     void GetUp( vec3f & up ) const
     {
-        up = transformVector( localToWorld, vec3f(0,0,1) );
+        up = axisZ;
     }
 
     void GetPosition( vec3f & position ) const
     {
-        position = localToWorld.value.w;
+        position = this->position;
+    }
+
+    void GetLocalToWorldMatrix( mat4f & matrix ) const
+    {
+        matrix.value = simd4x4f_create( axisX.value, 
+                                        axisY.value, 
+                                        axisZ.value, 
+                                        simd4f_create( position.x(), position.y(), position.z(), 1 ) );
+    }
+
+    void GetWorldToLocalMatrix( mat4f & matrix ) const
+    {
+        // http://graphics.stanford.edu/courses/cs248-98-fall/Final/q4.html
+        matrix.value = simd4x4f_create( axisX.value, axisY.value, axisZ.value, simd4f_zero() );
+        simd4x4f_transpose_inplace( &matrix.value );
+        matrix.value.w = simd4f_create( -dot( axisX, position ),
+                                        -dot( axisY, position ),
+                                        -dot( axisZ, position ),
+                                        1.0f );
     }
 };
 
+inline vec3f TransformVectorLocalToWorld( const RigidBodyTransform & transform, const vec3f & vector )
+{
+    simd4x4f m = simd4x4f_create( transform.axisX.value, transform.axisY.value, transform.axisZ.value, simd4f_zero() );
+    vec3f result;
+    simd4x4f_matrix_vector3_mul( &m, &vector.value, &result.value );
+    return result;
+}
+
+inline vec3f TransformPointLocalToWorld( const RigidBodyTransform & transform, const vec3f & point )
+{
+    return TransformVectorLocalToWorld( transform, point ) + transform.position;
+}
+
+inline vec3f TransformVectorWorldToLocal( const RigidBodyTransform & transform, const vec3f & vector )
+{
+    // IMPORTANT: the inverse of a rotation is its transpose, so we transpose the
+    // axes in registers and multiply instead of storing a world -> local matrix
+    simd4x4f m = simd4x4f_create( transform.axisX.value, transform.axisY.value, transform.axisZ.value, simd4f_zero() );
+    simd4x4f_transpose_inplace( &m );
+    vec3f result;
+    simd4x4f_matrix_vector3_mul( &m, &vector.value, &result.value );
+    return result;
+}
+
+inline vec3f TransformPointWorldToLocal( const RigidBodyTransform & transform, const vec3f & point )
+{
+    return TransformVectorWorldToLocal( transform, point - transform.position );
+}
+
+inline vec4f TransformPlaneWorldToLocal( const RigidBodyTransform & transform, const vec4f & plane )
+{
+    // plane is (nx,ny,nz,d) with dot(n,p) = d. rotate the normal into local space 
+    // and shift d by the distance of the body origin along the world space normal
+    const vec3f normal( plane.x(), plane.y(), plane.z() );
+    const vec3f localNormal = TransformVectorWorldToLocal( transform, normal );
+    const float d = plane.w() - dot( normal, transform.position );
+    return vec4f( localNormal.x(), localNormal.y(), localNormal.z(), d );
+}
+
+inline vec4f TransformPlaneLocalToWorld( const RigidBodyTransform & transform, const vec4f & plane )
+{
+    const vec3f localNormal( plane.x(), plane.y(), plane.z() );
+    const vec3f normal = TransformVectorLocalToWorld( transform, localNormal );
+    const float d = plane.w() + dot( normal, transform.position );
+    return vec4f( normal.x(), normal.y(), normal.z(), d );
+}
+
 #endif
@@ -12,5 +12,6 @@
 //#define DEBUG_SHADOW_VOLUMES
 //#define FRUSTUM_CULLING
 //#define DISCOVER_KEY_CODES
+//#define DEBUG_ALLOCATIONS
 
 #endif
@@ -0,0 +1,306 @@
+#ifndef DETERMINISM_H
+#define DETERMINISM_H
+
+#include "World.h"
+
+/*
+    Determinism.
+
+    Replaying recorded inputs only reproduces a run if every step computes
+    bit for bit the same result. "World::Step" is written for that: bodies
+    are visited in array order, the iteration and rotation substep counts
+    are fixed by "WorldParams", and nothing in the step reads a clock or
+    calls rand(). Tables stepped by the host on worker threads never share
+    state, so the thread that steps a table makes no difference either.
+    Anything random outside the step should come from a seeded
+    "DeterministicRandom" rather than rand(), whose state is shared with
+    everything else in the process.
+
+    This only holds for the same binary. Different compilers, compiler
+    flags, or SIMD paths (see VECTORIAL_SCALAR) round differently.
+
+    To catch a divergence as soon as it happens, a checksum of every body
+    is written each frame while recording, and compared against while
+    playing back. The first frame that doesn't match is reported along
+    with the first body on it that differs.
+
+    Checksum file layout:
+
+        [4 bytes] magic "VGCK"
+        [4 bytes] version
+        per frame:
+            [4 bytes] number of bodies
+            [8 bytes] hash of the whole frame
+            [4 bytes] hash per body
+
+    Only primary state is hashed: position, orientation, momentum and
+    whether the body is awake. Secondary quantities follow from those, and
+    the unused fourth lane of a vec3f may hold anything.
+*/
+
+const uint32_t ChecksumMagic = 0x4B434756;          // "VGCK"
+const uint32_t ChecksumVersion = 1;
+
+// xorshift32. same seed, same numbers, on every platform
+
+class DeterministicRandom
+{
+public:
+
+    DeterministicRandom( uint32_t seed = 1 )
+    {
+        Seed( seed );
+    }
+
+    void Seed( uint32_t seed )
+    {
+        state = seed ? seed : 1;
+    }
+
+    uint32_t GetUint32()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // in [min,max)
+
+    float GetFloat( float min, float max )
+    {
+        assert( max > min );
+        return ( GetUint32() >> 8 ) * ( 1.0f / 16777216.0f ) * ( max - min ) + min;
+    }
+
+private:
+
+    uint32_t state;
+};
+
+inline uint64_t HashRigidBody( const RigidBody & rigidBody, uint64_t seed = 0 )
+{
+    const float state[] =
+    {
+        rigidBody.position.x(), rigidBody.position.y(), rigidBody.position.z(),
+        rigidBody.orientation.x, rigidBody.orientation.y, rigidBody.orientation.z, rigidBody.orientation.w,
+        rigidBody.linearMomentum.x(), rigidBody.linearMomentum.y(), rigidBody.linearMomentum.z(),
+        rigidBody.angularMomentum.x(), rigidBody.angularMomentum.y(), rigidBody.angularMomentum.z(),
+        rigidBody.active ? 1.0f : 0.0f
+    };
+
+    return hash64( state, sizeof( state ), seed );
+}
+
+// per body hashes go in "bodyHashes" if it isn't NULL. returns the hash of the whole frame
+
+inline uint64_t HashBodies( const RigidBody * rigidBodies, int numBodies, uint32_t * bodyHashes = NULL )
+{
+    uint64_t frameHash = hash64( &numBodies, sizeof( numBodies ) );
+    for ( int i = 0; i < numBodies; ++i )
+    {
+        // IMPORTANT: seed with the index, so two bodies swapping places changes the hash
+
+        const uint64_t bodyHash = HashRigidBody( rigidBodies[i], i );
+        frameHash = hash64( &bodyHash, sizeof( bodyHash ), frameHash );
+        if ( bodyHashes )
+            bodyHashes[i] = uint32_t( bodyHash ^ ( bodyHash >> 32 ) );
+    }
+    return frameHash;
+}
+
+inline uint64_t HashWorld( const World & world )
+{
+    const int numBodies = world.GetNumBodies();
+    return HashBodies( numBodies ? &world.GetBody( 0 ) : NULL, numBodies );
+}
+
+// ----------------------------------------------------------------
+
+class ChecksumLog
+{
+public:
+
+    ChecksumLog()
+    {
+        file = NULL;
+        verify = false;
+        maxBodies = 0;
+        bodyHashes = NULL;
+        expectedHashes = NULL;
+        Reset();
+    }
+
+    ~ChecksumLog()
+    {
+        Close();
+    }
+
+    // "verifyMode" false writes checksums to the file, true compares against the ones already in it
+
+    bool Open( const char filename[], bool verifyMode, int bodies )
+    {
+        assert( filename );
+        assert( bodies > 0 );
+
+        Close();
+
+        FILE * f = fopen( filename, verifyMode ? "rb" : "wb" );
+        if ( !f )
+            return false;
+
+        bool ok;
+        if ( verifyMode )
+        {
+            uint32_t header[2];
+            ok = fread( header, sizeof( header ), 1, f ) == 1 && header[0] == ChecksumMagic && header[1] == ChecksumVersion;
+        }
+        else
+        {
+            const uint32_t header[2] = { ChecksumMagic, ChecksumVersion };
+            ok = fwrite( header, sizeof( header ), 1, f ) == 1;
+        }
+
+        if ( !ok )
+        {
+            fclose( f );
+            return false;
+        }
+
+        file = f;
+        verify = verifyMode;
+        maxBodies = bodies;
+        bodyHashes = new uint32_t[maxBodies];
+        expectedHashes = new uint32_t[maxBodies];
+
+        Reset();
+
+        return true;
+    }
+
+    void Close()
+    {
+        if ( file )
+            fclose( file );
+        delete [] bodyHashes;
+        delete [] expectedHashes;
+        file = NULL;
+        bodyHashes = NULL;
+        expectedHashes = NULL;
+        maxBodies = 0;
+    }
+
+    // call once per frame after stepping. returns false from the first frame that differs from the recording on
+
+    bool Update( const RigidBody * rigidBodies, int numBodies )
+    {
+        assert( file );
+        assert( numBodies <= maxBodies );
+
+        const uint64_t frameHash = HashBodies( rigidBodies, numBodies, bodyHashes );
+
+        const int64_t currentFrame = frame++;
+
+        if ( !verify )
+        {
+            const uint32_t count = numBodies;
+            fwrite( &count, sizeof( count ), 1, file );
+            fwrite( &frameHash, sizeof( frameHash ), 1, file );
+            if ( numBodies )
+                fwrite( bodyHashes, sizeof( uint32_t ), numBodies, file );
+            return true;
+        }
+
+        if ( diverged || endOfRecording )
+            return !diverged;
+
+        uint32_t expectedCount;
+        uint64_t expectedHash;
+        if ( fread( &expectedCount, sizeof( expectedCount ), 1, file ) != 1 ||
+             fread( &expectedHash, sizeof( expectedHash ), 1, file ) != 1 ||
+             expectedCount > uint32_t( maxBodies ) ||
+             ( expectedCount && fread( expectedHashes, sizeof( uint32_t ), expectedCount, file ) != expectedCount ) )
+        {
+            // the recording stopped here, or was cut short. nothing more to check
+            endOfRecording = true;
+            return true;
+        }
+
+        framesVerified++;
+
+        if ( expectedHash == frameHash )
+            return true;
+
+        diverged = true;
+        divergedFrame = currentFrame;
+        divergedBody = -1;
+
+        // IMPORTANT: a body count mismatch is reported as body -1
+
+        if ( expectedCount == uint32_t( numBodies ) )
+        {
+            for ( int i = 0; i < numBodies; ++i )
+            {
+                if ( bodyHashes[i] != expectedHashes[i] )
+                {
+                    divergedBody = i;
+                    break;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    bool Update( const World & world )
+    {
+        const int numBodies = world.GetNumBodies();
+        return Update( numBodies ? &world.GetBody( 0 ) : NULL, numBodies );
+    }
+
+    bool IsOpen() const { return file != NULL; }
+
+    bool IsVerifying() const { return verify; }
+
+    bool HasDiverged() const { return diverged; }
+
+    bool IsEndOfRecording() const { return endOfRecording; }
+
+    int64_t GetFrame() const { return frame; }
+
+    int64_t GetFramesVerified() const { return framesVerified; }
+
+    int64_t GetDivergedFrame() const { return divergedFrame; }
+
+    int GetDivergedBody() const { return divergedBody; }
+
+private:
+
+    ChecksumLog( const ChecksumLog & other );
+    ChecksumLog & operator = ( const ChecksumLog & other );
+
+    void Reset()
+    {
+        frame = 0;
+        framesVerified = 0;
+        diverged = false;
+        endOfRecording = false;
+        divergedFrame = -1;
+        divergedBody = -1;
+    }
+
+    FILE * file;
+    bool verify;
+    int maxBodies;
+    uint32_t * bodyHashes;
+    uint32_t * expectedHashes;
+
+    int64_t frame;
+    int64_t framesVerified;
+    bool diverged;
+    bool endOfRecording;
+    int64_t divergedFrame;
+    int divergedBody;
+};
+
+#endif
@@ -12,7 +12,11 @@
 #include "CollisionDetection.h"
 #include "CollisionResponse.h"
 #include "Intersection.h"
-#include <vector>
+#include "Determinism.h"
+#include "InputRecording.h"
+#include "Trajectory.h"
+#include "Capture.h"
+#include "VideoStream.h"
 
 using namespace platform;
 
@@ -35,7 +39,9 @@ Mode mode = Nothing;
 
 Stone stone;
 
-std::vector<RigidBody> snapshots;
+const int MaxSnapshots = 30;
+RigidBody snapshots[MaxSnapshots];
+int numSnapshots = 0;
 float snapshotAccumulator = FLT_MAX;
 
 void RandomStone( const Biconvex & biconvex, RigidBody & rigidBody, Mode mode )
@@ -65,7 +71,7 @@ void RandomStone( const Biconvex & biconvex, RigidBody & rigidBody, Mode mode )
     // todo
     //rigidBody.Update();
 
-    snapshots.clear();
+    numSnapshots = 0;
 
     snapshotAccumulator = FLT_MAX;
 }
@@ -84,6 +90,8 @@ int main( int argc, char * argv[] )
 {   
     bool playback = false;
     bool video = false;
+    bool stream = false;
+    VideoStreamFormat streamFormat = VIDEO_STREAM_Y4M;
 
     for ( int i = 1; i < argc; ++i )
     {
@@ -97,7 +105,23 @@ int main( int argc, char * argv[] )
             printf( "video\n" );
             video = true;
         }
+        else if ( GetVideoStreamFormat( argv[i], streamFormat ) )
+        {
+            printf( "video (%s)\n", argv[i] );
+            video = true;
+            stream = true;
+        }
+    }
+
+    // headless there is no one at the keyboard, so recording would only overwrite the inputs with a quit
+
+    #ifdef HEADLESS
+    if ( !playback )
+    {
+        printf( "headless only plays back recorded inputs. run with \"playback\"\n" );
+        return 1;
     }
+    #endif
 
     // initialize stones
 
@@ -107,8 +131,7 @@ int main( int argc, char * argv[] )
 
     stone.Initialize( stoneSize );
     stone.rigidBody.inertia = vec3f(1,1,1);
-    stone.rigidBody.inertiaTensor = mat4f::identity();
-    stone.rigidBody.inverseInertiaTensor = mat4f::identity();
+    stone.rigidBody.inverseInertia = vec3f(1,1,1);
 
     Mesh<Vertex,int> mesh;
     GenerateBiconvexMesh( mesh, stone.biconvex );
@@ -136,6 +159,14 @@ int main( int argc, char * argv[] )
 
     HideMouseCursor();
 
+    // upload meshes once, see Render.h
+
+    MeshBuffer meshBuffer;
+    meshBuffer.Upload( mesh );
+
+    MeshBuffer cheapMeshBuffer;
+    cheapMeshBuffer.Upload( cheapMesh );
+
     // setup opengl
 
     glEnable( GL_LINE_SMOOTH );
@@ -223,15 +254,68 @@ int main( int argc, char * argv[] )
         glBindBufferARB( GL_PIXEL_UNPACK_BUFFER_ARB, 0 );
     }
 
+    // frames read back go to writer threads to be compressed and written, see Capture.h.
+    // one TGA per frame, or with "y4m", "raw", "rle" or "delta" every frame in one file, see VideoStream.h
+
+    #ifdef LETTERBOX
+    const int crop = 40;
+    #else
+    const int crop = 0;
+    #endif
+    TGACaptureSink tgaSink( "output/frame-%05d.tga", crop );
+    VideoStreamSink streamSink;
+    CapturePipeline capture;
+    if ( video )
+    {
+        CaptureSink * captureSink = &tgaSink;
+        if ( stream )
+        {
+            char filename[256];
+            snprintf( filename, sizeof( filename ), "output/video.%s", GetVideoStreamExtension( streamFormat ) );
+            VideoStreamParams streamParams;
+            streamParams.format = streamFormat;
+            streamParams.width = displayWidth;
+            streamParams.height = displayHeight;
+            streamParams.crop = crop;
+            if ( !streamSink.Open( filename, streamParams ) )
+            {
+                printf( "failed to open %s\n", filename );
+                return 1;
+            }
+            captureSink = &streamSink;
+        }
+        CaptureParams captureParams;
+        captureParams.width = displayWidth;
+        captureParams.height = displayHeight;
+        if ( !capture.Initialize( captureParams, captureSink ) )
+        {
+            printf( "failed to start video capture\n" );
+            return 1;
+        }
+    }
+
     // record input to a file
     // read it back in playback mode for recording video
-    FILE * inputFile = fopen( "output/recordedInputs", playback ? "rb" : "wb" );
-    if ( !inputFile )
+    InputRecorder inputRecorder;
+    InputPlayback inputPlayback;
+    if ( playback ? !inputPlayback.Open( "output/recordedInputs" ) : !inputRecorder.Open( "output/recordedInputs" ) )
     {
         printf( "failed to open input file\n" );
         return 1;
     }
 
+    // checksum the stone every frame while recording, and check it matches in playback
+
+    ChecksumLog checksums;
+    if ( !checksums.Open( "output/recordedChecksums", playback, 1 ) )
+        printf( "failed to open checksum file, determinism will not be checked\n" );
+
+    // and record where the stone is every frame, to look at afterwards without simulating again
+
+    TrajectoryWriter trajectory;
+    if ( !playback && !trajectory.Open( "output/recordedTrajectory", 1 ) )
+        printf( "failed to open trajectory file\n" );
+
     while ( !quit )
     {
         CheckOpenGLError( "frame start" );
@@ -243,13 +327,11 @@ int main( int argc, char * argv[] )
         if ( !playback )
         {
             input = platform::Input::Sample();
-            fwrite( &input, sizeof( platform::Input ), 1, inputFile );
-            fflush( inputFile );
+            inputRecorder.Write( input );
         }
         else
         {
-            const int size = sizeof( platform::Input );
-            if ( !fread( &input, size, 1, inputFile ) )
+            if ( !inputPlayback.Read( input ) )
                 quit = true;
         }
 
@@ -394,6 +476,12 @@ int main( int argc, char * argv[] )
         stone.rigidBody.orientation += spin * dt;
         stone.rigidBody.orientation = normalize( stone.rigidBody.orientation );
 
+        if ( checksums.IsOpen() && !checksums.Update( &stone.rigidBody, 1 ) && checksums.GetDivergedFrame() == frame )
+            printf( "playback diverged on frame %d, body %d\n", (int) checksums.GetDivergedFrame(), checksums.GetDivergedBody() );
+
+        if ( trajectory.IsOpen() )
+            trajectory.Write( &stone.rigidBody, 1 );
+
         // update snapshots
 
         float strobeTime = 1.0f;
@@ -403,9 +491,9 @@ int main( int argc, char * argv[] )
             strobeTime = 0.0585f;
 
         snapshotAccumulator += dt;
-        if ( snapshotAccumulator >= strobeTime && snapshots.size() < 30 )
+        if ( snapshotAccumulator >= strobeTime && numSnapshots < MaxSnapshots )
         {
-            snapshots.push_back( stone.rigidBody );
+            snapshots[numSnapshots++] = stone.rigidBody;
             if ( snapshotAccumulator != FLT_MAX )
                 snapshotAccumulator -= strobeTime;
             else
@@ -425,7 +513,7 @@ int main( int argc, char * argv[] )
             glEnable( GL_DEPTH_TEST );
             glDepthMask( GL_FALSE );
 
-            for ( int i = 0; i < snapshots.size(); ++i )
+            for ( int i = 0; i < numSnapshots; ++i )
             {
                 glPushMatrix();
 
@@ -433,13 +521,14 @@ int main( int argc, char * argv[] )
 
                 // todo
                 /*
-                RigidBodyTransform biconvexTransform( rigidBody.position, rigidBody.orientation );
+                mat4f localToWorld;
+                rigidBody.transform.GetLocalToWorldMatrix( localToWorld );
                 float opengl_transform[16];
-                biconvexTransform.localToWorld.store( opengl_transform );
+                localToWorld.store( opengl_transform );
                 glMultMatrixf( opengl_transform );
                 */
 
-                RenderMesh( cheapMesh );
+                RenderMesh( cheapMeshBuffer );
 
                 glPopMatrix();
             }
@@ -460,9 +549,10 @@ int main( int argc, char * argv[] )
 
         // todo
         /*
-        RigidBodyTransform biconvexTransform( stone.rigidBody.position, stone.rigidBody.orientation );
+        mat4f localToWorld;
+        stone.rigidBody.transform.GetLocalToWorldMatrix( localToWorld );
         float opengl_transform[16];
-        biconvexTransform.localToWorld.store( opengl_transform );
+        localToWorld.store( opengl_transform );
         glMultMatrixf( opengl_transform );
         */
 
@@ -484,7 +574,7 @@ int main( int argc, char * argv[] )
 
         glLineWidth( 3 );
 
-        RenderMesh( mesh );
+        RenderMesh( meshBuffer );
 
         glPopMatrix();
 
@@ -497,8 +587,10 @@ int main( int argc, char * argv[] )
             index = ( index + 1 ) % NumPBOs;
             int prevIndex = ( index + NumPBOs - 1 ) % NumPBOs;
 
-            // set the target framebuffer to read
+            // set the target framebuffer to read. headless there is only the offscreen one, already bound
+            #ifndef HEADLESS
             glReadBuffer( GL_FRONT );
+            #endif
 
             // read pixels from framebuffer to PBO
             // glReadPixels() should return immediately.
@@ -512,13 +604,7 @@ int main( int argc, char * argv[] )
                                                            GL_READ_ONLY_ARB );
                 if ( ptr )
                 {
-                    char filename[256];
-                    snprintf( filename, sizeof(filename), "output/frame-%05d.tga", frame - NumPBOs );
-                    #ifdef LETTERBOX
-                    WriteTGA( filename, displayWidth, displayHeight - 80, ptr + displayWidth * 3 * 40 );
-                    #else
-                    WriteTGA( filename, displayWidth, displayHeight, ptr );
-                    #endif
+                    capture.Capture( frame - NumPBOs, ptr );
                     glUnmapBufferARB( GL_PIXEL_PACK_BUFFER_ARB );
                 }
             }
@@ -538,6 +624,9 @@ int main( int argc, char * argv[] )
         frame++;
     }
 
+    meshBuffer.Free();
+    cheapMeshBuffer.Free();
+
     CloseDisplay();
 
     return 0;
@@ -0,0 +1,437 @@
+#ifndef FRAME_DELTA_H
+#define FRAME_DELTA_H
+
+#include "Common.h"
+
+#if defined( VECTORIAL_SSE ) && defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+/*
+    Frame delta encoding.
+
+    In a replay capture the camera and the board don't move. Frame to
+    frame, the only pixels that change are around the stone that is
+    moving and its shadow, so storing every frame whole mostly stores the
+    same board over and over.
+
+    Instead each frame is cut into 16x16 tiles and compared with the
+    frame before it, tile by tile. Only the tiles that changed are
+    stored, along with a bitmap of which ones they are. The compare runs
+    16 bytes at a time with SSE2 where vectorial uses SSE, and falls back
+    to memcmp per row of the tile otherwise.
+
+    Every "keyframeInterval" frames, and whenever every tile changed, the
+    whole frame is stored instead, so that decoding can start partway
+    through a recording without going back to the start.
+
+    Frame layout:
+
+        [1 byte] FRAME_DELTA_KEYFRAME or FRAME_DELTA_TILES
+        keyframe:
+            the whole frame
+        tiles:
+            [(tiles+7)/8 bytes] one bit per tile, set if it changed
+            each changed tile in order, its rows one after the other
+
+    Tiles go along each row of tiles in turn, in the same order as the
+    pixels. Tiles on the right and top edges are cut short when the frame
+    isn't a multiple of 16 across.
+
+    Pixels are 24 bit, as read back from the frame buffer.
+*/
+
+const int FrameDeltaTileSize = 16;
+
+enum FrameDeltaType
+{
+    FRAME_DELTA_KEYFRAME,
+    FRAME_DELTA_TILES
+};
+
+// true if the tile at "a" and "b" match. both are frames "stride" bytes per row
+
+inline bool CompareTile( const uint8_t * a, const uint8_t * b, int rowBytes, int rows, int stride )
+{
+    for ( int y = 0; y < rows; ++y, a += stride, b += stride )
+    {
+        int i = 0;
+
+        #if defined( VECTORIAL_SSE ) && defined( __SSE2__ )
+
+            __m128i difference = _mm_setzero_si128();
+            for ( ; i + 16 <= rowBytes; i += 16 )
+            {
+                const __m128i va = _mm_loadu_si128( (const __m128i*) ( a + i ) );
+                const __m128i vb = _mm_loadu_si128( (const __m128i*) ( b + i ) );
+                difference = _mm_or_si128( difference, _mm_xor_si128( va, vb ) );
+            }
+            if ( _mm_movemask_epi8( _mm_cmpeq_epi8( difference, _mm_setzero_si128() ) ) != 0xFFFF )
+                return false;
+
+        #endif
+
+        if ( i < rowBytes && memcmp( a + i, b + i, rowBytes - i ) != 0 )
+            return false;
+    }
+
+    return true;
+}
+
+struct FrameDeltaStats
+{
+    FrameDeltaStats()
+    {
+        frames = 0;
+        keyframes = 0;
+        tilesCompared = 0;
+        tilesChanged = 0;
+        bytesIn = 0;
+        bytesOut = 0;
+    }
+
+    uint64_t frames;
+    uint64_t keyframes;
+    uint64_t tilesCompared;
+    uint64_t tilesChanged;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+};
+
+// ----------------------------------------------------------------
+
+class FrameDeltaEncoder
+{
+public:
+
+    FrameDeltaEncoder()
+    {
+        width = 0;
+        height = 0;
+        tilesX = 0;
+        tilesY = 0;
+        keyframeInterval = 0;
+        reference = NULL;
+        encoded = NULL;
+        framesSinceKeyframe = 0;
+    }
+
+    ~FrameDeltaEncoder()
+    {
+        Free();
+    }
+
+    void Initialize( int frameWidth, int frameHeight, int frameKeyframeInterval = 60 )
+    {
+        assert( frameWidth > 0 && frameHeight > 0 );
+        assert( frameKeyframeInterval > 0 );
+
+        Free();
+
+        width = frameWidth;
+        height = frameHeight;
+        tilesX = ( width + FrameDeltaTileSize - 1 ) / FrameDeltaTileSize;
+        tilesY = ( height + FrameDeltaTileSize - 1 ) / FrameDeltaTileSize;
+        keyframeInterval = frameKeyframeInterval;
+        reference = new uint8_t[width * height * 3];
+        encoded = new uint8_t[GetMaxEncodedBytes()];
+
+        Reset();
+    }
+
+    void Free()
+    {
+        delete [] reference;
+        delete [] encoded;
+        reference = NULL;
+        encoded = NULL;
+    }
+
+    // the next frame is a keyframe
+
+    void Reset()
+    {
+        framesSinceKeyframe = keyframeInterval;
+    }
+
+    size_t GetMaxEncodedBytes() const
+    {
+        return 1 + GetBitmapBytes() + size_t( width ) * height * 3;
+    }
+
+    // encodes the frame against the one before it, into a buffer the encoder keeps (see "GetEncoded").
+    // returns the bytes written
+
+    size_t EncodeFrame( const uint8_t * pixels )
+    {
+        assert( reference );
+        assert( pixels );
+
+        uint8_t * output = encoded;
+
+        const size_t frameBytes = size_t( width ) * height * 3;
+
+        stats.frames++;
+        stats.bytesIn += frameBytes;
+
+        if ( framesSinceKeyframe < keyframeInterval )
+        {
+            const size_t bytes = EncodeTiles( pixels, output );
+            if ( bytes )
+            {
+                framesSinceKeyframe++;
+                stats.bytesOut += bytes;
+                return bytes;
+            }
+        }
+
+        // keyframe
+
+        output[0] = FRAME_DELTA_KEYFRAME;
+        memcpy( output + 1, pixels, frameBytes );
+        memcpy( reference, pixels, frameBytes );
+
+        framesSinceKeyframe = 1;
+
+        stats.keyframes++;
+        stats.bytesOut += 1 + frameBytes;
+
+        return 1 + frameBytes;
+    }
+
+    int GetWidth() const { return width; }
+
+    int GetHeight() const { return height; }
+
+    int GetNumTiles() const { return tilesX * tilesY; }
+
+    // the last frame encoded. good until the next call to "EncodeFrame"
+
+    const uint8_t * GetEncoded() const { return encoded; }
+
+    const FrameDeltaStats & GetStats() const { return stats; }
+
+private:
+
+    FrameDeltaEncoder( const FrameDeltaEncoder & other );
+    FrameDeltaEncoder & operator = ( const FrameDeltaEncoder & other );
+
+    size_t GetBitmapBytes() const
+    {
+        return ( tilesX * tilesY + 7 ) / 8;
+    }
+
+    // returns 0 if every tile changed, in which case a keyframe is smaller
+
+    size_t EncodeTiles( const uint8_t * pixels, uint8_t * output )
+    {
+        const int stride = width * 3;
+        const int numTiles = tilesX * tilesY;
+
+        uint8_t * bitmap = output + 1;
+        uint8_t * out = bitmap + GetBitmapBytes();
+
+        memset( bitmap, 0, GetBitmapBytes() );
+
+        int changed = 0;
+
+        for ( int ty = 0; ty < tilesY; ++ty )
+        {
+            const int y0 = ty * FrameDeltaTileSize;
+            const int rows = height - y0 < FrameDeltaTileSize ? height - y0 : FrameDeltaTileSize;
+
+            for ( int tx = 0; tx < tilesX; ++tx )
+            {
+                const int x0 = tx * FrameDeltaTileSize;
+                const int rowBytes = ( width - x0 < FrameDeltaTileSize ? width - x0 : FrameDeltaTileSize ) * 3;
+                const size_t offset = size_t( y0 ) * stride + x0 * 3;
+
+                if ( CompareTile( pixels + offset, reference + offset, rowBytes, rows, stride ) )
+                    continue;
+
+                const int tile = ty * tilesX + tx;
+                bitmap[tile>>3] |= uint8_t( 1 << ( tile & 7 ) );
+                changed++;
+
+                // IMPORTANT: the reference is what the decoder will have, so only changed tiles go into it
+
+                for ( int y = 0; y < rows; ++y )
+                {
+                    const size_t row = offset + size_t( y ) * stride;
+                    memcpy( out, pixels + row, rowBytes );
+                    memcpy( reference + row, pixels + row, rowBytes );
+                    out += rowBytes;
+                }
+            }
+        }
+
+        stats.tilesCompared += numTiles;
+        stats.tilesChanged += changed;
+
+        if ( changed == numTiles )
+            return 0;
+
+        output[0] = FRAME_DELTA_TILES;
+
+        return out - output;
+    }
+
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+    int keyframeInterval;
+    uint8_t * reference;            // the frame as the decoder sees it
+    uint8_t * encoded;              // "GetMaxEncodedBytes", reused every frame
+    int framesSinceKeyframe;
+    FrameDeltaStats stats;
+};
+
+// ----------------------------------------------------------------
+
+inline bool IsFrameDeltaKeyframe( const uint8_t * data, size_t bytes )
+{
+    return bytes > 0 && data[0] == FRAME_DELTA_KEYFRAME;
+}
+
+class FrameDeltaDecoder
+{
+public:
+
+    FrameDeltaDecoder()
+    {
+        width = 0;
+        height = 0;
+        tilesX = 0;
+        tilesY = 0;
+        frame = NULL;
+        valid = false;
+    }
+
+    ~FrameDeltaDecoder()
+    {
+        Free();
+    }
+
+    void Initialize( int frameWidth, int frameHeight )
+    {
+        assert( frameWidth > 0 && frameHeight > 0 );
+
+        Free();
+
+        width = frameWidth;
+        height = frameHeight;
+        tilesX = ( width + FrameDeltaTileSize - 1 ) / FrameDeltaTileSize;
+        tilesY = ( height + FrameDeltaTileSize - 1 ) / FrameDeltaTileSize;
+        frame = new uint8_t[width * height * 3];
+        valid = false;
+    }
+
+    void Free()
+    {
+        delete [] frame;
+        frame = NULL;
+        valid = false;
+    }
+
+    // applies the next frame on top of the last. returns false if the data is bad, or if it
+    // is tiles and there is no keyframe before it. the frame is left invalid until the next keyframe
+
+    bool DecodeFrame( const uint8_t * data, size_t bytes )
+    {
+        assert( frame );
+
+        const size_t frameBytes = size_t( width ) * height * 3;
+
+        if ( bytes > 0 && data[0] == FRAME_DELTA_KEYFRAME )
+        {
+            valid = bytes == 1 + frameBytes;
+            if ( valid )
+                memcpy( frame, data + 1, frameBytes );
+        }
+        else if ( bytes > 0 && data[0] == FRAME_DELTA_TILES )
+        {
+            valid = valid && ApplyTiles( data + 1, bytes - 1 );
+        }
+        else
+        {
+            valid = false;
+        }
+
+        return valid;
+    }
+
+    // forget the current frame, eg. before seeking
+
+    void Reset()
+    {
+        valid = false;
+    }
+
+    bool HasFrame() const { return valid; }
+
+    const uint8_t * GetFrame() const
+    {
+        assert( valid );
+        return frame;
+    }
+
+    int GetWidth() const { return width; }
+
+    int GetHeight() const { return height; }
+
+private:
+
+    FrameDeltaDecoder( const FrameDeltaDecoder & other );
+    FrameDeltaDecoder & operator = ( const FrameDeltaDecoder & other );
+
+    bool ApplyTiles( const uint8_t * data, size_t bytes )
+    {
+        const int stride = width * 3;
+        const size_t bitmapBytes = ( tilesX * tilesY + 7 ) / 8;
+
+        if ( bytes < bitmapBytes )
+            return false;
+
+        const uint8_t * bitmap = data;
+        const uint8_t * in = data + bitmapBytes;
+        const uint8_t * end = data + bytes;
+
+        for ( int ty = 0; ty < tilesY; ++ty )
+        {
+            const int y0 = ty * FrameDeltaTileSize;
+            const int rows = height - y0 < FrameDeltaTileSize ? height - y0 : FrameDeltaTileSize;
+
+            for ( int tx = 0; tx < tilesX; ++tx )
+            {
+                const int tile = ty * tilesX + tx;
+                if ( !( bitmap[tile>>3] & ( 1 << ( tile & 7 ) ) ) )
+                    continue;
+
+                const int x0 = tx * FrameDeltaTileSize;
+                const int rowBytes = ( width - x0 < FrameDeltaTileSize ? width - x0 : FrameDeltaTileSize ) * 3;
+                if ( in + size_t( rowBytes ) * rows > end )
+                    return false;
+
+                uint8_t * out = frame + size_t( y0 ) * stride + x0 * 3;
+                for ( int y = 0; y < rows; ++y )
+                {
+                    memcpy( out, in, rowBytes );
+                    out += stride;
+                    in += rowBytes;
+                }
+            }
+        }
+
+        return in == end;
+    }
+
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+    uint8_t * frame;
+    bool valid;
+};
+
+#endif
@@ -0,0 +1,686 @@
+#ifndef GJK_H
+#define GJK_H
+
+#include <algorithm>
+#include "Board.h"
+#include "Biconvex.h"
+
+/*
+    GJK distance and EPA penetration depth between convex shapes.
+
+    Shapes are described only by their support mapping, so any convex shape
+    works as long as it provides, in world space:
+
+        vec3f GetCenter() const;
+        vec3f Support( vec3f direction ) const;
+
+    where "Support" returns the point on the shape furthest along direction.
+    Direction is not necessarily unit length.
+
+    GJK iterates a simplex on the minkowski difference A - B toward the origin.
+    If the shapes are separated it converges to the closest points. Otherwise
+    the simplex encloses the origin and EPA expands it into a polytope to find
+    the penetration depth and normal.
+
+    The directions that generated the final simplex can be kept in a "GJKCache"
+    and reused next frame. For coherent motion the warm started simplex is
+    already close to the answer and converges in 2-3 iterations.
+*/
+
+struct BiconvexShape
+{
+    BiconvexShape( const Biconvex & _biconvex, const RigidBodyTransform & _transform )
+        : biconvex( _biconvex ), transform( _transform ) {}
+
+    vec3f GetCenter() const
+    {
+        return transform.position;
+    }
+
+    vec3f Support( vec3f direction ) const
+    {
+        vec3f local_direction = TransformVectorWorldToLocal( transform, direction );
+        vec3f local_point = BiconvexSupportPoint_LocalSpace( biconvex, local_direction );
+        return TransformPointLocalToWorld( transform, local_point );
+    }
+
+    const Biconvex & biconvex;
+    const RigidBodyTransform & transform;
+};
+
+struct BoardShape
+{
+    BoardShape( const Board & board )
+    {
+        w = board.GetHalfWidth();
+        h = board.GetHalfHeight();
+        t = board.GetThickness();
+    }
+
+    vec3f GetCenter() const
+    {
+        return vec3f( 0, 0, t/2 );
+    }
+
+    vec3f Support( vec3f direction ) const
+    {
+        return vec3f( direction.x() >= 0 ? w : -w,
+                      direction.y() >= 0 ? h : -h,
+                      direction.z() >= 0 ? t : 0 );
+    }
+
+    float w,h,t;
+};
+
+// -----------------------------------------------------------------------
+
+struct GJKVertex
+{
+    vec3f a;                    // support point on shape A
+    vec3f b;                    // support point on shape B
+    vec3f w;                    // a - b
+    vec3f direction;            // direction this vertex was generated from
+};
+
+struct GJKSimplex
+{
+    GJKVertex vertex[4];
+    float lambda[4];            // barycentric coordinates of the closest point to the origin
+    int count;
+};
+
+struct GJKCache
+{
+    GJKCache()
+    {
+        count = 0;
+    }
+
+    int count;
+    vec3f direction[4];
+};
+
+struct GJKResult
+{
+    vec3f pointA;               // closest point (separated) or deepest point (penetrating) on A
+    vec3f pointB;               // same for B
+    vec3f normal;               // unit normal pointing from A to B
+    float distance;             // separation distance, negative when penetrating
+    int iterations;             // GJK iterations, plus EPA iterations if penetrating
+};
+
+template <typename ShapeA, typename ShapeB> inline void GJKSupport( const ShapeA & shapeA,
+                                                                    const ShapeB & shapeB,
+                                                                    vec3f direction,
+                                                                    GJKVertex & vertex )
+{
+    vertex.direction = direction;
+    vertex.a = shapeA.Support( direction );
+    vertex.b = shapeB.Support( -direction );
+    vertex.w = vertex.a - vertex.b;
+}
+
+/*
+    Simplex solvers. Each finds the closest point on the simplex to the origin,
+    discards the vertices that do not contribute to it and sets the barycentric
+    coordinates of the rest. See "Real-Time Collision Detection", chapter 5.
+*/
+
+inline void GJKSolve2( GJKSimplex & simplex )
+{
+    const vec3f a = simplex.vertex[0].w;
+    const vec3f ab = simplex.vertex[1].w - a;
+
+    const float t = -dot( a, ab );
+    const float denominator = dot( ab, ab );
+
+    if ( t <= 0 || denominator < FLT_EPSILON )
+    {
+        simplex.count = 1;
+        simplex.lambda[0] = 1;
+    }
+    else if ( t >= denominator )
+    {
+        simplex.vertex[0] = simplex.vertex[1];
+        simplex.count = 1;
+        simplex.lambda[0] = 1;
+    }
+    else
+    {
+        simplex.lambda[1] = t / denominator;
+        simplex.lambda[0] = 1 - simplex.lambda[1];
+    }
+}
+
+inline void GJKKeep( GJKSimplex & simplex, int i, int j, float lambda_j )
+{
+    const GJKVertex a = simplex.vertex[i];
+    const GJKVertex b = simplex.vertex[j];
+    simplex.vertex[0] = a;
+    simplex.vertex[1] = b;
+    simplex.lambda[0] = 1 - lambda_j;
+    simplex.lambda[1] = lambda_j;
+    simplex.count = 2;
+}
+
+inline void GJKKeep( GJKSimplex & simplex, int i )
+{
+    simplex.vertex[0] = simplex.vertex[i];
+    simplex.lambda[0] = 1;
+    simplex.count = 1;
+}
+
+inline void GJKSolve3( GJKSimplex & simplex )
+{
+    const vec3f a = simplex.vertex[0].w;
+    const vec3f b = simplex.vertex[1].w;
+    const vec3f c = simplex.vertex[2].w;
+
+    const vec3f ab = b - a;
+    const vec3f ac = c - a;
+
+    const float d1 = -dot( ab, a );
+    const float d2 = -dot( ac, a );
+    if ( d1 <= 0 && d2 <= 0 )
+        return GJKKeep( simplex, 0 );
+
+    const float d3 = -dot( ab, b );
+    const float d4 = -dot( ac, b );
+    if ( d3 >= 0 && d4 <= d3 )
+        return GJKKeep( simplex, 1 );
+
+    const float vc = d1*d4 - d3*d2;
+    if ( vc <= 0 && d1 >= 0 && d3 <= 0 )
+        return GJKKeep( simplex, 0, 1, d1 / ( d1 - d3 ) );
+
+    const float d5 = -dot( ab, c );
+    const float d6 = -dot( ac, c );
+    if ( d6 >= 0 && d5 <= d6 )
+        return GJKKeep( simplex, 2 );
+
+    const float vb = d5*d2 - d1*d6;
+    if ( vb <= 0 && d2 >= 0 && d6 <= 0 )
+        return GJKKeep( simplex, 0, 2, d2 / ( d2 - d6 ) );
+
+    const float va = d3*d6 - d5*d4;
+    if ( va <= 0 && ( d4 - d3 ) >= 0 && ( d5 - d6 ) >= 0 )
+        return GJKKeep( simplex, 1, 2, ( d4 - d3 ) / ( ( d4 - d3 ) + ( d5 - d6 ) ) );
+
+    const float sum = va + vb + vc;
+    if ( sum < FLT_EPSILON )
+    {
+        // degenerate triangle: fall back to its first edge
+        simplex.count = 2;
+        return GJKSolve2( simplex );
+    }
+
+    const float inverse = 1.0f / sum;
+    simplex.lambda[1] = vb * inverse;
+    simplex.lambda[2] = vc * inverse;
+    simplex.lambda[0] = 1 - simplex.lambda[1] - simplex.lambda[2];
+}
+
+inline void GJKSolve4( GJKSimplex & simplex )
+{
+    // the origin is inside the tetrahedron unless it is outside one of the
+    // faces. if so the closest point is the closest over the outside faces
+
+    static const int faces[4][4] = { { 0, 1, 2, 3 }, { 0, 2, 3, 1 }, { 0, 3, 1, 2 }, { 1, 3, 2, 0 } };
+
+    GJKSimplex best;
+    float bestDistanceSquared = FLT_MAX;
+    bool outside = false;
+
+    // a flat tetrahedron has no inside, so the sign tests below mean nothing.
+    // treat it as outside every face and keep the closest face instead
+
+    const vec3f & w0 = simplex.vertex[0].w;
+    const float volume = dot( cross( simplex.vertex[1].w - w0, simplex.vertex[2].w - w0 ), simplex.vertex[3].w - w0 );
+    const bool degenerate = fabs( volume ) < FLT_EPSILON;
+
+    for ( int i = 0; i < 4; ++i )
+    {
+        const vec3f a = simplex.vertex[faces[i][0]].w;
+        const vec3f b = simplex.vertex[faces[i][1]].w;
+        const vec3f c = simplex.vertex[faces[i][2]].w;
+        const vec3f d = simplex.vertex[faces[i][3]].w;
+
+        const vec3f normal = cross( b - a, c - a );
+        const float sign_origin = -dot( a, normal );
+        const float sign_d = dot( d - a, normal );
+
+        if ( !degenerate && sign_origin * sign_d >= 0 )
+            continue;
+
+        outside = true;
+
+        GJKSimplex face;
+        face.vertex[0] = simplex.vertex[faces[i][0]];
+        face.vertex[1] = simplex.vertex[faces[i][1]];
+        face.vertex[2] = simplex.vertex[faces[i][2]];
+        face.count = 3;
+        GJKSolve3( face );
+
+        vec3f v(0,0,0);
+        for ( int j = 0; j < face.count; ++j )
+            v += face.vertex[j].w * face.lambda[j];
+
+        const float distanceSquared = length_squared( v );
+        if ( distanceSquared < bestDistanceSquared )
+        {
+            bestDistanceSquared = distanceSquared;
+            best = face;
+        }
+    }
+
+    if ( outside )
+        simplex = best;
+}
+
+inline vec3f GJKSolve( GJKSimplex & simplex )
+{
+    if ( simplex.count == 1 )
+        simplex.lambda[0] = 1;
+    else if ( simplex.count == 2 )
+        GJKSolve2( simplex );
+    else if ( simplex.count == 3 )
+        GJKSolve3( simplex );
+    else
+        GJKSolve4( simplex );
+
+    if ( simplex.count == 4 )
+        return vec3f(0,0,0);
+
+    vec3f v(0,0,0);
+    for ( int i = 0; i < simplex.count; ++i )
+        v += simplex.vertex[i].w * simplex.lambda[i];
+    return v;
+}
+
+// -----------------------------------------------------------------------
+
+/*
+    GJK. Returns true if the shapes intersect, leaving the simplex enclosing
+    the origin for EPA. Otherwise fills the result with the closest points,
+    the separation distance and the normal.
+*/
+
+template <typename ShapeA, typename ShapeB> bool GJK( const ShapeA & shapeA,
+                                                      const ShapeB & shapeB,
+                                                      GJKSimplex & simplex,
+                                                      GJKResult & result,
+                                                      GJKCache * cache = NULL,
+                                                      int maxIterations = 32,
+                                                      float tolerance = 0.0001f )
+{
+    simplex.count = 0;
+
+    if ( cache && cache->count > 0 )
+    {
+        for ( int i = 0; i < cache->count; ++i )
+            GJKSupport( shapeA, shapeB, cache->direction[i], simplex.vertex[simplex.count++] );
+    }
+    else
+    {
+        vec3f direction = shapeB.GetCenter() - shapeA.GetCenter();
+        if ( length_squared( direction ) < tolerance * tolerance )
+            direction = vec3f(1,0,0);
+        GJKSupport( shapeA, shapeB, direction, simplex.vertex[simplex.count++] );
+    }
+
+    vec3f v = GJKSolve( simplex );
+
+    bool intersecting = false;
+
+    int iteration = 0;
+
+    while ( iteration < maxIterations )
+    {
+        iteration++;
+
+        const float distanceSquared = length_squared( v );
+
+        if ( simplex.count == 4 || distanceSquared < tolerance * tolerance )
+        {
+            intersecting = true;
+            break;
+        }
+
+        GJKVertex vertex;
+        GJKSupport( shapeA, shapeB, -v, vertex );
+
+        // dot(v,w)/|v| is a lower bound on the distance, so stop once it is within tolerance of |v|
+
+        if ( distanceSquared - dot( v, vertex.w ) <= tolerance * sqrt( distanceSquared ) )
+            break;
+
+        bool duplicate = false;
+        for ( int i = 0; i < simplex.count; ++i )
+        {
+            if ( length_squared( simplex.vertex[i].w - vertex.w ) < tolerance * tolerance )
+                duplicate = true;
+        }
+        if ( duplicate )
+            break;
+
+        const GJKSimplex previous = simplex;
+
+        simplex.vertex[simplex.count++] = vertex;
+
+        const vec3f next = GJKSolve( simplex );
+
+        // numerical trouble: no progress toward the origin
+
+        if ( simplex.count < 4 && length_squared( next ) >= distanceSquared )
+        {
+            simplex = previous;
+            break;
+        }
+
+        v = next;
+    }
+
+    if ( cache )
+    {
+        cache->count = simplex.count;
+        for ( int i = 0; i < simplex.count; ++i )
+            cache->direction[i] = simplex.vertex[i].direction;
+    }
+
+    result.iterations = iteration;
+
+    if ( intersecting )
+        return true;
+
+    result.pointA = vec3f(0,0,0);
+    result.pointB = vec3f(0,0,0);
+    for ( int i = 0; i < simplex.count; ++i )
+    {
+        result.pointA += simplex.vertex[i].a * simplex.lambda[i];
+        result.pointB += simplex.vertex[i].b * simplex.lambda[i];
+    }
+
+    result.distance = length( result.pointB - result.pointA );
+    result.normal = -v * ( 1.0f / sqrt( length_squared( v ) ) );
+
+    return false;
+}
+
+// -----------------------------------------------------------------------
+
+/*
+    EPA. Expands the simplex left by GJK into a tetrahedron, then grows it
+    as a convex polytope toward the surface of the minkowski difference
+    until the closest face to the origin is on the surface. The face normal
+    and distance are the penetration normal and depth.
+*/
+
+struct EPAFace
+{
+    int index[3];
+    vec3f normal;
+    float distance;
+};
+
+template <typename ShapeA, typename ShapeB> bool EPABuildTetrahedron( const ShapeA & shapeA,
+                                                                      const ShapeB & shapeB,
+                                                                      GJKSimplex & simplex,
+                                                                      float epsilon )
+{
+    // GJK may stop with the origin on a vertex, edge or face of the simplex
+    // when the shapes are just touching. search for more vertices until it
+    // is a tetrahedron with volume
+
+    static const vec3f axes[6] = { vec3f(1,0,0), vec3f(-1,0,0), vec3f(0,1,0), vec3f(0,-1,0), vec3f(0,0,1), vec3f(0,0,-1) };
+
+    if ( simplex.count == 1 )
+    {
+        for ( int i = 0; i < 6 && simplex.count == 1; ++i )
+        {
+            GJKSupport( shapeA, shapeB, axes[i], simplex.vertex[1] );
+            if ( length_squared( simplex.vertex[1].w - simplex.vertex[0].w ) > epsilon * epsilon )
+                simplex.count = 2;
+        }
+    }
+
+    if ( simplex.count == 2 )
+    {
+        const vec3f edge = simplex.vertex[1].w - simplex.vertex[0].w;
+        for ( int i = 0; i < 6 && simplex.count == 2; ++i )
+        {
+            const vec3f direction = cross( edge, axes[i] );
+            if ( length_squared( direction ) < epsilon * epsilon )
+                continue;
+            GJKSupport( shapeA, shapeB, direction, simplex.vertex[2] );
+            if ( length_squared( cross( edge, simplex.vertex[2].w - simplex.vertex[0].w ) ) > epsilon * epsilon )
+                simplex.count = 3;
+        }
+    }
+
+    if ( simplex.count == 3 )
+    {
+        const vec3f normal = cross( simplex.vertex[1].w - simplex.vertex[0].w, simplex.vertex[2].w - simplex.vertex[0].w );
+        for ( int i = 0; i < 2 && simplex.count == 3; ++i )
+        {
+            GJKSupport( shapeA, shapeB, i == 0 ? normal : -normal, simplex.vertex[3] );
+            if ( fabs( dot( simplex.vertex[3].w - simplex.vertex[0].w, normal ) ) > epsilon * sqrt( length_squared( normal ) ) )
+                simplex.count = 4;
+        }
+    }
+
+    return simplex.count == 4;
+}
+
+inline bool EPAMakeFace( const GJKVertex * vertices, int a, int b, int c, EPAFace & face )
+{
+    const vec3f normal = cross( vertices[b].w - vertices[a].w, vertices[c].w - vertices[a].w );
+    const float lengthSquared = length_squared( normal );
+    if ( lengthSquared < FLT_EPSILON * FLT_EPSILON )
+        return false;
+    face.index[0] = a;
+    face.index[1] = b;
+    face.index[2] = c;
+    face.normal = normal * ( 1.0f / sqrt( lengthSquared ) );
+    face.distance = dot( face.normal, vertices[a].w );
+    return true;
+}
+
+template <typename ShapeA, typename ShapeB> bool EPA( const ShapeA & shapeA,
+                                                      const ShapeB & shapeB,
+                                                      GJKSimplex & simplex,
+                                                      GJKResult & result,
+                                                      int maxIterations = 64,
+                                                      float tolerance = 0.0001f )
+{
+    const int MaxVertices = 4 + 64;
+    const int MaxFaces = 4 + 2 * 64;
+    const int MaxEdges = 3 * MaxFaces;
+
+    assert( maxIterations <= 64 );
+
+    if ( !EPABuildTetrahedron( shapeA, shapeB, simplex, tolerance ) )
+        return false;
+
+    GJKVertex vertices[MaxVertices];
+    EPAFace faces[MaxFaces];
+    int edges[MaxEdges][2];
+
+    int numVertices = 4;
+    int numFaces = 0;
+
+    for ( int i = 0; i < 4; ++i )
+        vertices[i] = simplex.vertex[i];
+
+    // faces of the tetrahedron, wound so normals point away from the opposite vertex
+
+    const float orientation = dot( cross( vertices[1].w - vertices[0].w, vertices[2].w - vertices[0].w ), vertices[3].w - vertices[0].w );
+
+    if ( orientation > 0 )
+        std::swap( vertices[1], vertices[2] );
+
+    if ( !EPAMakeFace( vertices, 0, 1, 2, faces[numFaces++] ) ||
+         !EPAMakeFace( vertices, 0, 3, 1, faces[numFaces++] ) ||
+         !EPAMakeFace( vertices, 0, 2, 3, faces[numFaces++] ) ||
+         !EPAMakeFace( vertices, 1, 3, 2, faces[numFaces++] ) )
+        return false;
+
+    int closest = 0;
+
+    for ( int iteration = 0; iteration < maxIterations; ++iteration )
+    {
+        result.iterations++;
+
+        closest = 0;
+        for ( int i = 1; i < numFaces; ++i )
+        {
+            if ( faces[i].distance < faces[closest].distance )
+                closest = i;
+        }
+
+        if ( numVertices == MaxVertices )
+            break;
+
+        GJKVertex & vertex = vertices[numVertices];
+        GJKSupport( shapeA, shapeB, faces[closest].normal, vertex );
+
+        if ( dot( vertex.w, faces[closest].normal ) - faces[closest].distance < tolerance )
+            break;
+
+        // remove every face the new vertex can see, keeping the horizon edges
+
+        int numEdges = 0;
+
+        for ( int i = 0; i < numFaces; )
+        {
+            const EPAFace & face = faces[i];
+
+            if ( dot( face.normal, vertex.w - vertices[face.index[0]].w ) <= 0 )
+            {
+                ++i;
+                continue;
+            }
+
+            for ( int j = 0; j < 3; ++j )
+            {
+                const int a = face.index[j];
+                const int b = face.index[(j+1)%3];
+
+                bool shared = false;
+                for ( int k = 0; k < numEdges; ++k )
+                {
+                    if ( edges[k][0] == b && edges[k][1] == a )
+                    {
+                        edges[k][0] = edges[numEdges-1][0];
+                        edges[k][1] = edges[numEdges-1][1];
+                        numEdges--;
+                        shared = true;
+                        break;
+                    }
+                }
+
+                if ( !shared )
+                {
+                    // dropping a horizon edge would leave a hole in the polytope
+                    if ( numEdges == MaxEdges )
+                        return false;
+                    edges[numEdges][0] = a;
+                    edges[numEdges][1] = b;
+                    numEdges++;
+                }
+            }
+
+            faces[i] = faces[--numFaces];
+        }
+
+        if ( numFaces + numEdges > MaxFaces )
+            return false;
+
+        const int index = numVertices++;
+
+        for ( int i = 0; i < numEdges; ++i )
+        {
+            if ( EPAMakeFace( vertices, edges[i][0], edges[i][1], index, faces[numFaces] ) )
+                numFaces++;
+        }
+
+        if ( numFaces == 0 )
+            return false;
+    }
+
+    // IMPORTANT: when the loop runs out of iterations the faces have changed
+    // since "closest" was picked, so pick again from the polytope as it is now
+
+    closest = 0;
+    for ( int i = 1; i < numFaces; ++i )
+    {
+        if ( faces[i].distance < faces[closest].distance )
+            closest = i;
+    }
+
+    // the deepest points are the barycentric combination of the closest face
+    // at the projection of the origin onto it
+
+    const EPAFace & face = faces[closest];
+
+    const vec3f a = vertices[face.index[0]].w;
+    const vec3f b = vertices[face.index[1]].w;
+    const vec3f c = vertices[face.index[2]].w;
+    const vec3f p = face.normal * face.distance;
+
+    const vec3f v0 = b - a;
+    const vec3f v1 = c - a;
+    const vec3f v2 = p - a;
+    const float d00 = dot( v0, v0 );
+    const float d01 = dot( v0, v1 );
+    const float d11 = dot( v1, v1 );
+    const float d20 = dot( v2, v0 );
+    const float d21 = dot( v2, v1 );
+    const float denominator = d00 * d11 - d01 * d01;
+    const float lambda_b = ( d11 * d20 - d01 * d21 ) / denominator;
+    const float lambda_c = ( d00 * d21 - d01 * d20 ) / denominator;
+    const float lambda_a = 1 - lambda_b - lambda_c;
+
+    result.pointA = vertices[face.index[0]].a * lambda_a + vertices[face.index[1]].a * lambda_b + vertices[face.index[2]].a * lambda_c;
+    result.pointB = vertices[face.index[0]].b * lambda_a + vertices[face.index[1]].b * lambda_b + vertices[face.index[2]].b * lambda_c;
+    result.normal = face.normal;
+    result.distance = -face.distance;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------
+
+/*
+    Distance between two shapes with closest points, or penetration depth
+    with deepest points if they intersect. Returns true if intersecting.
+*/
+
+template <typename ShapeA, typename ShapeB> bool GJKDistance( const ShapeA & shapeA,
+                                                              const ShapeB & shapeB,
+                                                              GJKResult & result,
+                                                              GJKCache * cache = NULL )
+{
+    GJKSimplex simplex;
+
+    if ( !GJK( shapeA, shapeB, simplex, result, cache ) )
+        return false;
+
+    if ( !EPA( shapeA, shapeB, simplex, result ) )
+    {
+        // degenerate polytope: the shapes are touching
+
+        result.pointA = vec3f(0,0,0);
+        result.pointB = vec3f(0,0,0);
+        for ( int i = 0; i < simplex.count; ++i )
+        {
+            result.pointA += simplex.vertex[i].a * ( 1.0f / simplex.count );
+            result.pointB += simplex.vertex[i].b * ( 1.0f / simplex.count );
+        }
+        result.normal = normalize( shapeB.GetCenter() - shapeA.GetCenter() );
+        result.distance = 0;
+    }
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,350 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include "Config.h"
+#include "Platform.h"
+#include "World.h"
+#include "Allocator.h"
+
+/*
+    Host.
+
+    Runs many independent go tables in one process. Each table is a world
+    with its own arena, so tables never share memory and a table can be
+    stepped on any worker without locks.
+
+    Each tick the host gathers the tables that have at least one stone
+    awake and hands them out to the workers one at a time. Tables with
+    every stone asleep are skipped entirely and cost nothing but the
+    check. Workers pull the next table off a shared counter, so a few
+    busy tables don't leave the other workers waiting.
+
+    Workers are "platform::WorkerThread", started once in "Initialize". Each
+    waits on its own semaphore for the next tick, steps tables until there
+    are none left, then signals back to the host. Workers are only joined
+    in "Free", so a tick costs a wake up per worker rather than a thread
+    create and join. With MULTITHREADED off in Config.h no threads are
+    started and every table is stepped serially on the calling thread.
+*/
+
+struct HostParams
+{
+    HostParams()
+    {
+        numTables = 256;
+        boardSize = 19;
+        stoneSize = STONE_SIZE_40;
+        maxStonesPerTable = 19 * 19;
+        numWorkers = 4;
+        tickRate = 60;
+    }
+
+    int numTables;
+    int boardSize;
+    StoneSize stoneSize;
+    int maxStonesPerTable;
+    int numWorkers;
+    int tickRate;                   // ticks per second. one tick is the budget for stepping every table
+    WorldParams worldParams;
+};
+
+struct HostStats
+{
+    HostStats()
+    {
+        ticks = 0;
+        tablesStepped = 0;
+        tablesIdle = 0;
+        ticksOverBudget = 0;
+        stepTime = 0.0;
+        tickTime = 0.0;
+        maxTickTime = 0.0f;
+        maxTableStepTime = 0.0f;
+    }
+
+    // number of tables with stones moving that one core can keep up with at this tick rate
+
+    float GetTablesPerCore( int tickRate ) const
+    {
+        if ( stepTime <= 0.0 )
+            return 0.0f;
+        return float( tablesStepped / stepTime / tickRate );
+    }
+
+    uint64_t ticks;
+    uint64_t tablesStepped;
+    uint64_t tablesIdle;
+    uint64_t ticksOverBudget;
+    double stepTime;                // seconds spent stepping tables, summed over all workers
+    double tickTime;                // wall clock seconds spent in "Tick"
+    float maxTickTime;
+    float maxTableStepTime;
+};
+
+class Host;
+
+class HostWorker : public platform::WorkerThread
+{
+public:
+
+    HostWorker()
+    {
+        host = NULL;
+        Clear();
+    }
+
+    void Clear()
+    {
+        tablesStepped = 0;
+        stepTime = 0.0;
+        maxTableStepTime = 0.0f;
+    }
+
+    // steps tables until every awake table has been handed out
+
+    void Step();
+
+    Host * host;
+    int tablesStepped;
+    double stepTime;
+    float maxTableStepTime;
+    platform::Semaphore start;      // signalled by the host once per tick, and once more to stop
+
+protected:
+
+    virtual void Run();
+};
+
+class Host
+{
+public:
+
+    Host()
+    {
+        numTables = 0;
+        numWorkers = 0;
+        numRunning = 0;
+        numAwake = 0;
+        nextAwake = 0;
+        stopping = false;
+        dt = 0.0f;
+        arenas = NULL;
+        worlds = NULL;
+        awake = NULL;
+        workers = NULL;
+    }
+
+    ~Host()
+    {
+        Free();
+    }
+
+    bool Initialize( const HostParams & hostParams = HostParams() )
+    {
+        assert( hostParams.numTables > 0 );
+        assert( hostParams.numWorkers > 0 );
+        assert( hostParams.tickRate > 0 );
+
+        Free();
+
+        params = hostParams;
+
+        numTables = params.numTables;
+        numWorkers = params.numWorkers;
+        dt = 1.0f / params.tickRate;
+
+        arenas = new Arena[numTables];
+        worlds = new World[numTables];
+        awake = new int[numTables];
+        workers = new HostWorker[numWorkers];
+
+        const size_t tableBytes = World::GetMemoryRequired( params.maxStonesPerTable );
+
+        for ( int i = 0; i < numTables; ++i )
+        {
+            arenas[i].Initialize( tableBytes );
+            if ( !worlds[i].Initialize( arenas[i], params.boardSize, params.stoneSize, params.maxStonesPerTable, params.worldParams ) )
+            {
+                Free();
+                return false;
+            }
+        }
+
+        for ( int i = 0; i < numWorkers; ++i )
+            workers[i].host = this;
+
+        #ifdef MULTITHREADED
+        for ( int i = 0; i < numWorkers; ++i )
+        {
+            if ( !workers[i].Start() )
+            {
+                Free();
+                return false;
+            }
+            numRunning++;
+        }
+        #endif
+
+        stats = HostStats();
+
+        return true;
+    }
+
+    void Free()
+    {
+        // IMPORTANT: workers must be stopped before anything they step is freed
+
+        stopping = true;
+        for ( int i = 0; i < numRunning; ++i )
+            workers[i].start.Signal();
+        for ( int i = 0; i < numRunning; ++i )
+            workers[i].Join();
+        numRunning = 0;
+        stopping = false;
+
+        delete [] workers;
+        delete [] awake;
+        delete [] worlds;
+        delete [] arenas;
+        workers = NULL;
+        awake = NULL;
+        worlds = NULL;
+        arenas = NULL;
+        numTables = 0;
+        numWorkers = 0;
+        numAwake = 0;
+    }
+
+    void Tick()
+    {
+        platform::Timer tickTimer;
+
+        numAwake = 0;
+        for ( int i = 0; i < numTables; ++i )
+        {
+            if ( worlds[i].IsAwake() )
+                awake[numAwake++] = i;
+        }
+
+        nextAwake = 0;
+
+        if ( numAwake > 0 )
+        {
+            const int activeWorkers = numWorkers < numAwake ? numWorkers : numAwake;
+
+            for ( int i = 0; i < activeWorkers; ++i )
+                workers[i].Clear();
+
+            #ifdef MULTITHREADED
+            for ( int i = 0; i < activeWorkers; ++i )
+                workers[i].start.Signal();
+            for ( int i = 0; i < activeWorkers; ++i )
+                finished.Wait();
+            #else
+            workers[0].Step();
+            #endif
+
+            for ( int i = 0; i < activeWorkers; ++i )
+            {
+                stats.stepTime += workers[i].stepTime;
+                stats.maxTableStepTime = max( stats.maxTableStepTime, workers[i].maxTableStepTime );
+            }
+        }
+
+        const float tickTime = tickTimer.time();
+
+        stats.ticks++;
+        stats.tablesStepped += numAwake;
+        stats.tablesIdle += numTables - numAwake;
+        stats.tickTime += tickTime;
+        stats.maxTickTime = max( stats.maxTickTime, tickTime );
+        if ( tickTime > dt )
+            stats.ticksOverBudget++;
+    }
+
+    int GetNumTables() const { return numTables; }
+
+    int GetNumAwake() const { return numAwake; }
+
+    World & GetWorld( int index ) { assert( index >= 0 && index < numTables ); return worlds[index]; }
+
+    const World & GetWorld( int index ) const { assert( index >= 0 && index < numTables ); return worlds[index]; }
+
+    const HostParams & GetParams() const { return params; }
+
+    const HostStats & GetStats() const { return stats; }
+
+    void ResetStats() { stats = HostStats(); }
+
+protected:
+
+    friend class HostWorker;
+
+    // returns the next awake table to step, or -1 once every awake table has been handed out
+
+    int NextTable()
+    {
+        const int index = platform::AtomicAdd( &nextAwake, 1 );
+        return index < numAwake ? awake[index] : -1;
+    }
+
+private:
+
+    Host( const Host & other );
+    Host & operator = ( const Host & other );
+
+    HostParams params;
+    HostStats stats;
+
+    int numTables;
+    int numWorkers;
+    int numRunning;                 // worker threads started
+    int numAwake;
+    int nextAwake;
+    bool stopping;
+    float dt;
+
+    platform::Semaphore finished;   // signalled by each worker when there are no tables left
+
+    Arena * arenas;
+    World * worlds;
+    int * awake;
+    HostWorker * workers;
+};
+
+inline void HostWorker::Run()
+{
+    while ( true )
+    {
+        start.Wait();
+
+        if ( host->stopping )
+            break;
+
+        Step();
+
+        host->finished.Signal();
+    }
+}
+
+inline void HostWorker::Step()
+{
+    platform::Timer timer;
+
+    while ( true )
+    {
+        const int index = host->NextTable();
+        if ( index < 0 )
+            break;
+
+        timer.reset();
+        host->worlds[index].Step( host->dt );
+        const float tableStepTime = timer.time();
+
+        tablesStepped++;
+        stepTime += tableStepTime;
+        maxTableStepTime = max( maxTableStepTime, tableStepTime );
+    }
+}
+
+#endif
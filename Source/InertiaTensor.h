@@ -1,36 +1,21 @@
 #ifndef INERTIA_TENSOR_H
 #define INERTIA_TENSOR_H
 
-void CalculateSphereInertiaTensor( float mass, float r, mat4f & inertiaTensor, mat4f & inverseInertiaTensor )
+void CalculateSphereInertia( float mass, float r, vec3f & inertia, vec3f & inverseInertia )
 {
     const float i = 2.0f / 5.0f * mass * r * r;
-    float values[] = { i, 0, 0, 0, 
-                       0, i, 0, 0,
-                       0, 0, i, 0,
-                       0, 0, 0, 1 };
-    float inverse_values[] = { 1/i,  0,   0,   0, 
-                                0, 1/i,   0,   0, 
-                                0,   0, 1/i,   0,
-                                0,   0,   0,   1 };
-    inertiaTensor.load( values );
-    inverseInertiaTensor.load( inverse_values );
+    inertia = vec3f( i, i, i );
+    inverseInertia = vec3f( 1/i, 1/i, 1/i );
 }
 
-void CalculateEllipsoidInertiaTensor( float mass, float a, float b, float c, mat4f & inertiaTensor, mat4f & inverseInertiaTensor )
+void CalculateEllipsoidInertia( float mass, float a, float c, vec3f & inertia, vec3f & inverseInertia )
 {
-    const float i_a = 1.0f/5.0f * mass * ( b*b + c*c );
-    const float i_b = 1.0f/5.0f * mass * ( a*a + c*c );
-    const float i_c = 1.0f/5.0f * mass * ( a*a + b*b );
-    float values[] = { i_a,   0,   0, 0, 
-                         0, i_b,   0, 0,
-                         0,   0, i_c, 0,
-                         0,   0,   0, 1 };
-    float inverse_values[] = { 1/i_a,     0,     0,   0, 
-                                   0, 1/i_b,     0,   0, 
-                                   0,     0, 1/i_c,   0,
-                                   0,     0,     0,   1 };
-    inertiaTensor.load( values );
-    inverseInertiaTensor.load( inverse_values );
+    // IMPORTANT: spheroid with equal semi-axes a along x and y and semi-axis c along z.
+    // rigid bodies only support symmetric tops about the local z axis.
+    const float i_a = 1.0f/5.0f * mass * ( a*a + c*c );
+    const float i_c = 1.0f/5.0f * mass * ( a*a + a*a );
+    inertia = vec3f( i_a, i_a, i_c );
+    inverseInertia = vec3f( 1/i_a, 1/i_a, 1/i_c );
 }
 
 float CalculateBiconvexVolume( const Biconvex & biconvex )
@@ -40,7 +25,7 @@ float CalculateBiconvexVolume( const Biconvex & biconvex )
     return h*h + ( pi * r / 4 + pi * h / 24 );
 }
 
-void CalculateBiconvexInertiaTensor( float mass, const Biconvex & biconvex, vec3f & inertia, mat4f & inertiaTensor, mat4f & inverseInertiaTensor )
+void CalculateBiconvexInertia( float mass, const Biconvex & biconvex, vec3f & inertia, vec3f & inverseInertia )
 {
     const float resolution = 0.1;
     const float width = biconvex.GetWidth();
@@ -100,21 +85,13 @@ void CalculateBiconvexInertiaTensor( float mass, const Biconvex & biconvex, vec3
     printf( "inertia tensor: %f, %f,%f\n", ix, iy, iz );
     */
 
-    const float inertiaValues[] = { ix, iy, iz };
+    // the biconvex is symmetric about its local z axis so ix and iy are
+    // equal up to summation order. average them to get an exact symmetric top
 
-    const float inertiaTensorValues[] = { ix, 0,  0, 0, 
-                                          0, iy,  0, 0, 
-                                          0,  0, iz, 0, 
-                                          0,  0,  0, 1 };
+    const float ixy = ( ix + iy ) * 0.5f;
 
-    const float inverseInertiaTensorValues[] = { 1/ix,    0,    0, 0, 
-                                                    0, 1/iy,    0, 0, 
-                                                    0,    0, 1/iz, 0, 
-                                                    0,    0,    0, 1 };
-
-    inertia.load( inertiaValues );
-    inertiaTensor.load( inertiaTensorValues );
-    inverseInertiaTensor.load( inverseInertiaTensorValues );
+    inertia = vec3f( ixy, ixy, iz );
+    inverseInertia = vec3f( 1/ixy, 1/ixy, 1/iz );
 }
 
 #endif
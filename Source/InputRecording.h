@@ -0,0 +1,454 @@
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include "Platform.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+    Input recording.
+
+    The demos record the keys held down every frame so a session can be
+    played back exactly, eg. to capture video of it offline. Writing the
+    input struct out raw costs a padded byte per key per frame, and most
+    frames nobody touches the keyboard at all.
+
+    Instead each frame's keys are packed into one bit per key, and a run of
+    frames with the same keys is stored once along with its length. A
+    minute of play with a handful of key presses is a few hundred bytes.
+    Runs collect in memory and go to the file 64k at a time, so there is
+    no file io in the frame loop. IMPORTANT: call "Flush" if the recording
+    has to survive the process being killed.
+
+    On playback the file is mapped rather than read, and one pass over it
+    builds a table of where each run starts, so seeking to any frame is a
+    binary search.
+
+    File layout:
+
+        [4 bytes] magic "VGIN"
+        [4 bytes] version
+        [4 bytes] number of keys
+        per run:
+            [1-5 bytes] number of frames, 7 bits per byte, low bits first
+            [(keys+7)/8 bytes] one bit per key, in "platform::Input" order
+
+    New keys go on the end of the input struct, so older recordings still
+    play back with the new keys up.
+*/
+
+const uint32_t InputMagic = 0x4E494756;             // "VGIN"
+const uint32_t InputVersion = 1;
+
+const int NumInputKeys = sizeof( platform::Input ) / sizeof( bool );
+
+// IMPORTANT: keys are packed by walking the input struct as an array of bools. this fails to compile if that stops working
+typedef char InputIsArrayOfKeys[ sizeof( platform::Input ) == NumInputKeys * sizeof( bool ) && NumInputKeys <= 64 ? 1 : -1 ];
+
+inline uint64_t PackInput( const platform::Input & input )
+{
+    const bool * keys = (const bool*) &input;
+    uint64_t packed = 0;
+    for ( int i = 0; i < NumInputKeys; ++i )
+        packed |= uint64_t( keys[i] ? 1 : 0 ) << i;
+    return packed;
+}
+
+inline void UnpackInput( uint64_t packed, platform::Input & input )
+{
+    bool * keys = (bool*) &input;
+    for ( int i = 0; i < NumInputKeys; ++i )
+        keys[i] = ( packed >> i ) & 1;
+}
+
+inline int GetInputKeyBytes( int numKeys )
+{
+    return ( numKeys + 7 ) / 8;
+}
+
+// ----------------------------------------------------------------
+
+class InputRecorder
+{
+public:
+
+    enum { BufferSize = 64 * 1024 };
+
+    InputRecorder()
+    {
+        file = NULL;
+        buffer = NULL;
+        bufferBytes = 0;
+        runKeys = 0;
+        runFrames = 0;
+        numFrames = 0;
+        numRuns = 0;
+        bytesWritten = 0;
+        error = false;
+    }
+
+    ~InputRecorder()
+    {
+        Close();
+    }
+
+    bool Open( const char filename[] )
+    {
+        assert( filename );
+
+        Close();
+
+        file = fopen( filename, "wb" );
+        if ( !file )
+            return false;
+
+        buffer = new uint8_t[BufferSize];
+        bufferBytes = 0;
+        runKeys = 0;
+        runFrames = 0;
+        numFrames = 0;
+        numRuns = 0;
+        bytesWritten = 0;
+        error = false;
+
+        WriteUint32( InputMagic );
+        WriteUint32( InputVersion );
+        WriteUint32( NumInputKeys );
+
+        return true;
+    }
+
+    // writes out anything still buffered. returns false if a write to the file has failed
+
+    bool Close()
+    {
+        if ( !file )
+            return true;
+
+        Flush();
+
+        const bool ok = !error && fclose( file ) == 0;
+
+        delete [] buffer;
+        file = NULL;
+        buffer = NULL;
+
+        return ok;
+    }
+
+    // call once per frame
+
+    void Write( const platform::Input & input )
+    {
+        assert( file );
+
+        const uint64_t keys = PackInput( input );
+
+        if ( runFrames > 0 && keys == runKeys && runFrames < 0xFFFFFFFF )
+        {
+            runFrames++;
+        }
+        else
+        {
+            EndRun();
+            runKeys = keys;
+            runFrames = 1;
+        }
+
+        numFrames++;
+    }
+
+    // pushes everything so far out to the file, including the run in progress. that run carries on
+    // afterwards, but is split in two in the file
+
+    bool Flush()
+    {
+        if ( !file )
+            return false;
+
+        EndRun();
+
+        if ( bufferBytes > 0 )
+        {
+            if ( fwrite( buffer, bufferBytes, 1, file ) != 1 )
+                error = true;
+            bufferBytes = 0;
+        }
+
+        if ( fflush( file ) != 0 )
+            error = true;
+
+        return !error;
+    }
+
+    bool IsOpen() const { return file != NULL; }
+
+    bool HasError() const { return error; }
+
+    uint64_t GetNumFrames() const { return numFrames; }
+
+    uint64_t GetNumRuns() const { return numRuns + ( runFrames ? 1 : 0 ); }
+
+    // header included, run in progress not
+
+    uint64_t GetBytesWritten() const { return bytesWritten; }
+
+private:
+
+    InputRecorder( const InputRecorder & other );
+    InputRecorder & operator = ( const InputRecorder & other );
+
+    void EndRun()
+    {
+        if ( !runFrames )
+            return;
+
+        uint8_t run[5 + 8];
+        int bytes = 0;
+
+        uint32_t value = runFrames;
+        while ( value >= 0x80 )
+        {
+            run[bytes++] = uint8_t( value | 0x80 );
+            value >>= 7;
+        }
+        run[bytes++] = uint8_t( value );
+
+        const int keyBytes = GetInputKeyBytes( NumInputKeys );
+        for ( int i = 0; i < keyBytes; ++i )
+            run[bytes++] = uint8_t( runKeys >> ( i * 8 ) );
+
+        WriteBytes( run, bytes );
+
+        runFrames = 0;
+        numRuns++;
+    }
+
+    void WriteUint32( uint32_t value )
+    {
+        const uint8_t bytes[] = { uint8_t( value ), uint8_t( value >> 8 ), uint8_t( value >> 16 ), uint8_t( value >> 24 ) };
+        WriteBytes( bytes, 4 );
+    }
+
+    void WriteBytes( const uint8_t * data, int bytes )
+    {
+        if ( bufferBytes + bytes > BufferSize )
+        {
+            if ( fwrite( buffer, bufferBytes, 1, file ) != 1 )
+                error = true;
+            bufferBytes = 0;
+        }
+
+        memcpy( buffer + bufferBytes, data, bytes );
+        bufferBytes += bytes;
+        bytesWritten += bytes;
+    }
+
+    FILE * file;
+    uint8_t * buffer;
+    int bufferBytes;
+    uint64_t runKeys;
+    uint32_t runFrames;
+    uint64_t numFrames;
+    uint64_t numRuns;
+    uint64_t bytesWritten;
+    bool error;
+};
+
+// ----------------------------------------------------------------
+
+class InputPlayback
+{
+public:
+
+    InputPlayback()
+    {
+        runStart = NULL;
+        runKeys = NULL;
+        numRuns = 0;
+        numFrames = 0;
+        frame = 0;
+        run = 0;
+    }
+
+    ~InputPlayback()
+    {
+        Close();
+    }
+
+    // fails if the file is missing or isn't an input recording. a recording cut short
+    // plays back up to the last whole run
+
+    bool Open( const char filename[] )
+    {
+        assert( filename );
+
+        Close();
+
+        size_t size = 0;
+        const uint8_t * data = platform::MapFile( filename, size );
+        if ( !data )
+            return false;
+
+        const bool ok = Parse( data, size );
+
+        platform::UnmapFile( data, size );
+
+        if ( !ok )
+            Close();
+
+        return ok;
+    }
+
+    void Close()
+    {
+        delete [] runStart;
+        delete [] runKeys;
+        runStart = NULL;
+        runKeys = NULL;
+        numRuns = 0;
+        numFrames = 0;
+        frame = 0;
+        run = 0;
+    }
+
+    // input for the next frame. returns false once the recording has run out
+
+    bool Read( platform::Input & input )
+    {
+        if ( frame >= numFrames )
+            return false;
+
+        while ( run + 1 < numRuns && runStart[run+1] <= frame )
+            run++;
+
+        UnpackInput( runKeys[run], input );
+
+        frame++;
+
+        return true;
+    }
+
+    // the next "Read" returns this frame. returns false if the recording is shorter than that
+
+    bool Seek( uint64_t targetFrame )
+    {
+        if ( targetFrame > numFrames )
+            return false;
+
+        // last run starting at or before the frame
+
+        int lo = 0;
+        int hi = numRuns;
+        while ( hi - lo > 1 )
+        {
+            const int mid = ( lo + hi ) / 2;
+            if ( runStart[mid] <= targetFrame )
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        run = lo;
+        frame = targetFrame;
+
+        return true;
+    }
+
+    bool IsOpen() const { return runStart != NULL; }
+
+    uint64_t GetNumFrames() const { return numFrames; }
+
+    int GetNumRuns() const { return numRuns; }
+
+    uint64_t GetFrame() const { return frame; }
+
+private:
+
+    InputPlayback( const InputPlayback & other );
+    InputPlayback & operator = ( const InputPlayback & other );
+
+    static uint32_t ReadUint32( const uint8_t * data )
+    {
+        return uint32_t( data[0] ) | ( uint32_t( data[1] ) << 8 ) | ( uint32_t( data[2] ) << 16 ) | ( uint32_t( data[3] ) << 24 );
+    }
+
+    // reads one run at "offset", returning the offset after it, or 0 if the data ends partway through
+
+    static size_t ReadRun( const uint8_t * data, size_t size, size_t offset, int keyBytes, uint32_t & frames, uint64_t & keys )
+    {
+        frames = 0;
+        for ( int shift = 0; ; shift += 7 )
+        {
+            if ( offset >= size || shift > 28 )
+                return 0;
+            const uint8_t byte = data[offset++];
+            frames |= uint32_t( byte & 0x7F ) << shift;
+            if ( !( byte & 0x80 ) )
+                break;
+        }
+
+        if ( offset + keyBytes > size )
+            return 0;
+
+        keys = 0;
+        for ( int i = 0; i < keyBytes; ++i )
+            keys |= uint64_t( data[offset++] ) << ( i * 8 );
+
+        return offset;
+    }
+
+    bool Parse( const uint8_t * data, size_t size )
+    {
+        const size_t headerBytes = 12;
+
+        if ( size < headerBytes || ReadUint32( data ) != InputMagic || ReadUint32( data + 4 ) != InputVersion )
+            return false;
+
+        const int numKeys = ReadUint32( data + 8 );
+        if ( numKeys <= 0 || numKeys > 64 )
+            return false;
+
+        const int keyBytes = GetInputKeyBytes( numKeys );
+
+        // keys this build doesn't know about are dropped
+
+        const uint64_t keyMask = NumInputKeys < 64 ? ( uint64_t( 1 ) << NumInputKeys ) - 1 : ~uint64_t( 0 );
+
+        // count the runs first, then fill in the table
+
+        uint32_t frames = 0;
+        uint64_t keys = 0;
+
+        int count = 0;
+        size_t offset = headerBytes;
+        while ( ( offset = ReadRun( data, size, offset, keyBytes, frames, keys ) ) != 0 )
+            count++;
+
+        runStart = new uint64_t[count + 1];
+        runKeys = new uint64_t[count + 1];
+
+        offset = headerBytes;
+        for ( int i = 0; i < count; ++i )
+        {
+            offset = ReadRun( data, size, offset, keyBytes, frames, keys );
+            runStart[numRuns] = numFrames;
+            runKeys[numRuns] = keys & keyMask;
+            numRuns++;
+            numFrames += frames;
+        }
+
+        return true;
+    }
+
+    uint64_t * runStart;            // first frame of each run
+    uint64_t * runKeys;
+    int numRuns;
+    uint64_t numFrames;
+    uint64_t frame;
+    int run;
+};
+
+#endif
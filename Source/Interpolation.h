@@ -0,0 +1,439 @@
+#ifndef INTERPOLATION_H
+#define INTERPOLATION_H
+
+#include "Snapshot.h"
+
+/*
+    Jitter buffer.
+
+    Snapshots arrive on the client at irregular times: late, out of order,
+    or not at all. Drawing each one as it lands makes stones stutter, and
+    the worse the network the worse it looks.
+
+    Instead the client holds on to the last few decoded snapshots and draws
+    the world as it was a fixed playout delay in the past. Most of the time
+    there is a snapshot on either side of that render time, so positions
+    are lerped and orientations slerped between the two. When the newer one
+    is lost, the last snapshot is extrapolated along its velocities for at
+    most "maxExtrapolation" seconds, then held until the next one arrives.
+
+    The delay only needs to cover one snapshot interval plus the jitter,
+    so the network can run at 10-20 snapshots a second while rendering runs
+    at full rate. The cost per render is linear in the number of stones.
+
+    Every snapshot slot is allocated in "Initialize". Adding a snapshot
+    dequantizes into the oldest slot, and nothing is allocated after that.
+
+    Each snapshot is stamped with the server time it was taken at (eg.
+    server frame / tick rate) and the local time it arrived. The fastest
+    arrival seen so far gives the offset between the two clocks, so the
+    playout delay only has to cover jitter, not latency. The offset creeps
+    back up slowly if latency rises for good.
+*/
+
+struct JitterBufferParams
+{
+    JitterBufferParams()
+    {
+        numSnapshots = 16;
+        maxStones = MaxSnapshotStones;
+        playoutDelay = 0.1f;
+        maxExtrapolation = 0.1f;
+        clockRelaxation = 0.01f;
+    }
+
+    int numSnapshots;               // slots, must cover the playout delay at the snapshot rate
+    int maxStones;
+    float playoutDelay;             // seconds the render time trails the fastest arriving snapshot
+    float maxExtrapolation;         // seconds past the newest snapshot before stones are held
+    float clockRelaxation;          // fraction of a slower arrival the clock offset moves towards
+};
+
+enum PlayoutMode
+{
+    PLAYOUT_EMPTY,                  // nothing received yet
+    PLAYOUT_HOLD,                   // render time is before the oldest snapshot, or extrapolation ran out
+    PLAYOUT_INTERPOLATE,
+    PLAYOUT_EXTRAPOLATE
+};
+
+struct JitterBufferStats
+{
+    JitterBufferStats()
+    {
+        snapshotsAdded = 0;
+        snapshotsLate = 0;
+        snapshotsDuplicate = 0;
+        framesInterpolated = 0;
+        framesExtrapolated = 0;
+        framesHeld = 0;
+    }
+
+    uint64_t snapshotsAdded;
+    uint64_t snapshotsLate;         // arrived after the render time had passed them
+    uint64_t snapshotsDuplicate;
+    uint64_t framesInterpolated;
+    uint64_t framesExtrapolated;
+    uint64_t framesHeld;
+};
+
+struct InterpolatedStone
+{
+    vec3f position;
+    quat4f orientation;
+    bool active;
+};
+
+class JitterBuffer
+{
+public:
+
+    JitterBuffer()
+    {
+        entries = NULL;
+        samples = NULL;
+        renderTime = 0.0;
+        hasRenderTime = false;
+        clockOffset = 0.0;
+        hasClockOffset = false;
+    }
+
+    ~JitterBuffer()
+    {
+        Free();
+    }
+
+    // "stone" supplies the mass and inertia, which snapshots don't carry, for turning momentum into velocity
+
+    void Initialize( const RigidBody & stone, const JitterBufferParams & jitterParams = JitterBufferParams() )
+    {
+        assert( jitterParams.numSnapshots >= 2 );
+        assert( jitterParams.maxStones > 0 && jitterParams.maxStones <= MaxSnapshotStones );
+        assert( jitterParams.playoutDelay >= 0.0f );
+        assert( jitterParams.maxExtrapolation >= 0.0f );
+
+        Free();
+
+        params = jitterParams;
+        prototype = stone;
+        entries = new Entry[params.numSnapshots];
+        samples = new Sample[params.numSnapshots * params.maxStones];
+
+        Reset();
+    }
+
+    void Free()
+    {
+        delete [] entries;
+        delete [] samples;
+        entries = NULL;
+        samples = NULL;
+    }
+
+    void Reset()
+    {
+        for ( int i = 0; i < params.numSnapshots; ++i )
+            entries[i].valid = false;
+        renderTime = 0.0;
+        hasRenderTime = false;
+        clockOffset = 0.0;
+        hasClockOffset = false;
+        stats = JitterBufferStats();
+    }
+
+    // "time" is when the snapshot was taken on the server, "localTime" when it arrived here.
+    // returns false if the snapshot was dropped as a duplicate or too late to ever be drawn
+
+    bool AddSnapshot( double localTime, double time, const SnapshotParams & snapshotParams, const Snapshot & snapshot )
+    {
+        assert( entries );
+        assert( snapshot.numStones <= params.maxStones );
+
+        const double offset = localTime - time;
+        if ( !hasClockOffset || offset < clockOffset )
+            clockOffset = offset;
+        else
+            clockOffset += ( offset - clockOffset ) * params.clockRelaxation;
+        hasClockOffset = true;
+
+        // take a free slot, otherwise the oldest
+
+        int slot = -1;
+        bool newest = true;
+        for ( int i = 0; i < params.numSnapshots; ++i )
+        {
+            const Entry & entry = entries[i];
+
+            if ( entry.valid )
+            {
+                if ( entry.time == time )
+                {
+                    stats.snapshotsDuplicate++;
+                    return false;
+                }
+                if ( entry.time > time )
+                    newest = false;
+            }
+
+            if ( slot < 0 || ( entries[slot].valid && ( !entry.valid || entry.time < entries[slot].time ) ) )
+                slot = i;
+        }
+
+        // IMPORTANT: a snapshot the render time has already passed is only worth keeping
+        // if it is the newest we have, to extrapolate or hold from
+
+        if ( !newest && ( ( hasRenderTime && time <= renderTime ) || ( entries[slot].valid && entries[slot].time > time ) ) )
+        {
+            stats.snapshotsLate++;
+            return false;
+        }
+
+        Entry & entry = entries[slot];
+
+        entry.valid = true;
+        entry.time = time;
+        entry.numStones = snapshot.numStones;
+
+        Sample * entrySamples = GetSamples( slot );
+
+        RigidBody rigidBody = prototype;
+
+        for ( int i = 0; i < snapshot.numStones; ++i )
+        {
+            DequantizeStone( snapshotParams, snapshot.stones[i], rigidBody );
+
+            Sample & sample = entrySamples[i];
+            sample.position = rigidBody.position;
+            sample.orientation = rigidBody.orientation;
+            sample.linearVelocity = rigidBody.linearVelocity;
+            sample.angularVelocity = rigidBody.angularVelocity;
+            sample.active = rigidBody.active;
+        }
+
+        stats.snapshotsAdded++;
+
+        return true;
+    }
+
+    // writes the stones as they were on the server at the render time for "localTime" and returns how many there are
+
+    int Interpolate( double localTime, InterpolatedStone * stones, PlayoutMode * playoutMode = NULL )
+    {
+        assert( entries );
+        assert( stones );
+
+        if ( !hasClockOffset )
+        {
+            if ( playoutMode )
+                *playoutMode = PLAYOUT_EMPTY;
+            return 0;
+        }
+
+        // render time never runs backwards, even when the clock offset drops
+
+        const double t = localTime - clockOffset - params.playoutDelay;
+        if ( !hasRenderTime || t > renderTime )
+            renderTime = t;
+        hasRenderTime = true;
+
+        // a is the newest snapshot at or before the render time, b the oldest one after it
+
+        int a = -1;
+        int b = -1;
+        for ( int i = 0; i < params.numSnapshots; ++i )
+        {
+            const Entry & entry = entries[i];
+            if ( !entry.valid )
+                continue;
+            if ( entry.time <= renderTime )
+            {
+                if ( a < 0 || entry.time > entries[a].time )
+                    a = i;
+            }
+            else
+            {
+                if ( b < 0 || entry.time < entries[b].time )
+                    b = i;
+            }
+        }
+
+        // snapshots older than a will never be drawn again. free their slots
+
+        if ( a >= 0 )
+        {
+            for ( int i = 0; i < params.numSnapshots; ++i )
+            {
+                if ( entries[i].valid && entries[i].time < entries[a].time )
+                    entries[i].valid = false;
+            }
+        }
+
+        PlayoutMode mode;
+        int numStones;
+
+        if ( a < 0 && b < 0 )
+        {
+            mode = PLAYOUT_EMPTY;
+            numStones = 0;
+        }
+        else if ( a >= 0 && b >= 0 )
+        {
+            mode = PLAYOUT_INTERPOLATE;
+            const float alpha = float( ( renderTime - entries[a].time ) / ( entries[b].time - entries[a].time ) );
+            numStones = InterpolateStones( a, b, alpha, stones );
+            stats.framesInterpolated++;
+        }
+        else if ( a >= 0 )
+        {
+            const double dt = renderTime - entries[a].time;
+            mode = dt <= params.maxExtrapolation ? PLAYOUT_EXTRAPOLATE : PLAYOUT_HOLD;
+            numStones = ExtrapolateStones( a, float( dt <= params.maxExtrapolation ? dt : params.maxExtrapolation ), stones );
+            if ( mode == PLAYOUT_EXTRAPOLATE )
+                stats.framesExtrapolated++;
+            else
+                stats.framesHeld++;
+        }
+        else
+        {
+            // still filling up: show the oldest snapshot until the render time reaches it
+
+            mode = PLAYOUT_HOLD;
+            numStones = ExtrapolateStones( b, 0.0f, stones );
+            stats.framesHeld++;
+        }
+
+        if ( playoutMode )
+            *playoutMode = mode;
+
+        return numStones;
+    }
+
+    int GetNumBuffered() const
+    {
+        int count = 0;
+        for ( int i = 0; i < params.numSnapshots; ++i )
+            count += entries[i].valid ? 1 : 0;
+        return count;
+    }
+
+    // server time being drawn
+
+    double GetRenderTime() const { return renderTime; }
+
+    // local time minus server time, as best we can tell
+
+    double GetClockOffset() const { return clockOffset; }
+
+    const JitterBufferParams & GetParams() const { return params; }
+
+    const JitterBufferStats & GetStats() const { return stats; }
+
+    void ResetStats()
+    {
+        stats = JitterBufferStats();
+    }
+
+private:
+
+    JitterBuffer( const JitterBuffer & other );
+    JitterBuffer & operator = ( const JitterBuffer & other );
+
+    struct Entry
+    {
+        double time;
+        int numStones;
+        bool valid;
+    };
+
+    struct Sample
+    {
+        vec3f position;
+        quat4f orientation;
+        vec3f linearVelocity;
+        vec3f angularVelocity;
+        bool active;
+    };
+
+    Sample * GetSamples( int slot )
+    {
+        return samples + slot * params.maxStones;
+    }
+
+    int InterpolateStones( int a, int b, float alpha, InterpolatedStone * stones )
+    {
+        const Sample * samplesA = GetSamples( a );
+        const Sample * samplesB = GetSamples( b );
+
+        const int numStonesA = entries[a].numStones;
+        const int numStonesB = entries[b].numStones;
+
+        // IMPORTANT: stones added between the two snapshots have nothing to interpolate from, so they pop in at b
+
+        for ( int i = 0; i < numStonesB; ++i )
+        {
+            const Sample & sampleB = samplesB[i];
+            InterpolatedStone & stone = stones[i];
+
+            if ( i < numStonesA )
+            {
+                const Sample & sampleA = samplesA[i];
+                stone.position = sampleA.position + ( sampleB.position - sampleA.position ) * alpha;
+                stone.orientation = slerp( sampleA.orientation, sampleB.orientation, alpha );
+                stone.active = sampleA.active || sampleB.active;
+            }
+            else
+            {
+                stone.position = sampleB.position;
+                stone.orientation = sampleB.orientation;
+                stone.active = sampleB.active;
+            }
+        }
+
+        return numStonesB;
+    }
+
+    int ExtrapolateStones( int a, float dt, InterpolatedStone * stones )
+    {
+        const Sample * samplesA = GetSamples( a );
+        const int numStones = entries[a].numStones;
+
+        for ( int i = 0; i < numStones; ++i )
+        {
+            const Sample & sample = samplesA[i];
+            InterpolatedStone & stone = stones[i];
+
+            stone.active = sample.active;
+
+            if ( !sample.active || dt <= 0.0f )
+            {
+                stone.position = sample.position;
+                stone.orientation = sample.orientation;
+                continue;
+            }
+
+            // one explicit euler step. short enough that gravity and collisions don't matter much
+
+            stone.position = sample.position + sample.linearVelocity * dt;
+
+            quat4f spin;
+            AngularVelocityToSpin( sample.orientation, sample.angularVelocity, spin );
+            stone.orientation = sample.orientation;
+            stone.orientation += spin * dt;
+            stone.orientation = normalize( stone.orientation );
+        }
+
+        return numStones;
+    }
+
+    JitterBufferParams params;
+    JitterBufferStats stats;
+    RigidBody prototype;
+    Entry * entries;
+    Sample * samples;
+    double renderTime;
+    double clockOffset;
+    bool hasRenderTime;
+    bool hasClockOffset;
+};
+
+#endif
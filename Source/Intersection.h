@@ -79,6 +79,53 @@ inline bool IntersectRayBiconvex_LocalSpace( vec3f rayStart,
     return false;
 }
 
+/*
+    Ray vs. biconvex by sphere tracing the signed distance function. Unlike
+    "IntersectRayBiconvex_LocalSpace" this sees the bevel. The ray is first
+    clipped to the bounding sphere, then each step advances by the distance
+    to the surface, which can never step through it.
+*/
+
+inline bool IntersectRayBiconvex_SphereTrace_LocalSpace( vec3f rayStart, 
+                                                         vec3f rayDirection, 
+                                                         const Biconvex & biconvex,
+                                                         float & t, 
+                                                         vec3f & point, 
+                                                         vec3f & normal,
+                                                         int maxSteps = 64,
+                                                         float epsilon = 0.0001f )
+{
+    const float boundingSphereRadius = biconvex.GetBoundingSphereRadius();
+    const float boundingSphereRadiusSquared = boundingSphereRadius * boundingSphereRadius;
+
+    t = 0.0f;
+
+    if ( length_squared( rayStart ) > boundingSphereRadiusSquared )
+    {
+        if ( !IntersectRaySphere( rayStart, rayDirection, vec3f(0,0,0), boundingSphereRadius, boundingSphereRadiusSquared, t ) )
+            return false;
+    }
+
+    const float t_max = t + 2 * boundingSphereRadius;
+
+    for ( int i = 0; i < maxSteps; ++i )
+    {
+        point = rayStart + rayDirection * t;
+
+        const float distance = BiconvexSignedDistance_LocalSpace( point, biconvex, normal );
+
+        if ( distance < epsilon )
+            return i > 0 || distance > -epsilon;        // one sided: no hit if the ray starts inside
+
+        t += distance;
+
+        if ( t > t_max )
+            return false;
+    }
+
+    return false;
+}
+
 inline float IntersectRayStone( const Biconvex & biconvex, 
                                 const RigidBodyTransform & biconvexTransform,
                                 vec3f rayStart, 
@@ -86,8 +133,8 @@ inline float IntersectRayStone( const Biconvex & biconvex,
                                 vec3f & point, 
                                 vec3f & normal )
 {
-    vec3f local_rayStart = TransformPoint( biconvexTransform.worldToLocal, rayStart );
-    vec3f local_rayDirection = TransformVector( biconvexTransform.worldToLocal, rayDirection );
+    vec3f local_rayStart = TransformPointWorldToLocal( biconvexTransform, rayStart );
+    vec3f local_rayDirection = TransformVectorWorldToLocal( biconvexTransform, rayDirection );
     
     vec3f local_point, local_normal;
 
@@ -102,8 +149,8 @@ inline float IntersectRayStone( const Biconvex & biconvex,
 
     if ( result )
     {
-        point = TransformPoint( biconvexTransform.localToWorld, local_point );
-        normal = TransformVector( biconvexTransform.localToWorld, local_normal );
+        point = TransformPointLocalToWorld( biconvexTransform, local_point );
+        normal = TransformVectorLocalToWorld( biconvexTransform, local_normal );
         return t;
     }
 
@@ -234,7 +281,6 @@ inline bool IntersectStoneBoard( const Board & board,
         numAxes = 1;
         axis[0].d = t;
         axis[0].normal = vec3f(0,0,1);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[0].normal, axis[0].s1, axis[0].s2 );
     }
     else if ( region == STONE_BOARD_REGION_LeftSide )
     {
@@ -243,17 +289,14 @@ inline bool IntersectStoneBoard( const Board & board,
         // primary
         axis[0].d = t;
         axis[0].normal = vec3f(0,0,1);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[0].normal, axis[0].s1, axis[0].s2 );
 
         // side
         axis[1].d = w;
         axis[1].normal = vec3f(-1,0,0);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[1].normal, axis[1].s1, axis[1].s2 );
 
         // edge
         axis[2].normal = vec3f( -0.70710,0,+0.70710 );
         axis[2].d = dot( vec3f( -w, 0, t ), axis[2].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[2].normal, axis[2].s1, axis[2].s2 );
     }
     else if ( region == STONE_BOARD_REGION_RightSide )
     {
@@ -262,17 +305,14 @@ inline bool IntersectStoneBoard( const Board & board,
         // primary
         axis[0].d = t;
         axis[0].normal = vec3f(0,0,1);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[0].normal, axis[0].s1, axis[0].s2 );
 
         // side
         axis[1].d = w;
         axis[1].normal = vec3f(1,0,0);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[1].normal, axis[1].s1, axis[1].s2 );
 
         // edge
         axis[2].normal = vec3f( +0.70710,0,+0.70710 );
         axis[2].d = dot( vec3f( w, 0, t ), axis[2].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[2].normal, axis[2].s1, axis[2].s2 );
     }
     else if ( region == STONE_BOARD_REGION_TopSide )
     {
@@ -281,17 +321,14 @@ inline bool IntersectStoneBoard( const Board & board,
         // primary
         axis[0].d = t;
         axis[0].normal = vec3f(0,0,1);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[0].normal, axis[0].s1, axis[0].s2 );
 
         // side
         axis[1].d = h;
         axis[1].normal = vec3f(0,1,0);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[1].normal, axis[1].s1, axis[1].s2 );
 
         // edge
         axis[2].normal = vec3f( 0,+0.70710,+0.70710 );
         axis[2].d = dot( vec3f( 0, h, t ), axis[2].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[2].normal, axis[2].s1, axis[2].s2 );
     }
     else if ( region == STONE_BOARD_REGION_BottomSide )
     {
@@ -300,17 +337,14 @@ inline bool IntersectStoneBoard( const Board & board,
         // primary
         axis[0].d = t;
         axis[0].normal = vec3f(0,0,1);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[0].normal, axis[0].s1, axis[0].s2 );
 
         // side
         axis[1].d = h;
         axis[1].normal = vec3f(0,-1,0);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[1].normal, axis[1].s1, axis[1].s2 );
 
         // edge
         axis[2].normal = vec3f( 0,-0.70710,+0.70710 );
         axis[2].d = dot( vec3f( 0, -h, t ), axis[2].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[2].normal, axis[2].s1, axis[2].s2 );
     }
     else if ( region == STONE_BOARD_REGION_BottomLeftCorner )
     {
@@ -319,37 +353,30 @@ inline bool IntersectStoneBoard( const Board & board,
         // primary
         axis[0].d = t;
         axis[0].normal = vec3f(0,0,1);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[0].normal, axis[0].s1, axis[0].s2 );
 
         // left side
         axis[1].d = w;
         axis[1].normal = vec3f(-1,0,0);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[1].normal, axis[1].s1, axis[1].s2 );
 
         // left edge
         axis[2].normal = vec3f( -0.70710,0,+0.70710 );
         axis[2].d = dot( vec3f( -w, -h, t ), axis[2].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[2].normal, axis[2].s1, axis[2].s2 );
 
         // bottom side
         axis[3].d = h;
         axis[3].normal = vec3f(0,-1,0);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[3].normal, axis[3].s1, axis[3].s2 );
 
         // bottom edge
         axis[4].normal = vec3f( 0,-0.70710,+0.70710 );
         axis[4].d = dot( vec3f( -w, -h, t ), axis[4].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[4].normal, axis[4].s1, axis[4].s2 );
 
         // bottom-left corner edge (vertical)
         axis[5].normal = vec3f( -0.70710,-0.70710, 0 );
         axis[5].d = dot( vec3f( -w, -h, t ), axis[5].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[5].normal, axis[5].s1, axis[5].s2 );
 
         // bottom-left corner
         axis[6].normal = vec3f( -0.577271, -0.577271, 0.577271 );
         axis[6].d = dot( vec3f( -w, -h, t ), axis[6].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[6].normal, axis[6].s1, axis[6].s2 );
     }
     else if ( region == STONE_BOARD_REGION_BottomRightCorner )
     {
@@ -358,37 +385,30 @@ inline bool IntersectStoneBoard( const Board & board,
         // primary
         axis[0].d = t;
         axis[0].normal = vec3f(0,0,1);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[0].normal, axis[0].s1, axis[0].s2 );
 
         // right side
         axis[1].d = w;
         axis[1].normal = vec3f(1,0,0);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[1].normal, axis[1].s1, axis[1].s2 );
 
         // right edge
         axis[2].normal = vec3f( +0.70710,0,+0.70710 );
         axis[2].d = dot( vec3f( w, 0, t ), axis[2].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[2].normal, axis[2].s1, axis[2].s2 );
 
         // bottom side
         axis[3].d = h;
         axis[3].normal = vec3f(0,-1,0);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[3].normal, axis[3].s1, axis[3].s2 );
 
         // bottom edge
         axis[4].normal = vec3f( 0,-0.70710,+0.70710 );
         axis[4].d = dot( vec3f( 0, -h, t ), axis[4].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[4].normal, axis[4].s1, axis[4].s2 );
 
         // bottom-right corner edge (vertical)
         axis[5].normal = vec3f( 0.70710,-0.70710, 0 );
         axis[5].d = dot( vec3f( w, -h, t ), axis[5].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[5].normal, axis[5].s1, axis[5].s2 );
 
         // bottom-right corner
         axis[6].normal = vec3f( 0.577271, -0.577271, 0.577271 );
         axis[6].d = dot( vec3f( w, -h, t ), axis[6].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[6].normal, axis[6].s1, axis[6].s2 );
     }
     else if ( region == STONE_BOARD_REGION_TopLeftCorner )
     {
@@ -397,37 +417,30 @@ inline bool IntersectStoneBoard( const Board & board,
         // primary
         axis[0].d = t;
         axis[0].normal = vec3f(0,0,1);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[0].normal, axis[0].s1, axis[0].s2 );
 
         // left side
         axis[1].d = w;
         axis[1].normal = vec3f(-1,0,0);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[1].normal, axis[1].s1, axis[1].s2 );
 
         // left edge
         axis[2].normal = vec3f( -0.70710,0,+0.70710 );
         axis[2].d = dot( vec3f( -w, 0, t ), axis[2].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[2].normal, axis[2].s1, axis[2].s2 );
 
         // top side
         axis[3].d = h;
         axis[3].normal = vec3f(0,1,0);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[3].normal, axis[3].s1, axis[3].s2 );
 
         // top edge
         axis[4].normal = vec3f( 0,0.70710,+0.70710 );
         axis[4].d = dot( vec3f( 0, h, t ), axis[4].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[4].normal, axis[4].s1, axis[4].s2 );
 
         // top-left corner edge (vertical)
         axis[5].normal = vec3f( -0.70710,0.70710,0 );
         axis[5].d = dot( vec3f( -w, h, t ), axis[5].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[5].normal, axis[5].s1, axis[5].s2 );
 
         // top-left corner
         axis[6].normal = vec3f( -0.577271, 0.577271, 0.577271 );
         axis[6].d = dot( vec3f( -w, h, t ), axis[6].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[6].normal, axis[6].s1, axis[6].s2 );
     }
     else if ( region == STONE_BOARD_REGION_TopRightCorner )
     {
@@ -436,43 +449,58 @@ inline bool IntersectStoneBoard( const Board & board,
         // primary
         axis[0].d = t;
         axis[0].normal = vec3f(0,0,1);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[0].normal, axis[0].s1, axis[0].s2 );
 
         // right side
         axis[1].d = w;
         axis[1].normal = vec3f(1,0,0);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[1].normal, axis[1].s1, axis[1].s2 );
 
         // right edge
         axis[2].normal = vec3f( 0.70710,0,+0.70710 );
         axis[2].d = dot( vec3f( w, 0, t ), axis[2].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[2].normal, axis[2].s1, axis[2].s2 );
 
         // top side
         axis[3].d = h;
         axis[3].normal = vec3f(0,1,0);
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[3].normal, axis[3].s1, axis[3].s2 );
 
         // top edge
         axis[4].normal = vec3f( 0,0.70710,0.70710 );
         axis[4].d = dot( vec3f( 0, h, t ), axis[4].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[4].normal, axis[4].s1, axis[4].s2 );
 
         // top-left corner edge (vertical)
         axis[5].normal = vec3f( 0.70710,0.70710,0 );
         axis[5].d = dot( vec3f( w, h, t ), axis[5].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[5].normal, axis[5].s1, axis[5].s2 );
 
         // top-right corner
         axis[6].normal = vec3f( 0.577271, 0.577271, 0.577271 );
         axis[6].d = dot( vec3f( w, h, t ), axis[6].normal );
-        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, axis[6].normal, axis[6].s1, axis[6].s2 );
     }
 
     // not colliding if no axes defined
     if ( numAxes == 0 )
         return false;
 
+    // support of the stone along each axis, four axes at a time
+
+    for ( int i = 0; i < numAxes; i += 4 )
+    {
+        vec3f normals[4];
+        for ( int j = 0; j < 4; ++j )
+            normals[j] = axis[ i + j < numAxes ? i + j : numAxes - 1 ].normal;
+
+        simd4f s1, s2;
+        BiconvexSupport_WorldSpace( biconvex, biconvexPosition, biconvexUp, vec3x4f( normals ), s1, s2 );
+
+        float support_s1[4], support_s2[4];
+        simd4f_ustore4( s1, support_s1 );
+        simd4f_ustore4( s2, support_s2 );
+
+        for ( int j = 0; j < 4 && i + j < numAxes; ++j )
+        {
+            axis[i+j].s1 = support_s1[j];
+            axis[i+j].s2 = support_s2[j];
+        }
+    }
+
     // not colliding if any axis separates the stone and the board
     for ( int i = 0; i < numAxes; ++i )
     {
@@ -0,0 +1,444 @@
+#ifndef LOOPBACK_H
+#define LOOPBACK_H
+
+#include "World.h"
+#include "Snapshot.h"
+#include "Replication.h"
+#include "Network.h"
+#include "Interpolation.h"
+#include "Priority.h"
+
+/*
+    Loopback.
+
+    A server world and a number of client worlds in one process, talking
+    through the network simulator. The server steps its world and sends
+    each client a snapshot, delta encoded against whatever that client
+    last acked. Clients decode snapshots, apply the newest one to their
+    world and ack it back. Every snapshot decoded also goes into that
+    client's jitter buffer, for drawing smoothly (see Interpolation.h).
+
+    With "priorityUpdates" set the server instead sends each client a state
+    update of its highest priority stones that fits the byte budget (see
+    Priority.h), and clients step their own worlds to fill in the rest.
+    Nothing is acked and the jitter buffers are not used in this mode.
+
+    This is the harness for developing and load testing replication on
+    one machine: it reports bytes per second in both directions and how
+    stale each client's view of the server is, under whatever latency,
+    jitter, loss and duplication the simulator is set to.
+
+    Server to client packet:
+
+        [32 bits] server frame the snapshot was taken on
+        snapshot packet (see Replication.h), or state update (see Priority.h)
+
+    Client to server packet:
+
+        [16 bits] ack
+*/
+
+struct LoopbackParams
+{
+    LoopbackParams()
+    {
+        numClients = 4;
+        boardSize = 19;
+        stoneSize = STONE_SIZE_40;
+        maxStones = 19 * 19;
+        tickRate = 60;
+        snapshotRate = 60;
+        priorityUpdates = false;
+    }
+
+    int numClients;
+    int boardSize;
+    StoneSize stoneSize;
+    int maxStones;
+    int tickRate;                   // server ticks per second
+    int snapshotRate;               // snapshots sent per second, must divide the tick rate
+    WorldParams worldParams;
+    NetworkSimulatorParams networkParams;
+    JitterBufferParams jitterParams;
+    bool priorityUpdates;           // send budgeted state updates instead of snapshots
+    PriorityParams priorityParams;
+};
+
+struct LoopbackStats
+{
+    LoopbackStats()
+    {
+        frames = 0;
+        clientFrames = 0;
+        totalStaleness = 0.0;
+        maxStaleness = 0.0f;
+        snapshotsApplied = 0;
+        snapshotsRejected = 0;
+    }
+
+    float GetAverageStaleness() const
+    {
+        return clientFrames ? float( totalStaleness / clientFrames ) : 0.0f;
+    }
+
+    uint64_t frames;
+    uint64_t clientFrames;
+    double totalStaleness;          // seconds the client view is behind the server, summed over clients and frames
+    float maxStaleness;
+    uint64_t snapshotsApplied;
+    uint64_t snapshotsRejected;     // baseline missing or malformed
+};
+
+class Loopback
+{
+public:
+
+    Loopback()
+    {
+        numClients = 0;
+        frame = 0;
+        arenas = NULL;
+        clients = NULL;
+        senders = NULL;
+        receivers = NULL;
+        clientFrames = NULL;
+        jitterBuffers = NULL;
+        accumulators = NULL;
+    }
+
+    ~Loopback()
+    {
+        Free();
+    }
+
+    bool Initialize( const LoopbackParams & loopbackParams = LoopbackParams() )
+    {
+        assert( loopbackParams.numClients > 0 );
+        assert( loopbackParams.snapshotRate > 0 );
+        assert( ( loopbackParams.tickRate % loopbackParams.snapshotRate ) == 0 );
+        assert( loopbackParams.maxStones <= MaxSnapshotStones );
+        assert( loopbackParams.maxStones <= loopbackParams.jitterParams.maxStones );
+
+        Free();
+
+        params = loopbackParams;
+        numClients = params.numClients;
+        frame = 0;
+
+        arenas = new Arena[numClients+1];
+        clients = new World[numClients];
+        senders = new SnapshotSender[numClients];
+        receivers = new SnapshotReceiver[numClients];
+        clientFrames = new int64_t[numClients];
+        jitterBuffers = new JitterBuffer[numClients];
+        accumulators = new PriorityAccumulator[numClients];
+
+        const size_t worldBytes = World::GetMemoryRequired( params.maxStones );
+
+        for ( int i = 0; i <= numClients; ++i )
+        {
+            arenas[i].Initialize( worldBytes );
+            World & world = i == 0 ? server : clients[i-1];
+            if ( !world.Initialize( arenas[i], params.boardSize, params.stoneSize, params.maxStones, params.worldParams ) )
+            {
+                Free();
+                return false;
+            }
+        }
+
+        for ( int i = 0; i < numClients; ++i )
+        {
+            clientFrames[i] = -1;
+            jitterBuffers[i].Initialize( server.GetStone().rigidBody, params.jitterParams );
+            accumulators[i].Initialize( params.maxStones, params.priorityParams );
+        }
+
+        snapshotParams.Initialize( server.GetBoard() );
+
+        // node 0 is the server, client i is node i+1
+
+        simulator.Initialize( numClients + 1, params.networkParams );
+
+        stats = LoopbackStats();
+
+        return true;
+    }
+
+    void Free()
+    {
+        delete [] accumulators;
+        delete [] jitterBuffers;
+        delete [] clientFrames;
+        delete [] receivers;
+        delete [] senders;
+        delete [] clients;
+        delete [] arenas;
+        accumulators = NULL;
+        jitterBuffers = NULL;
+        clientFrames = NULL;
+        receivers = NULL;
+        senders = NULL;
+        clients = NULL;
+        arenas = NULL;
+        numClients = 0;
+        simulator.Free();
+    }
+
+    void Update()
+    {
+        const float dt = 1.0f / params.tickRate;
+
+        server.Step( dt );
+        frame++;
+
+        if ( params.priorityUpdates )
+        {
+            for ( int i = 0; i < numClients; ++i )
+            {
+                accumulators[i].Accumulate( server, dt );
+                clients[i].Step( dt );
+            }
+        }
+
+        simulator.AdvanceTime( frame * double( dt ) );
+
+        if ( ( frame % ( params.tickRate / params.snapshotRate ) ) == 0 )
+        {
+            if ( params.priorityUpdates )
+                SendStateUpdates();
+            else
+                SendSnapshots();
+        }
+
+        ReceiveSnapshots();
+
+        ReceiveAcks();
+
+        // staleness is how far behind the server frame each client's newest snapshot is
+
+        stats.frames++;
+        for ( int i = 0; i < numClients; ++i )
+        {
+            if ( clientFrames[i] < 0 )
+                continue;
+            const float staleness = ( frame - clientFrames[i] ) * dt;
+            stats.clientFrames++;
+            stats.totalStaleness += staleness;
+            if ( staleness > stats.maxStaleness )
+                stats.maxStaleness = staleness;
+        }
+    }
+
+    World & GetServer() { return server; }
+
+    World & GetClient( int index ) { assert( index >= 0 && index < numClients ); return clients[index]; }
+
+    int GetNumClients() const { return numClients; }
+
+    int64_t GetFrame() const { return frame; }
+
+    // server frame of the newest snapshot applied on this client, or -1 if none yet
+
+    int64_t GetClientFrame( int index ) const { assert( index >= 0 && index < numClients ); return clientFrames[index]; }
+
+    // the client's view of the server world, interpolated for drawing now. returns the number of stones
+
+    int InterpolateClient( int index, InterpolatedStone * stones, PlayoutMode * playoutMode = NULL )
+    {
+        assert( index >= 0 && index < numClients );
+        return jitterBuffers[index].Interpolate( simulator.GetTime(), stones, playoutMode );
+    }
+
+    const JitterBuffer & GetJitterBuffer( int index ) const { assert( index >= 0 && index < numClients ); return jitterBuffers[index]; }
+
+    const PriorityAccumulator & GetPriorityAccumulator( int index ) const { assert( index >= 0 && index < numClients ); return accumulators[index]; }
+
+    const SnapshotParams & GetSnapshotParams() const { return snapshotParams; }
+
+    NetworkSimulator & GetSimulator() { return simulator; }
+
+    const LoopbackStats & GetStats() const { return stats; }
+
+    // server to client bytes per second, summed over every client
+
+    float GetServerBytesPerSecond() const
+    {
+        const double time = simulator.GetTime();
+        return time > 0 ? float( simulator.GetStats( 0 ).bytesSent / time ) : 0.0f;
+    }
+
+    // client to server bytes per second, summed over every client
+
+    float GetClientBytesPerSecond() const
+    {
+        const double time = simulator.GetTime();
+        uint64_t bytes = 0;
+        for ( int i = 0; i < numClients; ++i )
+            bytes += simulator.GetStats( i + 1 ).bytesSent;
+        return time > 0 ? float( bytes / time ) : 0.0f;
+    }
+
+    void ResetStats()
+    {
+        stats = LoopbackStats();
+        simulator.ResetStats();
+    }
+
+private:
+
+    Loopback( const Loopback & other );
+    Loopback & operator = ( const Loopback & other );
+
+    void SendSnapshots()
+    {
+        CaptureSnapshot( snapshotParams, server, 0, snapshot );
+
+        for ( int i = 0; i < numClients; ++i )
+        {
+            BitWriter writer( packet, sizeof( packet ) );
+            writer.WriteBits( uint32_t( frame ), 32 );
+            const bool ok = senders[i].WritePacket( writer, snapshotParams, snapshot );
+            assert( ok );
+            if ( !ok )
+                continue;
+            writer.FlushBits();
+            simulator.SendPacket( 0, i + 1, packet, writer.GetBytesWritten() );
+        }
+    }
+
+    void SendStateUpdates()
+    {
+        for ( int i = 0; i < numClients; ++i )
+        {
+            accumulators[i].BuildStateUpdate( snapshotParams, server, update );
+
+            BitWriter writer( packet, sizeof( packet ) );
+            writer.WriteBits( uint32_t( frame ), 32 );
+            const bool ok = WriteStateUpdate( writer, snapshotParams, update );
+            assert( ok );
+            if ( !ok )
+                continue;
+            writer.FlushBits();
+            simulator.SendPacket( 0, i + 1, packet, writer.GetBytesWritten() );
+        }
+    }
+
+    void ReceiveSnapshots()
+    {
+        for ( int i = 0; i < numClients; ++i )
+        {
+            SnapshotReceiver & receiver = receivers[i];
+
+            bool received = false;
+
+            int from;
+            int bytes;
+            while ( ( bytes = simulator.ReceivePacket( i + 1, packet, sizeof( packet ), from ) ) > 0 )
+            {
+                BitReader reader( packet, bytes );
+                const int64_t snapshotFrame = reader.ReadBits( 32 );
+
+                if ( params.priorityUpdates )
+                {
+                    if ( !ReadStateUpdate( reader, snapshotParams, update ) )
+                    {
+                        stats.snapshotsRejected++;
+                        continue;
+                    }
+
+                    // IMPORTANT: an update older than one already applied would move its stones back in time
+
+                    if ( snapshotFrame <= clientFrames[i] )
+                        continue;
+
+                    if ( !ApplyStateUpdate( snapshotParams, update, clients[i] ) )
+                    {
+                        stats.snapshotsRejected++;
+                        continue;
+                    }
+
+                    clientFrames[i] = snapshotFrame;
+                    stats.snapshotsApplied++;
+                    continue;
+                }
+
+                if ( !receiver.ReadPacket( reader, snapshotParams ) )
+                {
+                    stats.snapshotsRejected++;
+                    continue;
+                }
+
+                // IMPORTANT: a snapshot with more stones than the client can hold can be neither drawn nor applied
+
+                if ( receiver.GetReceived().numStones > clients[i].GetMaxBodies() )
+                {
+                    stats.snapshotsRejected++;
+                    continue;
+                }
+
+                received = true;
+
+                jitterBuffers[i].AddSnapshot( simulator.GetTime(), snapshotFrame / double( params.tickRate ), snapshotParams, receiver.GetReceived() );
+
+                // late and duplicate packets can still be baselines, but never move the client back in time
+
+                if ( snapshotFrame > clientFrames[i] )
+                {
+                    const bool applied = ApplySnapshot( snapshotParams, receiver.GetReceived(), clients[i] );
+                    assert( applied );
+                    if ( !applied )
+                        continue;
+                    clientFrames[i] = snapshotFrame;
+                    stats.snapshotsApplied++;
+                }
+            }
+
+            uint16_t ack;
+            if ( received && receiver.GetAck( ack ) )
+            {
+                uint8_t ackPacket[4];
+                BitWriter writer( ackPacket, sizeof( ackPacket ) );
+                writer.WriteBits( ack, 16 );
+                writer.FlushBits();
+                simulator.SendPacket( i + 1, 0, ackPacket, writer.GetBytesWritten() );
+            }
+        }
+    }
+
+    void ReceiveAcks()
+    {
+        int from;
+        int bytes;
+        while ( ( bytes = simulator.ReceivePacket( 0, packet, sizeof( packet ), from ) ) > 0 )
+        {
+            BitReader reader( packet, bytes );
+            const uint16_t ack = reader.ReadBits( 16 );
+            if ( !reader.IsOverflow() && from >= 1 && from <= numClients )
+                senders[from-1].ProcessAck( ack );
+        }
+    }
+
+    LoopbackParams params;
+    SnapshotParams snapshotParams;
+    LoopbackStats stats;
+
+    int numClients;
+    int64_t frame;
+
+    Arena * arenas;
+    World server;
+    World * clients;
+    SnapshotSender * senders;
+    SnapshotReceiver * receivers;
+    int64_t * clientFrames;
+    JitterBuffer * jitterBuffers;
+    PriorityAccumulator * accumulators;
+
+    NetworkSimulator simulator;
+
+    Snapshot snapshot;
+    StateUpdate update;
+    uint8_t packet[MaxPacketSize];
+};
+
+#endif
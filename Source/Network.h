@@ -0,0 +1,295 @@
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+    Network simulator.
+
+    An in-memory stand in for a UDP socket shared by a set of nodes in one
+    process. Packets sent between nodes are held back until their delivery
+    time, and on the way can be delayed, jittered (which reorders them),
+    dropped or duplicated. Nothing is allocated after "Initialize": every
+    packet in flight lives in one of a fixed number of slots, and a send
+    with every slot taken is dropped and counted as an overflow.
+
+    Random numbers come from a seeded generator owned by the simulator, so
+    a run with the same seed and the same sends drops the same packets.
+*/
+
+const int MaxPacketSize = 8 * 1024;
+
+struct NetworkSimulatorParams
+{
+    NetworkSimulatorParams()
+    {
+        latency = 0.0f;
+        jitter = 0.0f;
+        packetLoss = 0.0f;
+        duplicates = 0.0f;
+        maxPacketsInFlight = 1024;
+        seed = 1;
+    }
+
+    float latency;                  // seconds, one way
+    float jitter;                   // seconds, +/- added to latency per packet
+    float packetLoss;               // percent of packets dropped
+    float duplicates;               // percent of packets delivered twice
+    int maxPacketsInFlight;
+    uint32_t seed;
+};
+
+struct NetworkStats
+{
+    NetworkStats()
+    {
+        packetsSent = 0;
+        packetsReceived = 0;
+        packetsLost = 0;
+        packetsDuplicated = 0;
+        packetsOverflowed = 0;
+        bytesSent = 0;
+        bytesReceived = 0;
+        totalLatency = 0.0;
+        maxLatency = 0.0f;
+    }
+
+    float GetAverageLatency() const
+    {
+        return packetsReceived ? float( totalLatency / packetsReceived ) : 0.0f;
+    }
+
+    uint64_t packetsSent;
+    uint64_t packetsReceived;
+    uint64_t packetsLost;
+    uint64_t packetsDuplicated;
+    uint64_t packetsOverflowed;
+    uint64_t bytesSent;
+    uint64_t bytesReceived;
+    double totalLatency;
+    float maxLatency;
+};
+
+class NetworkSimulator
+{
+public:
+
+    NetworkSimulator()
+    {
+        packets = NULL;
+        numNodes = 0;
+        stats = NULL;
+        time = 0.0;
+        state = 1;
+    }
+
+    ~NetworkSimulator()
+    {
+        Free();
+    }
+
+    void Initialize( int nodes, const NetworkSimulatorParams & simulatorParams = NetworkSimulatorParams() )
+    {
+        assert( nodes > 0 );
+        assert( simulatorParams.maxPacketsInFlight > 0 );
+
+        Free();
+
+        params = simulatorParams;
+        numNodes = nodes;
+        packets = new Packet[params.maxPacketsInFlight];
+        stats = new NetworkStats[numNodes];
+        time = 0.0;
+        state = params.seed ? params.seed : 1;
+
+        for ( int i = 0; i < params.maxPacketsInFlight; ++i )
+            packets[i].used = false;
+    }
+
+    void Free()
+    {
+        delete [] packets;
+        delete [] stats;
+        packets = NULL;
+        stats = NULL;
+        numNodes = 0;
+    }
+
+    // conditions can be changed at any time. packets already in flight keep their delivery time
+
+    void SetParams( const NetworkSimulatorParams & simulatorParams )
+    {
+        assert( simulatorParams.maxPacketsInFlight == params.maxPacketsInFlight );
+        params = simulatorParams;
+    }
+
+    void SendPacket( int from, int to, const uint8_t * data, int bytes )
+    {
+        assert( from >= 0 && from < numNodes );
+        assert( to >= 0 && to < numNodes );
+        assert( bytes > 0 && bytes <= MaxPacketSize );
+
+        NetworkStats & sender = stats[from];
+        sender.packetsSent++;
+        sender.bytesSent += bytes;
+
+        if ( RandomPercent() < params.packetLoss )
+        {
+            sender.packetsLost++;
+            return;
+        }
+
+        const int copies = RandomPercent() < params.duplicates ? 2 : 1;
+        if ( copies > 1 )
+            sender.packetsDuplicated++;
+
+        for ( int i = 0; i < copies; ++i )
+        {
+            Packet * packet = FindFreePacket();
+            if ( !packet )
+            {
+                sender.packetsOverflowed++;
+                return;
+            }
+
+            float delay = params.latency + ( RandomFloat() * 2 - 1 ) * params.jitter;
+            if ( delay < 0 )
+                delay = 0;
+
+            packet->used = true;
+            packet->from = from;
+            packet->to = to;
+            packet->sendTime = time;
+            packet->deliveryTime = time + delay;
+            packet->bytes = bytes;
+            memcpy( packet->data, data, bytes );
+        }
+    }
+
+    // returns the size of the next packet due for this node and copies it out, or zero if there are none
+
+    int ReceivePacket( int to, uint8_t * data, int maxBytes, int & from )
+    {
+        assert( to >= 0 && to < numNodes );
+
+        // IMPORTANT: deliver the earliest due packet first, so jitter is the only source of reordering
+
+        Packet * next = NULL;
+        for ( int i = 0; i < params.maxPacketsInFlight; ++i )
+        {
+            Packet & packet = packets[i];
+            if ( packet.used && packet.to == to && packet.deliveryTime <= time )
+            {
+                if ( !next || packet.deliveryTime < next->deliveryTime )
+                    next = &packet;
+            }
+        }
+
+        if ( !next )
+            return 0;
+
+        next->used = false;
+
+        if ( next->bytes > maxBytes )
+            return 0;
+
+        memcpy( data, next->data, next->bytes );
+        from = next->from;
+
+        NetworkStats & receiver = stats[to];
+        const float latency = float( time - next->sendTime );
+        receiver.packetsReceived++;
+        receiver.bytesReceived += next->bytes;
+        receiver.totalLatency += latency;
+        if ( latency > receiver.maxLatency )
+            receiver.maxLatency = latency;
+
+        return next->bytes;
+    }
+
+    void AdvanceTime( double t )
+    {
+        time = t;
+    }
+
+    double GetTime() const { return time; }
+
+    int GetNumNodes() const { return numNodes; }
+
+    int GetNumPacketsInFlight() const
+    {
+        int count = 0;
+        for ( int i = 0; i < params.maxPacketsInFlight; ++i )
+            count += packets[i].used ? 1 : 0;
+        return count;
+    }
+
+    const NetworkStats & GetStats( int node ) const
+    {
+        assert( node >= 0 && node < numNodes );
+        return stats[node];
+    }
+
+    void ResetStats()
+    {
+        for ( int i = 0; i < numNodes; ++i )
+            stats[i] = NetworkStats();
+    }
+
+private:
+
+    NetworkSimulator( const NetworkSimulator & other );
+    NetworkSimulator & operator = ( const NetworkSimulator & other );
+
+    struct Packet
+    {
+        bool used;
+        int from;
+        int to;
+        double sendTime;
+        double deliveryTime;
+        int bytes;
+        uint8_t data[MaxPacketSize];
+    };
+
+    Packet * FindFreePacket()
+    {
+        for ( int i = 0; i < params.maxPacketsInFlight; ++i )
+        {
+            if ( !packets[i].used )
+                return &packets[i];
+        }
+        return NULL;
+    }
+
+    // xorshift32. good enough for dropping packets and cheap to reproduce
+
+    uint32_t Random()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    float RandomFloat()
+    {
+        return ( Random() >> 8 ) * ( 1.0f / 16777216.0f );
+    }
+
+    float RandomPercent()
+    {
+        return RandomFloat() * 100.0f;
+    }
+
+    NetworkSimulatorParams params;
+    Packet * packets;
+    int numNodes;
+    NetworkStats * stats;
+    double time;
+    uint32_t state;
+};
+
+#endif
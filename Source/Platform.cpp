@@ -5,6 +5,12 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#if PLATFORM != PLATFORM_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #define GL_SILENCE_DEPRECATION 1
 
 #if PLATFORM == PLATFORM_MAC
@@ -19,6 +25,14 @@
 #include <Carbon/Carbon.h>
 #endif
 
+#if PLATFORM == PLATFORM_LINUX && defined( HEADLESS )
+#define GL_GLEXT_PROTOTYPES 1
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
 #if PLATFORM == PLATFORM_UNIX || PLATFORM == PLATFORM_LINUX
 #include <time.h>
 #include <errno.h>
@@ -37,46 +51,50 @@ namespace platform
 	
 	WorkerThread::WorkerThread()
 	{
-		#ifdef MULTITHREADED
 		thread = 0;
-		#endif
 	}
 
 	WorkerThread::~WorkerThread()
 	{
-		#ifdef MULTITHREADED
 		thread = 0;
-		#endif
 	}
 
 	bool WorkerThread::Start()
 	{
 		#ifdef MULTITHREADED
 
-			pthread_attr_t attr;	
-			pthread_attr_init( &attr );
-			pthread_attr_setstacksize( &attr, THREAD_STACK_SIZE );
-			if ( pthread_create( &thread, &attr, StaticRun, (void*)this ) != 0 )
-			{
-				printf( "error: pthread_create failed\n" );
-				return false;
-			}
+			return StartThread();
 	
 		#else
 	
 			Run();
+
+			return true;
 		
 		#endif
-	
+	}
+
+	bool WorkerThread::StartThread()
+	{
+		pthread_attr_t attr;	
+		pthread_attr_init( &attr );
+		pthread_attr_setstacksize( &attr, THREAD_STACK_SIZE );
+		const bool created = pthread_create( &thread, &attr, StaticRun, (void*)this ) == 0;
+		pthread_attr_destroy( &attr );
+		if ( !created )
+		{
+			thread = 0;
+			printf( "error: pthread_create failed\n" );
+			return false;
+		}
 		return true;
 	}
 
 	bool WorkerThread::Join()
 	{
-		#ifdef MULTITHREADED
 		if ( thread )
 			pthread_join( thread, NULL );
-		#endif
+		thread = 0;
 		return true;
 	}
 
@@ -87,6 +105,36 @@ namespace platform
 		return NULL;
 	}
 
+	Semaphore::Semaphore( int initialCount )
+	{
+		count = initialCount;
+		pthread_mutex_init( &mutex, NULL );
+		pthread_cond_init( &condition, NULL );
+	}
+
+	Semaphore::~Semaphore()
+	{
+		pthread_cond_destroy( &condition );
+		pthread_mutex_destroy( &mutex );
+	}
+
+	void Semaphore::Signal()
+	{
+		pthread_mutex_lock( &mutex );
+		count++;
+		pthread_cond_signal( &condition );
+		pthread_mutex_unlock( &mutex );
+	}
+
+	void Semaphore::Wait()
+	{
+		pthread_mutex_lock( &mutex );
+		while ( count == 0 )
+			pthread_cond_wait( &condition, &mutex );
+		count--;
+		pthread_mutex_unlock( &mutex );
+	}
+
 #endif
 	
 	// platform independent wait for n seconds
@@ -105,6 +153,74 @@ namespace platform
 		usleep( (int) ( seconds * 1000000.0f ) ); 
 	}
 
+#endif
+
+	// memory mapped files
+
+#if PLATFORM == PLATFORM_WINDOWS
+
+	const uint8_t * MapFile( const char filename[], size_t & size )
+	{
+		FILE * file = fopen( filename, "rb" );
+		if ( !file )
+			return NULL;
+
+		fseek( file, 0, SEEK_END );
+		const long length = ftell( file );
+		fseek( file, 0, SEEK_SET );
+
+		uint8_t * data = length > 0 ? new uint8_t[length] : NULL;
+		if ( data && fread( data, length, 1, file ) != 1 )
+		{
+			delete [] data;
+			data = NULL;
+		}
+
+		fclose( file );
+
+		size = data ? length : 0;
+
+		return data;
+	}
+
+	void UnmapFile( const uint8_t * data, size_t size )
+	{
+		delete [] data;
+	}
+
+#else
+
+	const uint8_t * MapFile( const char filename[], size_t & size )
+	{
+		const int fd = open( filename, O_RDONLY );
+		if ( fd < 0 )
+			return NULL;
+
+		struct stat info;
+		if ( fstat( fd, &info ) != 0 || info.st_size == 0 )
+		{
+			close( fd );
+			return NULL;
+		}
+
+		void * data = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+		close( fd );
+
+		if ( data == MAP_FAILED )
+			return NULL;
+
+		size = info.st_size;
+
+		return (const uint8_t*) data;
+	}
+
+	void UnmapFile( const uint8_t * data, size_t size )
+	{
+		if ( data )
+			munmap( (void*) data, size );
+	}
+
 #endif
 
 #if PLATFORM == PLATFORM_MAC
@@ -166,6 +282,51 @@ namespace platform
 
 #endif
 
+#if PLATFORM == PLATFORM_LINUX
+
+	// high resolution timer (linux)
+
+	static uint64_t GetNanoseconds()
+	{
+		timespec ts;
+		clock_gettime( CLOCK_MONOTONIC, &ts );
+		return uint64_t( ts.tv_sec ) * 1000000000ULL + uint64_t( ts.tv_nsec );
+	}
+
+	Timer::Timer()
+	{
+		reset();
+	}
+
+	void Timer::reset()
+	{
+		_startTime = GetNanoseconds();
+		_deltaTime = _startTime;
+	}
+
+	float Timer::time()
+	{
+		uint64_t counter = GetNanoseconds();
+		return (float) ( 1e-9 * double( counter - _startTime ) );
+	}
+
+	float Timer::delta()
+	{
+		uint64_t counter = GetNanoseconds();
+		float dt = (float) ( 1e-9 * double( counter - _deltaTime ) );
+		_deltaTime = counter;
+		return dt;
+	}
+
+	float Timer::resolution()
+	{
+		timespec ts;
+		clock_getres( CLOCK_MONOTONIC, &ts );
+		return (float) ( ts.tv_sec + 1e-9 * ts.tv_nsec );
+	}
+
+#endif
+
 #if 0
 
 // todo - convert timers for other platforms
@@ -898,4 +1059,211 @@ namespace platform
 
 #endif
 
+#if PLATFORM == PLATFORM_LINUX && defined( HEADLESS )
+
+	/*
+		headless display (linux)
+
+		there is no window. frames render into an offscreen framebuffer
+		object on an EGL context with no surface, so the demos run on
+		servers with no display and no GPU, using mesa's software renderer.
+		with "video" they read back from that framebuffer into the capture
+		pipeline as usual.
+
+		nothing is shown, so "UpdateDisplay" never waits for vsync and the
+		demos run as fast as they can render. nobody can press a key either,
+		so input always says quit: run with "playback" to render a recording.
+	*/
+
+	static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+	static EGLContext eglContext = EGL_NO_CONTEXT;
+	static GLuint framebuffer = 0;
+	static GLuint colorBuffer = 0;
+	static GLuint depthStencilBuffer = 0;
+
+	static EGLDisplay GetHeadlessDisplay()
+	{
+		// mesa's surfaceless platform needs no X server or device. fall back to whatever the default is
+
+		#ifdef EGL_PLATFORM_SURFACELESS_MESA
+		const char * extensions = eglQueryString( EGL_NO_DISPLAY, EGL_EXTENSIONS );
+		if ( extensions && strstr( extensions, "EGL_MESA_platform_surfaceless" ) )
+		{
+			PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+			if ( getPlatformDisplay )
+			{
+				EGLDisplay display = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL );
+				if ( display != EGL_NO_DISPLAY )
+					return display;
+			}
+		}
+		#endif
+
+		return eglGetDisplay( EGL_DEFAULT_DISPLAY );
+	}
+
+	// releases whatever "OpenDisplay" got as far as creating. safe to call at any point
+
+	static void DestroyHeadlessDisplay()
+	{
+		if ( eglContext != EGL_NO_CONTEXT )
+		{
+			if ( framebuffer )
+			{
+				glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+				glDeleteFramebuffers( 1, &framebuffer );
+			}
+			if ( colorBuffer )
+				glDeleteRenderbuffers( 1, &colorBuffer );
+			if ( depthStencilBuffer )
+				glDeleteRenderbuffers( 1, &depthStencilBuffer );
+			eglMakeCurrent( eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+			eglDestroyContext( eglDisplay, eglContext );
+		}
+
+		if ( eglDisplay != EGL_NO_DISPLAY )
+			eglTerminate( eglDisplay );
+
+		framebuffer = 0;
+		colorBuffer = 0;
+		depthStencilBuffer = 0;
+		eglContext = EGL_NO_CONTEXT;
+		eglDisplay = EGL_NO_DISPLAY;
+	}
+
+	void GetDisplayResolution( int & width, int & height )
+	{
+		width = 1920;
+		height = 1080;
+	}
+
+	void HideMouseCursor()
+	{
+	}
+
+	void ShowMouseCursor()
+	{
+	}
+
+	void GetMousePosition( int & x, int & y )
+	{
+		x = 0;
+		y = 0;
+	}
+
+	bool OpenDisplay( const char /*title*/[], int width, int height, int /*bits*/, int /*refresh*/ )
+	{
+		eglDisplay = GetHeadlessDisplay();
+		if ( eglDisplay == EGL_NO_DISPLAY )
+		{
+			printf( "error: no EGL display\n" );
+			return false;
+		}
+
+		EGLint major, minor;
+		if ( !eglInitialize( eglDisplay, &major, &minor ) )
+		{
+			printf( "error: eglInitialize failed\n" );
+			DestroyHeadlessDisplay();
+			return false;
+		}
+
+		// the demos render with fixed function, so this needs desktop GL with the compatibility profile, not GLES
+
+		if ( !eglBindAPI( EGL_OPENGL_API ) )
+		{
+			printf( "error: EGL has no desktop OpenGL\n" );
+			DestroyHeadlessDisplay();
+			return false;
+		}
+
+		const EGLint configAttribs[] =
+		{
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_NONE
+		};
+
+		EGLConfig config;
+		EGLint numConfigs = 0;
+		if ( !eglChooseConfig( eglDisplay, configAttribs, &config, 1, &numConfigs ) || numConfigs == 0 )
+		{
+			printf( "error: eglChooseConfig failed\n" );
+			DestroyHeadlessDisplay();
+			return false;
+		}
+
+		eglContext = eglCreateContext( eglDisplay, config, EGL_NO_CONTEXT, NULL );
+		if ( eglContext == EGL_NO_CONTEXT )
+		{
+			printf( "error: eglCreateContext failed\n" );
+			DestroyHeadlessDisplay();
+			return false;
+		}
+
+		if ( !eglMakeCurrent( eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext ) )
+		{
+			printf( "error: eglMakeCurrent failed (no surfaceless contexts?)\n" );
+			DestroyHeadlessDisplay();
+			return false;
+		}
+
+		// everything renders into this framebuffer, and reads back from it. stencil is for shadow volumes
+
+		glGenRenderbuffers( 1, &colorBuffer );
+		glBindRenderbuffer( GL_RENDERBUFFER, colorBuffer );
+		glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width, height );
+
+		glGenRenderbuffers( 1, &depthStencilBuffer );
+		glBindRenderbuffer( GL_RENDERBUFFER, depthStencilBuffer );
+		glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height );
+
+		glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+		glGenFramebuffers( 1, &framebuffer );
+		glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+		glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer );
+		glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencilBuffer );
+
+		if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE )
+		{
+			printf( "error: offscreen framebuffer is incomplete\n" );
+			DestroyHeadlessDisplay();
+			return false;
+		}
+
+		glViewport( 0, 0, width, height );
+
+		printf( "headless: %s\n", (const char*) glGetString( GL_RENDERER ) );
+
+		return true;
+	}
+
+	void UpdateEvents()
+	{
+	}
+
+	void UpdateDisplay( int /*interval*/ )
+	{
+		// nothing to show, so nothing to wait for. just get the frame started
+
+		glFlush();
+	}
+
+	void CloseDisplay()
+	{
+		printf( "close display\n" );
+
+		DestroyHeadlessDisplay();
+	}
+
+	Input Input::Sample()
+	{
+		Input input;
+		input.quit = true;
+		return input;
+	}
+
+#endif
+
 }
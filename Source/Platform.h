@@ -23,11 +23,17 @@
 #define HAS_OPENGL
 #endif
 
+// linux has no window, only offscreen rendering with EGL for capturing video on servers. link with EGL and GL
+
+#if PLATFORM == PLATFORM_LINUX && defined( HEADLESS )
+#define HAS_OPENGL
+#endif
+
 #ifndef PLATFORM
 #error unknown platform!
 #endif
 
-#if PLATFORM == PLATFORM_MAC
+#if PLATFORM == PLATFORM_MAC || PLATFORM == PLATFORM_LINUX
 #include <pthread.h>
 #endif
 
@@ -109,6 +115,12 @@ namespace platform
 
 	void wait_seconds( float seconds );
 
+	// read only memory mapped files. returns NULL if the file is missing or empty.
+	// on windows the file is read into memory instead
+
+	const uint8_t * MapFile( const char filename[], size_t & size );
+	void UnmapFile( const uint8_t * data, size_t size );
+
 	class Timer
 	{
 	public:
@@ -135,7 +147,8 @@ namespace platform
 		WorkerThread();
 		virtual ~WorkerThread();
 			
-		bool Start();
+		bool Start();					// note: with MULTITHREADED off this runs the task on the calling thread
+		bool StartThread();				// always runs the task on its own thread, eg. for file io
 		bool Join();
 	
 	protected:
@@ -148,6 +161,54 @@ namespace platform
 
 		pthread_t thread;
 	};
+
+	// counting semaphore. "Wait" blocks until the count is above zero, then takes one
+
+	class Semaphore
+	{
+	public:
+
+		Semaphore( int count = 0 );
+		~Semaphore();
+
+		void Signal();
+		void Wait();
+
+	private:
+
+		Semaphore( const Semaphore & other );
+		Semaphore & operator = ( const Semaphore & other );
+
+		pthread_mutex_t mutex;
+		pthread_cond_t condition;
+		int count;
+	};
+
+	// atomics. loads acquire, stores release, and add and compare exchange are full barriers
+
+	template <typename T> inline T AtomicLoad( const T * value )
+	{
+		return __atomic_load_n( value, __ATOMIC_ACQUIRE );
+	}
+
+	template <typename T> inline void AtomicStore( T * value, T x )
+	{
+		__atomic_store_n( value, x, __ATOMIC_RELEASE );
+	}
+
+	// returns the value before the add
+
+	template <typename T> inline T AtomicAdd( T * value, T x )
+	{
+		return __sync_fetch_and_add( value, x );
+	}
+
+	// sets the value to "desired" if it is "expected". returns true if it was set
+
+	template <typename T> inline bool AtomicCompareExchange( T * value, T expected, T desired )
+	{
+		return __sync_bool_compare_and_swap( value, expected, desired );
+	}
 }
 
 #endif
@@ -0,0 +1,284 @@
+#ifndef PRIORITY_H
+#define PRIORITY_H
+
+#include "Snapshot.h"
+#include <algorithm>
+
+/*
+    Priority accumulator.
+
+    When a lot of stones are moving at once (a bowl spilled, a capture swept
+    off the board) a full snapshot no longer fits the packet budget. Instead
+    of sending everything, the server sends each client a state update with
+    only as many stones as fit, and the client simulates the rest itself
+    until their turn comes.
+
+    Which stones go in is decided per client. Every stone accumulates
+    priority each tick: a little if it is asleep, more if it is awake, and
+    more again the faster it moves or spins. Each update is filled greedily
+    with the highest priority stones that fit the byte budget, and the
+    priority of every stone sent goes back to zero. Fast stones are sent
+    often, but a stone that has been waiting long enough always gets in
+    eventually, so nothing is starved.
+
+    State update layout:
+
+        [9 bits] number of stones in the world
+        [9 bits] number of stones in this update
+        for each stone:
+            [9 bits] index
+            stone (see "WriteStone")
+*/
+
+struct PriorityParams
+{
+    PriorityParams()
+    {
+        sleepingPriority = 0.1f;
+        awakePriority = 1.0f;
+        speedPriority = 0.1f;
+        spinPriority = 0.5f;
+        maxBytes = 256;
+    }
+
+    float sleepingPriority;         // per second, for a stone at rest
+    float awakePriority;            // per second, for a stone that is awake
+    float speedPriority;            // per second for each cm/sec of linear speed, on top of awake
+    float spinPriority;             // per second for each radian/sec of angular speed, on top of awake
+    int maxBytes;                   // budget for one state update, header included
+};
+
+struct StateUpdate
+{
+    int numStones;                  // in the world. the client adds or removes stones to match
+    int numUpdates;
+    int indices[MaxSnapshotStones];
+    QuantizedStone stones[MaxSnapshotStones];
+};
+
+inline int GetStateUpdateHeaderBits()
+{
+    return BitsRequired( MaxSnapshotStones ) * 2;
+}
+
+inline int GetStateUpdateIndexBits()
+{
+    return BitsRequired( MaxSnapshotStones - 1 );
+}
+
+// returns false if the update did not fit. call "FlushBits" on the writer before sending
+
+inline bool WriteStateUpdate( BitWriter & writer, const SnapshotParams & params, const StateUpdate & update )
+{
+    assert( update.numStones <= MaxSnapshotStones );
+    assert( update.numUpdates <= update.numStones );
+
+    const SnapshotBits bits( params );
+    const int indexBits = GetStateUpdateIndexBits();
+
+    writer.WriteBits( update.numStones, bits.numStones );
+    writer.WriteBits( update.numUpdates, bits.numStones );
+
+    for ( int i = 0; i < update.numUpdates; ++i )
+    {
+        writer.WriteBits( update.indices[i], indexBits );
+        WriteStone( writer, bits, update.stones[i] );
+    }
+
+    return !writer.IsOverflow();
+}
+
+// returns false if the packet was truncated or malformed
+
+inline bool ReadStateUpdate( BitReader & reader, const SnapshotParams & params, StateUpdate & update )
+{
+    const SnapshotBits bits( params );
+    const int indexBits = GetStateUpdateIndexBits();
+
+    update.numStones = reader.ReadBits( bits.numStones );
+    update.numUpdates = reader.ReadBits( bits.numStones );
+    if ( update.numStones > MaxSnapshotStones || update.numUpdates > update.numStones )
+        return false;
+
+    for ( int i = 0; i < update.numUpdates; ++i )
+    {
+        update.indices[i] = reader.ReadBits( indexBits );
+        if ( update.indices[i] >= update.numStones )
+            return false;
+        ReadStone( reader, bits, update.stones[i] );
+    }
+
+    return !reader.IsOverflow();
+}
+
+// stones not in the update are left as they are. returns false if the world can't hold that many stones
+
+inline bool ApplyStateUpdate( const SnapshotParams & params, const StateUpdate & update, World & world )
+{
+    if ( !SetNumStones( world, update.numStones ) )
+        return false;
+
+    for ( int i = 0; i < update.numUpdates; ++i )
+        ApplyStone( params, update.stones[i], world, update.indices[i] );
+
+    return true;
+}
+
+// ----------------------------------------------------------------
+
+class PriorityAccumulator
+{
+public:
+
+    PriorityAccumulator()
+    {
+        maxStones = 0;
+        priorities = NULL;
+        order = NULL;
+    }
+
+    ~PriorityAccumulator()
+    {
+        Free();
+    }
+
+    void Initialize( int stones, const PriorityParams & priorityParams = PriorityParams() )
+    {
+        assert( stones > 0 && stones <= MaxSnapshotStones );
+        assert( priorityParams.maxBytes * 8 > GetStateUpdateHeaderBits() );
+
+        Free();
+
+        params = priorityParams;
+        maxStones = stones;
+        priorities = new float[maxStones];
+        order = new int[maxStones];
+
+        Reset();
+    }
+
+    void Free()
+    {
+        delete [] priorities;
+        delete [] order;
+        priorities = NULL;
+        order = NULL;
+        maxStones = 0;
+    }
+
+    void Reset()
+    {
+        for ( int i = 0; i < maxStones; ++i )
+            priorities[i] = 0.0f;
+    }
+
+    // call once per tick, whether or not an update is sent
+
+    void Accumulate( const World & world, float dt )
+    {
+        assert( priorities );
+        assert( world.GetNumBodies() <= maxStones );
+
+        // IMPORTANT: priority is kept by index. when a stone is removed the last stone
+        // takes its index, and its priority with it. close enough, it gets sent soon anyway
+
+        const int numStones = world.GetNumBodies();
+
+        for ( int i = 0; i < numStones; ++i )
+        {
+            const RigidBody & rigidBody = world.GetBody( i );
+
+            float priority = params.sleepingPriority;
+            if ( rigidBody.active )
+            {
+                priority = params.awakePriority +
+                           length( rigidBody.linearVelocity ) * params.speedPriority +
+                           length( rigidBody.angularVelocity ) * params.spinPriority;
+            }
+
+            priorities[i] += priority * dt;
+        }
+    }
+
+    // picks the highest priority stones that fit in the byte budget and zeroes their priority
+
+    void BuildStateUpdate( const SnapshotParams & snapshotParams, const World & world, StateUpdate & update )
+    {
+        assert( priorities );
+        assert( world.GetNumBodies() <= maxStones );
+
+        const SnapshotBits bits( snapshotParams );
+        const int indexBits = GetStateUpdateIndexBits();
+        const int minStoneBits = indexBits + bits.GetStone( false );
+
+        const int numStones = world.GetNumBodies();
+
+        for ( int i = 0; i < numStones; ++i )
+            order[i] = i;
+
+        std::sort( order, order + numStones, ComparePriority( priorities ) );
+
+        update.numStones = numStones;
+        update.numUpdates = 0;
+
+        int bitsAvailable = params.maxBytes * 8 - GetStateUpdateHeaderBits();
+
+        // a stone too big for what's left is skipped, not the end of the packet. a sleeping
+        // stone is about half the size of an awake one and may still fit
+
+        for ( int i = 0; i < numStones && bitsAvailable >= minStoneBits; ++i )
+        {
+            const int index = order[i];
+            if ( priorities[index] <= 0.0f )
+                break;
+
+            const RigidBody & rigidBody = world.GetBody( index );
+            const int stoneBits = indexBits + bits.GetStone( rigidBody.active );
+            if ( stoneBits > bitsAvailable )
+                continue;
+
+            update.indices[update.numUpdates] = index;
+            QuantizeStone( snapshotParams, rigidBody, update.stones[update.numUpdates] );
+            update.numUpdates++;
+
+            priorities[index] = 0.0f;
+            bitsAvailable -= stoneBits;
+        }
+    }
+
+    float GetPriority( int index ) const
+    {
+        assert( index >= 0 && index < maxStones );
+        return priorities[index];
+    }
+
+    const PriorityParams & GetParams() const { return params; }
+
+private:
+
+    PriorityAccumulator( const PriorityAccumulator & other );
+    PriorityAccumulator & operator = ( const PriorityAccumulator & other );
+
+    // highest priority first. ties go to the lower index so the order is the same every run
+
+    struct ComparePriority
+    {
+        ComparePriority( const float * priorities ) : priorities( priorities ) {}
+
+        bool operator() ( int a, int b ) const
+        {
+            if ( priorities[a] != priorities[b] )
+                return priorities[a] > priorities[b];
+            return a < b;
+        }
+
+        const float * priorities;
+    };
+
+    PriorityParams params;
+    int maxStones;
+    float * priorities;
+    int * order;
+};
+
+#endif
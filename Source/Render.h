@@ -4,6 +4,8 @@
 #include "Stone.h"
 #include "Board.h"
 #include "Mesh.h"
+#include "Platform.h"
+#include <stddef.h>
 
 #define GL_SILENCE_DEPRECATION
 
@@ -14,6 +16,13 @@
 #include <OpenGL/OpenGL.h>
 #endif
 
+#if PLATFORM == PLATFORM_LINUX
+#define GL_GLEXT_PROTOTYPES 1
+#include <GL/gl.h>
+#include <GL/glu.h>
+#include <GL/glext.h>
+#endif
+
 void ClearScreen( int displayWidth, int displayHeight, float r = 0, float g = 0, float b = 0 )
 {
     glViewport( 0, 0, displayWidth, displayHeight );
@@ -23,138 +32,96 @@ void ClearScreen( int displayWidth, int displayHeight, float r = 0, float g = 0,
     glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
 }
 
-void RenderBiconvexNaive( const Biconvex & biconvex, int numSegments = 128, int numRings = 32 )
+// draws vertices straight from memory, three to a triangle, in one call
+
+void RenderTriangles( const Vertex * vertices, int numVertices )
 {
-    glBegin( GL_TRIANGLES );
+    glEnableClientState( GL_VERTEX_ARRAY );
+    glEnableClientState( GL_NORMAL_ARRAY );
+
+    glVertexPointer( 3, GL_FLOAT, sizeof( Vertex ), &vertices[0].position );
+    glNormalPointer( GL_FLOAT, sizeof( Vertex ), &vertices[0].normal );
 
+    glDrawArrays( GL_TRIANGLES, 0, numVertices );
+
+    glDisableClientState( GL_NORMAL_ARRAY );
+    glDisableClientState( GL_VERTEX_ARRAY );
+}
+
+void RenderBiconvexNaive( const Biconvex & biconvex, int numSegments = 128, int numRings = 32 )
+{
     const float sphereRadius = biconvex.GetSphereRadius();
     const float segmentAngle = 2*pi / numSegments;
 
-    // bottom surface of biconvex
-    {
-        const float center_y = biconvex.GetSphereOffset();
-        const float delta_y = biconvex.GetHeight() / 2 / numRings;
+    // IMPORTANT: kept from one call to the next, so drawing every frame doesn't allocate. only
+    // touched on the render thread. every ring goes around at the same angles, so work them out
+    // once, and again only when the number of segments changes
 
-        for ( int i = 0; i < numRings; ++i )
-        {
-            const float y1 = -i * delta_y;
-            const float s1 = y1 - center_y;
-            const float r1 = sqrt( sphereRadius*sphereRadius - (s1*s1) );
-            const float y2 = -(i+1) * delta_y;
-            const float s2 = y2 - center_y;
-            const float r2 = sqrt( sphereRadius*sphereRadius - (s2*s2) );
+    static std::vector<float> cosAngle;
+    static std::vector<float> sinAngle;
+    static std::vector<Vertex> vertices;
 
-            for ( int j = 0; j < numSegments; ++j )
-            {
-                const float angle1 = j * segmentAngle;
-                const float angle2 = angle1 + segmentAngle;
-                
-                const float top_x1 = cos( angle1 ) * r1;
-                const float top_z1 = sin( angle1 ) * r1;    
-                const float top_x2 = cos( angle2 ) * r1;
-                const float top_z2 = sin( angle2 ) * r1;
-
-                const float bottom_x1 = cos( angle1 ) * r2;
-                const float bottom_z1 = sin( angle1 ) * r2;    
-                const float bottom_x2 = cos( angle2 ) * r2;
-                const float bottom_z2 = sin( angle2 ) * r2;
-
-                vec3f a( top_x1, y1, top_z1 );
-                vec3f b( bottom_x1, y2, bottom_z1 );
-                vec3f c( bottom_x2, y2, bottom_z2 );
-                vec3f d( top_x2, y1, top_z2 );
-
-                vec3f center( 0, center_y, 0 );
-
-                vec3f na = normalize( a - center );
-                vec3f nb = normalize( b - center );
-                vec3f nc = normalize( c - center );
-                vec3f nd = normalize( d - center );
-
-                glNormal3f( na.x(), na.y(), na.z() );
-                glVertex3f( a.x(), a.y(), a.z() );
-                
-                glNormal3f( nb.x(), nb.y(), nb.z() );
-                glVertex3f( b.x(), b.y(), b.z() );
-
-                glNormal3f( nc.x(), nc.y(), nc.z() );
-                glVertex3f( c.x(), c.y(), c.z() );
-                
-                glNormal3f( na.x(), na.y(), na.z() );
-                glVertex3f( a.x(), a.y(), a.z() );
-                
-                glNormal3f( nc.x(), nc.y(), nc.z() );
-                glVertex3f( c.x(), c.y(), c.z() );
-                
-                glNormal3f( nd.x(), nd.y(), nd.z() );
-                glVertex3f( d.x(), d.y(), d.z() );
-            }
+    if ( int( cosAngle.size() ) != numSegments + 1 )
+    {
+        cosAngle.resize( numSegments + 1 );
+        sinAngle.resize( numSegments + 1 );
+        for ( int j = 0; j <= numSegments; ++j )
+        {
+            cosAngle[j] = cos( j * segmentAngle );
+            sinAngle[j] = sin( j * segmentAngle );
         }
     }
 
-    // top surface of biconvex
+    vertices.resize( numRings * numSegments * 6 * 2 );
+    Vertex * vertex = &vertices[0];
+
+    // bottom surface of biconvex, then top. the top is the bottom mirrored, with its triangles wound the other way
+
+    for ( int surface = 0; surface < 2; ++surface )
     {
-        const float center_y = -biconvex.GetSphereOffset();
+        const float sign = surface == 0 ? -1.0f : +1.0f;
+        const float center_y = -sign * biconvex.GetSphereOffset();
         const float delta_y = biconvex.GetHeight() / 2 / numRings;
 
+        const vec3f center( 0, center_y, 0 );
+
         for ( int i = 0; i < numRings; ++i )
         {
-            const float y1 = i * delta_y;
+            const float y1 = sign * i * delta_y;
             const float s1 = y1 - center_y;
             const float r1 = sqrt( sphereRadius*sphereRadius - (s1*s1) );
-            const float y2 = (i+1) * delta_y;
+            const float y2 = sign * (i+1) * delta_y;
             const float s2 = y2 - center_y;
             const float r2 = sqrt( sphereRadius*sphereRadius - (s2*s2) );
 
             for ( int j = 0; j < numSegments; ++j )
             {
-                const float angle1 = j * segmentAngle;
-                const float angle2 = angle1 + segmentAngle;
-                
-                const float top_x1 = cos( angle1 ) * r1;
-                const float top_z1 = sin( angle1 ) * r1;    
-                const float top_x2 = cos( angle2 ) * r1;
-                const float top_z2 = sin( angle2 ) * r1;
-
-                const float bottom_x1 = cos( angle1 ) * r2;
-                const float bottom_z1 = sin( angle1 ) * r2;
-                const float bottom_x2 = cos( angle2 ) * r2;
-                const float bottom_z2 = sin( angle2 ) * r2;
-
-                vec3f a( bottom_x1, y2, bottom_z1 );
-                vec3f b( top_x1, y1, top_z1 );
-                vec3f c( top_x2, y1, top_z2 );
-                vec3f d( bottom_x2, y2, bottom_z2 );
-
-                vec3f center( 0, center_y, 0 );
-
-                vec3f na = normalize( a - center );
-                vec3f nb = normalize( b - center );
-                vec3f nc = normalize( c - center );
-                vec3f nd = normalize( d - center );
-
-                glNormal3f( na.x(), na.y(), na.z() );
-                glVertex3f( a.x(), a.y(), a.z() );
-                
-                glNormal3f( nb.x(), nb.y(), nb.z() );
-                glVertex3f( b.x(), b.y(), b.z() );
-
-                glNormal3f( nc.x(), nc.y(), nc.z() );
-                glVertex3f( c.x(), c.y(), c.z() );
-                
-                glNormal3f( na.x(), na.y(), na.z() );
-                glVertex3f( a.x(), a.y(), a.z() );
-                
-                glNormal3f( nc.x(), nc.y(), nc.z() );
-                glVertex3f( c.x(), c.y(), c.z() );
-                
-                glNormal3f( nd.x(), nd.y(), nd.z() );
-                glVertex3f( d.x(), d.y(), d.z() );
+                const vec3f top1( cosAngle[j] * r1, y1, sinAngle[j] * r1 );
+                const vec3f top2( cosAngle[j+1] * r1, y1, sinAngle[j+1] * r1 );
+                const vec3f bottom1( cosAngle[j] * r2, y2, sinAngle[j] * r2 );
+                const vec3f bottom2( cosAngle[j+1] * r2, y2, sinAngle[j+1] * r2 );
+
+                const vec3f a = surface == 0 ? top1 : bottom1;
+                const vec3f b = surface == 0 ? bottom1 : top1;
+                const vec3f c = surface == 0 ? bottom2 : top2;
+                const vec3f d = surface == 0 ? top2 : bottom2;
+
+                const vec3f na = normalize( a - center );
+                const vec3f nb = normalize( b - center );
+                const vec3f nc = normalize( c - center );
+                const vec3f nd = normalize( d - center );
+
+                vertex->position = a; vertex->normal = na; vertex++;
+                vertex->position = b; vertex->normal = nb; vertex++;
+                vertex->position = c; vertex->normal = nc; vertex++;
+                vertex->position = a; vertex->normal = na; vertex++;
+                vertex->position = c; vertex->normal = nc; vertex++;
+                vertex->position = d; vertex->normal = nd; vertex++;
             }
         }
     }
 
-    glEnd();
+    RenderTriangles( &vertices[0], vertices.size() );
 }
 
 void RenderGrid( float z, float size, float gridWidth, float gridHeight )
@@ -186,88 +153,239 @@ void RenderGrid( float z, float size, float gridWidth, float gridHeight )
     glEnd();
 }
 
-void RenderBoard( const Board & board )
+/*
+    Retained mode rendering.
+
+    Submitting every vertex with its own glNormal3f and glVertex3f each
+    frame costs a driver call per vertex. For a board full of stones that
+    is most of the frame, and with software GL (see the headless display
+    in Platform.cpp) nearly all of it.
+
+    Instead meshes are uploaded once into vertex and index buffers and
+    drawn with a single call per mesh. The board is uploaded again only
+    when its dimensions change.
+
+    IMPORTANT: buffers are not freed when destroyed, since by then the
+    GL context is usually gone. Call "Free" before closing the display.
+*/
+
+class MeshBuffer
 {
-    glBegin( GL_QUADS );
+public:
 
-    const float width = board.GetWidth();
-    const float height = board.GetHeight();
-    const float thickness = board.GetThickness();
+    MeshBuffer()
+    {
+        vertexBuffer = 0;
+        indexBuffer = 0;
+        numIndices = 0;
+        indexType = GL_UNSIGNED_INT;
+    }
+
+    // needs a current GL context. uploading again replaces the mesh
+
+    void Upload( Mesh<Vertex,int> & mesh )
+    {
+        Free();
 
-    // top of board
+        numIndices = mesh.GetNumIndices();
+        if ( numIndices == 0 )
+            return;
 
-    glNormal3f( 0,0,1 );
+        const int numVertices = mesh.GetNumVertices();
 
-    glTexCoord2f( 1, 0 );   glVertex3f( width/2, -height/2, thickness );
-    glTexCoord2f( 1, 1 );   glVertex3f( width/2, height/2, thickness );
-    glTexCoord2f( 0, 1 );   glVertex3f( -width/2, height/2, thickness );
-    glTexCoord2f( 0, 0 );   glVertex3f( -width/2, -height/2, thickness );
+        glGenBuffersARB( 1, &vertexBuffer );
+        glBindBufferARB( GL_ARRAY_BUFFER_ARB, vertexBuffer );
+        glBufferDataARB( GL_ARRAY_BUFFER_ARB, numVertices * sizeof( Vertex ), mesh.GetVertexBuffer(), GL_STATIC_DRAW_ARB );
+        glBindBufferARB( GL_ARRAY_BUFFER_ARB, 0 );
 
-    // front side
+        // stone meshes have well under 64k vertices, so their indices fit in half the space
 
-    glNormal3f( 0,-1,0 );
-    
-    glVertex3f( width/2, -height/2, 0 );
-    glVertex3f( width/2, -height/2, thickness );
-    glVertex3f( -width/2, -height/2, thickness );
-    glVertex3f( -width/2, -height/2, 0 );
+        glGenBuffersARB( 1, &indexBuffer );
+        glBindBufferARB( GL_ELEMENT_ARRAY_BUFFER_ARB, indexBuffer );
+        if ( numVertices <= 65536 )
+        {
+            const int * indices = mesh.GetIndexBuffer();
+            std::vector<uint16_t> shortIndices( numIndices );
+            for ( int i = 0; i < numIndices; ++i )
+                shortIndices[i] = uint16_t( indices[i] );
+            glBufferDataARB( GL_ELEMENT_ARRAY_BUFFER_ARB, numIndices * sizeof( uint16_t ), &shortIndices[0], GL_STATIC_DRAW_ARB );
+            indexType = GL_UNSIGNED_SHORT;
+        }
+        else
+        {
+            glBufferDataARB( GL_ELEMENT_ARRAY_BUFFER_ARB, numIndices * sizeof( int ), mesh.GetIndexBuffer(), GL_STATIC_DRAW_ARB );
+            indexType = GL_UNSIGNED_INT;
+        }
+        glBindBufferARB( GL_ELEMENT_ARRAY_BUFFER_ARB, 0 );
+    }
 
-    // back side
+    void Free()
+    {
+        if ( vertexBuffer )
+            glDeleteBuffersARB( 1, &vertexBuffer );
+        if ( indexBuffer )
+            glDeleteBuffersARB( 1, &indexBuffer );
+        vertexBuffer = 0;
+        indexBuffer = 0;
+        numIndices = 0;
+    }
 
-    glNormal3f( 0,+1,0 );
-    glVertex3f( width/2, height/2, thickness );
-    glVertex3f( width/2, height/2, 0 );
-    glVertex3f( -width/2, height/2, 0 );
-    glVertex3f( -width/2, height/2, thickness );
+    bool IsUploaded() const { return vertexBuffer != 0; }
 
-    // left side
+    int GetNumTriangles() const { return numIndices / 3; }
 
-    glNormal3f( -1,0,0 );
-    glVertex3f( -width/2, -height/2, 0 );
-    glVertex3f( -width/2, -height/2, thickness );
-    glVertex3f( -width/2, +height/2, thickness );
-    glVertex3f( -width/2, +height/2, 0 );
+private:
 
-    // right side
+    MeshBuffer( const MeshBuffer & other );
+    MeshBuffer & operator = ( const MeshBuffer & other );
 
-    glNormal3f( +1,0,0 );
-    glVertex3f( width/2, -height/2, thickness );
-    glVertex3f( width/2, -height/2, 0 );
-    glVertex3f( width/2, +height/2, 0 );
-    glVertex3f( width/2, +height/2, thickness );
+    friend void RenderMesh( const MeshBuffer & buffer );
 
-    glEnd();
-}
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    int numIndices;
+    GLenum indexType;
+};
 
-void RenderMesh( Mesh<Vertex,int> & mesh )
+class BoardBuffer
 {
-    glBegin( GL_TRIANGLES );
+public:
 
-    int numTriangles = mesh.GetNumTriangles();
-    int * indexBuffer = mesh.GetIndexBuffer();
-    Vertex * vertexBuffer = mesh.GetVertexBuffer();
+    BoardBuffer()
+    {
+        vertexBuffer = 0;
+        width = 0.0f;
+        height = 0.0f;
+        thickness = 0.0f;
+    }
+
+    // uploads the board if it isn't already, or has changed shape since
 
-    for ( int i = 0; i < numTriangles; ++i )
+    void Update( const Board & board )
     {
-        const int index_a = indexBuffer[i*3];
-        const int index_b = indexBuffer[i*3+1];
-        const int index_c = indexBuffer[i*3+2];
+        if ( vertexBuffer && board.GetWidth() == width && board.GetHeight() == height && board.GetThickness() == thickness )
+            return;
 
-        const Vertex & a = vertexBuffer[index_a];
-        const Vertex & b = vertexBuffer[index_b];
-        const Vertex & c = vertexBuffer[index_c];
+        width = board.GetWidth();
+        height = board.GetHeight();
+        thickness = board.GetThickness();
 
-        glNormal3f( a.normal.x(), a.normal.y(), a.normal.z() );
-        glVertex3f( a.position.x(), a.position.y(), a.position.z() );
+        // quads, so the board draws as its outline in wireframe. only the top is textured
 
-        glNormal3f( b.normal.x(), b.normal.y(), b.normal.z() );
-        glVertex3f( b.position.x(), b.position.y(), b.position.z() );
+        const BoardVertex vertices[NumVertices] =
+        {
+            // top of board
+            { {  width/2, -height/2, thickness }, { 0, 0, 1 }, { 1, 0 } },
+            { {  width/2,  height/2, thickness }, { 0, 0, 1 }, { 1, 1 } },
+            { { -width/2,  height/2, thickness }, { 0, 0, 1 }, { 0, 1 } },
+            { { -width/2, -height/2, thickness }, { 0, 0, 1 }, { 0, 0 } },
+
+            // front side
+            { {  width/2, -height/2, 0 },         { 0, -1, 0 }, { 0, 0 } },
+            { {  width/2, -height/2, thickness }, { 0, -1, 0 }, { 0, 0 } },
+            { { -width/2, -height/2, thickness }, { 0, -1, 0 }, { 0, 0 } },
+            { { -width/2, -height/2, 0 },         { 0, -1, 0 }, { 0, 0 } },
+
+            // back side
+            { {  width/2, height/2, thickness },  { 0, +1, 0 }, { 0, 0 } },
+            { {  width/2, height/2, 0 },          { 0, +1, 0 }, { 0, 0 } },
+            { { -width/2, height/2, 0 },          { 0, +1, 0 }, { 0, 0 } },
+            { { -width/2, height/2, thickness },  { 0, +1, 0 }, { 0, 0 } },
+
+            // left side
+            { { -width/2, -height/2, 0 },         { -1, 0, 0 }, { 0, 0 } },
+            { { -width/2, -height/2, thickness }, { -1, 0, 0 }, { 0, 0 } },
+            { { -width/2, +height/2, thickness }, { -1, 0, 0 }, { 0, 0 } },
+            { { -width/2, +height/2, 0 },         { -1, 0, 0 }, { 0, 0 } },
+
+            // right side
+            { { width/2, -height/2, thickness },  { +1, 0, 0 }, { 0, 0 } },
+            { { width/2, -height/2, 0 },          { +1, 0, 0 }, { 0, 0 } },
+            { { width/2, +height/2, 0 },          { +1, 0, 0 }, { 0, 0 } },
+            { { width/2, +height/2, thickness },  { +1, 0, 0 }, { 0, 0 } },
+        };
+
+        if ( !vertexBuffer )
+            glGenBuffersARB( 1, &vertexBuffer );
+        glBindBufferARB( GL_ARRAY_BUFFER_ARB, vertexBuffer );
+        glBufferDataARB( GL_ARRAY_BUFFER_ARB, sizeof( vertices ), vertices, GL_STATIC_DRAW_ARB );
+        glBindBufferARB( GL_ARRAY_BUFFER_ARB, 0 );
+    }
 
-        glNormal3f( c.normal.x(), c.normal.y(), c.normal.z() );
-        glVertex3f( c.position.x(), c.position.y(), c.position.z() );
+    void Free()
+    {
+        if ( vertexBuffer )
+            glDeleteBuffersARB( 1, &vertexBuffer );
+        vertexBuffer = 0;
     }
 
-    glEnd();
+private:
+
+    BoardBuffer( const BoardBuffer & other );
+    BoardBuffer & operator = ( const BoardBuffer & other );
+
+    friend void RenderBoard( BoardBuffer & buffer, const Board & board );
+
+    enum { NumVertices = 20 };
+
+    struct BoardVertex
+    {
+        float position[3];
+        float normal[3];
+        float texCoords[2];
+    };
+
+    GLuint vertexBuffer;
+    float width;
+    float height;
+    float thickness;
+};
+
+void RenderBoard( BoardBuffer & buffer, const Board & board )
+{
+    buffer.Update( board );
+
+    glBindBufferARB( GL_ARRAY_BUFFER_ARB, buffer.vertexBuffer );
+
+    glEnableClientState( GL_VERTEX_ARRAY );
+    glEnableClientState( GL_NORMAL_ARRAY );
+    glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+
+    const int stride = sizeof( BoardBuffer::BoardVertex );
+    glVertexPointer( 3, GL_FLOAT, stride, (const GLvoid*) offsetof( BoardBuffer::BoardVertex, position ) );
+    glNormalPointer( GL_FLOAT, stride, (const GLvoid*) offsetof( BoardBuffer::BoardVertex, normal ) );
+    glTexCoordPointer( 2, GL_FLOAT, stride, (const GLvoid*) offsetof( BoardBuffer::BoardVertex, texCoords ) );
+
+    glDrawArrays( GL_QUADS, 0, BoardBuffer::NumVertices );
+
+    glDisableClientState( GL_TEXTURE_COORD_ARRAY );
+    glDisableClientState( GL_NORMAL_ARRAY );
+    glDisableClientState( GL_VERTEX_ARRAY );
+
+    glBindBufferARB( GL_ARRAY_BUFFER_ARB, 0 );
+}
+
+void RenderMesh( const MeshBuffer & buffer )
+{
+    if ( !buffer.numIndices )
+        return;
+
+    glBindBufferARB( GL_ARRAY_BUFFER_ARB, buffer.vertexBuffer );
+    glBindBufferARB( GL_ELEMENT_ARRAY_BUFFER_ARB, buffer.indexBuffer );
+
+    glEnableClientState( GL_VERTEX_ARRAY );
+    glEnableClientState( GL_NORMAL_ARRAY );
+
+    glVertexPointer( 3, GL_FLOAT, sizeof( Vertex ), (const GLvoid*) offsetof( Vertex, position ) );
+    glNormalPointer( GL_FLOAT, sizeof( Vertex ), (const GLvoid*) offsetof( Vertex, normal ) );
+
+    glDrawElements( GL_TRIANGLES, buffer.numIndices, buffer.indexType, 0 );
+
+    glDisableClientState( GL_NORMAL_ARRAY );
+    glDisableClientState( GL_VERTEX_ARRAY );
+
+    glBindBufferARB( GL_ELEMENT_ARRAY_BUFFER_ARB, 0 );
+    glBindBufferARB( GL_ARRAY_BUFFER_ARB, 0 );
 }
 
 #endif
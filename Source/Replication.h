@@ -0,0 +1,235 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include "Snapshot.h"
+
+/*
+    Replication.
+
+    Sends world snapshots from a server to a client, delta encoded against
+    the most recent snapshot the client has acknowledged.
+
+    Both ends keep a sliding window of recent snapshots indexed by sequence
+    number. The sender remembers what it sent, and the receiver what it
+    decoded, so whichever snapshot the client acks last is on both sides
+    and can be the baseline. If the acked snapshot has fallen out of the
+    sender's window (or nothing has been acked yet) the sender falls back
+    to a full snapshot.
+
+    Packet layout:
+
+        [1 bit] delta
+        [16 bits] baseline sequence, if delta
+        snapshot, full or delta (see Snapshot.h)
+*/
+
+const int SnapshotWindowSize = 32;
+
+inline bool SequenceGreaterThan( uint16_t s1, uint16_t s2 )
+{
+    return ( ( s1 > s2 ) && ( s1 - s2 <= 32768 ) ) ||
+           ( ( s1 < s2 ) && ( s2 - s1 > 32768 ) );
+}
+
+inline void CopySnapshot( const Snapshot & source, Snapshot & dest )
+{
+    dest.sequence = source.sequence;
+    dest.numStones = source.numStones;
+    memcpy( dest.stones, source.stones, sizeof( QuantizedStone ) * source.numStones );
+}
+
+class SnapshotWindow
+{
+public:
+
+    SnapshotWindow()
+    {
+        snapshots = new Snapshot[SnapshotWindowSize];
+        Reset();
+    }
+
+    ~SnapshotWindow()
+    {
+        delete [] snapshots;
+    }
+
+    void Reset()
+    {
+        for ( int i = 0; i < SnapshotWindowSize; ++i )
+            valid[i] = false;
+    }
+
+    Snapshot & Insert( uint16_t sequence )
+    {
+        const int index = sequence % SnapshotWindowSize;
+        valid[index] = true;
+        snapshots[index].sequence = sequence;
+        return snapshots[index];
+    }
+
+    const Snapshot * Find( uint16_t sequence ) const
+    {
+        const int index = sequence % SnapshotWindowSize;
+        if ( !valid[index] || snapshots[index].sequence != sequence )
+            return NULL;
+        return &snapshots[index];
+    }
+
+private:
+
+    SnapshotWindow( const SnapshotWindow & other );
+    SnapshotWindow & operator = ( const SnapshotWindow & other );
+
+    Snapshot * snapshots;
+    bool valid[SnapshotWindowSize];
+};
+
+class SnapshotSender
+{
+public:
+
+    SnapshotSender()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        window.Reset();
+        sequence = 0;
+        ackSequence = 0;
+        hasAck = false;
+    }
+
+    // writes the snapshot under the next sequence number. returns false if it didn't fit
+
+    bool WritePacket( BitWriter & writer, const SnapshotParams & params, const Snapshot & current )
+    {
+        // IMPORTANT: look up the baseline before inserting, the new snapshot may take its slot
+
+        const Snapshot * baseline = NULL;
+        if ( hasAck && uint16_t( sequence - ackSequence ) < SnapshotWindowSize )
+            baseline = window.Find( ackSequence );
+
+        Snapshot & snapshot = window.Insert( sequence );
+        CopySnapshot( current, snapshot );
+        snapshot.sequence = sequence;
+
+        sequence++;
+
+        writer.WriteBool( baseline != NULL );
+
+        if ( !baseline )
+            return WriteSnapshot( writer, params, snapshot );
+
+        writer.WriteBits( baseline->sequence, 16 );
+
+        return WriteSnapshotDelta( writer, params, snapshot, *baseline );
+    }
+
+    void ProcessAck( uint16_t ack )
+    {
+        if ( !hasAck || SequenceGreaterThan( ack, ackSequence ) )
+        {
+            ackSequence = ack;
+            hasAck = true;
+        }
+    }
+
+    uint16_t GetSequence() const { return sequence; }
+
+    bool HasAck() const { return hasAck; }
+
+    uint16_t GetAckSequence() const { return ackSequence; }
+
+private:
+
+    SnapshotWindow window;
+    uint16_t sequence;
+    uint16_t ackSequence;
+    bool hasAck;
+};
+
+class SnapshotReceiver
+{
+public:
+
+    SnapshotReceiver()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        window.Reset();
+        latestSequence = 0;
+        hasLatest = false;
+    }
+
+    // returns false if the packet is malformed or its baseline is no longer in the window
+
+    bool ReadPacket( BitReader & reader, const SnapshotParams & params )
+    {
+        // IMPORTANT: decode into scratch, so a packet that fails half way leaves "received" as it was
+
+        const bool delta = reader.ReadBool();
+
+        if ( !delta )
+        {
+            if ( !ReadSnapshot( reader, params, decoded ) )
+                return false;
+        }
+        else
+        {
+            const uint16_t baselineSequence = reader.ReadBits( 16 );
+            const Snapshot * baseline = window.Find( baselineSequence );
+            if ( !baseline || !ReadSnapshotDelta( reader, params, *baseline, decoded ) )
+                return false;
+        }
+
+        CopySnapshot( decoded, received );
+
+        // keep it as a future baseline unless it is so old it would evict a newer snapshot
+
+        if ( hasLatest && uint16_t( latestSequence - received.sequence ) < 32768 &&
+                          uint16_t( latestSequence - received.sequence ) >= SnapshotWindowSize )
+            return true;
+
+        CopySnapshot( received, window.Insert( received.sequence ) );
+
+        if ( !hasLatest || SequenceGreaterThan( received.sequence, latestSequence ) )
+        {
+            latestSequence = received.sequence;
+            hasLatest = true;
+        }
+
+        return true;
+    }
+
+    // the snapshot decoded by the last successful "ReadPacket"
+
+    const Snapshot & GetReceived() const { return received; }
+
+    // the newest snapshot received so far. send this back to the server as the ack
+
+    bool GetAck( uint16_t & ack ) const
+    {
+        ack = latestSequence;
+        return hasLatest;
+    }
+
+    const Snapshot * GetLatest() const
+    {
+        return hasLatest ? window.Find( latestSequence ) : NULL;
+    }
+
+private:
+
+    SnapshotWindow window;
+    Snapshot decoded;
+    Snapshot received;
+    uint16_t latestSequence;
+    bool hasLatest;
+};
+
+#endif
@@ -9,18 +9,17 @@
 
 struct RigidBody
 {
-    mat4f inertiaTensor;
-    mat4f inverseInertiaTensor;
-
     // IMPORTANT: these are secondary quantities calculated in "UpdateTransform"
     RigidBodyTransform transform;
-    mat4f rotation, transposeRotation;
-    mat4f inertiaTensorWorld;
-    mat4f inverseInertiaTensorWorld;
 
     quat4f orientation;
 
+    // IMPORTANT: stones are symmetric tops about their local z axis, so the
+    // inertia tensor is diagonal with ix == iy. we store only the diagonal
+    // and never build the 4x4 tensor (see "TransformByInverseInertiaWorld")
     vec3f inertia;
+    vec3f inverseInertia;
+
     vec3f position;
     vec3f linearMomentum, angularMomentum;
 
@@ -44,8 +43,7 @@ struct RigidBody
         mass = 1.0f;
         inverseMass = 1.0f / mass;
         inertia = vec3f(1,1,1);
-        inertiaTensor = mat4f::identity();
-        inverseInertiaTensor = mat4f::identity();
+        inverseInertia = vec3f(1,1,1);
 
         UpdateTransform();
         UpdateMomentum();
@@ -53,13 +51,7 @@ struct RigidBody
 
     void UpdateTransform()
     {
-        orientation.toMatrix( rotation );
-        transposeRotation = transpose( rotation );
-
-        inertiaTensorWorld = rotation * inertiaTensor * transposeRotation;
-        inverseInertiaTensorWorld = rotation * inverseInertiaTensor * transposeRotation;
-
-        transform.Initialize( position, rotation, transposeRotation );
+        transform.Initialize( position, orientation );
     }
 
     void UpdateMomentum()
@@ -78,7 +70,7 @@ struct RigidBody
             angularMomentum = vec3f( x,y,z );
 
             linearVelocity = linearMomentum * inverseMass;
-            angularVelocity = transformVector( inverseInertiaTensorWorld, angularMomentum );
+            angularVelocity = TransformByInverseInertiaWorld( angularMomentum );
         }
         else
         {
@@ -89,9 +81,25 @@ struct RigidBody
         }
     }
 
+    vec3f TransformByInverseInertiaWorld( const vec3f & vector ) const
+    {
+        // for a symmetric top with local axis "up" the world space inverse inertia tensor is:
+        //
+        //      I^-1 = 1/ixy * identity + ( 1/iz - 1/ixy ) * up * up^T
+        //
+        // so applying it to a vector is one dot product and two multiply-adds
+
+        assert( fabs( inverseInertia.x() - inverseInertia.y() ) <= 0.001f * inverseInertia.x() );
+
+        const float a = inverseInertia.x();
+        const float b = inverseInertia.z() - a;
+        const vec3f & up = transform.axisZ;
+        return vector * a + up * ( b * dot( up, vector ) );
+    }
+
     void GetVelocityAtWorldPoint( const vec3f & point, vec3f & velocity ) const
     {
-        vec3f angularVelocity = transformVector( inverseInertiaTensorWorld, angularMomentum );
+        vec3f angularVelocity = TransformByInverseInertiaWorld( angularMomentum );
         velocity = linearVelocity + cross( angularVelocity, point - position );
     }
 
@@ -102,20 +110,11 @@ struct RigidBody
 
         const float linearKE = length_squared( linearMomentum ) / ( 2 * mass );
 
-        vec3f angularMomentumLocal = transformVector( transposeRotation, angularMomentum );
-        vec3f angularVelocityLocal = transformVector( inverseInertiaTensor, angularMomentumLocal );
-
-        const float ix = inertia.x();
-        const float iy = inertia.y();
-        const float iz = inertia.z();
+        // 1/2 w^T I w == 1/2 L.w because L = I w
 
-        const float wx = angularVelocityLocal.x();
-        const float wy = angularVelocityLocal.y();
-        const float wz = angularVelocityLocal.z();
+        const vec3f angularVelocityWorld = TransformByInverseInertiaWorld( angularMomentum );
 
-        const float angularKE = 0.5f * ( ix * wx * wx + 
-                                         iy * wy * wy +
-                                         iz * wz * wz );
+        const float angularKE = 0.5f * dot( angularMomentum, angularVelocityWorld );
 
         return linearKE + angularKE;
     }
@@ -0,0 +1,422 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include "World.h"
+
+#if defined( VECTORIAL_SSE ) && defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
+
+/*
+    Rollback buffer.
+
+    Client prediction and lag compensation both need to take the world
+    back a few frames, apply an input that arrived late and simulate
+    forward again to the present. This keeps the last "maxFrames" world
+    states in a ring so that any of them can be restored in one go.
+
+    Saving has to be cheap enough to do every step at 60Hz, so only what
+    has changed gets copied:
+
+        - every awake body is copied
+        - a sleeping body is compared with its copy in the previous frame,
+          and when they match the copy is shared instead (copy on write).
+          a board full of settled stones costs a compare per stone.
+        - the body pool's slot tables are only copied when stones have
+          been added or removed, otherwise the previous copy is shared
+
+    Copies are reference counted, and everything is allocated up front in
+    "Initialize", enough for every body in every frame to be awake.
+
+    Frames must be saved in order with no gaps. Rewinding to a frame
+    drops every frame after it, since re-simulating saves them again.
+*/
+
+struct RollbackStats
+{
+    RollbackStats()
+    {
+        framesSaved = 0;
+        framesRestored = 0;
+        bodiesCopied = 0;
+        bodiesShared = 0;
+        layoutsCopied = 0;
+    }
+
+    uint64_t framesSaved;
+    uint64_t framesRestored;
+    uint64_t bodiesCopied;
+    uint64_t bodiesShared;          // sleeping and unchanged, so the previous frame's copy was reused
+    uint64_t layoutsCopied;
+};
+
+// IMPORTANT: sleeping bodies are matched bit for bit rather than with float compares,
+// so -0 and +0 differ and a shared copy restores exactly
+
+inline bool RollbackSameBits( float a, float b )
+{
+    return memcmp( &a, &b, sizeof( float ) ) == 0;
+}
+
+inline bool RollbackSameBits( const vec3f & a, const vec3f & b )
+{
+    #if defined( VECTORIAL_SSE ) && defined( __SSE2__ )
+
+        const __m128i equal = _mm_cmpeq_epi32( _mm_castps_si128( a.value ), _mm_castps_si128( b.value ) );
+        return ( _mm_movemask_epi8( equal ) & 0xFFF ) == 0xFFF;
+
+    #else
+
+        return RollbackSameBits( a.x(), b.x() ) && RollbackSameBits( a.y(), b.y() ) && RollbackSameBits( a.z(), b.z() );
+
+    #endif
+}
+
+// true if restoring either body gives exactly the same simulation. only the state that isn't
+// recalculated from the rest is compared: the transform and velocities follow from it
+
+inline bool RollbackBodiesMatch( const RigidBody & a, const RigidBody & b )
+{
+    return a.active == b.active &&
+           RollbackSameBits( a.position, b.position ) &&
+           memcmp( &a.orientation, &b.orientation, sizeof( quat4f ) ) == 0 &&
+           RollbackSameBits( a.linearMomentum, b.linearMomentum ) &&
+           RollbackSameBits( a.angularMomentum, b.angularMomentum ) &&
+           RollbackSameBits( a.inertia, b.inertia ) &&
+           RollbackSameBits( a.inverseInertia, b.inverseInertia ) &&
+           RollbackSameBits( a.mass, b.mass ) &&
+           RollbackSameBits( a.inverseMass, b.inverseMass ) &&
+           RollbackSameBits( a.deactivateTimer, b.deactivateTimer );
+}
+
+class RollbackBuffer
+{
+public:
+
+    RollbackBuffer()
+    {
+        maxFrames = 0;
+        maxBodies = 0;
+        layoutSize = 0;
+        frames = NULL;
+        bodyRefs = NULL;
+        copies = NULL;
+        copyRefCounts = NULL;
+        freeCopies = NULL;
+        numFreeCopies = 0;
+        layouts = NULL;
+        layoutRefCounts = NULL;
+        lastRefs = NULL;
+        lastLayout = -1;
+        lastLayoutVersion = 0;
+        oldestFrame = 0;
+        newestFrame = -1;
+    }
+
+    ~RollbackBuffer()
+    {
+        Free();
+    }
+
+    void Initialize( int numFrames, int numBodies )
+    {
+        assert( numFrames > 0 );
+        assert( numBodies > 0 );
+
+        Free();
+
+        maxFrames = numFrames;
+        maxBodies = numBodies;
+        layoutSize = BodyPool::GetLayoutSize( maxBodies );
+
+        // IMPORTANT: one frame more than the ring holds, since a new frame is copied before the oldest is released
+
+        const int maxCopies = ( maxFrames + 1 ) * maxBodies;
+        const int maxLayouts = maxFrames + 1;
+
+        frames = new Frame[maxFrames];
+        bodyRefs = new int[maxFrames * maxBodies];
+        copies = new RigidBody[maxCopies];
+        copyRefCounts = new int[maxCopies];
+        freeCopies = new int[maxCopies];
+        layouts = new uint8_t[maxLayouts * layoutSize];
+        layoutRefCounts = new int[maxLayouts];
+        lastRefs = new int[maxBodies];
+
+        Reset();
+    }
+
+    void Free()
+    {
+        delete [] frames;
+        delete [] bodyRefs;
+        delete [] copies;
+        delete [] copyRefCounts;
+        delete [] freeCopies;
+        delete [] layouts;
+        delete [] layoutRefCounts;
+        delete [] lastRefs;
+        frames = NULL;
+        bodyRefs = NULL;
+        copies = NULL;
+        copyRefCounts = NULL;
+        freeCopies = NULL;
+        layouts = NULL;
+        layoutRefCounts = NULL;
+        lastRefs = NULL;
+        maxFrames = 0;
+        maxBodies = 0;
+    }
+
+    void Reset()
+    {
+        const int maxCopies = ( maxFrames + 1 ) * maxBodies;
+        for ( int i = 0; i < maxCopies; ++i )
+        {
+            copyRefCounts[i] = 0;
+            freeCopies[i] = maxCopies - 1 - i;
+        }
+        numFreeCopies = maxCopies;
+
+        for ( int i = 0; i <= maxFrames; ++i )
+            layoutRefCounts[i] = 0;
+
+        for ( int i = 0; i < maxFrames; ++i )
+            frames[i].valid = false;
+
+        for ( int i = 0; i < maxBodies; ++i )
+            lastRefs[i] = -1;
+
+        lastLayout = -1;
+        lastLayoutVersion = 0;
+        oldestFrame = 0;
+        newestFrame = -1;
+    }
+
+    // saves the world as it is at this frame. must be the frame after the newest saved, unless nothing is saved yet
+
+    void SaveFrame( int64_t frame, const World & world )
+    {
+        assert( frames );
+        assert( frame >= 0 );
+        assert( IsEmpty() || frame == newestFrame + 1 );
+
+        const BodyPool & pool = world.GetBodyPool();
+        assert( pool.GetCapacity() <= maxBodies );
+
+        if ( IsEmpty() )
+            oldestFrame = frame;
+
+        const int slot = int( frame % maxFrames );
+        Frame & entry = frames[slot];
+
+        // the pool layout, shared with the previous frame unless a stone was added or removed since
+
+        int layout = lastLayout;
+        if ( layout < 0 || pool.GetLayoutVersion() != lastLayoutVersion )
+        {
+            layout = AllocateLayout();
+            pool.SaveLayout( layouts + layout * layoutSize );
+            lastLayoutVersion = pool.GetLayoutVersion();
+            stats.layoutsCopied++;
+        }
+        layoutRefCounts[layout]++;
+
+        // bodies. awake bodies are always copied, sleeping bodies only when they differ from their last copy
+
+        const RigidBody * rigidBodies = pool.GetBodies();
+        const int numBodies = pool.GetNumBodies();
+
+        // IMPORTANT: refs go into "lastRefs" first. the slot's own refs still belong to the frame being replaced
+
+        for ( int i = 0; i < numBodies; ++i )
+        {
+            const RigidBody & rigidBody = rigidBodies[i];
+            const int last = lastRefs[i];
+
+            int ref;
+            if ( !rigidBody.active && last >= 0 && RollbackBodiesMatch( copies[last], rigidBody ) )
+            {
+                ref = last;
+                stats.bodiesShared++;
+            }
+            else
+            {
+                ref = AllocateCopy();
+                copies[ref] = rigidBody;
+                stats.bodiesCopied++;
+            }
+
+            copyRefCounts[ref]++;
+            lastRefs[i] = ref;
+        }
+        for ( int i = numBodies; i < maxBodies; ++i )
+            lastRefs[i] = -1;
+
+        // release the frame this one replaces only now, after any copies shared with it have been referenced
+
+        if ( entry.valid )
+        {
+            assert( entry.frame == frame - maxFrames );
+            ReleaseFrame( slot );
+            oldestFrame = frame - maxFrames + 1;
+        }
+
+        entry.valid = true;
+        entry.frame = frame;
+        entry.numBodies = numBodies;
+        entry.layout = layout;
+
+        memcpy( bodyRefs + slot * maxBodies, lastRefs, sizeof( int ) * numBodies );
+        lastLayout = layout;
+
+        newestFrame = frame;
+
+        stats.framesSaved++;
+    }
+
+    // puts the world back as it was when this frame was saved and drops every newer frame.
+    // returns false if the frame is no longer, or not yet, in the buffer
+
+    bool Rewind( int64_t frame, World & world )
+    {
+        assert( frames );
+
+        if ( !HasFrame( frame ) )
+            return false;
+
+        BodyPool & pool = world.GetBodyPool();
+        assert( pool.GetCapacity() <= maxBodies );
+
+        for ( int64_t i = newestFrame; i > frame; --i )
+            ReleaseFrame( int( i % maxFrames ) );
+
+        const int slot = int( frame % maxFrames );
+        const Frame & entry = frames[slot];
+        const int * refs = bodyRefs + slot * maxBodies;
+
+        pool.RestoreLayout( layouts + entry.layout * layoutSize );
+        assert( pool.GetNumBodies() == entry.numBodies );
+
+        RigidBody * rigidBodies = pool.GetBodies();
+        for ( int i = 0; i < entry.numBodies; ++i )
+            rigidBodies[i] = copies[refs[i]];
+
+        world.UpdateNumActive();
+
+        // the next save follows on from this frame, so compare against its copies
+
+        for ( int i = 0; i < entry.numBodies; ++i )
+            lastRefs[i] = refs[i];
+        for ( int i = entry.numBodies; i < maxBodies; ++i )
+            lastRefs[i] = -1;
+        lastLayout = entry.layout;
+        lastLayoutVersion = pool.GetLayoutVersion();
+
+        newestFrame = frame;
+
+        stats.framesRestored++;
+
+        return true;
+    }
+
+    bool HasFrame( int64_t frame ) const
+    {
+        return !IsEmpty() && frame >= oldestFrame && frame <= newestFrame;
+    }
+
+    bool IsEmpty() const { return newestFrame < oldestFrame; }
+
+    int GetNumFrames() const { return IsEmpty() ? 0 : int( newestFrame - oldestFrame + 1 ); }
+
+    int64_t GetOldestFrame() const { return oldestFrame; }
+
+    int64_t GetNewestFrame() const { return newestFrame; }
+
+    int GetMaxFrames() const { return maxFrames; }
+
+    // body copies in use across every frame. a frame of sleeping stones adds next to nothing
+
+    int GetNumCopies() const { return ( maxFrames + 1 ) * maxBodies - numFreeCopies; }
+
+    const RollbackStats & GetStats() const { return stats; }
+
+    void ResetStats()
+    {
+        stats = RollbackStats();
+    }
+
+private:
+
+    RollbackBuffer( const RollbackBuffer & other );
+    RollbackBuffer & operator = ( const RollbackBuffer & other );
+
+    struct Frame
+    {
+        int64_t frame;
+        int numBodies;
+        int layout;
+        bool valid;
+    };
+
+    int AllocateCopy()
+    {
+        assert( numFreeCopies > 0 );
+        return freeCopies[--numFreeCopies];
+    }
+
+    int AllocateLayout()
+    {
+        for ( int i = 0; i <= maxFrames; ++i )
+        {
+            if ( layoutRefCounts[i] == 0 )
+                return i;
+        }
+        assert( !"out of layouts" );
+        return 0;
+    }
+
+    void ReleaseFrame( int slot )
+    {
+        Frame & entry = frames[slot];
+        assert( entry.valid );
+
+        const int * refs = bodyRefs + slot * maxBodies;
+        for ( int i = 0; i < entry.numBodies; ++i )
+        {
+            const int ref = refs[i];
+            assert( copyRefCounts[ref] > 0 );
+            if ( --copyRefCounts[ref] == 0 )
+                freeCopies[numFreeCopies++] = ref;
+        }
+
+        assert( layoutRefCounts[entry.layout] > 0 );
+        layoutRefCounts[entry.layout]--;
+
+        entry.valid = false;
+    }
+
+    int maxFrames;
+    int maxBodies;
+    size_t layoutSize;
+
+    Frame * frames;
+    int * bodyRefs;                 // per frame, per body: index of its copy
+    RigidBody * copies;
+    int * copyRefCounts;
+    int * freeCopies;
+    int numFreeCopies;
+    uint8_t * layouts;
+    int * layoutRefCounts;
+
+    int * lastRefs;                 // copies in the newest frame, to share sleepers with
+    int lastLayout;
+    uint32_t lastLayoutVersion;
+
+    int64_t oldestFrame;
+    int64_t newestFrame;
+
+    RollbackStats stats;
+};
+
+#endif
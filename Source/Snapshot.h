@@ -0,0 +1,628 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "Common.h"
+#include "Board.h"
+#include "RigidBody.h"
+#include "BitPacker.h"
+#include "World.h"
+
+/*
+    World snapshots.
+
+    A snapshot is the state of every stone on a table, quantized so it can
+    be bit-packed into a packet and reconstructed exactly the same way on
+    the other side. Quantized values are what get compared and delta
+    encoded, so the server and every client agree on them bit for bit.
+
+    Per stone:
+
+        - one bit for awake or asleep
+        - position quantized within the table bounds
+        - orientation as "smallest three": the index of the largest
+          component in two bits, then the other three, which must lie in
+          [-1/sqrt(2),1/sqrt(2)]. the largest is rebuilt from unit length
+        - linear and angular momentum clamped to a maximum and quantized,
+          only for stones that are awake. sleeping stones have none
+
+    The default params cover a 19x19 board at 1/512 cm. A moving stone is
+    165 bits and a sleeping stone 78 bits, so a full board of sleeping
+    stones is about 3.4k. See "BenchmarkSnapshot" for measured numbers.
+*/
+
+const int MaxSnapshotStones = 19 * 19;
+
+struct SnapshotParams
+{
+    SnapshotParams()
+    {
+        boundsX = 30.0f;
+        boundsY = 31.0f;
+        minZ = 0.0f;
+        maxZ = 32.0f;
+        positionResolution = 1.0f / 512.0f;
+        orientationBits = 10;
+        maxLinearMomentum = 64.0f;
+        linearMomentumResolution = 1.0f / 128.0f;
+        maxAngularMomentum = 32.0f;
+        angularMomentumResolution = 1.0f / 128.0f;
+    }
+
+    // bounds fit the board with some margin for stones on the floor around it
+
+    void Initialize( const Board & board, float margin = 8.0f )
+    {
+        boundsX = board.GetWidth() * 0.5f + margin;
+        boundsY = board.GetHeight() * 0.5f + margin;
+    }
+
+    float boundsX;                      // position x in [-boundsX,boundsX]
+    float boundsY;                      // position y in [-boundsY,boundsY]
+    float minZ;
+    float maxZ;
+    float positionResolution;           // cms
+    int orientationBits;                // per smallest three component
+    float maxLinearMomentum;            // per component
+    float linearMomentumResolution;
+    float maxAngularMomentum;           // per component
+    float angularMomentumResolution;
+};
+
+struct QuantizedStone
+{
+    bool active;
+    uint32_t position[3];
+    uint32_t orientationLargest;
+    uint32_t orientation[3];
+    uint32_t linearMomentum[3];
+    uint32_t angularMomentum[3];
+};
+
+struct Snapshot
+{
+    Snapshot()
+    {
+        sequence = 0;
+        numStones = 0;
+    }
+
+    uint16_t sequence;
+    int numStones;
+    QuantizedStone stones[MaxSnapshotStones];
+};
+
+// ----------------------------------------------------------------
+
+inline uint32_t QuantizeFloat( float value, float min, float max, float resolution )
+{
+    return uint32_t( ( clamp( value, min, max ) - min ) / resolution + 0.5f );
+}
+
+inline float DequantizeFloat( uint32_t value, float min, float resolution )
+{
+    return min + value * resolution;
+}
+
+inline int QuantizedBits( float min, float max, float resolution )
+{
+    return BitsRequired( QuantizeFloat( max, min, max, resolution ) );
+}
+
+inline void QuantizeOrientation( const quat4f & orientation, int bits, uint32_t & largest, uint32_t * components )
+{
+    float q[] = { orientation.x, orientation.y, orientation.z, orientation.w };
+
+    largest = 0;
+    for ( int i = 1; i < 4; ++i )
+    {
+        if ( fabs( q[i] ) > fabs( q[largest] ) )
+            largest = i;
+    }
+
+    // q and -q are the same rotation, so flip to make the largest positive and drop it
+
+    const float sign = q[largest] < 0 ? -1.0f : 1.0f;
+
+    const float bound = 0.707107f;
+    const float resolution = ( 2 * bound ) / ( ( 1 << bits ) - 1 );
+
+    int j = 0;
+    for ( int i = 0; i < 4; ++i )
+    {
+        if ( i != (int) largest )
+            components[j++] = QuantizeFloat( q[i] * sign, -bound, bound, resolution );
+    }
+}
+
+inline quat4f DequantizeOrientation( uint32_t largest, const uint32_t * components, int bits )
+{
+    const float bound = 0.707107f;
+    const float resolution = ( 2 * bound ) / ( ( 1 << bits ) - 1 );
+
+    float q[4];
+    float sum = 0.0f;
+    int j = 0;
+    for ( int i = 0; i < 4; ++i )
+    {
+        if ( i == (int) largest )
+            continue;
+        q[i] = DequantizeFloat( components[j++], -bound, resolution );
+        sum += q[i] * q[i];
+    }
+
+    q[largest] = sqrt( max( 0.0f, 1.0f - sum ) );
+
+    return normalize( quat4f( q[3], q[0], q[1], q[2] ) );
+}
+
+inline void QuantizeStone( const SnapshotParams & params, const RigidBody & rigidBody, QuantizedStone & stone )
+{
+    stone.active = rigidBody.active;
+
+    stone.position[0] = QuantizeFloat( rigidBody.position.x(), -params.boundsX, params.boundsX, params.positionResolution );
+    stone.position[1] = QuantizeFloat( rigidBody.position.y(), -params.boundsY, params.boundsY, params.positionResolution );
+    stone.position[2] = QuantizeFloat( rigidBody.position.z(), params.minZ, params.maxZ, params.positionResolution );
+
+    QuantizeOrientation( rigidBody.orientation, params.orientationBits, stone.orientationLargest, stone.orientation );
+
+    const float ml = params.maxLinearMomentum;
+    const float ma = params.maxAngularMomentum;
+
+    const vec3f & l = rigidBody.linearMomentum;
+    const vec3f & a = rigidBody.angularMomentum;
+
+    // IMPORTANT: sleeping stones store quantized zero momentum, so a stone waking up deltas against zero
+
+    const float linearMomentum[] = { l.x(), l.y(), l.z() };
+    const float angularMomentum[] = { a.x(), a.y(), a.z() };
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        stone.linearMomentum[i] = QuantizeFloat( rigidBody.active ? linearMomentum[i] : 0.0f, -ml, ml, params.linearMomentumResolution );
+        stone.angularMomentum[i] = QuantizeFloat( rigidBody.active ? angularMomentum[i] : 0.0f, -ma, ma, params.angularMomentumResolution );
+    }
+}
+
+// IMPORTANT: only the state is written. mass and inertia are the same for every stone on a table
+
+inline void DequantizeStone( const SnapshotParams & params, const QuantizedStone & stone, RigidBody & rigidBody )
+{
+    rigidBody.position = vec3f( DequantizeFloat( stone.position[0], -params.boundsX, params.positionResolution ),
+                                DequantizeFloat( stone.position[1], -params.boundsY, params.positionResolution ),
+                                DequantizeFloat( stone.position[2], params.minZ, params.positionResolution ) );
+
+    rigidBody.orientation = DequantizeOrientation( stone.orientationLargest, stone.orientation, params.orientationBits );
+
+    rigidBody.active = stone.active;
+
+    if ( stone.active )
+    {
+        const float ml = params.maxLinearMomentum;
+        const float ma = params.maxAngularMomentum;
+
+        rigidBody.linearMomentum = vec3f( DequantizeFloat( stone.linearMomentum[0], -ml, params.linearMomentumResolution ),
+                                          DequantizeFloat( stone.linearMomentum[1], -ml, params.linearMomentumResolution ),
+                                          DequantizeFloat( stone.linearMomentum[2], -ml, params.linearMomentumResolution ) );
+
+        rigidBody.angularMomentum = vec3f( DequantizeFloat( stone.angularMomentum[0], -ma, params.angularMomentumResolution ),
+                                           DequantizeFloat( stone.angularMomentum[1], -ma, params.angularMomentumResolution ),
+                                           DequantizeFloat( stone.angularMomentum[2], -ma, params.angularMomentumResolution ) );
+    }
+    else
+    {
+        rigidBody.linearMomentum = vec3f(0,0,0);
+        rigidBody.angularMomentum = vec3f(0,0,0);
+    }
+
+    rigidBody.UpdateTransform();
+    rigidBody.UpdateMomentum();
+}
+
+// ----------------------------------------------------------------
+
+/*
+    Field widths in bits for one set of params, plus the quantized zero
+    momentum that sleeping stones carry. Worked out once per snapshot
+    rather than once per stone.
+*/
+
+struct SnapshotBits
+{
+    SnapshotBits( const SnapshotParams & params )
+    {
+        positionXY[0] = QuantizedBits( -params.boundsX, params.boundsX, params.positionResolution );
+        positionXY[1] = QuantizedBits( -params.boundsY, params.boundsY, params.positionResolution );
+        positionZ = QuantizedBits( params.minZ, params.maxZ, params.positionResolution );
+        orientation = params.orientationBits;
+        linearMomentum = QuantizedBits( -params.maxLinearMomentum, params.maxLinearMomentum, params.linearMomentumResolution );
+        angularMomentum = QuantizedBits( -params.maxAngularMomentum, params.maxAngularMomentum, params.angularMomentumResolution );
+        numStones = BitsRequired( MaxSnapshotStones );
+        linearMomentumZero = QuantizeFloat( 0.0f, -params.maxLinearMomentum, params.maxLinearMomentum, params.linearMomentumResolution );
+        angularMomentumZero = QuantizeFloat( 0.0f, -params.maxAngularMomentum, params.maxAngularMomentum, params.angularMomentumResolution );
+    }
+
+    int GetPosition( int axis ) const
+    {
+        return axis < 2 ? positionXY[axis] : positionZ;
+    }
+
+    // bits "WriteStone" takes for a stone. sleeping stones leave out their momentum
+
+    int GetStone( bool active ) const
+    {
+        const int bits = 1 + positionXY[0] + positionXY[1] + positionZ + 2 + orientation * 3;
+        return active ? bits + linearMomentum * 3 + angularMomentum * 3 : bits;
+    }
+
+    int positionXY[2];
+    int positionZ;
+    int orientation;
+    int linearMomentum;
+    int angularMomentum;
+    int numStones;
+    uint32_t linearMomentumZero;
+    uint32_t angularMomentumZero;
+};
+
+inline bool operator == ( const QuantizedStone & a, const QuantizedStone & b )
+{
+    if ( a.active != b.active || a.orientationLargest != b.orientationLargest )
+        return false;
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        if ( a.position[i] != b.position[i] ||
+             a.orientation[i] != b.orientation[i] ||
+             a.linearMomentum[i] != b.linearMomentum[i] ||
+             a.angularMomentum[i] != b.angularMomentum[i] )
+            return false;
+    }
+
+    return true;
+}
+
+inline bool operator != ( const QuantizedStone & a, const QuantizedStone & b )
+{
+    return !( a == b );
+}
+
+inline void WriteStone( BitWriter & writer, const SnapshotBits & bits, const QuantizedStone & stone )
+{
+    writer.WriteBool( stone.active );
+
+    for ( int i = 0; i < 3; ++i )
+        writer.WriteBits( stone.position[i], bits.GetPosition( i ) );
+
+    writer.WriteBits( stone.orientationLargest, 2 );
+    for ( int i = 0; i < 3; ++i )
+        writer.WriteBits( stone.orientation[i], bits.orientation );
+
+    if ( !stone.active )
+        return;
+
+    for ( int i = 0; i < 3; ++i )
+        writer.WriteBits( stone.linearMomentum[i], bits.linearMomentum );
+
+    for ( int i = 0; i < 3; ++i )
+        writer.WriteBits( stone.angularMomentum[i], bits.angularMomentum );
+}
+
+inline void ReadStone( BitReader & reader, const SnapshotBits & bits, QuantizedStone & stone )
+{
+    stone.active = reader.ReadBool();
+
+    for ( int i = 0; i < 3; ++i )
+        stone.position[i] = reader.ReadBits( bits.GetPosition( i ) );
+
+    stone.orientationLargest = reader.ReadBits( 2 );
+    for ( int i = 0; i < 3; ++i )
+        stone.orientation[i] = reader.ReadBits( bits.orientation );
+
+    for ( int i = 0; i < 3; ++i )
+        stone.linearMomentum[i] = stone.active ? reader.ReadBits( bits.linearMomentum ) : bits.linearMomentumZero;
+
+    for ( int i = 0; i < 3; ++i )
+        stone.angularMomentum[i] = stone.active ? reader.ReadBits( bits.angularMomentum ) : bits.angularMomentumZero;
+}
+
+// returns false if the snapshot did not fit. call "FlushBits" on the writer before sending
+
+inline bool WriteSnapshot( BitWriter & writer, const SnapshotParams & params, const Snapshot & snapshot )
+{
+    const SnapshotBits bits( params );
+
+    writer.WriteBits( snapshot.sequence, 16 );
+    writer.WriteBits( snapshot.numStones, bits.numStones );
+
+    for ( int i = 0; i < snapshot.numStones; ++i )
+        WriteStone( writer, bits, snapshot.stones[i] );
+
+    return !writer.IsOverflow();
+}
+
+// returns false if the packet was truncated or malformed
+
+inline bool ReadSnapshot( BitReader & reader, const SnapshotParams & params, Snapshot & snapshot )
+{
+    const SnapshotBits bits( params );
+
+    snapshot.sequence = reader.ReadBits( 16 );
+    snapshot.numStones = reader.ReadBits( bits.numStones );
+    if ( snapshot.numStones > MaxSnapshotStones )
+        return false;
+
+    for ( int i = 0; i < snapshot.numStones; ++i )
+        ReadStone( reader, bits, snapshot.stones[i] );
+
+    return !reader.IsOverflow();
+}
+
+// ----------------------------------------------------------------
+
+/*
+    Delta compression.
+
+    A snapshot can be written relative to a baseline snapshot the receiver
+    already has. Each stone that matches its baseline is a single zero bit.
+    A changed stone sends only the groups that changed (position,
+    orientation, momentum), and each changed value is sent as a small
+    signed offset from the baseline when it is close, falling back to the
+    full value when it is not.
+
+    Offsets are zigzag encoded and sent with a prefix:
+
+        0  + 4 bits     offset in [-8,7]
+        10 + 8 bits     offset in [-128,127]
+        11 + full       the absolute value
+
+    Stones past the end of the baseline are sent in full.
+*/
+
+const int SmallDeltaBits = 4;
+const int MediumDeltaBits = 8;
+
+inline void WriteRelative( BitWriter & writer, uint32_t value, uint32_t baseline, int bits )
+{
+    const int32_t delta = int32_t( value - baseline );
+    const uint32_t zigzag = ( uint32_t( delta ) << 1 ) ^ uint32_t( delta >> 31 );
+
+    if ( zigzag < ( 1u << SmallDeltaBits ) )
+    {
+        writer.WriteBool( false );
+        writer.WriteBits( zigzag, SmallDeltaBits );
+    }
+    else if ( zigzag < ( 1u << MediumDeltaBits ) )
+    {
+        writer.WriteBool( true );
+        writer.WriteBool( false );
+        writer.WriteBits( zigzag, MediumDeltaBits );
+    }
+    else
+    {
+        writer.WriteBool( true );
+        writer.WriteBool( true );
+        writer.WriteBits( value, bits );
+    }
+}
+
+inline uint32_t ReadRelative( BitReader & reader, uint32_t baseline, int bits )
+{
+    uint32_t zigzag;
+    if ( !reader.ReadBool() )
+        zigzag = reader.ReadBits( SmallDeltaBits );
+    else if ( !reader.ReadBool() )
+        zigzag = reader.ReadBits( MediumDeltaBits );
+    else
+        return reader.ReadBits( bits );
+
+    const int32_t delta = int32_t( zigzag >> 1 ) ^ -int32_t( zigzag & 1 );
+    return baseline + uint32_t( delta );
+}
+
+inline void WriteStoneDelta( BitWriter & writer, const SnapshotBits & bits, const QuantizedStone & stone, const QuantizedStone & baseline )
+{
+    writer.WriteBool( stone.active );
+
+    const bool positionChanged = stone.position[0] != baseline.position[0] ||
+                                 stone.position[1] != baseline.position[1] ||
+                                 stone.position[2] != baseline.position[2];
+    writer.WriteBool( positionChanged );
+    if ( positionChanged )
+    {
+        for ( int i = 0; i < 3; ++i )
+            WriteRelative( writer, stone.position[i], baseline.position[i], bits.GetPosition( i ) );
+    }
+
+    const bool orientationChanged = stone.orientationLargest != baseline.orientationLargest ||
+                                    stone.orientation[0] != baseline.orientation[0] ||
+                                    stone.orientation[1] != baseline.orientation[1] ||
+                                    stone.orientation[2] != baseline.orientation[2];
+    writer.WriteBool( orientationChanged );
+    if ( orientationChanged )
+    {
+        // components are only comparable when the same one was dropped
+
+        writer.WriteBits( stone.orientationLargest, 2 );
+        const bool sameLargest = stone.orientationLargest == baseline.orientationLargest;
+        for ( int i = 0; i < 3; ++i )
+        {
+            if ( sameLargest )
+                WriteRelative( writer, stone.orientation[i], baseline.orientation[i], bits.orientation );
+            else
+                writer.WriteBits( stone.orientation[i], bits.orientation );
+        }
+    }
+
+    if ( !stone.active )
+        return;
+
+    bool momentumChanged = false;
+    for ( int i = 0; i < 3; ++i )
+    {
+        if ( stone.linearMomentum[i] != baseline.linearMomentum[i] || stone.angularMomentum[i] != baseline.angularMomentum[i] )
+            momentumChanged = true;
+    }
+
+    writer.WriteBool( momentumChanged );
+    if ( momentumChanged )
+    {
+        for ( int i = 0; i < 3; ++i )
+            WriteRelative( writer, stone.linearMomentum[i], baseline.linearMomentum[i], bits.linearMomentum );
+        for ( int i = 0; i < 3; ++i )
+            WriteRelative( writer, stone.angularMomentum[i], baseline.angularMomentum[i], bits.angularMomentum );
+    }
+}
+
+inline void ReadStoneDelta( BitReader & reader, const SnapshotBits & bits, const QuantizedStone & baseline, QuantizedStone & stone )
+{
+    stone = baseline;
+
+    stone.active = reader.ReadBool();
+
+    if ( reader.ReadBool() )
+    {
+        for ( int i = 0; i < 3; ++i )
+            stone.position[i] = ReadRelative( reader, baseline.position[i], bits.GetPosition( i ) );
+    }
+
+    if ( reader.ReadBool() )
+    {
+        stone.orientationLargest = reader.ReadBits( 2 );
+        const bool sameLargest = stone.orientationLargest == baseline.orientationLargest;
+        for ( int i = 0; i < 3; ++i )
+            stone.orientation[i] = sameLargest ? ReadRelative( reader, baseline.orientation[i], bits.orientation ) : reader.ReadBits( bits.orientation );
+    }
+
+    if ( !stone.active )
+    {
+        for ( int i = 0; i < 3; ++i )
+        {
+            stone.linearMomentum[i] = bits.linearMomentumZero;
+            stone.angularMomentum[i] = bits.angularMomentumZero;
+        }
+        return;
+    }
+
+    if ( reader.ReadBool() )
+    {
+        for ( int i = 0; i < 3; ++i )
+            stone.linearMomentum[i] = ReadRelative( reader, baseline.linearMomentum[i], bits.linearMomentum );
+        for ( int i = 0; i < 3; ++i )
+            stone.angularMomentum[i] = ReadRelative( reader, baseline.angularMomentum[i], bits.angularMomentum );
+    }
+}
+
+// IMPORTANT: the baseline is not named in the stream. sender and receiver must agree on it (see Replication.h)
+
+inline bool WriteSnapshotDelta( BitWriter & writer, const SnapshotParams & params, const Snapshot & snapshot, const Snapshot & baseline )
+{
+    const SnapshotBits bits( params );
+
+    writer.WriteBits( snapshot.sequence, 16 );
+    writer.WriteBits( snapshot.numStones, bits.numStones );
+
+    for ( int i = 0; i < snapshot.numStones; ++i )
+    {
+        const QuantizedStone & stone = snapshot.stones[i];
+
+        if ( i >= baseline.numStones )
+        {
+            WriteStone( writer, bits, stone );
+            continue;
+        }
+
+        const QuantizedStone & base = baseline.stones[i];
+        const bool changed = stone != base;
+        writer.WriteBool( changed );
+        if ( changed )
+            WriteStoneDelta( writer, bits, stone, base );
+    }
+
+    return !writer.IsOverflow();
+}
+
+inline bool ReadSnapshotDelta( BitReader & reader, const SnapshotParams & params, const Snapshot & baseline, Snapshot & snapshot )
+{
+    assert( &baseline != &snapshot );
+
+    const SnapshotBits bits( params );
+
+    snapshot.sequence = reader.ReadBits( 16 );
+    snapshot.numStones = reader.ReadBits( bits.numStones );
+    if ( snapshot.numStones > MaxSnapshotStones )
+        return false;
+
+    for ( int i = 0; i < snapshot.numStones; ++i )
+    {
+        QuantizedStone & stone = snapshot.stones[i];
+
+        if ( i >= baseline.numStones )
+            ReadStone( reader, bits, stone );
+        else if ( reader.ReadBool() )
+            ReadStoneDelta( reader, bits, baseline.stones[i], stone );
+        else
+            stone = baseline.stones[i];
+    }
+
+    return !reader.IsOverflow();
+}
+
+// ----------------------------------------------------------------
+
+inline void CaptureSnapshot( const SnapshotParams & params, const World & world, uint16_t sequence, Snapshot & snapshot )
+{
+    assert( world.GetNumBodies() <= MaxSnapshotStones );
+
+    snapshot.sequence = sequence;
+    snapshot.numStones = world.GetNumBodies();
+
+    for ( int i = 0; i < snapshot.numStones; ++i )
+        QuantizeStone( params, world.GetBody( i ), snapshot.stones[i] );
+}
+
+// adds or removes stones at the end of the world until it has this many.
+// returns false, leaving the world as it was, if the world can't hold that many
+
+inline bool SetNumStones( World & world, int numStones )
+{
+    if ( numStones < 0 || numStones > world.GetMaxBodies() )
+        return false;
+
+    while ( world.GetNumBodies() > numStones )
+        world.RemoveStone( world.GetHandle( world.GetNumBodies() - 1 ) );
+
+    while ( world.GetNumBodies() < numStones )
+        world.AddStone( vec3f(0,0,0), quat4f::identity() );
+
+    return true;
+}
+
+inline void ApplyStone( const SnapshotParams & params, const QuantizedStone & stone, World & world, int index )
+{
+    const BodyHandle handle = world.GetHandle( index );
+
+    // IMPORTANT: wake and sleep through the world so it keeps count of active stones
+
+    if ( stone.active )
+        world.Wake( handle );
+    else
+        world.Sleep( handle );
+
+    DequantizeStone( params, stone, world.GetBody( handle ) );
+}
+
+// makes the world match the snapshot, adding or removing stones so the counts agree.
+// returns false, leaving the world as it was, if the snapshot has more stones than the world can hold
+
+inline bool ApplySnapshot( const SnapshotParams & params, const Snapshot & snapshot, World & world )
+{
+    if ( !SetNumStones( world, snapshot.numStones ) )
+        return false;
+
+    for ( int i = 0; i < snapshot.numStones; ++i )
+        ApplyStone( params, snapshot.stones[i], world, i );
+
+    return true;
+}
+
+#endif
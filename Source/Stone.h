@@ -64,7 +64,7 @@ struct Stone
         biconvex = Biconvex( GetStoneWidth( stoneSize, black ), GetStoneHeight( stoneSize, black ), bevel );
         rigidBody.mass = mass;
         rigidBody.inverseMass = 1.0f / mass;
-        CalculateBiconvexInertiaTensor( mass, biconvex, rigidBody.inertia, rigidBody.inertiaTensor, rigidBody.inverseInertiaTensor );
+        CalculateBiconvexInertia( mass, biconvex, rigidBody.inertia, rigidBody.inverseInertia );
     }
 
     Biconvex biconvex;
@@ -75,9 +75,22 @@ inline vec3f NearestPointOnStone( const Biconvex & biconvex,
                                   const RigidBodyTransform & biconvexTransform, 
                                   vec3f point )
 {
-	vec3f localPoint = TransformPoint( biconvexTransform.worldToLocal, point );
+	vec3f localPoint = TransformPointWorldToLocal( biconvexTransform, point );
     vec3f nearestLocal = GetNearestPointOnBiconvexSurface_LocalSpace( localPoint, biconvex );
-    return TransformPoint( biconvexTransform.localToWorld, nearestLocal );
+    return TransformPointLocalToWorld( biconvexTransform, nearestLocal );
+}
+
+inline bool StonePointPenetration( const Biconvex & biconvex,
+                                   const RigidBodyTransform & biconvexTransform,
+                                   vec3f point,
+                                   float & depth,
+                                   vec3f & normal )
+{
+    vec3f localPoint = TransformPointWorldToLocal( biconvexTransform, point );
+    vec3f localNormal;
+    const bool penetrating = BiconvexPointPenetration_LocalSpace( localPoint, biconvex, depth, localNormal );
+    normal = TransformVectorLocalToWorld( biconvexTransform, localNormal );
+    return penetrating;
 }
 
 #endif
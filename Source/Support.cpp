@@ -11,6 +11,9 @@
 #include "RigidBody.h"
 #include "Intersection.h"
 #include "CollisionDetection.h"
+#include "InputRecording.h"
+#include "Capture.h"
+#include "VideoStream.h"
 
 using namespace platform;
 
@@ -18,6 +21,8 @@ int main( int argc, char * argv[] )
 {   
     bool playback = false;
     bool video = false;
+    bool stream = false;
+    VideoStreamFormat streamFormat = VIDEO_STREAM_Y4M;
 
     for ( int i = 1; i < argc; ++i )
     {
@@ -31,8 +36,24 @@ int main( int argc, char * argv[] )
             printf( "video\n" );
             video = true;
         }
+        else if ( GetVideoStreamFormat( argv[i], streamFormat ) )
+        {
+            printf( "video (%s)\n", argv[i] );
+            video = true;
+            stream = true;
+        }
     }
 
+    // headless there is no one at the keyboard, so recording would only overwrite the inputs with a quit
+
+    #ifdef HEADLESS
+    if ( !playback )
+    {
+        printf( "headless only plays back recorded inputs. run with \"playback\"\n" );
+        return 1;
+    }
+    #endif
+
     printf( "[support demo]\n" );
 
     Biconvex biconvex( 2.2f, 1.13f );
@@ -58,6 +79,11 @@ int main( int argc, char * argv[] )
 
     HideMouseCursor();
 
+    // upload the mesh once, see Render.h
+
+    MeshBuffer meshBuffer;
+    meshBuffer.Upload( mesh );
+
     glEnable( GL_LINE_SMOOTH );
     glEnable( GL_POLYGON_SMOOTH );
     glHint( GL_LINE_SMOOTH_HINT, GL_NICEST );
@@ -80,10 +106,51 @@ int main( int argc, char * argv[] )
         glBindBufferARB( GL_PIXEL_UNPACK_BUFFER_ARB, 0 );
     }
 
+    // frames read back go to writer threads to be compressed and written, see Capture.h.
+    // one TGA per frame, or with "y4m", "raw", "rle" or "delta" every frame in one file, see VideoStream.h
+
+    #ifdef LETTERBOX
+    const int crop = 40;
+    #else
+    const int crop = 0;
+    #endif
+    TGACaptureSink tgaSink( "output/frame-%05d.tga", crop );
+    VideoStreamSink streamSink;
+    CapturePipeline capture;
+    if ( video )
+    {
+        CaptureSink * captureSink = &tgaSink;
+        if ( stream )
+        {
+            char filename[256];
+            snprintf( filename, sizeof( filename ), "output/video.%s", GetVideoStreamExtension( streamFormat ) );
+            VideoStreamParams streamParams;
+            streamParams.format = streamFormat;
+            streamParams.width = displayWidth;
+            streamParams.height = displayHeight;
+            streamParams.crop = crop;
+            if ( !streamSink.Open( filename, streamParams ) )
+            {
+                printf( "failed to open %s\n", filename );
+                return 1;
+            }
+            captureSink = &streamSink;
+        }
+        CaptureParams captureParams;
+        captureParams.width = displayWidth;
+        captureParams.height = displayHeight;
+        if ( !capture.Initialize( captureParams, captureSink ) )
+        {
+            printf( "failed to start video capture\n" );
+            return 1;
+        }
+    }
+
     // record input to a file
     // read it back in playback mode for recording video
-    FILE * inputFile = fopen( "output/recordedInputs", playback ? "rb" : "wb" );
-    if ( !inputFile )
+    InputRecorder inputRecorder;
+    InputPlayback inputPlayback;
+    if ( playback ? !inputPlayback.Open( "output/recordedInputs" ) : !inputRecorder.Open( "output/recordedInputs" ) )
     {
         printf( "failed to open input file\n" );
         return 1;
@@ -114,13 +181,11 @@ int main( int argc, char * argv[] )
         if ( !playback )
         {
             input = platform::Input::Sample();
-            fwrite( &input, sizeof( platform::Input ), 1, inputFile );
-            fflush( inputFile );
+            inputRecorder.Write( input );
         }
         else
         {
-            const int size = sizeof( platform::Input );
-            if ( !fread( &input, size, 1, inputFile ) )
+            if ( !inputPlayback.Read( input ) )
                 quit = true;
         }
 
@@ -170,10 +235,9 @@ int main( int argc, char * argv[] )
             smoothedRotation += ( targetRotation - smoothedRotation ) * 0.15f;
             mat4f deltaRotation = mat4f::axisRotation( smoothedRotation, vec3f(1,2,3) );
             rotation = rotation * deltaRotation;
-            mat4f inverseRotation = transpose( rotation );
 
             RigidBodyTransform biconvexTransform;
-            biconvexTransform.Initialize( vec3f(0,0,0), rotation, inverseRotation );
+            biconvexTransform.Initialize( vec3f(0,0,0), rotation );
 
             glEnable( GL_LIGHTING );
             glEnable( GL_LIGHT0 );
@@ -195,13 +259,15 @@ int main( int argc, char * argv[] )
             
             glPushMatrix();
 
+            mat4f localToWorld;
+            biconvexTransform.GetLocalToWorldMatrix( localToWorld );
             float opengl_transform[16];
-            biconvexTransform.localToWorld.store( opengl_transform );
+            localToWorld.store( opengl_transform );
             glMultMatrixf( opengl_transform );
 
             glColor4f(1,1,1,1);
 
-            RenderMesh( mesh );
+            RenderMesh( meshBuffer );
 
             glPopMatrix();
 
@@ -250,8 +316,10 @@ int main( int argc, char * argv[] )
             index = ( index + 1 ) % NumPBOs;
             int prevIndex = ( index + NumPBOs - 1 ) % NumPBOs;
 
-            // set the target framebuffer to read
+            // set the target framebuffer to read. headless there is only the offscreen one, already bound
+            #ifndef HEADLESS
             glReadBuffer( GL_FRONT );
+            #endif
 
             // read pixels from framebuffer to PBO
             // glReadPixels() should return immediately.
@@ -265,13 +333,7 @@ int main( int argc, char * argv[] )
                                                            GL_READ_ONLY_ARB );
                 if ( ptr )
                 {
-                    char filename[256];
-                    snprintf( filename, sizeof(filename), "output/frame-%05d.tga", frame - NumPBOs );
-                    #ifdef LETTERBOX
-                    WriteTGA( filename, displayWidth, displayHeight - 80, ptr + displayWidth * 3 * 40 );
-                    #else
-                    WriteTGA( filename, displayWidth, displayHeight, ptr );
-                    #endif
+                    capture.Capture( frame - NumPBOs, ptr );
                     glUnmapBufferARB( GL_PIXEL_PACK_BUFFER_ARB );
                 }
             }
@@ -291,6 +353,8 @@ int main( int argc, char * argv[] )
         frame++;
     }
 
+    meshBuffer.Free();
+
     CloseDisplay();
 
     return 0;
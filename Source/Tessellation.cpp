@@ -41,7 +41,7 @@ struct TessellationData
 
 TessellationData tessellation;
 
-void UpdateTessellation( Mesh<Vertex,int> & mesh, Mode mode, int subdivisions )
+void UpdateTessellation( Mesh<Vertex,int> & mesh, MeshBuffer & meshBuffer, Mode mode, int subdivisions )
 {
     if ( mode == tessellation.mode && subdivisions == tessellation.subdivisions )
         return;
@@ -53,6 +53,8 @@ void UpdateTessellation( Mesh<Vertex,int> & mesh, Mode mode, int subdivisions )
     else
         GenerateBiconvexMesh( mesh, biconvex, subdivisions );
 
+    meshBuffer.Upload( mesh );
+
     tessellation.mode = mode;
     tessellation.subdivisions = subdivisions;
 }
@@ -70,7 +72,7 @@ int main()
     RigidBody rigidBody;
     rigidBody.mass = 1.0f;
     rigidBody.inverseMass = 1.0f / rigidBody.mass;
-    CalculateBiconvexInertiaTensor( rigidBody.mass, biconvex, rigidBody.inertia, rigidBody.inertiaTensor, rigidBody.inverseInertiaTensor );
+    CalculateBiconvexInertia( rigidBody.mass, biconvex, rigidBody.inertia, rigidBody.inverseInertia );
 
     Mesh<Vertex,int> mesh;
     
@@ -92,6 +94,10 @@ int main()
 
     HideMouseCursor();
 
+    // the mesh is uploaded again each time the tessellation changes, see Render.h
+
+    MeshBuffer meshBuffer;
+
     // setup for render
 
     glEnable( GL_LINE_SMOOTH );
@@ -202,7 +208,7 @@ int main()
         }
         prevLeft = input.left;
 
-        UpdateTessellation( mesh, mode, subdivisions );
+        UpdateTessellation( mesh, meshBuffer, mode, subdivisions );
 
         ClearScreen( displayWidth, displayHeight );
 
@@ -247,15 +253,16 @@ int main()
             smoothedRotation += ( targetRotation - smoothedRotation ) * 0.15f;
             mat4f deltaRotation = mat4f::axisRotation( smoothedRotation, vec3f(-3,-2,1) );
             rotation = rotation * deltaRotation;
-            mat4f inverseRotation = transpose( rotation );
 
             RigidBodyTransform biconvexTransform;
-            biconvexTransform.Initialize( vec3f(0,0,0), rotation, inverseRotation );
+            biconvexTransform.Initialize( vec3f(0,0,0), rotation );
 
             glPushMatrix();
 
+            mat4f localToWorld;
+            biconvexTransform.GetLocalToWorldMatrix( localToWorld );
             float opengl_transform[16];
-            biconvexTransform.localToWorld.store( opengl_transform );
+            localToWorld.store( opengl_transform );
             glMultMatrixf( opengl_transform );
 
             glEnable( GL_LIGHTING );
@@ -272,7 +279,7 @@ int main()
                 RenderBiconvexNaive( biconvex, numSegments, numRings );
             }
             else
-                RenderMesh( mesh );
+                RenderMesh( meshBuffer );
 
             glPopMatrix();
         }
@@ -286,6 +293,8 @@ int main()
         frame++;
     }
 
+    meshBuffer.Free();
+
     CloseDisplay();
 
     return 0;
@@ -0,0 +1,551 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "World.h"
+#include "Platform.h"
+#include <stdio.h>
+#include <vector>
+
+/*
+    Trajectory recording.
+
+    Recorded inputs reproduce a session, but only by simulating it again
+    from the start, and only on the same build. For looking at what
+    happened after the fact (plotting a stone's path, scrubbing back and
+    forth through a replay) it is simpler to record the simulation output
+    itself: where every body was, each frame.
+
+    Every "keyframeInterval" frames the transform of each body is written
+    out in full. The frames in between only carry the bodies that changed
+    since the frame before, along with a bit per body saying which ones
+    those are, so sleeping stones cost one bit a frame. Nothing is
+    quantized, the transforms read back exactly as they were written.
+
+    At the end of the file is an index with the offset of every frame. The
+    reader maps the file, so getting to any frame costs decoding the
+    keyframe before it and at most "keyframeInterval - 1" deltas. Reading
+    forward one frame at a time costs one delta per frame.
+
+    File layout:
+
+        [4 bytes] magic "VGTR"
+        [4 bytes] version
+        [4 bytes] keyframe interval
+        [4 bytes] max bodies
+        per frame:
+            [4 bytes] number of bodies
+            [1 byte] keyframe or delta
+            keyframe: every body
+            delta: [1 bit per body, rounded up to bytes] which bodies changed, then those bodies
+        index:
+            [8 bytes] offset of each frame
+        [8 bytes] offset of the index
+        [4 bytes] number of frames
+        [4 bytes] magic "VGTR"
+
+    Each body is position (3 floats), orientation (4 floats) and whether it
+    is awake (1 byte). Bodies past the previous frame's count are always
+    marked as changed. Values are in host byte order, so the recording
+    must be read on a little endian machine, same as it was written.
+*/
+
+const uint32_t TrajectoryMagic = 0x52544756;        // "VGTR"
+const uint32_t TrajectoryVersion = 1;
+
+const int TrajectoryBodyBytes = 7 * 4 + 1;
+
+enum TrajectoryFrameType
+{
+    TRAJECTORY_KEYFRAME,
+    TRAJECTORY_DELTA
+};
+
+struct TrajectoryBody
+{
+    vec3f position;
+    quat4f orientation;
+    bool active;
+};
+
+inline void PackTrajectoryBody( const vec3f & position, const quat4f & orientation, bool active, uint8_t * data )
+{
+    const float values[] = { position.x(), position.y(), position.z(), orientation.x, orientation.y, orientation.z, orientation.w };
+    memcpy( data, values, sizeof( values ) );
+    data[sizeof( values )] = active ? 1 : 0;
+}
+
+inline void UnpackTrajectoryBody( const uint8_t * data, TrajectoryBody & body )
+{
+    float values[7];
+    memcpy( values, data, sizeof( values ) );
+    body.position = vec3f( values[0], values[1], values[2] );
+    body.orientation = quat4f( values[6], values[3], values[4], values[5] );
+    body.active = data[sizeof( values )] != 0;
+}
+
+// ----------------------------------------------------------------
+
+class TrajectoryWriter
+{
+public:
+
+    enum { BufferSize = 256 * 1024 };
+
+    TrajectoryWriter()
+    {
+        file = NULL;
+        buffer = NULL;
+        previous = NULL;
+        current = NULL;
+        changed = NULL;
+        maxBodies = 0;
+        keyframeInterval = 0;
+        Reset();
+    }
+
+    ~TrajectoryWriter()
+    {
+        Close();
+    }
+
+    bool Open( const char filename[], int bodies, int interval = 60 )
+    {
+        assert( filename );
+        assert( bodies > 0 );
+        assert( interval > 0 );
+
+        Close();
+
+        file = fopen( filename, "wb" );
+        if ( !file )
+            return false;
+
+        maxBodies = bodies;
+        keyframeInterval = interval;
+        buffer = new uint8_t[BufferSize];
+        previous = new uint8_t[maxBodies * TrajectoryBodyBytes];
+        current = new uint8_t[maxBodies * TrajectoryBodyBytes];
+        changed = new uint8_t[( maxBodies + 7 ) / 8];
+
+        Reset();
+
+        WriteUint32( TrajectoryMagic );
+        WriteUint32( TrajectoryVersion );
+        WriteUint32( keyframeInterval );
+        WriteUint32( maxBodies );
+
+        return true;
+    }
+
+    // writes the index and footer. the recording can't be read back until this is done.
+    // returns false if any write to the file failed
+
+    bool Close()
+    {
+        if ( !file )
+            return true;
+
+        const uint64_t indexOffset = offset;
+        if ( !frameOffsets.empty() )
+            WriteBytes( (const uint8_t*) &frameOffsets[0], frameOffsets.size() * sizeof( uint64_t ) );
+        WriteBytes( (const uint8_t*) &indexOffset, sizeof( indexOffset ) );
+        WriteUint32( uint32_t( frameOffsets.size() ) );
+        WriteUint32( TrajectoryMagic );
+
+        FlushBuffer();
+
+        const bool ok = !error && fclose( file ) == 0;
+
+        delete [] buffer;
+        delete [] previous;
+        delete [] current;
+        delete [] changed;
+        file = NULL;
+        buffer = NULL;
+        previous = NULL;
+        current = NULL;
+        changed = NULL;
+        std::vector<uint64_t>().swap( frameOffsets );
+
+        return ok;
+    }
+
+    // call once per frame
+
+    void Write( const RigidBody * rigidBodies, int numBodies )
+    {
+        assert( file );
+        assert( numBodies >= 0 && numBodies <= maxBodies );
+
+        for ( int i = 0; i < numBodies; ++i )
+        {
+            const RigidBody & rigidBody = rigidBodies[i];
+            PackTrajectoryBody( rigidBody.position, rigidBody.orientation, rigidBody.active, current + i * TrajectoryBodyBytes );
+        }
+
+        const bool keyframe = ( frameOffsets.size() % keyframeInterval ) == 0;
+
+        frameOffsets.push_back( offset );
+
+        const uint8_t header[] = { uint8_t( numBodies ), uint8_t( numBodies >> 8 ), uint8_t( numBodies >> 16 ), uint8_t( numBodies >> 24 ),
+                                   uint8_t( keyframe ? TRAJECTORY_KEYFRAME : TRAJECTORY_DELTA ) };
+        WriteBytes( header, sizeof( header ) );
+
+        if ( keyframe )
+        {
+            WriteBytes( current, numBodies * TrajectoryBodyBytes );
+            numKeyframes++;
+        }
+        else
+        {
+            const int changedBytes = ( numBodies + 7 ) / 8;
+            memset( changed, 0, changedBytes );
+
+            for ( int i = 0; i < numBodies; ++i )
+            {
+                const int o = i * TrajectoryBodyBytes;
+                if ( i >= numPrevious || memcmp( current + o, previous + o, TrajectoryBodyBytes ) != 0 )
+                    changed[i/8] |= 1 << ( i % 8 );
+            }
+
+            WriteBytes( changed, changedBytes );
+
+            for ( int i = 0; i < numBodies; ++i )
+            {
+                if ( changed[i/8] & ( 1 << ( i % 8 ) ) )
+                {
+                    WriteBytes( current + i * TrajectoryBodyBytes, TrajectoryBodyBytes );
+                    bodiesChanged++;
+                }
+            }
+        }
+
+        uint8_t * swap = previous;
+        previous = current;
+        current = swap;
+        numPrevious = numBodies;
+    }
+
+    void Write( const World & world )
+    {
+        const int numBodies = world.GetNumBodies();
+        Write( numBodies ? &world.GetBody( 0 ) : NULL, numBodies );
+    }
+
+    bool IsOpen() const { return file != NULL; }
+
+    bool HasError() const { return error; }
+
+    int GetNumFrames() const { return int( frameOffsets.size() ); }
+
+    int GetNumKeyframes() const { return numKeyframes; }
+
+    // bodies written in delta frames
+
+    uint64_t GetBodiesChanged() const { return bodiesChanged; }
+
+    uint64_t GetBytesWritten() const { return offset; }
+
+private:
+
+    TrajectoryWriter( const TrajectoryWriter & other );
+    TrajectoryWriter & operator = ( const TrajectoryWriter & other );
+
+    void Reset()
+    {
+        bufferBytes = 0;
+        offset = 0;
+        numPrevious = 0;
+        numKeyframes = 0;
+        bodiesChanged = 0;
+        error = false;
+        frameOffsets.clear();
+    }
+
+    void WriteUint32( uint32_t value )
+    {
+        const uint8_t bytes[] = { uint8_t( value ), uint8_t( value >> 8 ), uint8_t( value >> 16 ), uint8_t( value >> 24 ) };
+        WriteBytes( bytes, 4 );
+    }
+
+    void WriteBytes( const uint8_t * data, size_t bytes )
+    {
+        offset += bytes;
+
+        if ( bufferBytes + bytes > BufferSize )
+        {
+            FlushBuffer();
+
+            // bigger than the whole buffer, eg. a keyframe of a lot of bodies. straight to the file
+
+            if ( bytes > BufferSize )
+            {
+                if ( fwrite( data, bytes, 1, file ) != 1 )
+                    error = true;
+                return;
+            }
+        }
+
+        memcpy( buffer + bufferBytes, data, bytes );
+        bufferBytes += bytes;
+    }
+
+    void FlushBuffer()
+    {
+        if ( bufferBytes > 0 && fwrite( buffer, bufferBytes, 1, file ) != 1 )
+            error = true;
+        bufferBytes = 0;
+    }
+
+    FILE * file;
+    uint8_t * buffer;
+    size_t bufferBytes;
+    uint64_t offset;
+
+    int maxBodies;
+    int keyframeInterval;
+    uint8_t * previous;
+    uint8_t * current;
+    uint8_t * changed;
+    int numPrevious;
+
+    std::vector<uint64_t> frameOffsets;
+    int numKeyframes;
+    uint64_t bodiesChanged;
+    bool error;
+};
+
+// ----------------------------------------------------------------
+
+class TrajectoryReader
+{
+public:
+
+    TrajectoryReader()
+    {
+        data = NULL;
+        size = 0;
+        frameOffsets = NULL;
+        numFrames = 0;
+        keyframeInterval = 0;
+        maxBodies = 0;
+        state = NULL;
+        stateFrame = -1;
+        numStateBodies = 0;
+        framesDecoded = 0;
+    }
+
+    ~TrajectoryReader()
+    {
+        Close();
+    }
+
+    // fails if the file is missing, isn't a trajectory, or was never closed by the writer
+
+    bool Open( const char filename[] )
+    {
+        assert( filename );
+
+        Close();
+
+        data = platform::MapFile( filename, size );
+        if ( !data )
+            return false;
+
+        const size_t headerBytes = 16;
+        const size_t footerBytes = 16;
+
+        bool ok = size >= headerBytes + footerBytes &&
+                  ReadUint32( 0 ) == TrajectoryMagic &&
+                  ReadUint32( 4 ) == TrajectoryVersion &&
+                  ReadUint32( size - 4 ) == TrajectoryMagic;
+
+        if ( ok )
+        {
+            keyframeInterval = ReadUint32( 8 );
+            maxBodies = ReadUint32( 12 );
+            numFrames = ReadUint32( size - 8 );
+
+            uint64_t indexOffset;
+            memcpy( &indexOffset, data + size - footerBytes, sizeof( indexOffset ) );
+
+            ok = keyframeInterval > 0 && maxBodies > 0 && numFrames >= 0 &&
+                 indexOffset >= headerBytes &&
+                 indexOffset + uint64_t( numFrames ) * sizeof( uint64_t ) == size - footerBytes;
+
+            if ( ok )
+            {
+                // IMPORTANT: the index follows variable sized frames, so it may not be aligned. copy it out
+
+                frameOffsets = new uint64_t[numFrames + 1];
+                if ( numFrames )
+                    memcpy( frameOffsets, data + indexOffset, numFrames * sizeof( uint64_t ) );
+                frameOffsets[numFrames] = indexOffset;
+
+                for ( int i = 0; i < numFrames && ok; ++i )
+                    ok = frameOffsets[i] >= headerBytes && frameOffsets[i] < frameOffsets[i+1];
+            }
+        }
+
+        if ( !ok )
+        {
+            Close();
+            return false;
+        }
+
+        state = new uint8_t[maxBodies * TrajectoryBodyBytes];
+        stateFrame = -1;
+        numStateBodies = 0;
+        framesDecoded = 0;
+
+        return true;
+    }
+
+    void Close()
+    {
+        if ( data )
+            platform::UnmapFile( data, size );
+        delete [] frameOffsets;
+        delete [] state;
+        data = NULL;
+        size = 0;
+        frameOffsets = NULL;
+        state = NULL;
+        numFrames = 0;
+        keyframeInterval = 0;
+        maxBodies = 0;
+        stateFrame = -1;
+        numStateBodies = 0;
+    }
+
+    // writes the bodies as they were on this frame and returns how many there are.
+    // returns -1 if the frame isn't in the recording or its data is bad
+
+    int ReadFrame( int frame, TrajectoryBody * bodies )
+    {
+        assert( data );
+        assert( bodies );
+
+        if ( frame < 0 || frame >= numFrames )
+            return -1;
+
+        // carry on from the last frame read if it is on the way, otherwise start from the keyframe
+
+        int start = frame - frame % keyframeInterval;
+        if ( stateFrame >= start && stateFrame <= frame )
+            start = stateFrame + 1;
+
+        for ( int i = start; i <= frame; ++i )
+        {
+            if ( !DecodeFrame( i ) )
+            {
+                stateFrame = -1;
+                return -1;
+            }
+        }
+
+        for ( int i = 0; i < numStateBodies; ++i )
+            UnpackTrajectoryBody( state + i * TrajectoryBodyBytes, bodies[i] );
+
+        return numStateBodies;
+    }
+
+    bool IsOpen() const { return data != NULL; }
+
+    int GetNumFrames() const { return numFrames; }
+
+    int GetKeyframeInterval() const { return keyframeInterval; }
+
+    int GetMaxBodies() const { return maxBodies; }
+
+    // keyframes and deltas decoded so far, to see what seeking costs
+
+    uint64_t GetFramesDecoded() const { return framesDecoded; }
+
+private:
+
+    TrajectoryReader( const TrajectoryReader & other );
+    TrajectoryReader & operator = ( const TrajectoryReader & other );
+
+    uint32_t ReadUint32( size_t offset ) const
+    {
+        const uint8_t * p = data + offset;
+        return uint32_t( p[0] ) | ( uint32_t( p[1] ) << 8 ) | ( uint32_t( p[2] ) << 16 ) | ( uint32_t( p[3] ) << 24 );
+    }
+
+    bool DecodeFrame( int frame )
+    {
+        const uint64_t begin = frameOffsets[frame];
+        const uint64_t end = frameOffsets[frame+1];
+
+        if ( end - begin < 5 )
+            return false;
+
+        const int numBodies = ReadUint32( begin );
+        const uint8_t type = data[begin+4];
+        if ( numBodies < 0 || numBodies > maxBodies )
+            return false;
+
+        const uint8_t * p = data + begin + 5;
+        const uint64_t available = end - begin - 5;
+
+        if ( type == TRAJECTORY_KEYFRAME )
+        {
+            if ( available != uint64_t( numBodies ) * TrajectoryBodyBytes )
+                return false;
+            memcpy( state, p, numBodies * TrajectoryBodyBytes );
+        }
+        else if ( type == TRAJECTORY_DELTA && stateFrame == frame - 1 )
+        {
+            const int changedBytes = ( numBodies + 7 ) / 8;
+            if ( available < uint64_t( changedBytes ) )
+                return false;
+
+            const uint8_t * changed = p;
+            const uint8_t * body = p + changedBytes;
+            const uint8_t * bodyEnd = data + end;
+
+            for ( int i = 0; i < numBodies; ++i )
+            {
+                if ( changed[i/8] & ( 1 << ( i % 8 ) ) )
+                {
+                    if ( body + TrajectoryBodyBytes > bodyEnd )
+                        return false;
+                    memcpy( state + i * TrajectoryBodyBytes, body, TrajectoryBodyBytes );
+                    body += TrajectoryBodyBytes;
+                }
+                else if ( i >= numStateBodies )
+                {
+                    return false;
+                }
+            }
+
+            if ( body != bodyEnd )
+                return false;
+        }
+        else
+        {
+            return false;
+        }
+
+        stateFrame = frame;
+        numStateBodies = numBodies;
+        framesDecoded++;
+
+        return true;
+    }
+
+    const uint8_t * data;
+    size_t size;
+    uint64_t * frameOffsets;        // one past the end is the index offset, so each frame's size is the gap to the next
+    int numFrames;
+    int keyframeInterval;
+    int maxBodies;
+
+    uint8_t * state;                // bodies as of "stateFrame"
+    int stateFrame;
+    int numStateBodies;
+    uint64_t framesDecoded;
+};
+
+#endif
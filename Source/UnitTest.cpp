@@ -4,6 +4,24 @@
 #include "Intersection.h"
 #include "InertiaTensor.h"
 #include "CollisionDetection.h"
+#include "Stone.h"
+#include "GJK.h"
+#include "World.h"
+#include "Host.h"
+#include "BitPacker.h"
+#include "Snapshot.h"
+#include "Replication.h"
+#include "Network.h"
+#include "Loopback.h"
+#include "Interpolation.h"
+#include "Priority.h"
+#include "Determinism.h"
+#include "Rollback.h"
+#include "InputRecording.h"
+#include "Trajectory.h"
+#include "Capture.h"
+#include "VideoStream.h"
+#include "FrameDelta.h"
 
 #include "UnitTest++/UnitTest++.h"
 #include "UnitTest++/TestRunner.h"
@@ -495,6 +513,2822 @@ SUITE( Intersection )
         CHECK( !Biconvex_SAT( biconvex, vec3f(0,0,0), vec3f(0,0,-10), vec3f(0,1,0), vec3f(1,0,0), epsilon ) );
     }
 }
+*/
+
+SUITE( Packet )
+{
+    TEST( vec3x4f_dot_cross_normalize )
+    {
+        const vec3f a[] = { vec3f(1,2,3), vec3f(-4,0.5f,2), vec3f(0,0,-7), vec3f(3,-3,1) };
+        const vec3f b[] = { vec3f(0,1,0), vec3f(2,2,-1), vec3f(5,-1,0.25f), vec3f(-1,-2,-3) };
+
+        vec3x4f pa( a );
+        vec3x4f pb( b );
+
+        float d[4];
+        simd4f_ustore4( dot( pa, pb ), d );
+
+        vec3f c[4], n[4];
+        cross( pa, pb ).store( c );
+        normalize( pa ).store( n );
+
+        for ( int i = 0; i < 4; ++i )
+        {
+            CHECK_CLOSE( d[i], dot( a[i], b[i] ), 0.0001f );
+            CHECK_CLOSE_VEC3( c[i], cross( a[i], b[i] ), 0.0001f );
+            CHECK_CLOSE_VEC3( n[i], a[i] * ( 1.0f / sqrt( dot( a[i], a[i] ) ) ), 0.00001f );
+        }
+    }
+
+    TEST( vec3x8f_matches_vec3x4f )
+    {
+        vec3f a[8], b[8];
+        for ( int i = 0; i < 8; ++i )
+        {
+            a[i] = vec3f( i + 1.0f, 2.0f - i, 0.5f * i );
+            b[i] = vec3f( 3.0f - i, i * 0.25f, -1.0f );
+        }
+
+        vec3x8f pa( a );
+        vec3x8f pb( b );
+
+        vec3f c[8], n[8];
+        cross( pa, pb ).store( c );
+        normalize( pa ).store( n );
+        const simd8f d = dot( pa, pb );
+
+        for ( int i = 0; i < 8; ++i )
+        {
+            CHECK_CLOSE( simd8f_get( d, i ), dot( a[i], b[i] ), 0.0001f );
+            CHECK_CLOSE_VEC3( c[i], cross( a[i], b[i] ), 0.0001f );
+            CHECK_CLOSE_VEC3( n[i], a[i] * ( 1.0f / sqrt( dot( a[i], a[i] ) ) ), 0.00001f );
+            CHECK_CLOSE_VEC3( pa.get(i), a[i], 0.0f );
+        }
+
+        // batches of four and eight must agree exactly, or results depend on how bodies were batched
+
+        vec3f e[8], f[8];
+        for ( int i = 0; i < 8; ++i )
+        {
+            e[i] = vec3f( 0.1f * i + 0.3f, 1.7f - 0.3f * i, 0.7f / ( i + 1 ) );
+            f[i] = vec3f( 2.3f - 0.7f * i, 0.11f * i, -1.9f / ( i + 3 ) );
+        }
+
+        float d8[8], d4[8];
+        const simd8f dot8 = dot( vec3x8f( e ), vec3x8f( f ) );
+        for ( int i = 0; i < 8; ++i )
+            d8[i] = simd8f_get( dot8, i );
+        simd4f_ustore4( dot( vec3x4f( e ), vec3x4f( f ) ), d4 );
+        simd4f_ustore4( dot( vec3x4f( e + 4 ), vec3x4f( f + 4 ) ), d4 + 4 );
+
+        CHECK( memcmp( d8, d4, sizeof( d8 ) ) == 0 );
+    }
+
+    TEST( quat4x4f_multiply_transform )
+    {
+        quat4f q[4], r[4];
+        for ( int i = 0; i < 4; ++i )
+        {
+            q[i] = quat4f::axisRotation( 0.3f + i, vec3f( 1.0f / sqrt(3.0f), 1.0f / sqrt(3.0f), 1.0f / sqrt(3.0f) ) );
+            r[i] = quat4f::axisRotation( 1.1f * i, vec3f(0,0,1) );
+        }
+
+        const int stride = sizeof( quat4f ) / sizeof( float );
+
+        quat4x4f pq( &q[0].x, stride );
+        quat4x4f pr( &r[0].x, stride );
+
+        quat4f product[4];
+        normalize( pq * pr ).store( &product[0].x, stride );
+
+        const vec3f v[] = { vec3f(1,0,0), vec3f(0,2,0), vec3f(1,1,1), vec3f(-3,0.5f,2) };
+        vec3f rotated[4];
+        transformVector( pq, vec3x4f( v ) ).store( rotated );
+
+        for ( int i = 0; i < 4; ++i )
+        {
+            const quat4f expected = q[i] * r[i];
+            CHECK_CLOSE( product[i].x, expected.x, 0.0001f );
+            CHECK_CLOSE( product[i].y, expected.y, 0.0001f );
+            CHECK_CLOSE( product[i].z, expected.z, 0.0001f );
+            CHECK_CLOSE( product[i].w, expected.w, 0.0001f );
+
+            mat4f rotation;
+            q[i].toMatrix( rotation );
+            CHECK_CLOSE_VEC3( rotated[i], transformVector( rotation, v[i] ), 0.0001f );
+        }
+    }
+
+    TEST( quat4x8f_multiply_transform )
+    {
+        quat4f q[8], r[8];
+        vec3f v[8];
+        for ( int i = 0; i < 8; ++i )
+        {
+            q[i] = quat4f::axisRotation( 0.2f * i, vec3f(0,1,0) );
+            r[i] = quat4f::axisRotation( 0.7f + i, vec3f(1,0,0) );
+            v[i] = vec3f( 1.0f, 0.5f * i, -2.0f );
+        }
+
+        const int stride = sizeof( quat4f ) / sizeof( float );
+
+        quat4x8f pq( &q[0].x, stride );
+        quat4x8f pr( &r[0].x, stride );
+
+        quat4f product[8];
+        ( pq * pr ).store( &product[0].x, stride );
+
+        vec3f rotated[8];
+        transformVector( pq, vec3x8f( v ) ).store( rotated );
+
+        for ( int i = 0; i < 8; ++i )
+        {
+            const quat4f expected = q[i] * r[i];
+            CHECK_CLOSE( product[i].x, expected.x, 0.0001f );
+            CHECK_CLOSE( product[i].y, expected.y, 0.0001f );
+            CHECK_CLOSE( product[i].z, expected.z, 0.0001f );
+            CHECK_CLOSE( product[i].w, expected.w, 0.0001f );
+
+            mat4f rotation;
+            q[i].toMatrix( rotation );
+            CHECK_CLOSE_VEC3( rotated[i], transformVector( rotation, v[i] ), 0.0001f );
+        }
+    }
+}
+
+SUITE( Biconvex )
+{
+    TEST( biconvex_support_sphere_dot )
+    {
+        // the support switches from the circle edge to the sphere surface where the sphere
+        // normal at the edge is. check the support against the profile sampled by brute force
+
+        const float widths[] = { 2.0f, 2.2f };
+        const float heights[] = { 1.0f, 1.13f };
+
+        for ( int i = 0; i < 2; ++i )
+        {
+            Biconvex biconvex( widths[i], heights[i] );
+
+            const float sphereRadius = biconvex.GetSphereRadius();
+            const float sphereOffset = biconvex.GetSphereOffset();
+
+            CHECK_CLOSE( biconvex.GetSphereDot(), sphereOffset / sphereRadius, 0.0001f );
+
+            for ( int j = 0; j <= 100; ++j )
+            {
+                const float z = j / 100.0f;
+                const vec3f axis( sqrt( 1 - z*z ), 0, z );
+
+                // top half of the profile, which is on the bottom sphere
+
+                float expected = 0.0f;
+                for ( int k = 0; k <= 10000; ++k )
+                {
+                    const float pz = ( k / 10000.0f ) * biconvex.GetHeight() / 2;
+                    // IMPORTANT: at the top of the profile this is zero, and with fma contraction it can round just below
+
+                    const float px = sqrt( max( 0.0f, sphereRadius * sphereRadius - ( pz + sphereOffset ) * ( pz + sphereOffset ) ) );
+                    expected = max( expected, px * axis.x() + pz * axis.z() );
+                }
+
+                float s1, s2;
+                BiconvexSupport_LocalSpace( biconvex, axis, s1, s2 );
+                CHECK_CLOSE( s2, expected, 0.001f );
+                CHECK_CLOSE( s1, -expected, 0.001f );
+            }
+        }
+    }
+
+    TEST( biconvex_support_packet )
+    {
+        Biconvex biconvex( 2.2f, 1.13f, 0.1f );
+
+        srand( 0 );
+
+        for ( int iteration = 0; iteration < 100; ++iteration )
+        {
+            vec3f center[8], up[8], axis[8];
+            for ( int i = 0; i < 8; ++i )
+            {
+                center[i] = vec3f( random_float(-10,10), random_float(-10,10), random_float(-10,10) );
+                up[i] = normalize( vec3f( random_float(-1,1), random_float(-1,1), random_float(-1,1) ) );
+                axis[i] = normalize( vec3f( random_float(-1,1), random_float(-1,1), random_float(-1,1) ) );
+            }
+
+            simd4f s1, s2;
+            BiconvexSupport_WorldSpace( biconvex, vec3x4f( center ), vec3x4f( up ), vec3x4f( axis ), s1, s2 );
+
+            simd8f t1, t2;
+            BiconvexSupport_WorldSpace( biconvex, vec3x8f( center ), vec3x8f( up ), vec3x8f( axis ), t1, t2 );
+
+            float packet_s1[4], packet_s2[4];
+            simd4f_ustore4( s1, packet_s1 );
+            simd4f_ustore4( s2, packet_s2 );
+
+            for ( int i = 0; i < 8; ++i )
+            {
+                float expected_s1, expected_s2;
+                BiconvexSupport_WorldSpace( biconvex, center[i], up[i], axis[i], expected_s1, expected_s2 );
+
+                if ( i < 4 )
+                {
+                    CHECK_CLOSE( packet_s1[i], expected_s1, 0.001f );
+                    CHECK_CLOSE( packet_s2[i], expected_s2, 0.001f );
+                }
+
+                CHECK_CLOSE( simd8f_get( t1, i ), expected_s1, 0.001f );
+                CHECK_CLOSE( simd8f_get( t2, i ), expected_s2, 0.001f );
+            }
+        }
+    }
+
+    TEST( biconvex_sat_packet )
+    {
+        Biconvex biconvex( 2.2f, 1.13f, 0.1f );
+
+        srand( 0 );
+
+        const int NumStones = 64;
+        const int NumPairs = 1000;
+
+        vec3f position[NumStones], up[NumStones];
+        for ( int i = 0; i < NumStones; ++i )
+        {
+            position[i] = vec3f( random_float(-3,3), random_float(-3,3), random_float(-1,1) );
+            up[i] = normalize( vec3f( random_float(-1,1), random_float(-1,1), random_float(-1,1) ) );
+        }
+
+        BiconvexPair pairs[NumPairs];
+        for ( int i = 0; i < NumPairs; ++i )
+        {
+            pairs[i].a = rand() % NumStones;
+            pairs[i].b = ( pairs[i].a + 1 + rand() % ( NumStones - 1 ) ) % NumStones;
+        }
+
+        int hits[NumPairs];
+        const int numHits = Biconvex_SAT_Batch( biconvex, position, up, pairs, NumPairs, hits );
+
+        // the packet and scalar versions may disagree on pairs within
+        // rounding of touching, so allow a few mismatches
+
+        int numExpected = 0;
+        int numMismatches = 0;
+        int hitIndex = 0;
+
+        for ( int i = 0; i < NumPairs; ++i )
+        {
+            const BiconvexPair & pair = pairs[i];
+            const bool expected = Biconvex_SAT( biconvex, position[pair.a], position[pair.b], up[pair.a], up[pair.b] );
+
+            const bool hit = hitIndex < numHits && hits[hitIndex] == i;
+            if ( hit )
+                hitIndex++;
+
+            if ( expected )
+                numExpected++;
+
+            if ( hit != expected )
+                numMismatches++;
+
+            if ( i < 4 )
+            {
+                vec3f position_a[4], position_b[4], up_a[4], up_b[4];
+                for ( int j = 0; j < 4; ++j )
+                {
+                    position_a[j] = position[pairs[j].a];
+                    position_b[j] = position[pairs[j].b];
+                    up_a[j] = up[pairs[j].a];
+                    up_b[j] = up[pairs[j].b];
+                }
+                const int mask = Biconvex_SAT( biconvex, vec3x4f( position_a ), vec3x4f( position_b ), vec3x4f( up_a ), vec3x4f( up_b ) );
+                CHECK_EQUAL( ( mask & ( 1 << i ) ) != 0, hit );
+            }
+        }
+
+        CHECK_EQUAL( hitIndex, numHits );
+        CHECK( numExpected > 0 && numExpected < NumPairs );
+        CHECK( numMismatches <= 4 );
+    }
+
+    TEST( biconvex_signed_distance )
+    {
+        Biconvex biconvex( 2.2f, 1.13f );
+        Biconvex bevelled( 2.2f, 1.13f, 0.1f );
+
+        const float h = biconvex.GetHeight() / 2;
+
+        vec3f gradient;
+        CHECK_CLOSE( BiconvexSignedDistance_LocalSpace( vec3f(0,0,0), biconvex ), -h, 0.0001f );
+        CHECK_CLOSE( BiconvexSignedDistance_LocalSpace( vec3f(0,0,h+1), biconvex, gradient ), 1.0f, 0.0001f );
+        CHECK_CLOSE( gradient.z(), 1.0f, 0.0001f );
+        CHECK_CLOSE( BiconvexSignedDistance_LocalSpace( vec3f(0,0,-h-1), biconvex, gradient ), 1.0f, 0.0001f );
+        CHECK_CLOSE( gradient.z(), -1.0f, 0.0001f );
+        CHECK_CLOSE( BiconvexSignedDistance_LocalSpace( vec3f(2.1f,0,0), biconvex, gradient ), 1.0f, 0.0001f );
+        CHECK_CLOSE( gradient.x(), 1.0f, 0.0001f );
+
+        // the bevel trims the circle edge
+
+        const float bevelEdge = bevelled.GetBevelTorusMajorRadius() + bevelled.GetBevelTorusMinorRadius();
+        CHECK( bevelEdge < bevelled.GetCircleRadius() );
+        CHECK_CLOSE( BiconvexSignedDistance_LocalSpace( vec3f(0,bevelEdge,0), bevelled ), 0.0f, 0.0001f );
+
+        srand( 0 );
+
+        for ( int i = 0; i < 1000; ++i )
+        {
+            vec3f point( random_float(-2,2), random_float(-2,2), random_float(-2,2) );
+
+            // inside agrees with the existing point test away from the surface
+
+            const float distance = BiconvexSignedDistance_LocalSpace( point, biconvex, gradient );
+            if ( fabs( distance ) > 0.01f )
+                CHECK_EQUAL( distance < 0, PointInsideBiconvex_LocalSpace( point, biconvex ) );
+
+            // the nearest point is on the surface and matches the existing nearest point
+
+            CHECK_CLOSE( length( gradient ), 1.0f, 0.001f );
+            vec3f nearest = point - gradient * distance;
+            CHECK_CLOSE( BiconvexSignedDistance_LocalSpace( nearest, biconvex ), 0.0f, 0.001f );
+            if ( distance > 0 )
+                CHECK_CLOSE( length( nearest - GetNearestPointOnBiconvexSurface_LocalSpace( point, biconvex ) ), 0.0f, 0.01f );
+
+            // same with the bevel, and the gradient matches central differences
+
+            const float bevelDistance = BiconvexSignedDistance_LocalSpace( point, bevelled, gradient );
+            CHECK( bevelDistance >= distance - 0.0001f );
+            CHECK_CLOSE( BiconvexSignedDistance_LocalSpace( point - gradient * bevelDistance, bevelled ), 0.0f, 0.001f );
+
+            const float delta = 0.001f;
+            vec3f numerical( BiconvexSignedDistance_LocalSpace( point + vec3f(delta,0,0), bevelled ) - BiconvexSignedDistance_LocalSpace( point - vec3f(delta,0,0), bevelled ),
+                             BiconvexSignedDistance_LocalSpace( point + vec3f(0,delta,0), bevelled ) - BiconvexSignedDistance_LocalSpace( point - vec3f(0,delta,0), bevelled ),
+                             BiconvexSignedDistance_LocalSpace( point + vec3f(0,0,delta), bevelled ) - BiconvexSignedDistance_LocalSpace( point - vec3f(0,0,delta), bevelled ) );
+            CHECK_CLOSE( dot( numerical * ( 0.5f / delta ), gradient ), 1.0f, 0.01f );
+        }
+    }
+
+    TEST( biconvex_signed_distance_packet )
+    {
+        Biconvex biconvex( 2.2f, 1.13f, 0.1f );
+
+        srand( 0 );
+
+        const int NumPoints = 203;
+
+        vec3f points[NumPoints];
+        for ( int i = 0; i < NumPoints; ++i )
+            points[i] = vec3f( random_float(-2,2), random_float(-2,2), random_float(-2,2) );
+
+        points[0] = vec3f(0,0,0);
+        points[1] = vec3f(0,0,1);
+
+        float distance[NumPoints];
+        vec3f gradient[NumPoints];
+        BiconvexSignedDistance_LocalSpace( biconvex, points, NumPoints, distance, gradient );
+
+        simd4f packet_distance;
+        vec3x4f packet_gradient;
+        BiconvexSignedDistance_LocalSpace( vec3x4f( points ), biconvex, packet_distance, packet_gradient );
+
+        float packet4_distance[4];
+        simd4f_ustore4( packet_distance, packet4_distance );
+
+        for ( int i = 0; i < NumPoints; ++i )
+        {
+            vec3f expected_gradient;
+            const float expected_distance = BiconvexSignedDistance_LocalSpace( points[i], biconvex, expected_gradient );
+            CHECK_CLOSE( distance[i], expected_distance, 0.0001f );
+            CHECK_CLOSE( length( gradient[i] - expected_gradient ), 0.0f, 0.0001f );
+            if ( i < 4 )
+            {
+                CHECK_CLOSE( packet4_distance[i], expected_distance, 0.0001f );
+                CHECK_CLOSE( length( packet_gradient.get( i ) - expected_gradient ), 0.0f, 0.0001f );
+            }
+        }
+    }
+
+    TEST( biconvex_ray_sphere_trace )
+    {
+        Biconvex biconvex( 2.2f, 1.13f );
+
+        srand( 0 );
+
+        int numHits = 0;
+
+        for ( int i = 0; i < 1000; ++i )
+        {
+            // IMPORTANT: normalize is approximate and the analytic ray test needs an exact unit direction
+
+            vec3f rayStart = normalize( vec3f( random_float(-1,1), random_float(-1,1), random_float(-1,1) ) ) * 5;
+            vec3f rayDirection = vec3f( random_float(-0.5f,0.5f), random_float(-0.5f,0.5f), random_float(-0.5f,0.5f) ) - rayStart * 0.2f;
+            rayDirection *= 1.0f / sqrt( length_squared( rayDirection ) );
+
+            float t, expected_t;
+            vec3f point, normal, expected_point, expected_normal;
+            const bool hit = IntersectRayBiconvex_SphereTrace_LocalSpace( rayStart, rayDirection, biconvex, t, point, normal );
+            const bool expected = IntersectRayBiconvex_LocalSpace( rayStart, rayDirection, biconvex, expected_t, expected_point, expected_normal );
+
+            // sphere tracing converges slowly for grazing rays, so they may
+            // run out of steps or stop slightly short of the surface
+
+            if ( hit )
+            {
+                numHits++;
+                CHECK( expected );
+                CHECK_CLOSE( t, expected_t, 0.002f );
+                CHECK_CLOSE( length( point - expected_point ), 0.0f, 0.002f );
+            }
+            else if ( expected )
+            {
+                CHECK( dot( expected_normal, rayDirection ) > -0.1f );
+            }
+        }
+
+        CHECK( numHits > 100 );
+    }
+}
+
+SUITE( Collision )
+{
+    TEST( stone_board_collision_batch )
+    {
+        Stone stone;
+        stone.Initialize( STONE_SIZE_40 );
+
+        Board board;
+        board.Initialize( 9 );
+
+        const float w = board.GetHalfWidth();
+        const float h = board.GetHalfHeight();
+        const float t = board.GetThickness();
+
+        const int NumStones = 257;
+
+        RigidBody * rigidBodies = new RigidBody[NumStones];
+        int * primary = new int[NumStones];
+        int * tail = new int[NumStones];
+        StaticContact * contacts = new StaticContact[NumStones];
+
+        srand( 0 );
+
+        for ( int i = 0; i < NumStones; ++i )
+        {
+            RigidBody & rigidBody = rigidBodies[i];
+            rigidBody.position = vec3f( random_float( -w - 2, w + 2 ), random_float( -h - 2, h + 2 ), t + random_float( -0.5f, 1.0f ) );
+            rigidBody.orientation = quat4f::axisRotation( random_float( 0, 2*pi ),
+                                                          normalize( vec3f( random_float( 0.1f, 1 ),
+                                                                            random_float( 0.1f, 1 ),
+                                                                            random_float( 0.1f, 1 ) ) ) );
+            rigidBody.active = ( i % 17 ) != 0;
+            rigidBody.UpdateTransform();
+        }
+
+        const int numContacts = StoneBoardCollision_Batch( stone.biconvex, board, rigidBodies, NumStones, primary, tail, contacts );
+
+        CHECK( numContacts > 0 );
+
+        int numExpected = 0;
+
+        for ( int i = 0; i < NumStones; ++i )
+        {
+            RigidBody & rigidBody = rigidBodies[i];
+
+            StaticContact expected;
+            const bool collided = rigidBody.active && StoneBoardCollision( stone.biconvex, board, rigidBody, expected );
+
+            const StaticContact * contact = NULL;
+            for ( int j = 0; j < numContacts; ++j )
+            {
+                if ( contacts[j].body == i )
+                    contact = &contacts[j];
+            }
+
+            // the scalar path works in local space with an approximate normalize,
+            // so only stones clearly in or out of contact must agree exactly
+
+            if ( collided )
+                numExpected++;
+
+            if ( collided && expected.depth > 0.01f )
+            {
+                CHECK( contact );
+                if ( contact )
+                {
+                    CHECK_CLOSE( contact->depth, expected.depth, 0.01f );
+                    CHECK_CLOSE( dot( contact->normal, expected.normal ), 1.0f, 0.001f );
+                    CHECK_CLOSE( length( contact->point - expected.point ), 0.0f, 0.01f );
+                }
+            }
+            else if ( !collided )
+            {
+                CHECK( !contact || contact->depth < 0.01f );
+            }
+        }
+
+        CHECK_CLOSE( numContacts, numExpected, 4 );
+
+        delete [] rigidBodies;
+        delete [] primary;
+        delete [] tail;
+        delete [] contacts;
+    }
+}
+
+SUITE( GJK )
+{
+    TEST( biconvex_support_point )
+    {
+        Biconvex biconvex( 2.2f, 1.13f );
+
+        srand( 0 );
+
+        for ( int i = 0; i < 1000; ++i )
+        {
+            vec3f axis = vec3f( random_float(-1,1), random_float(-1,1), random_float(-1,1) );
+            axis *= 1.0f / sqrt( length_squared( axis ) );
+
+            vec3f point = BiconvexSupportPoint_LocalSpace( biconvex, axis );
+
+            float s1, s2;
+            BiconvexSupport_LocalSpace( biconvex, axis, s1, s2 );
+
+            CHECK_CLOSE( dot( point, axis ), s2, 0.001f );
+            CHECK_CLOSE( BiconvexSignedDistance_LocalSpace( point, biconvex ), 0.0f, 0.001f );
+
+            // no point on the surface is further along the axis
+
+            vec3f other( random_float(-2,2), random_float(-2,2), random_float(-2,2) );
+            vec3f gradient;
+            const float distance = BiconvexSignedDistance_LocalSpace( other, biconvex, gradient );
+            CHECK( dot( other - gradient * distance, axis ) <= s2 + 0.001f );
+        }
+    }
+
+    TEST( gjk_biconvex_distance )
+    {
+        Biconvex biconvex( 2.2f, 1.13f );
+
+        RigidBodyTransform transform_a, transform_b;
+        transform_a.Initialize( vec3f(0,0,0), quat4f::identity() );
+
+        BiconvexShape a( biconvex, transform_a );
+        BiconvexShape b( biconvex, transform_b );
+
+        GJKResult result;
+
+        // side by side
+
+        transform_b.Initialize( vec3f(3,0,0), quat4f::identity() );
+        CHECK( !GJKDistance( a, b, result ) );
+        CHECK_CLOSE( result.distance, 0.8f, 0.0001f );
+        CHECK_CLOSE( length( result.pointA - vec3f(1.1f,0,0) ), 0.0f, 0.0001f );
+        CHECK_CLOSE( length( result.pointB - vec3f(1.9f,0,0) ), 0.0f, 0.0001f );
+        CHECK_CLOSE( result.normal.x(), 1.0f, 0.0001f );
+
+        // stacked
+
+        transform_b.Initialize( vec3f(0,0,biconvex.GetHeight()+0.5f), quat4f::identity() );
+        CHECK( !GJKDistance( a, b, result ) );
+        CHECK_CLOSE( result.distance, 0.5f, 0.0001f );
+        CHECK_CLOSE( result.normal.z(), 1.0f, 0.0001f );
+
+        // stacked and overlapping
+
+        transform_b.Initialize( vec3f(0,0,biconvex.GetHeight()-0.1f), quat4f::identity() );
+        CHECK( GJKDistance( a, b, result ) );
+        CHECK_CLOSE( result.distance, -0.1f, 0.001f );
+        CHECK_CLOSE( result.normal.z(), 1.0f, 0.001f );
+
+        // separated pairs agree with the separating axis test
+
+        srand( 0 );
+
+        for ( int i = 0; i < 1000; ++i )
+        {
+            // IMPORTANT: normalize is approximate and the closest points are checked against an exactly rigid transform
+
+            vec3f position( random_float(-3,3), random_float(-3,3), random_float(-1,1) );
+            vec3f axis( random_float(0.1f,1), random_float(0.1f,1), random_float(0.1f,1) );
+            axis *= 1.0f / sqrt( length_squared( axis ) );
+            quat4f orientation = quat4f::axisRotation( random_float(0,2*pi), axis );
+            transform_b.Initialize( position, orientation );
+
+            const bool intersecting = GJKDistance( a, b, result );
+
+            // the separating axis test only tries five axes, so it may miss a
+            // separation, but it must never separate intersecting stones
+
+            if ( intersecting && result.distance < -0.01f )
+                CHECK( Biconvex_SAT( biconvex, vec3f(0,0,0), position, vec3f(0,0,1), transform_b.axisZ ) );
+
+            if ( !intersecting )
+            {
+                CHECK_CLOSE( length( result.pointB - result.pointA ), result.distance, 0.001f );
+                CHECK( BiconvexSignedDistance_LocalSpace( result.pointA, biconvex ) < 0.001f );
+                CHECK( BiconvexSignedDistance_LocalSpace( TransformPointWorldToLocal( transform_b, result.pointB ), biconvex ) < 0.001f );
+            }
+        }
+    }
+
+    TEST( gjk_stone_board_penetration )
+    {
+        Biconvex biconvex( 2.2f, 1.13f );
+
+        Board board;
+        board.Initialize( 9 );
+
+        BoardShape boardShape( board );
+
+        srand( 0 );
+
+        for ( int i = 0; i < 1000; ++i )
+        {
+            RigidBody rigidBody;
+            rigidBody.position = vec3f( random_float(-5,5), random_float(-5,5), board.GetThickness() + random_float(-0.3f,0.5f) );
+            rigidBody.orientation = quat4f::axisRotation( random_float(0,2*pi), normalize( vec3f( random_float(0.1f,1), random_float(0.1f,1), random_float(0.1f,1) ) ) );
+            rigidBody.UpdateTransform();
+
+            StaticContact contact;
+            const bool colliding = StoneBoardCollision( biconvex, board, rigidBody, contact );
+
+            GJKResult result;
+            const bool intersecting = GJKDistance( BiconvexShape( biconvex, rigidBody.transform ), boardShape, result );
+
+            if ( fabs( result.distance ) > 0.01f )
+                CHECK_EQUAL( colliding, intersecting );
+
+            if ( colliding && intersecting )
+            {
+                CHECK_CLOSE( -result.distance, contact.depth, 0.002f );
+                CHECK_CLOSE( dot( -result.normal, contact.normal ), 1.0f, 0.001f );
+            }
+        }
+    }
+
+    TEST( gjk_warm_start )
+    {
+        Biconvex biconvex( 2.2f, 1.13f );
+
+        RigidBodyTransform transform_a, transform_b;
+        transform_a.Initialize( vec3f(0,0,0), quat4f::identity() );
+
+        GJKCache cache;
+
+        int coldIterations = 0;
+        int warmIterations = 0;
+
+        for ( int i = 0; i < 100; ++i )
+        {
+            transform_b.Initialize( vec3f( 2.5f + 0.01f * i, 0.3f, 0.1f ), quat4f::axisRotation( 0.01f * i, vec3f(1,0,0) ) );
+
+            GJKResult cold, warm;
+            CHECK( !GJKDistance( BiconvexShape( biconvex, transform_a ), BiconvexShape( biconvex, transform_b ), cold ) );
+            CHECK( !GJKDistance( BiconvexShape( biconvex, transform_a ), BiconvexShape( biconvex, transform_b ), warm, &cache ) );
+
+            CHECK_CLOSE( warm.distance, cold.distance, 0.0001f );
+
+            coldIterations += cold.iterations;
+            if ( i > 0 )
+                warmIterations += warm.iterations;
+        }
+
+        CHECK( warmIterations <= 3 * 99 );
+        CHECK( warmIterations < coldIterations );
+    }
+
+    TEST( gjk_flat_tetrahedron )
+    {
+        // four points in the plane z = 1 have no inside. the origin is a distance of 1 away, not enclosed
+
+        const vec3f points[] = { vec3f(-1,-1,1), vec3f(1,-1,1), vec3f(1,1,1), vec3f(-1,1,1) };
+
+        GJKSimplex simplex;
+        simplex.count = 4;
+        for ( int i = 0; i < 4; ++i )
+        {
+            simplex.vertex[i].a = points[i];
+            simplex.vertex[i].b = vec3f(0,0,0);
+            simplex.vertex[i].w = points[i];
+            simplex.vertex[i].direction = points[i];
+        }
+
+        const vec3f v = GJKSolve( simplex );
+
+        CHECK( simplex.count < 4 );
+        CHECK_CLOSE( v.x(), 0.0f, 0.0001f );
+        CHECK_CLOSE( v.y(), 0.0f, 0.0001f );
+        CHECK_CLOSE( v.z(), 1.0f, 0.0001f );
+    }
+
+    TEST( epa_iteration_cap )
+    {
+        Biconvex biconvex( 2.2f, 1.13f );
+
+        RigidBodyTransform transform_a, transform_b;
+        transform_a.Initialize( vec3f(0,0,0), quat4f::identity() );
+
+        BiconvexShape a( biconvex, transform_a );
+        BiconvexShape b( biconvex, transform_b );
+
+        srand( 0 );
+
+        int capped = 0;
+
+        for ( int i = 0; i < 200; ++i )
+        {
+            vec3f axis( random_float(0.1f,1), random_float(0.1f,1), random_float(0.1f,1) );
+            axis *= 1.0f / sqrt( length_squared( axis ) );
+            transform_b.Initialize( vec3f( random_float(-1,1), random_float(-1,1), random_float(-0.5f,0.5f) ), quat4f::axisRotation( random_float(0,2*pi), axis ) );
+
+            GJKSimplex simplex;
+            GJKResult converged;
+            if ( !GJK( a, b, simplex, converged ) || !EPA( a, b, simplex, converged ) )
+                continue;
+
+            // stopping early must still report the closest face of the polytope so far. the polytope
+            // only grows, so the depth never goes down as the cap goes up and never passes the real depth
+
+            float previousDepth = 0.0f;
+
+            for ( int maxIterations = 1; maxIterations <= 8; ++maxIterations )
+            {
+                GJKResult result;
+                CHECK( GJK( a, b, simplex, result ) );
+                if ( !EPA( a, b, simplex, result, maxIterations ) )
+                    continue;
+
+                const float depth = -result.distance;
+                CHECK( depth > 0.0f );
+                CHECK( depth >= previousDepth - 0.0001f );
+                CHECK( depth <= -converged.distance + 0.0001f );
+                CHECK_CLOSE( length_squared( result.normal ), 1.0f, 0.001f );
+                CHECK_CLOSE( length( result.pointA - result.pointB ), depth, 0.001f );
+
+                if ( depth < -converged.distance - 0.0001f )
+                    capped++;
+
+                previousDepth = depth;
+            }
+        }
+
+        CHECK( capped > 0 );
+    }
+}
+
+SUITE( Allocator )
+{
+    TEST( arena_scratch_reset )
+    {
+        Arena arena;
+        arena.Initialize( 1024 );
+
+        char * a = (char*) arena.Allocate( 3, 1 );
+        float * b = AllocateArray<float>( arena, 5 );
+        CHECK( a );
+        CHECK( b );
+        CHECK_EQUAL( 0, int( uintptr_t( b ) & 15 ) );
+        CHECK( (char*) b >= a + 3 );
+
+        Arena scratch;
+        CHECK( scratch.Initialize( arena, 256 ) );
+        CHECK_EQUAL( 256, (int) scratch.GetSize() );
+        CHECK( arena.GetUsed() >= 256 + 3 + 5 * sizeof( float ) );
+
+        void * first = scratch.Allocate( 100 );
+        scratch.Allocate( 100 );
+        CHECK_EQUAL( 212, (int) scratch.GetUsed() );
+
+        scratch.Reset();
+        CHECK_EQUAL( 0, (int) scratch.GetUsed() );
+        CHECK( scratch.Allocate( 100 ) == first );
+    }
+}
+
+SUITE( World )
+{
+    TEST( body_pool_handles )
+    {
+        Arena arena;
+        arena.Initialize( BodyPool::GetMemoryRequired( 8 ) );
+
+        BodyPool pool;
+        CHECK( pool.Initialize( arena, 8 ) );
+
+        BodyHandle handles[8];
+        for ( int i = 0; i < 8; ++i )
+        {
+            handles[i] = pool.Create();
+            CHECK( pool.IsValid( handles[i] ) );
+            pool.Get( handles[i] )->position = vec3f( float( i ), 0, 0 );
+        }
+
+        CHECK( !pool.IsValid( pool.Create() ) );
+        CHECK( !pool.IsValid( BodyHandle() ) );
+
+        // destroy swaps the last body into the hole, and its handle follows it
+
+        pool.Destroy( handles[2] );
+        CHECK_EQUAL( 7, pool.GetNumBodies() );
+        CHECK( !pool.IsValid( handles[2] ) );
+        CHECK( pool.Get( handles[2] ) == NULL );
+        CHECK_EQUAL( 2, pool.GetIndex( handles[7] ) );
+        CHECK( pool.GetHandle( 2 ) == handles[7] );
+
+        for ( int i = 0; i < 8; ++i )
+        {
+            if ( i != 2 )
+                CHECK_CLOSE( float( i ), pool.Get( handles[i] )->position.x(), 0.0f );
+        }
+
+        // a new body reusing the slot gets a new generation, so the old handle stays dead
+
+        const BodyHandle reused = pool.Create();
+        CHECK_EQUAL( handles[2].slot, reused.slot );
+        CHECK( reused != handles[2] );
+        CHECK( !pool.IsValid( handles[2] ) );
+        CHECK_EQUAL( 7, pool.GetIndex( reused ) );
+
+        for ( int i = 0; i < pool.GetNumBodies(); ++i )
+            CHECK_EQUAL( i, pool.GetIndex( pool.GetHandle( i ) ) );
+    }
+
+    TEST( world_remove_stones )
+    {
+        Arena arena;
+        arena.Initialize( World::GetMemoryRequired( 16 ) );
+
+        World world;
+        CHECK( world.Initialize( arena, 9, STONE_SIZE_40, 16 ) );
+
+        BodyHandle handles[16];
+        for ( int i = 0; i < 16; ++i )
+            handles[i] = world.AddStone( vec3f( i - 8.0f, 0, 5 ), quat4f::identity() );
+
+        for ( int i = 0; i < 16; i += 3 )
+            world.RemoveStone( handles[i] );
+
+        CHECK_EQUAL( 10, world.GetNumBodies() );
+        CHECK_EQUAL( 10, world.GetNumActive() );
+
+        for ( int i = 0; i < 10; ++i )
+            world.Step( 1.0f / 60.0f );
+
+        for ( int i = 0; i < 16; ++i )
+        {
+            CHECK_EQUAL( i % 3 != 0, world.IsValid( handles[i] ) );
+            if ( world.IsValid( handles[i] ) )
+                CHECK_CLOSE( i - 8.0f, world.GetBody( handles[i] ).position.x(), 0.001f );
+        }
+    }
+
+    TEST( world_stones_fall_asleep )
+    {
+        Arena arena;
+        arena.Initialize( World::GetMemoryRequired( 9 ) );
+
+        World world;
+        CHECK( world.Initialize( arena, 9, STONE_SIZE_40, 9 ) );
+
+        const float w = world.GetBoard().GetWidth() * 0.5f;
+
+        for ( int i = 0; i < 9; ++i )
+        {
+            const float x = -w + ( 2 * w ) * ( i + 0.5f ) / 9;
+            const vec3f position = ( i & 1 ) ? vec3f( x, 0, 2 ) : vec3f( x, w + 4, 2 );
+            world.AddStone( position, quat4f::axisRotation( 0.2f * i, vec3f(1,0,0) ) );
+        }
+
+        CHECK( world.IsAwake() );
+        CHECK_EQUAL( 9, world.GetNumActive() );
+
+        const float dt = 1.0f / 60.0f;
+
+        int frames = 0;
+        while ( world.IsAwake() && frames < 60 * 20 )
+        {
+            world.Step( dt );
+            frames++;
+        }
+
+        CHECK( !world.IsAwake() );
+
+        // stones on the board rest on top of it, the rest on the floor
+
+        const float t = world.GetBoard().GetThickness();
+        const float h = world.GetBiconvex().GetHeight() * 0.5f;
+
+        for ( int i = 0; i < world.GetNumBodies(); ++i )
+        {
+            const RigidBody & rigidBody = world.GetBody( i );
+            CHECK( !rigidBody.active );
+            CHECK_CLOSE( rigidBody.position.z(), ( i & 1 ) ? t + h : h, 0.02f );
+        }
+
+        // a sleeping world does no work, and a stone that is woken up stays where it is
+
+        const vec3f position = world.GetBody( 1 ).position;
+        world.Step( dt );
+        CHECK_CLOSE_VEC3( world.GetBody( 1 ).position, position, 0.0f );
+
+        world.Wake( world.GetHandle( 1 ) );
+        CHECK_EQUAL( 1, world.GetNumActive() );
+        world.Step( dt );
+        CHECK_CLOSE_VEC3( world.GetBody( 1 ).position, position, 0.01f );
+    }
+
+    TEST( host_skips_idle_tables )
+    {
+        HostParams params;
+        params.numTables = 16;
+        params.boardSize = 9;
+        params.maxStonesPerTable = 4;
+        params.numWorkers = 3;
+
+        Host host;
+        CHECK( host.Initialize( params ) );
+
+        host.Tick();
+        CHECK_EQUAL( 0, host.GetNumAwake() );
+        CHECK_EQUAL( 16, (int) host.GetStats().tablesIdle );
+
+        for ( int i = 0; i < host.GetNumTables(); i += 4 )
+            host.GetWorld( i ).AddStone( vec3f( 0, 0, 2 + i * 0.1f ), quat4f::identity() );
+
+        host.Tick();
+        CHECK_EQUAL( 4, host.GetNumAwake() );
+        CHECK_EQUAL( 4, (int) host.GetStats().tablesStepped );
+
+        int ticks = 0;
+        while ( host.GetNumAwake() > 0 && ticks < 60 * 20 )
+        {
+            host.Tick();
+            ticks++;
+        }
+
+        CHECK_EQUAL( 0, host.GetNumAwake() );
+
+        for ( int i = 0; i < host.GetNumTables(); ++i )
+            CHECK( !host.GetWorld( i ).IsAwake() );
+
+        const uint64_t stepped = host.GetStats().tablesStepped;
+        host.Tick();
+        CHECK_EQUAL( stepped, host.GetStats().tablesStepped );
+    }
+}
+
+SUITE( Snapshot )
+{
+    TEST( bit_packer )
+    {
+        uint8_t buffer[256];
+
+        BitWriter writer( buffer, sizeof( buffer ) );
+
+        CHECK_EQUAL( 0, BitsRequired( 0 ) );
+        CHECK_EQUAL( 1, BitsRequired( 1 ) );
+        CHECK_EQUAL( 9, BitsRequired( 361 ) );
+        CHECK_EQUAL( 32, BitsRequired( 0xFFFFFFFF ) );
+
+        int expectedBits = 0;
+        for ( int i = 0; i < 50; ++i )
+        {
+            const int bits = 1 + ( i * 7 ) % 32;
+            const uint32_t value = uint32_t( i * 2654435761u ) >> ( 32 - bits );
+            writer.WriteBits( value, bits );
+            expectedBits += bits;
+        }
+        writer.WriteBool( true );
+        writer.FlushBits();
+
+        CHECK_EQUAL( expectedBits + 1, writer.GetBitsWritten() );
+        CHECK( !writer.IsOverflow() );
+
+        BitReader reader( buffer, writer.GetBytesWritten() );
+
+        for ( int i = 0; i < 50; ++i )
+        {
+            const int bits = 1 + ( i * 7 ) % 32;
+            const uint32_t value = uint32_t( i * 2654435761u ) >> ( 32 - bits );
+            CHECK_EQUAL( value, reader.ReadBits( bits ) );
+        }
+        CHECK( reader.ReadBool() );
+        CHECK( !reader.IsOverflow() );
+
+        reader.ReadBits( 8 );
+        CHECK( reader.IsOverflow() );
+
+        uint8_t small[4];
+        BitWriter smallWriter( small, sizeof( small ) );
+        smallWriter.WriteBits( 0, 30 );
+        CHECK( !smallWriter.IsOverflow() );
+        smallWriter.WriteBits( 0, 3 );
+        CHECK( smallWriter.IsOverflow() );
+    }
+
+    TEST( snapshot_round_trip )
+    {
+        Board board;
+        board.Initialize( 19 );
+
+        SnapshotParams params;
+        params.Initialize( board );
+
+        Arena arena;
+        arena.Initialize( World::GetMemoryRequired( 64 ) * 2 );
+
+        World server, client;
+        CHECK( server.Initialize( arena, 19, STONE_SIZE_40, 64 ) );
+        CHECK( client.Initialize( arena, 19, STONE_SIZE_40, 64 ) );
+
+        for ( int i = 0; i < 64; ++i )
+        {
+            const vec3f position( random_float( -20, 20 ), random_float( -20, 20 ), random_float( 2, 10 ) );
+            vec3f axis( random_float( -1, 1 ), random_float( -1, 1 ), random_float( -1, 1 ) );
+            axis *= 1.0f / sqrt( length_squared( axis ) );
+            server.AddStone( position, quat4f::axisRotation( random_float( 0, 2 * pi ), axis ) );
+        }
+
+        for ( int i = 0; i < 20; ++i )
+            server.Step( 1.0f / 60.0f );
+
+        for ( int i = 0; i < 64; i += 4 )
+            server.Sleep( server.GetHandle( i ) );
+
+        static Snapshot snapshot, received;
+        CaptureSnapshot( params, server, 1000, snapshot );
+
+        uint8_t buffer[4096];
+        BitWriter writer( buffer, sizeof( buffer ) );
+        CHECK( WriteSnapshot( writer, params, snapshot ) );
+        writer.FlushBits();
+
+        const SnapshotBits bits( params );
+        const int activeBits = 1 + bits.positionXY[0] + bits.positionXY[1] + bits.positionZ + 2 + 3 * bits.orientation + 3 * bits.linearMomentum + 3 * bits.angularMomentum;
+        const int sleepingBits = 1 + bits.positionXY[0] + bits.positionXY[1] + bits.positionZ + 2 + 3 * bits.orientation;
+        CHECK_EQUAL( 165, activeBits );
+        CHECK_EQUAL( 78, sleepingBits );
+        CHECK_EQUAL( 16 + bits.numStones + 48 * activeBits + 16 * sleepingBits, writer.GetBitsWritten() );
+
+        BitReader reader( buffer, writer.GetBytesWritten() );
+        CHECK( ReadSnapshot( reader, params, received ) );
+        CHECK_EQUAL( 1000, received.sequence );
+        CHECK_EQUAL( 64, received.numStones );
+        for ( int i = 0; i < 64; ++i )
+            CHECK( snapshot.stones[i] == received.stones[i] );
+
+        CHECK( ApplySnapshot( params, received, client ) );
+
+        CHECK_EQUAL( 64, client.GetNumBodies() );
+        CHECK_EQUAL( server.GetNumActive(), client.GetNumActive() );
+
+        for ( int i = 0; i < 64; ++i )
+        {
+            const RigidBody & a = server.GetBody( i );
+            const RigidBody & b = client.GetBody( i );
+
+            CHECK_EQUAL( a.active, b.active );
+            CHECK_CLOSE_VEC3( a.position, b.position, params.positionResolution );
+
+            const float d = fabs( a.orientation.x * b.orientation.x + a.orientation.y * b.orientation.y +
+                                  a.orientation.z * b.orientation.z + a.orientation.w * b.orientation.w );
+            CHECK_CLOSE( 1.0f, d, 0.0001f );
+
+            CHECK_CLOSE_VEC3( a.linearMomentum, b.linearMomentum, params.linearMomentumResolution );
+            CHECK_CLOSE_VEC3( a.angularMomentum, b.angularMomentum, params.angularMomentumResolution );
+        }
+
+        // a truncated packet is rejected
+
+        BitReader truncated( buffer, writer.GetBytesWritten() / 2 );
+        CHECK( !ReadSnapshot( truncated, params, received ) );
+
+        // a snapshot with more stones than the world can hold is rejected and leaves the world alone
+
+        Arena smallArena;
+        smallArena.Initialize( World::GetMemoryRequired( 16 ) );
+
+        World small;
+        CHECK( small.Initialize( smallArena, 19, STONE_SIZE_40, 16 ) );
+        small.AddStone( vec3f(0,0,5), quat4f::identity() );
+
+        CHECK( !ApplySnapshot( params, received, small ) );
+        CHECK_EQUAL( 1, small.GetNumBodies() );
+
+        received.numStones = -1;
+        CHECK( !ApplySnapshot( params, received, small ) );
+        CHECK_EQUAL( 1, small.GetNumBodies() );
+    }
+
+    TEST( snapshot_delta )
+    {
+        SnapshotParams params;
+
+        Arena arena;
+        arena.Initialize( World::GetMemoryRequired( 100 ) );
+
+        World world;
+        CHECK( world.Initialize( arena, 19, STONE_SIZE_40, 100 ) );
+
+        for ( int i = 0; i < 90; ++i )
+        {
+            const vec3f point = world.GetBoard().GetPointPosition( 1 + i % 19, 1 + i / 19 );
+            world.AddStone( point + vec3f( 0, 0, 0.6f ), quat4f::identity() );
+        }
+
+        while ( world.IsAwake() )
+            world.Step( 1.0f / 60.0f );
+
+        static Snapshot baseline, snapshot, received;
+        CaptureSnapshot( params, world, 10, baseline );
+
+        // nothing moved: one bit per stone
+
+        CaptureSnapshot( params, world, 11, snapshot );
+
+        uint8_t buffer[8192];
+        {
+            BitWriter writer( buffer, sizeof( buffer ) );
+            CHECK( WriteSnapshotDelta( writer, params, snapshot, baseline ) );
+            CHECK_EQUAL( 16 + SnapshotBits( params ).numStones + 90, writer.GetBitsWritten() );
+        }
+
+        // nudge a few stones, wake one up and drop in new ones past the end of the baseline
+
+        for ( int i = 0; i < 5; ++i )
+            world.AddStone( vec3f( i * 3.0f, 0, 8 ), quat4f::axisRotation( 0.5f, vec3f(0,0,1) ) );
+
+        world.GetBody( 3 ).position += vec3f( 0.01f, 0, 0 );
+        world.GetBody( 7 ).orientation = quat4f::axisRotation( 0.01f, vec3f(0,0,1) );
+        world.Wake( world.GetHandle( 20 ) );
+        world.GetBody( 20 ).linearMomentum = vec3f( 1, 0, 0 );
+
+        CaptureSnapshot( params, world, 12, snapshot );
+
+        BitWriter writer( buffer, sizeof( buffer ) );
+        CHECK( WriteSnapshotDelta( writer, params, snapshot, baseline ) );
+        writer.FlushBits();
+
+        BitWriter fullWriter( buffer + 4096, 4096 );
+        WriteSnapshot( fullWriter, params, snapshot );
+        CHECK( writer.GetBitsWritten() * 5 < fullWriter.GetBitsWritten() );
+
+        BitReader reader( buffer, writer.GetBytesWritten() );
+        CHECK( ReadSnapshotDelta( reader, params, baseline, received ) );
+        CHECK_EQUAL( 12, received.sequence );
+        CHECK_EQUAL( 95, received.numStones );
+        for ( int i = 0; i < 95; ++i )
+            CHECK( snapshot.stones[i] == received.stones[i] );
+    }
+
+    TEST( replication_with_loss )
+    {
+        SnapshotParams params;
+
+        Arena arena;
+        arena.Initialize( World::GetMemoryRequired( 32 ) );
+
+        World world;
+        CHECK( world.Initialize( arena, 9, STONE_SIZE_40, 32 ) );
+
+        for ( int i = 0; i < 32; ++i )
+            world.AddStone( vec3f( random_float( -8, 8 ), random_float( -8, 8 ), random_float( 2, 6 ) ), quat4f::identity() );
+
+        SnapshotSender sender;
+        SnapshotReceiver receiver;
+
+        static Snapshot current;
+        uint8_t buffer[4096];
+
+        int numReceived = 0;
+        int fullBytes = 0;
+        int deltaBytes = 0;
+
+        for ( int frame = 0; frame < 240; ++frame )
+        {
+            world.Step( 1.0f / 60.0f );
+
+            CaptureSnapshot( params, world, 0, current );
+
+            const bool delta = sender.HasAck() && uint16_t( sender.GetSequence() - sender.GetAckSequence() ) < SnapshotWindowSize;
+
+            BitWriter writer( buffer, sizeof( buffer ) );
+            CHECK( sender.WritePacket( writer, params, current ) );
+            writer.FlushBits();
+
+            if ( delta )
+                deltaBytes = writer.GetBytesWritten();
+            else
+                fullBytes = writer.GetBytesWritten();
+
+            // drop a third of the packets and ack the rest a few frames late
+
+            if ( frame % 3 == 1 )
+                continue;
+
+            BitReader reader( buffer, writer.GetBytesWritten() );
+            CHECK( receiver.ReadPacket( reader, params ) );
+            numReceived++;
+
+            const Snapshot & received = receiver.GetReceived();
+            CHECK_EQUAL( current.numStones, received.numStones );
+            for ( int i = 0; i < current.numStones; ++i )
+                CHECK( current.stones[i] == received.stones[i] );
+
+            uint16_t ack;
+            if ( frame % 4 == 0 && receiver.GetAck( ack ) )
+                sender.ProcessAck( ack );
+        }
+
+        CHECK_EQUAL( 160, numReceived );
+        CHECK( !world.IsAwake() );
+        CHECK( deltaBytes * 8 < fullBytes );
+
+        // a delta against a baseline the receiver never got is rejected
+
+        SnapshotReceiver fresh;
+        BitWriter writer( buffer, sizeof( buffer ) );
+        sender.WritePacket( writer, params, current );
+        writer.FlushBits();
+        BitReader reader( buffer, writer.GetBytesWritten() );
+        CHECK( !fresh.ReadPacket( reader, params ) );
+
+        // a truncated packet is rejected and leaves the last received snapshot as it was
+
+        const uint16_t before = receiver.GetReceived().sequence;
+        BitReader truncated( buffer, writer.GetBytesWritten() / 2 );
+        CHECK( !receiver.ReadPacket( truncated, params ) );
+        CHECK_EQUAL( before, receiver.GetReceived().sequence );
+        CHECK_EQUAL( current.numStones, receiver.GetReceived().numStones );
+        for ( int i = 0; i < current.numStones; ++i )
+            CHECK( current.stones[i] == receiver.GetReceived().stones[i] );
+    }
+}
+
+SUITE( Network )
+{
+    TEST( network_simulator )
+    {
+        NetworkSimulatorParams params;
+        params.latency = 0.1f;
+        params.jitter = 0.02f;
+        params.packetLoss = 20.0f;
+        params.duplicates = 10.0f;
+
+        NetworkSimulator simulator;
+        simulator.Initialize( 2, params );
+
+        uint8_t data[4];
+        for ( int i = 0; i < 1000; ++i )
+        {
+            memcpy( data, &i, 4 );
+            simulator.SendPacket( 0, 1, data, 4 );
+        }
+
+        const NetworkStats & sender = simulator.GetStats( 0 );
+        CHECK_EQUAL( 1000, (int) sender.packetsSent );
+        CHECK( sender.packetsLost > 150 && sender.packetsLost < 250 );
+        CHECK( sender.packetsDuplicated > 50 && sender.packetsDuplicated < 150 );
+
+        // nothing arrives before the minimum latency
+
+        int from;
+        simulator.AdvanceTime( 0.079 );
+        CHECK_EQUAL( 0, simulator.ReceivePacket( 1, data, 4, from ) );
+
+        simulator.AdvanceTime( 0.121 );
+
+        int received = 0;
+        int outOfOrder = 0;
+        int last = -1;
+        while ( simulator.ReceivePacket( 1, data, 4, from ) == 4 )
+        {
+            CHECK_EQUAL( 0, from );
+            int value;
+            memcpy( &value, data, 4 );
+            if ( value < last )
+                outOfOrder++;
+            last = value;
+            received++;
+        }
+
+        CHECK_EQUAL( int( 1000 - sender.packetsLost + sender.packetsDuplicated ), received );
+        CHECK_EQUAL( received, (int) simulator.GetStats( 1 ).packetsReceived );
+        CHECK( outOfOrder > 0 );
+        CHECK_EQUAL( 0, simulator.GetNumPacketsInFlight() );
+
+        const float latency = simulator.GetStats( 1 ).GetAverageLatency();
+        CHECK( latency >= 0.08f && latency <= 0.121f );
+    }
+
+    TEST( loopback_clients_converge )
+    {
+        LoopbackParams params;
+        params.numClients = 3;
+        params.boardSize = 9;
+        params.maxStones = 16;
+        params.snapshotRate = 20;
+        params.networkParams.latency = 0.05f;
+        params.networkParams.jitter = 0.01f;
+        params.networkParams.packetLoss = 10.0f;
+        params.networkParams.duplicates = 5.0f;
+
+        Loopback loopback;
+        CHECK( loopback.Initialize( params ) );
+
+        World & server = loopback.GetServer();
+        for ( int i = 0; i < 16; ++i )
+            server.AddStone( vec3f( random_float( -8, 8 ), random_float( -8, 8 ), random_float( 2, 6 ) ), quat4f::identity() );
+
+        for ( int i = 0; i < 60 * 5; ++i )
+            loopback.Update();
+
+        CHECK( !server.IsAwake() );
+
+        const SnapshotParams & snapshotParams = loopback.GetSnapshotParams();
+
+        static Snapshot expected, actual;
+        CaptureSnapshot( snapshotParams, server, 0, expected );
+
+        for ( int i = 0; i < loopback.GetNumClients(); ++i )
+        {
+            CHECK( loopback.GetClientFrame( i ) > loopback.GetFrame() - 30 );
+
+            CaptureSnapshot( snapshotParams, loopback.GetClient( i ), 0, actual );
+            CHECK_EQUAL( expected.numStones, actual.numStones );
+            for ( int j = 0; j < expected.numStones; ++j )
+                CHECK( expected.stones[j] == actual.stones[j] );
+        }
+
+        const LoopbackStats & stats = loopback.GetStats();
+        CHECK( stats.GetAverageStaleness() >= 0.05f );
+        CHECK( stats.GetAverageStaleness() < 0.2f );
+        CHECK_EQUAL( 0, (int) stats.snapshotsRejected );
+        CHECK( loopback.GetServerBytesPerSecond() > 0.0f );
+        CHECK( loopback.GetClientBytesPerSecond() > 0.0f );
+    }
+
+    TEST( loopback_rejects_oversized_snapshot )
+    {
+        LoopbackParams params;
+        params.numClients = 1;
+        params.boardSize = 9;
+        params.maxStones = 4;
+
+        Loopback loopback;
+        CHECK( loopback.Initialize( params ) );
+
+        loopback.GetServer().AddStone( vec3f(0,0,5), quat4f::identity() );
+
+        // a server with room for more stones than the client sends it a snapshot
+
+        Arena arena;
+        arena.Initialize( World::GetMemoryRequired( 8 ) );
+
+        World other;
+        CHECK( other.Initialize( arena, 9, STONE_SIZE_40, 8 ) );
+        for ( int i = 0; i < 8; ++i )
+            other.AddStone( vec3f( i - 4.0f, 0, 5 ), quat4f::identity() );
+
+        static Snapshot snapshot;
+        CaptureSnapshot( loopback.GetSnapshotParams(), other, 0, snapshot );
+
+        uint8_t packet[4096];
+        BitWriter writer( packet, sizeof( packet ) );
+        writer.WriteBits( 1000, 32 );
+        SnapshotSender sender;
+        CHECK( sender.WritePacket( writer, loopback.GetSnapshotParams(), snapshot ) );
+        writer.FlushBits();
+        loopback.GetSimulator().SendPacket( 0, 1, packet, writer.GetBytesWritten() );
+
+        loopback.Update();
+
+        CHECK_EQUAL( 1, (int) loopback.GetStats().snapshotsRejected );
+        CHECK_EQUAL( 1, loopback.GetClient( 0 ).GetNumBodies() );
+        CHECK( loopback.GetClientFrame( 0 ) < 1000 );
+    }
+}
+
+SUITE( Interpolation )
+{
+    TEST( slerp )
+    {
+        const quat4f a = quat4f::identity();
+        const quat4f b = quat4f::axisRotation( pi / 2, vec3f(0,0,1) );
+        const quat4f expected = quat4f::axisRotation( pi / 4, vec3f(0,0,1) );
+
+        quat4f q = slerp( a, b, 0.0f );
+        CHECK_CLOSE( 1.0f, dot( q, a ), 0.00001f );
+
+        q = slerp( a, b, 1.0f );
+        CHECK_CLOSE( 1.0f, dot( q, b ), 0.00001f );
+
+        q = slerp( a, b, 0.5f );
+        CHECK_CLOSE( 1.0f, dot( q, expected ), 0.00001f );
+
+        // -b is the same rotation as b. slerp must still take the short way
+
+        q = slerp( a, b * -1.0f, 0.5f );
+        CHECK_CLOSE( 1.0f, fabs( dot( q, expected ) ), 0.00001f );
+
+        // nearly identical quaternions fall back to lerp without blowing up
+
+        const quat4f c = quat4f::axisRotation( 0.0001f, vec3f(1,0,0) );
+        q = slerp( a, c, 0.5f );
+        CHECK_CLOSE( 1.0f, q.length(), 0.00001f );
+    }
+
+    TEST( jitter_buffer )
+    {
+        Board board;
+        board.Initialize( 19 );
+
+        Stone stone;
+        stone.Initialize( STONE_SIZE_40 );
+
+        SnapshotParams snapshotParams;
+        snapshotParams.Initialize( board );
+
+        JitterBufferParams params;
+        params.numSnapshots = 4;
+        params.maxStones = 1;
+        params.playoutDelay = 0.15f;
+        params.maxExtrapolation = 0.1f;
+
+        JitterBuffer buffer;
+        buffer.Initialize( stone.rigidBody, params );
+
+        InterpolatedStone stones[1];
+        PlayoutMode mode;
+        CHECK_EQUAL( 0, buffer.Interpolate( 0.0, stones, &mode ) );
+        CHECK_EQUAL( PLAYOUT_EMPTY, mode );
+
+        // a stone sliding along x and turning about z, sent at 10 snapshots per second over
+        // 50ms +/- 20ms. snapshot 3 is delayed until after snapshot 4, snapshot 6 is lost
+
+        const int NumSnapshots = 10;
+        const float speed = 10.0f;
+        const float spin = 1.0f;
+
+        static Snapshot snapshots[NumSnapshots];
+        double arrival[NumSnapshots];
+
+        RigidBody rigidBody = stone.rigidBody;
+        for ( int i = 0; i < NumSnapshots; ++i )
+        {
+            const float time = i * 0.1f;
+            rigidBody.position = vec3f( time * speed, 0, 1 );
+            rigidBody.orientation = quat4f::axisRotation( time * spin, vec3f(0,0,1) );
+            rigidBody.linearMomentum = vec3f( speed * rigidBody.mass, 0, 0 );
+            rigidBody.angularMomentum = vec3f( 0, 0, spin * rigidBody.inertia.z() );
+            rigidBody.UpdateTransform();
+            rigidBody.UpdateMomentum();
+
+            snapshots[i].sequence = i;
+            snapshots[i].numStones = 1;
+            QuantizeStone( snapshotParams, rigidBody, snapshots[i].stones[0] );
+
+            arrival[i] = time + 0.05 + ( ( i & 1 ) ? 0.02 : -0.02 );
+        }
+        arrival[3] = 0.3 + 0.15;
+        arrival[6] = -1;
+
+        int modes[4] = { 0, 0, 0, 0 };
+
+        for ( int frame = 0; frame < 90; ++frame )
+        {
+            const double localTime = frame / 60.0;
+
+            for ( int i = 0; i < NumSnapshots; ++i )
+            {
+                if ( arrival[i] >= 0 && arrival[i] <= localTime )
+                {
+                    CHECK( buffer.AddSnapshot( localTime, i * 0.1, snapshotParams, snapshots[i] ) );
+                    arrival[i] = -1;
+                }
+            }
+
+            const int numStones = buffer.Interpolate( localTime, stones, &mode );
+            modes[mode]++;
+
+            if ( mode == PLAYOUT_EMPTY )
+            {
+                CHECK_EQUAL( 0, numStones );
+                continue;
+            }
+
+            CHECK_EQUAL( 1, numStones );
+            CHECK( buffer.GetNumBuffered() <= params.numSnapshots );
+
+            // the fastest snapshots arrive 30ms after they were taken, plus up to a frame before they are seen
+
+            CHECK( buffer.GetClockOffset() >= 0.03 && buffer.GetClockOffset() < 0.05 );
+
+            const float renderTime = float( buffer.GetRenderTime() );
+
+            if ( mode == PLAYOUT_INTERPOLATE || mode == PLAYOUT_EXTRAPOLATE )
+            {
+                CHECK_CLOSE( renderTime * speed, stones[0].position.x(), 0.01f );
+                const quat4f expected = quat4f::axisRotation( renderTime * spin, vec3f(0,0,1) );
+                CHECK_CLOSE( 1.0f, fabs( dot( stones[0].orientation, expected ) ), 0.0001f );
+            }
+            else if ( renderTime > 0.0f )
+            {
+                // held at the limit of extrapolation
+
+                CHECK_CLOSE( ( 0.9f + params.maxExtrapolation ) * speed, stones[0].position.x(), 0.01f );
+            }
+        }
+
+        CHECK( modes[PLAYOUT_EMPTY] > 0 );
+        CHECK( modes[PLAYOUT_HOLD] > 0 );
+        CHECK( modes[PLAYOUT_INTERPOLATE] > 0 );
+        CHECK( modes[PLAYOUT_EXTRAPOLATE] > 0 );
+
+        // a duplicate, and a snapshot the render time has long passed, are both dropped
+
+        CHECK( !buffer.AddSnapshot( 1.5, 0.9, snapshotParams, snapshots[9] ) );
+        CHECK( !buffer.AddSnapshot( 1.5, 0.8, snapshotParams, snapshots[8] ) );
+        CHECK_EQUAL( 1, (int) buffer.GetStats().snapshotsDuplicate );
+        CHECK_EQUAL( 1, (int) buffer.GetStats().snapshotsLate );
+    }
+
+    TEST( loopback_interpolation )
+    {
+        // 10 snapshots per second over a jittery, lossy network still gives smooth stones on the client
+
+        LoopbackParams params;
+        params.numClients = 2;
+        params.maxStones = 16;
+        params.snapshotRate = 10;
+        params.networkParams.latency = 0.05f;
+        params.networkParams.jitter = 0.02f;
+        params.networkParams.packetLoss = 10.0f;
+        params.jitterParams.maxStones = 16;
+        params.jitterParams.playoutDelay = 0.15f;
+
+        Loopback loopback;
+        CHECK( loopback.Initialize( params ) );
+
+        World & server = loopback.GetServer();
+        for ( int i = 0; i < 8; ++i )
+        {
+            const BodyHandle handle = server.AddStone( vec3f( i * 3.0f - 10, 0, 10.0f + i ), quat4f::axisRotation( i * 0.5f, vec3f(1,0,0) ) );
+            RigidBody & rigidBody = server.GetBody( handle );
+            rigidBody.linearMomentum = vec3f( 5, 0, 0 ) * rigidBody.mass;
+            rigidBody.UpdateMomentum();
+        }
+
+        InterpolatedStone stones[16];
+
+        int interpolated = 0;
+        for ( int i = 0; i < 120; ++i )
+        {
+            loopback.Update();
+
+            for ( int j = 0; j < loopback.GetNumClients(); ++j )
+            {
+                PlayoutMode mode;
+                const int numStones = loopback.InterpolateClient( j, stones, &mode );
+                if ( mode == PLAYOUT_EMPTY )
+                    continue;
+                CHECK_EQUAL( 8, numStones );
+                if ( mode == PLAYOUT_INTERPOLATE )
+                    interpolated++;
+                for ( int k = 0; k < numStones; ++k )
+                    CHECK_CLOSE( 1.0f, stones[k].orientation.length(), 0.0001f );
+            }
+        }
+
+        CHECK( interpolated > 120 );
+
+        for ( int j = 0; j < loopback.GetNumClients(); ++j )
+        {
+            const JitterBufferStats & stats = loopback.GetJitterBuffer( j ).GetStats();
+            CHECK( stats.snapshotsAdded > 0 );
+            CHECK( stats.framesInterpolated > stats.framesExtrapolated + stats.framesHeld );
+        }
+    }
+}
+
+SUITE( Priority )
+{
+    TEST( priority_accumulator )
+    {
+        Board board;
+        board.Initialize( 19 );
+
+        SnapshotParams snapshotParams;
+        snapshotParams.Initialize( board );
+
+        Arena arena;
+        arena.Initialize( World::GetMemoryRequired( 64 ) * 2 );
+
+        World server, client;
+        CHECK( server.Initialize( arena, 19, STONE_SIZE_40, 64 ) );
+        CHECK( client.Initialize( arena, 19, STONE_SIZE_40, 64 ) );
+
+        // 48 stones at rest and 16 sliding, the last ones fastest
+
+        for ( int i = 0; i < 64; ++i )
+        {
+            const BodyHandle handle = server.AddStone( vec3f( ( i % 8 ) * 4.0f - 14, ( i / 8 ) * 4.0f - 14, 1 ), quat4f::identity() );
+            if ( i < 48 )
+            {
+                server.Sleep( handle );
+                continue;
+            }
+            RigidBody & rigidBody = server.GetBody( handle );
+            rigidBody.linearMomentum = vec3f( float( i - 47 ), 0, 0 ) * rigidBody.mass;
+            rigidBody.UpdateMomentum();
+        }
+
+        const SnapshotBits bits( snapshotParams );
+        CHECK_EQUAL( 165, bits.GetStone( true ) );
+        CHECK_EQUAL( 78, bits.GetStone( false ) );
+
+        PriorityParams params;
+        params.maxBytes = 64;
+
+        PriorityAccumulator accumulator;
+        accumulator.Initialize( 64, params );
+
+        accumulator.Accumulate( server, 1.0f / 60.0f );
+
+        for ( int i = 1; i < 64; ++i )
+            CHECK( accumulator.GetPriority( i ) >= accumulator.GetPriority( i - 1 ) );
+        CHECK( accumulator.GetPriority( 48 ) > accumulator.GetPriority( 47 ) * 10 );
+
+        // only the fastest stones fit, and a skipped awake stone leaves room for a sleeping one
+
+        static StateUpdate update, received;
+        accumulator.BuildStateUpdate( snapshotParams, server, update );
+        CHECK_EQUAL( 64, update.numStones );
+        CHECK_EQUAL( 3, update.numUpdates );
+        CHECK_EQUAL( 63, update.indices[0] );
+        CHECK_EQUAL( 62, update.indices[1] );
+        CHECK_EQUAL( 0, update.indices[2] );
+        CHECK_EQUAL( 0.0f, accumulator.GetPriority( 63 ) );
+        CHECK( accumulator.GetPriority( 61 ) > 0.0f );
+
+        uint8_t buffer[MaxPacketSize];
+        BitWriter writer( buffer, sizeof( buffer ) );
+        CHECK( WriteStateUpdate( writer, snapshotParams, update ) );
+        writer.FlushBits();
+        CHECK( writer.GetBytesWritten() <= params.maxBytes );
+
+        BitReader reader( buffer, writer.GetBytesWritten() );
+        CHECK( ReadStateUpdate( reader, snapshotParams, received ) );
+        CHECK_EQUAL( update.numStones, received.numStones );
+        CHECK_EQUAL( update.numUpdates, received.numUpdates );
+        for ( int i = 0; i < update.numUpdates; ++i )
+        {
+            CHECK_EQUAL( update.indices[i], received.indices[i] );
+            CHECK( update.stones[i] == received.stones[i] );
+        }
+
+        // keep sending. every stone gets through within a bounded number of updates,
+        // and the client ends up with the same state as the server
+
+        CHECK( ApplyStateUpdate( snapshotParams, received, client ) );
+        CHECK_EQUAL( 64, client.GetNumBodies() );
+
+        int sent[64];
+        for ( int i = 0; i < 64; ++i )
+            sent[i] = 0;
+
+        for ( int i = 0; i < 200; ++i )
+        {
+            accumulator.Accumulate( server, 1.0f / 60.0f );
+            accumulator.BuildStateUpdate( snapshotParams, server, update );
+            for ( int j = 0; j < update.numUpdates; ++j )
+                sent[update.indices[j]]++;
+            CHECK( ApplyStateUpdate( snapshotParams, update, client ) );
+        }
+
+        for ( int i = 0; i < 64; ++i )
+            CHECK( sent[i] > 0 );
+        CHECK( sent[63] > sent[48] );
+        CHECK( sent[48] > sent[0] * 2 );
+
+        static Snapshot expected, actual;
+        CaptureSnapshot( snapshotParams, server, 0, expected );
+        CaptureSnapshot( snapshotParams, client, 0, actual );
+        for ( int i = 0; i < 64; ++i )
+            CHECK( expected.stones[i] == actual.stones[i] );
+    }
+
+    TEST( loopback_priority_updates )
+    {
+        // a burst of stones replicated through a 200 byte budget. bandwidth stays under it,
+        // and once everything settles every client matches the server
+
+        LoopbackParams params;
+        params.numClients = 2;
+        params.maxStones = 64;
+        params.snapshotRate = 30;
+        params.networkParams.latency = 0.05f;
+        params.networkParams.packetLoss = 5.0f;
+        params.priorityUpdates = true;
+        params.priorityParams.maxBytes = 200;
+
+        Loopback loopback;
+        CHECK( loopback.Initialize( params ) );
+
+        World & server = loopback.GetServer();
+        for ( int i = 0; i < 64; ++i )
+            server.AddStone( vec3f( ( i % 8 ) * 4.0f - 14, ( i / 8 ) * 4.0f - 14, 4.0f + ( i % 3 ) ), quat4f::axisRotation( i * 0.3f, vec3f(1,0,0) ) );
+
+        for ( int i = 0; i < 60 * 20 && server.IsAwake(); ++i )
+            loopback.Update();
+        CHECK( !server.IsAwake() );
+
+        for ( int i = 0; i < 60 * 5; ++i )
+            loopback.Update();
+
+        const NetworkStats & stats = loopback.GetSimulator().GetStats( 0 );
+        CHECK( stats.bytesSent <= stats.packetsSent * uint64_t( params.priorityParams.maxBytes + 4 ) );
+        CHECK_EQUAL( 0, (int) loopback.GetStats().snapshotsRejected );
+
+        const SnapshotParams & snapshotParams = loopback.GetSnapshotParams();
+        static Snapshot expected, actual;
+        CaptureSnapshot( snapshotParams, server, 0, expected );
+
+        for ( int i = 0; i < loopback.GetNumClients(); ++i )
+        {
+            CaptureSnapshot( snapshotParams, loopback.GetClient( i ), 0, actual );
+            CHECK_EQUAL( expected.numStones, actual.numStones );
+            for ( int j = 0; j < expected.numStones; ++j )
+                CHECK( expected.stones[j] == actual.stones[j] );
+        }
+    }
+}
+
+SUITE( Determinism )
+{
+    TEST( hash64 )
+    {
+        // every input bit changes the hash, and the seed does too
+
+        uint8_t data[37];
+        for ( int i = 0; i < (int) sizeof( data ); ++i )
+            data[i] = uint8_t( i * 7 );
+
+        const uint64_t h = hash64( data, sizeof( data ) );
+        CHECK( h == hash64( data, sizeof( data ) ) );
+        CHECK( h != hash64( data, sizeof( data ), 1 ) );
+        CHECK( h != hash64( data, sizeof( data ) - 1 ) );
+
+        for ( int i = 0; i < (int) sizeof( data ) * 8; ++i )
+        {
+            data[i/8] ^= 1 << ( i % 8 );
+            CHECK( h != hash64( data, sizeof( data ) ) );
+            data[i/8] ^= 1 << ( i % 8 );
+        }
+
+        // same seed, same sequence
+
+        DeterministicRandom a( 1234 );
+        DeterministicRandom b( 1234 );
+        for ( int i = 0; i < 1000; ++i )
+        {
+            const float value = a.GetFloat( -1, 1 );
+            CHECK_EQUAL( value, b.GetFloat( -1, 1 ) );
+            CHECK( value >= -1 && value < 1 );
+        }
+    }
+
+    static void DropStones( World & world, DeterministicRandom & random, int count )
+    {
+        for ( int i = 0; i < count; ++i )
+        {
+            const float x = random.GetFloat( -15, 15 );
+            const float y = random.GetFloat( -15, 15 );
+            const float z = random.GetFloat( 2, 10 );
+            const float angle = random.GetFloat( 0, 2 * pi );
+            world.AddStone( vec3f( x, y, z ), quat4f::axisRotation( angle, vec3f(1,0,0) ) );
+        }
+    }
+
+    static void RunChecksums( ChecksumLog & log, int numStones, int numFrames, int perturbFrame = -1, int perturbBody = -1 )
+    {
+        Arena arena;
+        arena.Initialize( World::GetMemoryRequired( numStones ) );
+
+        World world;
+        CHECK( world.Initialize( arena, 19, STONE_SIZE_40, numStones ) );
+
+        DeterministicRandom random( 5 );
+        DropStones( world, random, numStones );
+
+        for ( int i = 0; i < numFrames; ++i )
+        {
+            world.Step( 1.0f / 60.0f );
+
+            // the smallest change there is: one bit of one coordinate
+
+            if ( i == perturbFrame )
+            {
+                RigidBody & rigidBody = world.GetBody( perturbBody );
+                float x = rigidBody.position.x();
+                uint32_t bits;
+                memcpy( &bits, &x, 4 );
+                bits ^= 1;
+                memcpy( &x, &bits, 4 );
+                rigidBody.position = vec3f( x, rigidBody.position.y(), rigidBody.position.z() );
+            }
+
+            log.Update( world );
+        }
+    }
+
+    TEST( checksum_playback )
+    {
+        const int NumStones = 32;
+        const int NumFrames = 120;
+        const char filename[] = "test_checksums.bin";
+
+        {
+            ChecksumLog log;
+            CHECK( log.Open( filename, false, NumStones ) );
+            RunChecksums( log, NumStones, NumFrames );
+        }
+
+        // the same run again matches every frame
+
+        {
+            ChecksumLog log;
+            CHECK( log.Open( filename, true, NumStones ) );
+            RunChecksums( log, NumStones, NumFrames );
+            CHECK( !log.HasDiverged() );
+            CHECK_EQUAL( NumFrames, (int) log.GetFramesVerified() );
+        }
+
+        // running past the end of the recording is not a divergence
+
+        {
+            ChecksumLog log;
+            CHECK( log.Open( filename, true, NumStones ) );
+            RunChecksums( log, NumStones, NumFrames + 10 );
+            CHECK( !log.HasDiverged() );
+            CHECK( log.IsEndOfRecording() );
+            CHECK_EQUAL( NumFrames, (int) log.GetFramesVerified() );
+        }
+
+        // flip one bit and the first diverging frame and body are reported
+
+        {
+            ChecksumLog log;
+            CHECK( log.Open( filename, true, NumStones ) );
+            RunChecksums( log, NumStones, NumFrames, 60, 17 );
+            CHECK( log.HasDiverged() );
+            CHECK_EQUAL( 60, (int) log.GetDivergedFrame() );
+            CHECK_EQUAL( 17, log.GetDivergedBody() );
+        }
+
+        remove( filename );
+
+        CHECK( !ChecksumLog().Open( filename, true, NumStones ) );
+    }
+
+    TEST( host_workers_deterministic )
+    {
+        // the number of worker threads stepping tables makes no difference to the result
+
+        const int NumTables = 8;
+        const int NumStones = 16;
+
+        uint64_t hashes[2][NumTables];
+
+        for ( int pass = 0; pass < 2; ++pass )
+        {
+            HostParams params;
+            params.numTables = NumTables;
+            params.maxStonesPerTable = NumStones;
+            params.numWorkers = pass == 0 ? 1 : 4;
+
+            Host host;
+            CHECK( host.Initialize( params ) );
+
+            DeterministicRandom random( 11 );
+            for ( int i = 0; i < NumTables; ++i )
+                DropStones( host.GetWorld( i ), random, NumStones );
+
+            for ( int i = 0; i < 90; ++i )
+                host.Tick();
+
+            for ( int i = 0; i < NumTables; ++i )
+                hashes[pass][i] = HashWorld( host.GetWorld( i ) );
+        }
+
+        for ( int i = 0; i < NumTables; ++i )
+        {
+            CHECK( hashes[0][i] == hashes[1][i] );
+            if ( i > 0 )
+                CHECK( hashes[0][i] != hashes[0][i-1] );
+        }
+    }
+}
+
+SUITE( Rollback )
+{
+    TEST( rollback_resimulate )
+    {
+        const int NumStones = 32;
+        const int NumFrames = 120;
+        const int MaxFrames = 64;
+
+        Arena arena;
+        arena.Initialize( World::GetMemoryRequired( NumStones ) );
+
+        World world;
+        CHECK( world.Initialize( arena, 19, STONE_SIZE_40, NumStones ) );
+
+        DeterministicRandom random( 7 );
+        for ( int i = 0; i < NumStones; ++i )
+        {
+            const float x = random.GetFloat( -15, 15 );
+            const float y = random.GetFloat( -15, 15 );
+            const float z = random.GetFloat( 2, 10 );
+            world.AddStone( vec3f( x, y, z ), quat4f::axisRotation( random.GetFloat( 0, 2 * pi ), vec3f(1,0,0) ) );
+        }
+
+        RollbackBuffer rollback;
+        rollback.Initialize( MaxFrames, NumStones );
+
+        // each frame is saved before it is stepped
+
+        uint64_t hashes[NumFrames];
+        for ( int i = 0; i < NumFrames; ++i )
+        {
+            rollback.SaveFrame( i, world );
+            hashes[i] = HashWorld( world );
+            world.Step( 1.0f / 60.0f );
+        }
+
+        const uint64_t finalHash = HashWorld( world );
+
+        CHECK_EQUAL( MaxFrames, rollback.GetNumFrames() );
+        CHECK_EQUAL( NumFrames - MaxFrames, (int) rollback.GetOldestFrame() );
+        CHECK_EQUAL( NumFrames - 1, (int) rollback.GetNewestFrame() );
+        CHECK( !rollback.Rewind( NumFrames - MaxFrames - 1, world ) );
+        CHECK( !rollback.Rewind( NumFrames, world ) );
+        CHECK( finalHash == HashWorld( world ) );
+
+        // rewind and simulate forward again. every frame comes out bit for bit the same
+
+        const int RewindFrame = 100;
+
+        CHECK( rollback.Rewind( RewindFrame, world ) );
+        CHECK( hashes[RewindFrame] == HashWorld( world ) );
+        CHECK_EQUAL( RewindFrame, (int) rollback.GetNewestFrame() );
+        CHECK( !rollback.HasFrame( RewindFrame + 1 ) );
+
+        world.Step( 1.0f / 60.0f );
+        for ( int i = RewindFrame + 1; i < NumFrames; ++i )
+        {
+            rollback.SaveFrame( i, world );
+            CHECK( hashes[i] == HashWorld( world ) );
+            world.Step( 1.0f / 60.0f );
+        }
+
+        CHECK( finalHash == HashWorld( world ) );
+
+        // once everything is asleep, frames share their copies instead of adding more
+
+        int frame = NumFrames;
+        while ( world.IsAwake() && frame < 60 * 30 )
+        {
+            rollback.SaveFrame( frame++, world );
+            world.Step( 1.0f / 60.0f );
+        }
+
+        CHECK( !world.IsAwake() );
+
+        for ( int i = 0; i < MaxFrames; ++i )
+            rollback.SaveFrame( frame++, world );
+
+        CHECK_EQUAL( NumStones, rollback.GetNumCopies() );
+
+        rollback.ResetStats();
+        rollback.SaveFrame( frame, world );
+        CHECK_EQUAL( 0, (int) rollback.GetStats().bodiesCopied );
+        CHECK_EQUAL( NumStones, (int) rollback.GetStats().bodiesShared );
+        CHECK_EQUAL( 0, (int) rollback.GetStats().layoutsCopied );
+
+        // waking one stone copies just that one
+
+        world.Wake( world.GetHandle( 5 ) );
+        world.Step( 1.0f / 60.0f );
+        rollback.SaveFrame( frame + 1, world );
+        CHECK_EQUAL( 1, (int) rollback.GetStats().bodiesCopied );
+    }
+
+    TEST( rollback_add_remove_stones )
+    {
+        const int NumStones = 8;
+
+        Arena arena;
+        arena.Initialize( World::GetMemoryRequired( NumStones ) );
+
+        World world;
+        CHECK( world.Initialize( arena, 9, STONE_SIZE_40, NumStones ) );
+
+        BodyHandle handles[NumStones];
+        for ( int i = 0; i < 6; ++i )
+            handles[i] = world.AddStone( vec3f( i - 3.0f, 0, 5 ), quat4f::identity() );
+
+        RollbackBuffer rollback;
+        rollback.Initialize( 8, NumStones );
+
+        rollback.SaveFrame( 0, world );
+        world.Step( 1.0f / 60.0f );
+
+        // remove two stones and add one, which takes a freed slot
+
+        world.RemoveStone( handles[1] );
+        world.RemoveStone( handles[4] );
+        const BodyHandle added = world.AddStone( vec3f( 0, 3, 5 ), quat4f::identity() );
+
+        rollback.SaveFrame( 1, world );
+        world.Step( 1.0f / 60.0f );
+
+        CHECK_EQUAL( 2, (int) rollback.GetStats().layoutsCopied );
+
+        // rewinding brings the removed stones back under their old handles, and the added one is gone
+
+        CHECK( rollback.Rewind( 0, world ) );
+        CHECK_EQUAL( 6, world.GetNumBodies() );
+        CHECK_EQUAL( 6, world.GetNumActive() );
+        CHECK( !world.IsValid( added ) );
+
+        for ( int i = 0; i < 6; ++i )
+        {
+            CHECK( world.IsValid( handles[i] ) );
+            CHECK_CLOSE_VEC3( world.GetBody( handles[i] ).position, vec3f( i - 3.0f, 0, 5 ), 0.0f );
+        }
+
+        // re-simulating hands out the same handles as the first time
+
+        world.Step( 1.0f / 60.0f );
+        world.RemoveStone( handles[1] );
+        world.RemoveStone( handles[4] );
+        CHECK( world.AddStone( vec3f( 0, 3, 5 ), quat4f::identity() ) == added );
+        CHECK_EQUAL( 5, world.GetNumBodies() );
+    }
+}
+
+SUITE( InputRecording )
+{
+    TEST( input_pack_unpack )
+    {
+        CHECK_EQUAL( 42, NumInputKeys );
+
+        platform::Input input;
+        CHECK( PackInput( input ) == 0 );
+
+        input.quit = true;
+        input.alt = true;
+        input.space = true;
+        const uint64_t packed = PackInput( input );
+        CHECK( packed == ( uint64_t( 1 ) | ( uint64_t( 1 ) << 5 ) | ( uint64_t( 1 ) << 41 ) ) );
+
+        platform::Input unpacked;
+        unpacked.left = true;
+        UnpackInput( packed, unpacked );
+        CHECK( memcmp( &input, &unpacked, sizeof( platform::Input ) ) == 0 );
+    }
+
+    static platform::Input GetTestInput( int frame )
+    {
+        // held keys change every so often, like someone playing
+
+        platform::Input input;
+        input.left = ( frame / 37 ) % 3 == 0;
+        input.space = frame % 200 > 190;
+        input.one = frame == 500;
+        input.control = ( frame / 250 ) & 1;
+        return input;
+    }
+
+    TEST( input_record_playback )
+    {
+        const int NumFrames = 3600;
+        const char filename[] = "test_inputs.bin";
+
+        {
+            InputRecorder recorder;
+            CHECK( recorder.Open( filename ) );
+            for ( int i = 0; i < NumFrames; ++i )
+                recorder.Write( GetTestInput( i ) );
+            CHECK_EQUAL( NumFrames, (int) recorder.GetNumFrames() );
+            CHECK( recorder.Close() );
+
+            // a minute of input in a few hundred bytes, against 42 bytes a frame raw
+
+            CHECK( recorder.GetBytesWritten() < 1024 );
+        }
+
+        InputPlayback playback;
+        CHECK( playback.Open( filename ) );
+        CHECK_EQUAL( NumFrames, (int) playback.GetNumFrames() );
+
+        platform::Input input;
+        for ( int i = 0; i < NumFrames; ++i )
+        {
+            CHECK( playback.Read( input ) );
+            const platform::Input expected = GetTestInput( i );
+            CHECK( memcmp( &input, &expected, sizeof( platform::Input ) ) == 0 );
+        }
+        CHECK( !playback.Read( input ) );
+
+        // seek anywhere, in any order
+
+        const int frames[] = { 500, 0, 3599, 37, 36, 1234 };
+        for ( int i = 0; i < (int) ( sizeof( frames ) / sizeof( int ) ); ++i )
+        {
+            CHECK( playback.Seek( frames[i] ) );
+            CHECK( playback.Read( input ) );
+            const platform::Input expected = GetTestInput( frames[i] );
+            CHECK( memcmp( &input, &expected, sizeof( platform::Input ) ) == 0 );
+        }
+        CHECK( !playback.Seek( NumFrames + 1 ) );
+
+        // a recording cut off partway through a run plays back up to the run before
+
+        size_t size = 0;
+        const uint8_t * data = platform::MapFile( filename, size );
+        CHECK( data );
+        uint8_t * contents = new uint8_t[size];
+        memcpy( contents, data, size );
+        platform::UnmapFile( data, size );
+
+        FILE * file = fopen( filename, "wb" );
+        fwrite( contents, size - 1, 1, file );
+        fclose( file );
+        delete [] contents;
+
+        CHECK( playback.Open( filename ) );
+        CHECK( playback.GetNumFrames() > 0 && playback.GetNumFrames() < NumFrames );
+
+        // anything but an input recording is refused
+
+        file = fopen( filename, "wb" );
+        platform::Input raw;
+        fwrite( &raw, sizeof( raw ), 1, file );
+        fclose( file );
+        CHECK( !playback.Open( filename ) );
+        CHECK( !playback.IsOpen() );
+
+        remove( filename );
+
+        CHECK( !playback.Open( filename ) );
+    }
+}
+
+SUITE( Trajectory )
+{
+    static bool SameBody( const TrajectoryBody & body, const RigidBody & rigidBody )
+    {
+        return body.position.x() == rigidBody.position.x() &&
+               body.position.y() == rigidBody.position.y() &&
+               body.position.z() == rigidBody.position.z() &&
+               body.orientation.x == rigidBody.orientation.x &&
+               body.orientation.y == rigidBody.orientation.y &&
+               body.orientation.z == rigidBody.orientation.z &&
+               body.orientation.w == rigidBody.orientation.w &&
+               body.active == rigidBody.active;
+    }
+
+    TEST( trajectory_seek )
+    {
+        const int MaxStones = 32;
+        const int NumFrames = 300;
+        const int KeyframeInterval = 30;
+        const char filename[] = "test_trajectory.bin";
+
+        Arena arena;
+        arena.Initialize( World::GetMemoryRequired( MaxStones ) );
+
+        World world;
+        CHECK( world.Initialize( arena, 19, STONE_SIZE_40, MaxStones ) );
+
+        DeterministicRandom random( 3 );
+        for ( int i = 0; i < MaxStones - 4; ++i )
+            world.AddStone( vec3f( random.GetFloat( -15, 15 ), random.GetFloat( -15, 15 ), random.GetFloat( 2, 6 ) ), quat4f::identity() );
+
+        // keep every frame in memory to compare against
+
+        RigidBody * expected = new RigidBody[NumFrames * MaxStones];
+        int numBodies[NumFrames];
+
+        TrajectoryWriter writer;
+        CHECK( writer.Open( filename, MaxStones, KeyframeInterval ) );
+
+        for ( int i = 0; i < NumFrames; ++i )
+        {
+            // stones come and go partway through, in the middle of a keyframe interval
+
+            if ( i == 145 )
+            {
+                world.RemoveStone( world.GetHandle( 3 ) );
+                world.RemoveStone( world.GetHandle( 10 ) );
+            }
+            if ( i == 200 )
+                world.AddStone( vec3f( 0, 0, 5 ), quat4f::identity() );
+
+            world.Step( 1.0f / 60.0f );
+            writer.Write( world );
+
+            numBodies[i] = world.GetNumBodies();
+            for ( int j = 0; j < numBodies[i]; ++j )
+                expected[i*MaxStones+j] = world.GetBody( j );
+        }
+
+        CHECK_EQUAL( NumFrames, writer.GetNumFrames() );
+        CHECK_EQUAL( NumFrames / KeyframeInterval, writer.GetNumKeyframes() );
+
+        // stones at rest aren't written again between keyframes
+
+        CHECK( writer.GetBodiesChanged() < uint64_t( ( NumFrames - writer.GetNumKeyframes() ) * ( MaxStones - 4 ) / 2 ) );
+
+        CHECK( writer.Close() );
+
+        TrajectoryReader reader;
+        CHECK( reader.Open( filename ) );
+        CHECK_EQUAL( NumFrames, reader.GetNumFrames() );
+        CHECK_EQUAL( KeyframeInterval, reader.GetKeyframeInterval() );
+
+        TrajectoryBody bodies[MaxStones];
+
+        // forwards, one delta per frame
+
+        for ( int i = 0; i < NumFrames; ++i )
+        {
+            CHECK_EQUAL( numBodies[i], reader.ReadFrame( i, bodies ) );
+            for ( int j = 0; j < numBodies[i]; ++j )
+                CHECK( SameBody( bodies[j], expected[i*MaxStones+j] ) );
+        }
+        CHECK_EQUAL( NumFrames, (int) reader.GetFramesDecoded() );
+
+        // anywhere, in any order, never more than a keyframe and the deltas after it
+
+        const int frames[] = { 299, 0, 146, 145, 144, 200, 59, 60, 201, 150 };
+        for ( int i = 0; i < (int) ( sizeof( frames ) / sizeof( int ) ); ++i )
+        {
+            const int frame = frames[i];
+            const uint64_t decoded = reader.GetFramesDecoded();
+            CHECK_EQUAL( numBodies[frame], reader.ReadFrame( frame, bodies ) );
+            CHECK( reader.GetFramesDecoded() - decoded <= uint64_t( KeyframeInterval ) );
+            for ( int j = 0; j < numBodies[frame]; ++j )
+                CHECK( SameBody( bodies[j], expected[frame*MaxStones+j] ) );
+        }
+
+        CHECK_EQUAL( -1, reader.ReadFrame( NumFrames, bodies ) );
+
+        reader.Close();
+        remove( filename );
+
+        delete [] expected;
+    }
+
+    TEST( trajectory_bad_files )
+    {
+        const char filename[] = "test_trajectory.bin";
+
+        TrajectoryReader reader;
+        CHECK( !reader.Open( filename ) );
+
+        // a recording that was never closed has no index, so it can't be read
+
+        RigidBody rigidBody;
+        {
+            TrajectoryWriter writer;
+            CHECK( writer.Open( filename, 4 ) );
+            for ( int i = 0; i < 10; ++i )
+                writer.Write( &rigidBody, 1 );
+
+            CHECK( !reader.Open( filename ) );
+
+            CHECK( writer.Close() );
+        }
+
+        CHECK( reader.Open( filename ) );
+        CHECK_EQUAL( 10, reader.GetNumFrames() );
+
+        TrajectoryBody body;
+        CHECK_EQUAL( 1, reader.ReadFrame( 9, &body ) );
+        CHECK( SameBody( body, rigidBody ) );
+        reader.Close();
+
+        // one byte short and the footer is gone
+
+        size_t size = 0;
+        const uint8_t * data = platform::MapFile( filename, size );
+        CHECK( data );
+        uint8_t * contents = new uint8_t[size];
+        memcpy( contents, data, size );
+        platform::UnmapFile( data, size );
+
+        FILE * file = fopen( filename, "wb" );
+        fwrite( contents, size - 1, 1, file );
+        fclose( file );
+        CHECK( !reader.Open( filename ) );
+
+        // a frame whose body count disagrees with its size is caught when it is read
+
+        contents[16] = 2;
+        file = fopen( filename, "wb" );
+        fwrite( contents, size, 1, file );
+        fclose( file );
+        CHECK( reader.Open( filename ) );
+        CHECK_EQUAL( -1, reader.ReadFrame( 0, &body ) );
+
+        delete [] contents;
+        reader.Close();
+        remove( filename );
+    }
+}
+
+SUITE( Capture )
+{
+    // synthetic frames: every pixel depends on the frame number, so a frame written with the wrong pixels is caught
+
+    static void FillFrame( uint8_t * pixels, int width, int height, int frame )
+    {
+        for ( int i = 0; i < width * height * 3; ++i )
+            pixels[i] = uint8_t( i * 7 + frame * 13 + ( i >> 8 ) );
+    }
+
+    class TestSink : public CaptureSink
+    {
+    public:
+
+        enum { MaxFrames = 256 };
+
+        TestSink( float delay ) : delay( delay )
+        {
+            for ( int i = 0; i < MaxFrames; ++i )
+            {
+                writes[i] = 0;
+                correct[i] = false;
+            }
+        }
+
+        virtual bool WriteFrame( const CaptureFrame & frame )
+        {
+            assert( frame.frame >= 0 && frame.frame < MaxFrames );
+
+            // a slow disk
+
+            if ( delay > 0.0f )
+                platform::wait_seconds( delay );
+
+            uint8_t * expected = new uint8_t[frame.width * frame.height * 3];
+            FillFrame( expected, frame.width, frame.height, frame.frame );
+            correct[frame.frame] = memcmp( expected, frame.pixels, frame.width * frame.height * 3 ) == 0;
+            delete [] expected;
+
+            platform::AtomicAdd( &writes[frame.frame], 1 );
+
+            return true;
+        }
+
+        float delay;
+        int writes[MaxFrames];
+        bool correct[MaxFrames];
+    };
+
+    TEST( capture_pipeline )
+    {
+        const int Width = 64;
+        const int Height = 48;
+        const int NumFrames = 100;
+
+        CaptureParams params;
+        params.width = Width;
+        params.height = Height;
+        params.numBuffers = 4;
+        params.numWriters = 3;
+
+        TestSink sink( 0.001f );
+
+        CapturePipeline pipeline;
+        CHECK( pipeline.Initialize( params, &sink ) );
+
+        uint8_t pixels[Width*Height*3];
+
+        for ( int i = 0; i < NumFrames; ++i )
+        {
+            FillFrame( pixels, Width, Height, i );
+            CHECK( pipeline.Capture( i, pixels ) );
+        }
+
+        // the writers can't keep up, so capture waited for them instead of losing frames
+
+        pipeline.Shutdown();
+
+        CHECK_EQUAL( NumFrames, (int) pipeline.GetStats().framesSubmitted );
+        CHECK_EQUAL( NumFrames, (int) pipeline.GetStats().framesWritten );
+        CHECK_EQUAL( 0, (int) pipeline.GetStats().framesDropped );
+
+        for ( int i = 0; i < NumFrames; ++i )
+        {
+            CHECK_EQUAL( 1, sink.writes[i] );
+            CHECK( sink.correct[i] );
+        }
+    }
+
+    TEST( capture_drop_when_full )
+    {
+        const int Width = 32;
+        const int Height = 32;
+        const int NumFrames = 200;
+
+        CaptureParams params;
+        params.width = Width;
+        params.height = Height;
+        params.numBuffers = 2;
+        params.numWriters = 1;
+        params.dropWhenFull = true;
+
+        TestSink sink( 0.002f );
+
+        CapturePipeline pipeline;
+        CHECK( pipeline.Initialize( params, &sink ) );
+
+        // submitting straight into the buffers, the way a PBO is read back
+
+        for ( int i = 0; i < NumFrames; ++i )
+        {
+            const int index = pipeline.AcquireBuffer();
+            if ( index >= 0 )
+            {
+                FillFrame( pipeline.GetBuffer( index ), Width, Height, i );
+                pipeline.SubmitBuffer( index, i );
+            }
+        }
+
+        pipeline.Shutdown();
+
+        // some frames were dropped rather than waiting, and the rest came out whole
+
+        const CaptureStats & stats = pipeline.GetStats();
+        CHECK_EQUAL( NumFrames, (int) ( stats.framesWritten + stats.framesDropped ) );
+        CHECK_EQUAL( 0, (int) stats.stalls );
+        CHECK( stats.framesDropped > 0 );
+
+        int written = 0;
+        for ( int i = 0; i < NumFrames; ++i )
+        {
+            CHECK( sink.writes[i] <= 1 );
+            if ( sink.writes[i] )
+            {
+                CHECK( sink.correct[i] );
+                written++;
+            }
+        }
+        CHECK_EQUAL( (int) stats.framesWritten, written );
+    }
+}
+
+SUITE( VideoStream )
+{
+    TEST( tga_rle )
+    {
+        const int Width = 37;
+        const int Height = 5;
+
+        // runs, literals, and the worst case of runs of two between single pixels
+
+        uint8_t pixels[Width*Height*3];
+        for ( int y = 0; y < Height; ++y )
+        {
+            for ( int x = 0; x < Width; ++x )
+            {
+                uint8_t * p = pixels + ( y * Width + x ) * 3;
+                int value;
+                if ( y == 0 )
+                    value = x < 20 ? 0 : 1;
+                else if ( y == 1 )
+                    value = x * 11;
+                else if ( y == 2 )
+                    value = ( x % 3 ) == 0 ? x : x - ( x % 3 ) + 1;
+                else
+                    value = ( x * y ) / 4;
+                p[0] = uint8_t( value );
+                p[1] = uint8_t( value * 3 );
+                p[2] = uint8_t( y );
+            }
+        }
+
+        uint8_t * encoded = new uint8_t[GetMaxTGARLEBytes( Width, Height )];
+        const size_t bytes = EncodeTGARLE( Width, Height, pixels, encoded );
+        CHECK( bytes <= GetMaxTGARLEBytes( Width, Height ) );
+
+        uint8_t decoded[Width*Height*3];
+        CHECK( DecodeTGARLE( encoded, bytes, Width, Height, decoded ) );
+        CHECK( memcmp( pixels, decoded, sizeof( pixels ) ) == 0 );
+
+        // cut short
+
+        CHECK( !DecodeTGARLE( encoded, bytes - 1, Width, Height, decoded ) );
+
+        delete [] encoded;
+    }
+
+    static void FillFrame( uint8_t * pixels, int width, int height, int frame )
+    {
+        // flat areas so rle has something to do, and noise so it doesn't have it too easy
+
+        for ( int i = 0; i < width * height; ++i )
+        {
+            const int x = i % width;
+            const uint8_t value = uint8_t( x < width / 2 ? frame : ( i * 7 + frame * 13 ) );
+            pixels[i*3+0] = value;
+            pixels[i*3+1] = uint8_t( i / width );
+            pixels[i*3+2] = uint8_t( frame );
+        }
+    }
+
+    TEST( video_stream_raw_rle )
+    {
+        const int Width = 64;
+        const int Height = 48;
+        const int Crop = 4;
+        const int NumFrames = 50;
+        const char filename[] = "test_video.vgv";
+
+        for ( int pass = 0; pass < 2; ++pass )
+        {
+            // a small buffer so the stream is written out several times over, and direct io where the file system has it
+
+            VideoStreamParams streamParams;
+            streamParams.format = pass == 0 ? VIDEO_STREAM_RAW : VIDEO_STREAM_RLE;
+            streamParams.width = Width;
+            streamParams.height = Height;
+            streamParams.crop = Crop;
+            streamParams.bufferSize = 4096 * 4;
+            streamParams.directIO = pass == 0;
+            streamParams.dropCache = pass == 1;
+
+            VideoStreamSink sink;
+            CHECK( sink.Open( filename, streamParams ) );
+
+            CaptureParams params;
+            params.width = Width;
+            params.height = Height;
+            params.numBuffers = 4;
+            params.numWriters = 3;
+
+            CapturePipeline pipeline;
+            CHECK( pipeline.Initialize( params, &sink ) );
+
+            uint8_t pixels[Width*Height*3];
+            for ( int i = 0; i < NumFrames; ++i )
+            {
+                FillFrame( pixels, Width, Height, i );
+                CHECK( pipeline.Capture( i * 2, pixels ) );
+            }
+
+            pipeline.Shutdown();
+            CHECK_EQUAL( NumFrames, (int) pipeline.GetStats().framesWritten );
+            CHECK( sink.Close() );
+
+            // every frame back, in order, cropped
+
+            VideoStreamReader reader;
+            CHECK( reader.Open( filename ) );
+            CHECK_EQUAL( Width, reader.GetWidth() );
+            CHECK_EQUAL( Height - Crop * 2, reader.GetHeight() );
+            CHECK_EQUAL( NumFrames, reader.GetNumFrames() );
+            CHECK( reader.GetFormat() == streamParams.format );
+
+            uint8_t frame[Width*Height*3];
+            for ( int i = 0; i < reader.GetNumFrames(); ++i )
+            {
+                CHECK_EQUAL( i * 2, reader.GetFrameNumber( i ) );
+                CHECK( reader.ReadFrame( i, frame ) );
+                FillFrame( pixels, Width, Height, i );
+                CHECK( memcmp( pixels + Width * 3 * Crop, frame, Width * ( Height - Crop * 2 ) * 3 ) == 0 );
+            }
+
+            reader.Close();
+        }
+
+        // not a stream
+
+        FILE * file = fopen( filename, "wb" );
+        fprintf( file, "YUV4MPEG2 W64 H48 F60:1 Ip A1:1 C444\n" );
+        fclose( file );
+
+        VideoStreamReader reader;
+        CHECK( !reader.Open( filename ) );
+
+        remove( filename );
+    }
+
+    TEST( video_stream_y4m )
+    {
+        const int Width = 16;
+        const int Height = 8;
+        const int NumFrames = 3;
+        const char filename[] = "test_video.y4m";
+
+        VideoStreamParams streamParams;
+        streamParams.width = Width;
+        streamParams.height = Height;
+        streamParams.frameRate = 30;
+
+        VideoStreamSink sink;
+        CHECK( sink.Open( filename, streamParams ) );
+
+        CaptureParams params;
+        params.width = Width;
+        params.height = Height;
+
+        CapturePipeline pipeline;
+        CHECK( pipeline.Initialize( params, &sink ) );
+
+        // white on the bottom row, black everywhere else
+
+        uint8_t pixels[Width*Height*3];
+        memset( pixels, 0, sizeof( pixels ) );
+        memset( pixels, 255, Width * 3 );
+
+        for ( int i = 0; i < NumFrames; ++i )
+            CHECK( pipeline.Capture( i, pixels ) );
+
+        pipeline.Shutdown();
+        CHECK( sink.Close() );
+
+        size_t size = 0;
+        const uint8_t * data = platform::MapFile( filename, size );
+        CHECK( data );
+
+        const char header[] = "YUV4MPEG2 W16 H8 F30:1 Ip A1:1 C444\n";
+        const size_t headerBytes = strlen( header );
+        const size_t frameBytes = 6 + Width * Height * 3;
+        CHECK_EQUAL( headerBytes + frameBytes * NumFrames, size );
+        CHECK( memcmp( data, header, headerBytes ) == 0 );
+
+        // the bottom row is the last row of luma, studio range
+
+        const uint8_t * frame = data + headerBytes + frameBytes * ( NumFrames - 1 );
+        CHECK( memcmp( frame, "FRAME\n", 6 ) == 0 );
+        const uint8_t * Y = frame + 6;
+        const uint8_t * U = Y + Width * Height;
+        CHECK_EQUAL( 16, (int) Y[0] );
+        CHECK_EQUAL( 235, (int) Y[Width*(Height-1)] );
+        CHECK_EQUAL( 128, (int) U[0] );
+        CHECK_EQUAL( 128, (int) U[Width*(Height-1)] );
+
+        platform::UnmapFile( data, size );
+
+        remove( filename );
+    }
+}
+
+SUITE( FrameDelta )
+{
+    // a flat board with a stone moving across it, so most tiles stay the same
+
+    static void FillFrame( uint8_t * pixels, int width, int height, int frame )
+    {
+        for ( int y = 0; y < height; ++y )
+        {
+            for ( int x = 0; x < width; ++x )
+            {
+                uint8_t * p = pixels + ( y * width + x ) * 3;
+                const bool stone = x >= frame * 3 && x < frame * 3 + 10 && y >= 12 && y < 22;
+                p[0] = uint8_t( stone ? 250 : 40 + y );
+                p[1] = uint8_t( stone ? 250 : 90 + x );
+                p[2] = uint8_t( stone ? 250 : 160 );
+            }
+        }
+    }
+
+    TEST( frame_delta_encode_decode )
+    {
+        // not a multiple of the tile size either way, so the edge tiles are cut short
+
+        const int Width = 70;
+        const int Height = 37;
+        const int NumFrames = 24;
+        const int KeyframeInterval = 10;
+
+        FrameDeltaEncoder encoder;
+        encoder.Initialize( Width, Height, KeyframeInterval );
+        CHECK_EQUAL( 5 * 3, encoder.GetNumTiles() );
+
+        FrameDeltaDecoder decoder;
+        decoder.Initialize( Width, Height );
+
+        uint8_t pixels[Width*Height*3];
+        const uint8_t * encoded = encoder.GetEncoded();
+
+        for ( int i = 0; i < NumFrames; ++i )
+        {
+            FillFrame( pixels, Width, Height, i );
+
+            const size_t bytes = encoder.EncodeFrame( pixels );
+            CHECK( bytes <= encoder.GetMaxEncodedBytes() );
+            CHECK_EQUAL( ( i % KeyframeInterval ) == 0, IsFrameDeltaKeyframe( encoded, bytes ) );
+
+            // the stone covers at most 4 tiles, so delta frames are small
+
+            if ( !IsFrameDeltaKeyframe( encoded, bytes ) )
+                CHECK( bytes <= 1 + 2 + 4 * 16 * 16 * 3 );
+
+            CHECK( decoder.DecodeFrame( encoded, bytes ) );
+            CHECK( memcmp( decoder.GetFrame(), pixels, sizeof( pixels ) ) == 0 );
+        }
+
+        // the same frame again has no changed tiles
+
+        const size_t bytes = encoder.EncodeFrame( pixels );
+        CHECK_EQUAL( 1 + 2, (int) bytes );
+
+        const FrameDeltaStats & stats = encoder.GetStats();
+        CHECK_EQUAL( NumFrames + 1, (int) stats.frames );
+        CHECK_EQUAL( 3, (int) stats.keyframes );
+        CHECK( stats.tilesChanged < stats.tilesCompared / 2 );
+        CHECK( stats.bytesOut * 2 < stats.bytesIn );
+
+        // tiles without a keyframe before them, and tiles cut short
+
+        FrameDeltaDecoder other;
+        other.Initialize( Width, Height );
+        CHECK( !other.DecodeFrame( encoded, bytes ) );
+        CHECK( !other.HasFrame() );
+
+        FillFrame( pixels, Width, Height, 0 );
+        const size_t changedBytes = encoder.EncodeFrame( pixels );
+        CHECK( !IsFrameDeltaKeyframe( encoded, changedBytes ) );
+        CHECK( !decoder.DecodeFrame( encoded, changedBytes - 1 ) );
+        CHECK( !decoder.HasFrame() );
+    }
+
+    TEST( video_stream_delta )
+    {
+        const int Width = 64;
+        const int Height = 48;
+        const int Crop = 4;
+        const int NumFrames = 30;
+        const char filename[] = "test_video.vgv";
+
+        VideoStreamParams streamParams;
+        streamParams.format = VIDEO_STREAM_DELTA;
+        streamParams.width = Width;
+        streamParams.height = Height;
+        streamParams.crop = Crop;
+        streamParams.keyframeInterval = 8;
+
+        VideoStreamSink sink;
+        CHECK( sink.Open( filename, streamParams ) );
+
+        CaptureParams params;
+        params.width = Width;
+        params.height = Height;
+        params.numBuffers = 4;
+        params.numWriters = 3;
+
+        CapturePipeline pipeline;
+        CHECK( pipeline.Initialize( params, &sink ) );
+
+        uint8_t pixels[Width*Height*3];
+        for ( int i = 0; i < NumFrames; ++i )
+        {
+            FillFrame( pixels, Width, Height, i );
+            CHECK( pipeline.Capture( i, pixels ) );
+        }
+
+        pipeline.Shutdown();
+        CHECK_EQUAL( NumFrames, (int) sink.GetDeltaStats().frames );
+        CHECK_EQUAL( 4, (int) sink.GetDeltaStats().keyframes );
+        CHECK( sink.Close() );
+
+        // frames in order, then jumping around, which has to go back to a keyframe
+
+        VideoStreamReader reader;
+        CHECK( reader.Open( filename ) );
+        CHECK( reader.GetFormat() == VIDEO_STREAM_DELTA );
+        CHECK_EQUAL( NumFrames, reader.GetNumFrames() );
+
+        const int order[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 29, 13, 14, 3, 22, 22, 16 };
+
+        uint8_t frame[Width*Height*3];
+        for ( int i = 0; i < int( sizeof( order ) / sizeof( int ) ); ++i )
+        {
+            CHECK( reader.ReadFrame( order[i], frame ) );
+            FillFrame( pixels, Width, Height, order[i] );
+            CHECK( memcmp( pixels + Width * 3 * Crop, frame, Width * ( Height - Crop * 2 ) * 3 ) == 0 );
+        }
+
+        reader.Close();
+
+        remove( filename );
+    }
+}
 
 class MyTestReporter : public UnitTest::TestReporterStdout
 {
@@ -503,16 +3337,12 @@ class MyTestReporter : public UnitTest::TestReporterStdout
         printf( "test_%s\n", details.testName );
     }
 };
-*/
 
 int main( int argc, char * argv[] )
 {
-    /*
     MyTestReporter reporter;
 
     UnitTest::TestRunner runner( reporter );
 
     return runner.RunTestsIf( UnitTest::Test::GetTestList(), NULL, UnitTest::True(), 0 );
-    */
-    return 0;
 }
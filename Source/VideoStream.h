@@ -0,0 +1,757 @@
+#ifndef VIDEO_STREAM_H
+#define VIDEO_STREAM_H
+
+#include "Capture.h"
+#include "FrameDelta.h"
+#include <vector>
+
+#if PLATFORM != PLATFORM_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+/*
+    Video stream.
+
+    Writing one TGA per frame means hundreds of thousands of files for a
+    long replay, each with its own open and close, and a directory that
+    nothing wants to list. This writes every frame captured into a single
+    file instead, in one of four formats:
+
+        y4m     uncompressed 4:4:4 YUV that ffmpeg and most players read
+                as is. every frame is the same size, so it seeks by
+                arithmetic
+
+        raw     24 bit pixels exactly as read back, plus an index
+
+        rle     each frame compressed the same way as the TGA files,
+                plus an index
+
+        delta   only the 16x16 tiles that changed since the frame before,
+                with a whole frame every "keyframeInterval" frames, plus
+                an index (see FrameDelta.h)
+
+    Frames are collected into one large buffer and written a buffer at a
+    time, so the disk sees a few big sequential writes instead of many
+    small ones. On Linux "directIO" opens the file with O_DIRECT (F_NOCACHE
+    on Mac) so a recording many times the size of memory doesn't push
+    everything else out of the page cache. "dropCache" asks the kernel to
+    drop each buffer from the cache once written instead, for file systems
+    that don't do O_DIRECT.
+
+    Frames come from several writer threads at once (see Capture.h).
+    Each thread converts or compresses its frame by itself, into a buffer
+    allocated for it when the pipeline starts, then waits its turn to
+    append it, so the file is always in capture order. Waiting is on a
+    semaphore per turn, signalled by the frame before.
+
+    Delta frames depend on the frame before, so they are encoded once it
+    is their turn, which means delta encoding is done by one writer at a
+    time and the rest wait on it. Extra writers don't make delta any
+    faster. A frame where little changed is mostly the tile compare, at
+    about 0.4ms for 720p, so one writer at a time still keeps up with
+    capture at 60fps.
+
+    Layout of raw, rle and delta files:
+
+        [4 bytes] magic "VGVS"
+        [4 bytes] version
+        [4 bytes] format
+        [4 bytes] width
+        [4 bytes] height
+        [4 bytes] frames per second
+        frames, each where the index says
+        index, per frame:
+            [8 bytes] offset
+            [4 bytes] frame number
+            [4 bytes] size
+        [8 bytes] offset of the index
+        [4 bytes] number of frames
+        [4 bytes] magic "VGVS"
+
+    Pixels are BGR, bottom row first, like TGA. Values are in host byte
+    order, which for every machine we run on is little endian.
+*/
+
+const uint32_t VideoStreamMagic = 0x53564756;       // "VGVS"
+const uint32_t VideoStreamVersion = 1;
+
+enum VideoStreamFormat
+{
+    VIDEO_STREAM_Y4M,
+    VIDEO_STREAM_RAW,
+    VIDEO_STREAM_RLE,
+    VIDEO_STREAM_DELTA
+};
+
+// "y4m", "raw", "rle" or "delta", eg. from the command line
+
+inline bool GetVideoStreamFormat( const char name[], VideoStreamFormat & format )
+{
+    if ( strcmp( name, "y4m" ) == 0 )
+        format = VIDEO_STREAM_Y4M;
+    else if ( strcmp( name, "raw" ) == 0 )
+        format = VIDEO_STREAM_RAW;
+    else if ( strcmp( name, "rle" ) == 0 )
+        format = VIDEO_STREAM_RLE;
+    else if ( strcmp( name, "delta" ) == 0 )
+        format = VIDEO_STREAM_DELTA;
+    else
+        return false;
+    return true;
+}
+
+inline const char * GetVideoStreamExtension( VideoStreamFormat format )
+{
+    return format == VIDEO_STREAM_Y4M ? "y4m" : "vgv";
+}
+
+struct VideoStreamParams
+{
+    VideoStreamParams()
+    {
+        format = VIDEO_STREAM_Y4M;
+        width = 0;
+        height = 0;
+        crop = 0;
+        frameRate = 60;
+        keyframeInterval = 60;
+        bufferSize = 8 * 1024 * 1024;
+        directIO = false;
+        dropCache = false;
+    }
+
+    VideoStreamFormat format;
+    int width;                      // of the frames captured
+    int height;
+    int crop;                       // rows left off the top and bottom of every frame
+    int frameRate;
+    int keyframeInterval;           // frames between whole frames, with delta
+    int bufferSize;                 // bytes per write. a multiple of 4k
+    bool directIO;                  // bypass the page cache, where the file system allows
+    bool dropCache;                 // drop each buffer from the page cache once it is written
+};
+
+// BT.601 studio range, as y4m players expect
+
+inline void ConvertBGRToYUV444( const uint8_t * pixels, int width, int height, uint8_t * output )
+{
+    uint8_t * Y = output;
+    uint8_t * U = output + width * height;
+    uint8_t * V = output + width * height * 2;
+
+    // IMPORTANT: y4m is top row first, read back pixels are bottom row first
+
+    for ( int y = 0; y < height; ++y )
+    {
+        const uint8_t * p = pixels + ( height - 1 - y ) * width * 3;
+        for ( int x = 0; x < width; ++x, p += 3 )
+        {
+            const int b = p[0];
+            const int g = p[1];
+            const int r = p[2];
+            *Y++ = uint8_t( ( ( 66 * r + 129 * g + 25 * b + 128 ) >> 8 ) + 16 );
+            *U++ = uint8_t( ( ( -38 * r - 74 * g + 112 * b + 128 ) >> 8 ) + 128 );
+            *V++ = uint8_t( ( ( 112 * r - 94 * g - 18 * b + 128 ) >> 8 ) + 128 );
+        }
+    }
+}
+
+// ----------------------------------------------------------------
+
+class VideoStreamSink : public CaptureSink
+{
+public:
+
+    VideoStreamSink()
+    {
+        #if PLATFORM == PLATFORM_WINDOWS
+        file = NULL;
+        #else
+        fd = -1;
+        #endif
+        direct = false;
+        staging = NULL;
+        stagingMemory = NULL;
+        stagingBytes = 0;
+        fileOffset = 0;
+        offset = 0;
+        numSlots = 0;
+        encodeBytes = 0;
+        encodeBuffers = NULL;
+        turns = NULL;
+        nextSequence = 0;
+        error = false;
+    }
+
+    ~VideoStreamSink()
+    {
+        Close();
+    }
+
+    bool Open( const char filename[], const VideoStreamParams & streamParams )
+    {
+        assert( filename );
+        assert( streamParams.width > 0 );
+        assert( streamParams.height > streamParams.crop * 2 );
+        assert( streamParams.bufferSize > 0 && ( streamParams.bufferSize % 4096 ) == 0 );
+
+        Close();
+
+        params = streamParams;
+
+        if ( !OpenFile( filename ) )
+            return false;
+
+        // IMPORTANT: O_DIRECT wants the memory, the file offset and the size of each write aligned
+
+        stagingMemory = new uint8_t[params.bufferSize + 4096];
+        staging = (uint8_t*) ( ( uintptr_t( stagingMemory ) + 4095 ) & ~uintptr_t( 4095 ) );
+        stagingBytes = 0;
+        fileOffset = 0;
+        offset = 0;
+        nextSequence = 0;
+        error = false;
+        index.clear();
+
+        if ( params.format == VIDEO_STREAM_DELTA )
+            deltaEncoder.Initialize( params.width, GetHeight(), params.keyframeInterval );
+
+        if ( params.format == VIDEO_STREAM_Y4M )
+        {
+            char header[256];
+            const int bytes = snprintf( header, sizeof( header ), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", params.width, GetHeight(), params.frameRate );
+            Append( (const uint8_t*) header, bytes );
+        }
+        else
+        {
+            const uint32_t header[] = { VideoStreamMagic, VideoStreamVersion, uint32_t( params.format ), uint32_t( params.width ), uint32_t( GetHeight() ), uint32_t( params.frameRate ) };
+            Append( (const uint8_t*) header, sizeof( header ) );
+        }
+
+        return true;
+    }
+
+    // writes the index, if there is one, and whatever is still buffered.
+    // returns false if any write failed. stop the capture pipeline first
+
+    bool Close()
+    {
+        if ( !staging )
+            return true;
+
+        if ( params.format != VIDEO_STREAM_Y4M )
+        {
+            const uint64_t indexOffset = offset;
+            if ( !index.empty() )
+                Append( (const uint8_t*) &index[0], index.size() * sizeof( IndexEntry ) );
+            Append( (const uint8_t*) &indexOffset, sizeof( indexOffset ) );
+            const uint32_t footer[] = { uint32_t( index.size() ), VideoStreamMagic };
+            Append( (const uint8_t*) footer, sizeof( footer ) );
+        }
+
+        Flush();
+
+        const bool ok = CloseFile() && !error;
+
+        delete [] stagingMemory;
+        stagingMemory = NULL;
+        staging = NULL;
+        std::vector<IndexEntry>().swap( index );
+        deltaEncoder.Free();
+        FreeSlots();
+
+        return ok;
+    }
+
+    // IMPORTANT: a writer holds its frame until it has been appended, and they are taken in sequence order,
+    // so the frames in flight always have consecutive sequence numbers. "sequence % numWriters" is unique
+    // among them, and picks both the encode buffer and the semaphore each frame waits on for its turn
+
+    virtual void Start( int numWriters )
+    {
+        assert( staging );
+        assert( numWriters > 0 );
+
+        FreeSlots();
+
+        const int height = GetHeight();
+
+        numSlots = numWriters;
+        encodeBytes = 0;
+        if ( params.format == VIDEO_STREAM_Y4M )
+            encodeBytes = size_t( params.width ) * height * 3;
+        else if ( params.format == VIDEO_STREAM_RLE )
+            encodeBytes = GetMaxTGARLEBytes( params.width, height );
+        if ( encodeBytes > 0 )
+            encodeBuffers = new uint8_t[encodeBytes * numSlots];
+
+        turns = new platform::Semaphore[numSlots];
+        turns[0].Signal();
+        nextSequence = 0;
+    }
+
+    virtual bool WriteFrame( const CaptureFrame & frame )
+    {
+        assert( staging );
+        assert( frame.width == params.width );
+        assert( frame.height == params.height );
+
+        const int height = GetHeight();
+        const uint8_t * pixels = frame.pixels + params.width * 3 * params.crop;
+        const size_t frameBytes = size_t( params.width ) * height * 3;
+
+        assert( turns );
+        assert( frame.sequence >= 0 );
+
+        const int slot = frame.sequence % numSlots;
+
+        // convert or compress before taking a turn, so other writers can do the same meanwhile
+
+        uint8_t * encoded = encodeBuffers ? encodeBuffers + encodeBytes * slot : NULL;
+        const uint8_t * data = encoded ? encoded : pixels;
+        size_t encodedBytes = frameBytes;
+
+        if ( params.format == VIDEO_STREAM_Y4M )
+            ConvertBGRToYUV444( pixels, params.width, height, encoded );
+        else if ( params.format == VIDEO_STREAM_RLE )
+            encodedBytes = EncodeTGARLE( params.width, height, pixels, encoded );
+
+        // wait for every frame before this one to go in
+
+        turns[slot].Wait();
+
+        assert( nextSequence == frame.sequence );
+
+        // IMPORTANT: only one frame can be delta encoded at a time, so this holds up every other writer
+
+        if ( params.format == VIDEO_STREAM_DELTA )
+        {
+            encodedBytes = deltaEncoder.EncodeFrame( pixels );
+            data = deltaEncoder.GetEncoded();
+        }
+
+        if ( params.format == VIDEO_STREAM_Y4M )
+        {
+            Append( (const uint8_t*) "FRAME\n", 6 );
+        }
+        else
+        {
+            IndexEntry entry;
+            entry.offset = offset;
+            entry.frame = frame.frame;
+            entry.size = uint32_t( encodedBytes );
+            index.push_back( entry );
+        }
+
+        Append( data, encodedBytes );
+
+        const bool ok = !error;
+
+        nextSequence = frame.sequence + 1;
+        turns[nextSequence % numSlots].Signal();
+
+        return ok;
+    }
+
+    bool IsOpen() const { return staging != NULL; }
+
+    bool HasError() const { return error; }
+
+    // true if O_DIRECT or F_NOCACHE took. not every file system supports it
+
+    bool IsDirect() const { return direct; }
+
+    // height after cropping
+
+    int GetHeight() const { return params.height - params.crop * 2; }
+
+    uint64_t GetBytesWritten() const { return offset; }
+
+    // tiles compared and changed, with delta. stop the capture pipeline first
+
+    const FrameDeltaStats & GetDeltaStats() const { return deltaEncoder.GetStats(); }
+
+private:
+
+    VideoStreamSink( const VideoStreamSink & other );
+    VideoStreamSink & operator = ( const VideoStreamSink & other );
+
+    struct IndexEntry
+    {
+        uint64_t offset;
+        int32_t frame;
+        uint32_t size;
+    };
+
+    void FreeSlots()
+    {
+        delete [] encodeBuffers;
+        delete [] turns;
+        encodeBuffers = NULL;
+        turns = NULL;
+        encodeBytes = 0;
+        numSlots = 0;
+    }
+
+    void Append( const uint8_t * data, size_t bytes )
+    {
+        offset += bytes;
+
+        while ( bytes > 0 )
+        {
+            size_t copy = params.bufferSize - stagingBytes;
+            if ( copy > bytes )
+                copy = bytes;
+
+            memcpy( staging + stagingBytes, data, copy );
+            stagingBytes += copy;
+            data += copy;
+            bytes -= copy;
+
+            if ( stagingBytes == size_t( params.bufferSize ) )
+                Flush();
+        }
+    }
+
+    void Flush()
+    {
+        if ( stagingBytes == 0 )
+            return;
+
+        if ( !WriteFile( staging, stagingBytes ) )
+            error = true;
+
+        fileOffset += stagingBytes;
+        stagingBytes = 0;
+    }
+
+    bool OpenFile( const char filename[] )
+    {
+        direct = false;
+
+        #if PLATFORM == PLATFORM_WINDOWS
+
+            file = fopen( filename, "wb" );
+            return file != NULL;
+
+        #else
+
+            const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+            fd = -1;
+
+            #ifdef O_DIRECT
+            if ( params.directIO )
+            {
+                // tmpfs and some others refuse O_DIRECT. fall back to going through the cache
+                fd = open( filename, flags | O_DIRECT, 0644 );
+                direct = fd >= 0;
+            }
+            #endif
+
+            if ( fd < 0 )
+                fd = open( filename, flags, 0644 );
+
+            if ( fd < 0 )
+                return false;
+
+            #ifdef F_NOCACHE
+            if ( params.directIO )
+                direct = fcntl( fd, F_NOCACHE, 1 ) == 0;
+            #endif
+
+            #ifdef POSIX_FADV_SEQUENTIAL
+            posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+            #endif
+
+            return true;
+
+        #endif
+    }
+
+    bool WriteFile( const uint8_t * data, size_t bytes )
+    {
+        #if PLATFORM == PLATFORM_WINDOWS
+
+            return fwrite( data, bytes, 1, file ) == 1;
+
+        #else
+
+            #ifdef O_DIRECT
+            if ( direct && ( bytes % 4096 ) != 0 )
+            {
+                // the last write is short. it can't go direct, so switch back for it
+                fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) & ~O_DIRECT );
+                direct = false;
+            }
+            #endif
+
+            const size_t length = bytes;
+
+            while ( bytes > 0 )
+            {
+                const ssize_t result = write( fd, data, bytes );
+                if ( result < 0 )
+                {
+                    if ( errno == EINTR )
+                        continue;
+                    return false;
+                }
+                data += result;
+                bytes -= result;
+            }
+
+            #ifdef POSIX_FADV_DONTNEED
+            if ( params.dropCache )
+                posix_fadvise( fd, fileOffset, length, POSIX_FADV_DONTNEED );
+            #else
+            (void) length;
+            #endif
+
+            return true;
+
+        #endif
+    }
+
+    bool CloseFile()
+    {
+        #if PLATFORM == PLATFORM_WINDOWS
+            const bool ok = fclose( file ) == 0;
+            file = NULL;
+        #else
+            const bool ok = close( fd ) == 0;
+            fd = -1;
+        #endif
+        return ok;
+    }
+
+    VideoStreamParams params;
+
+    #if PLATFORM == PLATFORM_WINDOWS
+    FILE * file;
+    #else
+    int fd;
+    #endif
+    bool direct;
+
+    uint8_t * staging;              // aligned to 4k within "stagingMemory"
+    uint8_t * stagingMemory;
+    size_t stagingBytes;
+    uint64_t fileOffset;            // where the staging buffer goes in the file
+    uint64_t offset;                // bytes appended so far, buffered or not
+
+    std::vector<IndexEntry> index;
+    FrameDeltaEncoder deltaEncoder;
+
+    int numSlots;                   // one per writer thread
+    size_t encodeBytes;             // per slot
+    uint8_t * encodeBuffers;        // y4m and rle frames are converted here before their turn
+    platform::Semaphore * turns;    // signalled when it is the turn of the frame in this slot
+    int nextSequence;               // only touched by the frame whose turn it is
+    bool error;
+};
+
+// ----------------------------------------------------------------
+
+// reads back raw, rle and delta streams. y4m is read by everything else
+
+class VideoStreamReader
+{
+public:
+
+    VideoStreamReader()
+    {
+        data = NULL;
+        size = 0;
+        index = NULL;
+        numFrames = 0;
+        format = VIDEO_STREAM_RAW;
+        width = 0;
+        height = 0;
+        frameRate = 0;
+        decodedFrame = -1;
+    }
+
+    ~VideoStreamReader()
+    {
+        Close();
+    }
+
+    bool Open( const char filename[] )
+    {
+        assert( filename );
+
+        Close();
+
+        data = platform::MapFile( filename, size );
+        if ( !data )
+            return false;
+
+        const size_t headerBytes = 24;
+        const size_t footerBytes = 16;
+
+        uint32_t header[6];
+        bool ok = size >= headerBytes + footerBytes;
+        if ( ok )
+        {
+            memcpy( header, data, sizeof( header ) );
+            ok = header[0] == VideoStreamMagic && header[1] == VideoStreamVersion &&
+                 ( header[2] == VIDEO_STREAM_RAW || header[2] == VIDEO_STREAM_RLE || header[2] == VIDEO_STREAM_DELTA ) &&
+                 header[3] > 0 && header[4] > 0 && header[3] <= 16384 && header[4] <= 16384;
+        }
+
+        uint64_t indexOffset = 0;
+        uint32_t footer[2] = { 0, 0 };
+        if ( ok )
+        {
+            memcpy( &indexOffset, data + size - footerBytes, sizeof( indexOffset ) );
+            memcpy( footer, data + size - 8, sizeof( footer ) );
+            ok = footer[1] == VideoStreamMagic &&
+                 indexOffset >= headerBytes &&
+                 indexOffset + uint64_t( footer[0] ) * 16 == size - footerBytes;
+        }
+
+        if ( !ok )
+        {
+            Close();
+            return false;
+        }
+
+        format = VideoStreamFormat( header[2] );
+        width = header[3];
+        height = header[4];
+        frameRate = header[5];
+        numFrames = footer[0];
+
+        // IMPORTANT: the index follows variable sized frames, so it may not be aligned. copy it out
+
+        index = new Entry[numFrames];
+        for ( int i = 0; i < numFrames; ++i )
+        {
+            const uint8_t * p = data + indexOffset + i * 16;
+            memcpy( &index[i].offset, p, 8 );
+            memcpy( &index[i].frame, p + 8, 4 );
+            memcpy( &index[i].size, p + 12, 4 );
+            if ( index[i].offset < headerBytes || index[i].offset + index[i].size > indexOffset )
+            {
+                Close();
+                return false;
+            }
+        }
+
+        if ( format == VIDEO_STREAM_DELTA )
+            decoder.Initialize( width, height );
+        decodedFrame = -1;
+
+        return true;
+    }
+
+    void Close()
+    {
+        if ( data )
+            platform::UnmapFile( data, size );
+        delete [] index;
+        data = NULL;
+        size = 0;
+        index = NULL;
+        numFrames = 0;
+        decoder.Free();
+        decodedFrame = -1;
+    }
+
+    // "pixels" must hold width * height * 3 bytes. returns false if the frame data is bad.
+    // delta frames are quickest read in order, otherwise they decode on from the last keyframe
+
+    bool ReadFrame( int i, uint8_t * pixels )
+    {
+        assert( data );
+        assert( i >= 0 && i < numFrames );
+
+        const Entry & entry = index[i];
+        const uint8_t * frameData = data + entry.offset;
+
+        if ( format == VIDEO_STREAM_RAW )
+        {
+            if ( entry.size != uint32_t( width * height * 3 ) )
+                return false;
+            memcpy( pixels, frameData, entry.size );
+            return true;
+        }
+
+        if ( format == VIDEO_STREAM_DELTA )
+        {
+            int start = i;
+            if ( decoder.HasFrame() && decodedFrame >= 0 && decodedFrame <= i )
+            {
+                start = decodedFrame + 1;
+            }
+            else
+            {
+                while ( start > 0 && !IsFrameDeltaKeyframe( data + index[start].offset, index[start].size ) )
+                    start--;
+            }
+
+            for ( int j = start; j <= i; ++j )
+            {
+                if ( !decoder.DecodeFrame( data + index[j].offset, index[j].size ) )
+                {
+                    decodedFrame = -1;
+                    return false;
+                }
+            }
+
+            decodedFrame = i;
+            memcpy( pixels, decoder.GetFrame(), size_t( width ) * height * 3 );
+            return true;
+        }
+
+        return DecodeTGARLE( frameData, entry.size, width, height, pixels );
+    }
+
+    bool IsOpen() const { return data != NULL; }
+
+    VideoStreamFormat GetFormat() const { return format; }
+
+    int GetWidth() const { return width; }
+
+    int GetHeight() const { return height; }
+
+    int GetFrameRate() const { return frameRate; }
+
+    int GetNumFrames() const { return numFrames; }
+
+    // frame number it was captured as. dropped frames leave gaps
+
+    int GetFrameNumber( int i ) const
+    {
+        assert( i >= 0 && i < numFrames );
+        return index[i].frame;
+    }
+
+private:
+
+    VideoStreamReader( const VideoStreamReader & other );
+    VideoStreamReader & operator = ( const VideoStreamReader & other );
+
+    struct Entry
+    {
+        uint64_t offset;
+        int32_t frame;
+        uint32_t size;
+    };
+
+    const uint8_t * data;
+    size_t size;
+    Entry * index;
+    int numFrames;
+    VideoStreamFormat format;
+    int width;
+    int height;
+    int frameRate;
+    FrameDeltaDecoder decoder;
+    int decodedFrame;               // the frame "decoder" holds, or -1
+};
+
+#endif
@@ -0,0 +1,361 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "Board.h"
+#include "Stone.h"
+#include "RigidBody.h"
+#include "CollisionDetection.h"
+#include "CollisionResponse.h"
+#include "Allocator.h"
+#include "BodyPool.h"
+
+/*
+    World.
+
+    A go board plus every stone on it, stepped together. All stones in a
+    world share one biconvex, which is what lets the stone vs. board pass
+    run as a batch over every active body (see "StoneBoardCollision_Batch")
+    instead of one call per stone.
+
+    All memory comes from the arena passed in to "Initialize", which must
+    outlive the world. Bodies live there for the life of the world, while
+    temporaries for a step come from a scratch arena carved out of it and
+    reset at the start of each step. Stepping never touches the heap.
+
+    Stones are named by "BodyHandle". Indices into the body array are only
+    good until the next stone is removed.
+
+    Stones fall asleep once they have been at rest for "sleepTime" seconds.
+    A world with every stone asleep does no work.
+*/
+
+struct WorldParams
+{
+    WorldParams()
+    {
+        gravity = 9.8f * 10;
+        iterations = 20;
+        rotationSubsteps = 10;
+        board_e = 0.8f;
+        board_u = 0.1f;
+        floor_e = 0.5f;
+        floor_u = 0.15f;
+        linearDamping = 0.99999f;
+        angularDamping = 0.9999f;
+        rollingFrictionSlow = 0.9915f;
+        rollingFrictionFast = 0.9995f;
+        sleepEnergy = 0.01f;
+        sleepTime = 0.5f;
+    }
+
+    float gravity;                  // cms/sec^2
+    int iterations;
+    int rotationSubsteps;
+    float board_e;
+    float board_u;
+    float floor_e;
+    float floor_u;
+    float linearDamping;
+    float angularDamping;
+    float rollingFrictionSlow;      // angular damping for a stone in contact spinning slowly
+    float rollingFrictionFast;      // angular damping for a stone in contact spinning fast
+    float sleepEnergy;              // kinetic energy below which a stone is at rest
+    float sleepTime;                // seconds at rest before a stone goes to sleep
+};
+
+class World
+{
+public:
+
+    World()
+    {
+        numActive = 0;
+        numContacts = 0;
+        contacts = NULL;
+    }
+
+    static size_t GetMemoryRequired( int maxStones )
+    {
+        return BodyPool::GetMemoryRequired( maxStones ) + GetArraySize<uint8_t>( GetScratchRequired( maxStones ) );
+    }
+
+    static size_t GetScratchRequired( int maxStones )
+    {
+        return GetArraySize<int>( maxStones ) * 2 +
+               GetArraySize<uint8_t>( maxStones ) +
+               GetArraySize<StaticContact>( maxStones );
+    }
+
+    bool Initialize( Arena & arena, int boardSize, StoneSize stoneSize, int maxStones, const WorldParams & worldParams = WorldParams() )
+    {
+        assert( maxStones > 0 );
+
+        params = worldParams;
+
+        board.Initialize( boardSize );
+
+        stone.Initialize( stoneSize );
+
+        numActive = 0;
+        numContacts = 0;
+
+        if ( !bodies.Initialize( arena, maxStones ) )
+            return false;
+
+        return scratch.Initialize( arena, GetScratchRequired( maxStones ) );
+    }
+
+    // returns an invalid handle if the world is full
+
+    BodyHandle AddStone( const vec3f & position, const quat4f & orientation )
+    {
+        const BodyHandle handle = bodies.Create();
+        assert( bodies.IsValid( handle ) );
+        if ( !bodies.IsValid( handle ) )
+            return handle;
+
+        RigidBody & rigidBody = *bodies.Get( handle );
+        rigidBody = stone.rigidBody;
+        rigidBody.position = position;
+        rigidBody.orientation = orientation;
+        rigidBody.active = true;
+        rigidBody.deactivateTimer = 0.0f;
+        rigidBody.UpdateTransform();
+        rigidBody.UpdateMomentum();
+
+        numActive++;
+
+        return handle;
+    }
+
+    // removing a stone moves the last stone into its place. handles stay valid, indices don't
+
+    void RemoveStone( BodyHandle handle )
+    {
+        const RigidBody * rigidBody = bodies.Get( handle );
+        assert( rigidBody );
+        if ( !rigidBody )
+            return;
+        if ( rigidBody->active )
+            numActive--;
+        bodies.Destroy( handle );
+    }
+
+    void Wake( BodyHandle handle )
+    {
+        RigidBody & rigidBody = GetBody( handle );
+        if ( rigidBody.active )
+            return;
+        rigidBody.active = true;
+        rigidBody.deactivateTimer = 0.0f;
+        numActive++;
+    }
+
+    void Sleep( BodyHandle handle )
+    {
+        RigidBody & rigidBody = GetBody( handle );
+        if ( !rigidBody.active )
+            return;
+        rigidBody.Deactivate();
+        numActive--;
+    }
+
+    bool IsAwake() const
+    {
+        return numActive > 0;
+    }
+
+    int GetNumActive() const
+    {
+        return numActive;
+    }
+
+    void Step( float dt )
+    {
+        #ifdef DEBUG_ALLOCATIONS
+        HeapAllocationCheck heapAllocationCheck;
+        #endif
+
+        if ( numActive == 0 )
+            return;
+
+        scratch.Reset();
+
+        RigidBody * rigidBodies = bodies.GetBodies();
+        const int numBodies = bodies.GetNumBodies();
+
+        int * primary = AllocateArray<int>( scratch, numBodies );
+        int * tail = AllocateArray<int>( scratch, numBodies );
+        uint8_t * touching = AllocateArray<uint8_t>( scratch, numBodies );
+        contacts = AllocateArray<StaticContact>( scratch, numBodies );
+
+        const float iteration_dt = dt / params.iterations;
+        const float rotation_substep_dt = iteration_dt / params.rotationSubsteps;
+
+        const float linear_factor = DecayFactor( params.linearDamping, dt );
+        const float angular_factor = DecayFactor( params.angularDamping, dt );
+
+        const float slow_factor = DecayFactor( params.rollingFrictionSlow, dt );
+        const float fast_factor = DecayFactor( params.rollingFrictionFast, dt );
+
+        for ( int i = 0; i < params.iterations; ++i )
+        {
+            // integrate
+
+            for ( int j = 0; j < numBodies; ++j )
+            {
+                RigidBody & rigidBody = rigidBodies[j];
+                if ( !rigidBody.active )
+                    continue;
+
+                rigidBody.linearMomentum += vec3f(0,0,-params.gravity) * rigidBody.mass * iteration_dt;
+                rigidBody.UpdateMomentum();
+
+                rigidBody.position += rigidBody.linearVelocity * iteration_dt;
+
+                for ( int k = 0; k < params.rotationSubsteps; ++k )
+                {
+                    quat4f spin;
+                    AngularVelocityToSpin( rigidBody.orientation, rigidBody.angularVelocity, spin );
+                    rigidBody.orientation += spin * rotation_substep_dt;
+                    rigidBody.orientation = normalize( rigidBody.orientation );
+                }
+
+                rigidBody.UpdateTransform();
+            }
+
+            // collision between stones and board
+
+            numContacts = StoneBoardCollision_Batch( stone.biconvex, board, rigidBodies, numBodies, primary, tail, contacts, true );
+
+            for ( int j = 0; j < numBodies; ++j )
+                touching[j] = 0;
+
+            for ( int j = 0; j < numContacts; ++j )
+            {
+                RigidBody & rigidBody = rigidBodies[contacts[j].body];
+                ApplyCollisionImpulseWithFriction( rigidBody, contacts[j], params.board_e, params.board_u );
+                rigidBody.UpdateMomentum();
+                touching[contacts[j].body] = 1;
+            }
+
+            // collision between stones and floor
+
+            for ( int j = 0; j < numBodies; ++j )
+            {
+                RigidBody & rigidBody = rigidBodies[j];
+                if ( !rigidBody.active )
+                    continue;
+
+                StaticContact floorContact;
+                if ( StonePlaneCollision( stone.biconvex, vec4f(0,0,1,0), rigidBody, floorContact ) )
+                {
+                    ApplyCollisionImpulseWithFriction( rigidBody, floorContact, params.floor_e, params.floor_u );
+                    rigidBody.UpdateMomentum();
+                    touching[j] = 1;
+                }
+
+                // same made up rolling/spinning friction as the collision demo. without it
+                // a stone resting on its rim rocks forever and never goes to sleep
+
+                if ( touching[j] )
+                {
+                    const float momentum = length( rigidBody.angularMomentum );
+                    const float alpha = min( momentum, 1.0f );
+                    rigidBody.angularMomentum *= slow_factor * ( 1 - alpha ) + fast_factor * alpha;
+                }
+
+                rigidBody.linearMomentum *= linear_factor;
+                rigidBody.angularMomentum *= angular_factor;
+            }
+        }
+
+        // put stones at rest to sleep
+
+        for ( int i = 0; i < numBodies; ++i )
+        {
+            RigidBody & rigidBody = rigidBodies[i];
+            if ( !rigidBody.active )
+                continue;
+
+            rigidBody.UpdateMomentum();
+
+            if ( rigidBody.GetKineticEnergy() < params.sleepEnergy )
+                rigidBody.deactivateTimer += dt;
+            else
+                rigidBody.deactivateTimer = 0.0f;
+
+            if ( rigidBody.deactivateTimer >= params.sleepTime )
+            {
+                rigidBody.Deactivate();
+                numActive--;
+            }
+        }
+    }
+
+    const Board & GetBoard() const { return board; }
+
+    const Biconvex & GetBiconvex() const { return stone.biconvex; }
+
+    // every stone on the table is a copy of this one
+
+    const Stone & GetStone() const { return stone; }
+
+    int GetNumBodies() const { return bodies.GetNumBodies(); }
+
+    int GetMaxBodies() const { return bodies.GetCapacity(); }
+
+    RigidBody & GetBody( int index ) { assert( index >= 0 && index < bodies.GetNumBodies() ); return bodies.GetBodies()[index]; }
+
+    const RigidBody & GetBody( int index ) const { assert( index >= 0 && index < bodies.GetNumBodies() ); return bodies.GetBodies()[index]; }
+
+    RigidBody & GetBody( BodyHandle handle ) { assert( bodies.IsValid( handle ) ); return *bodies.Get( handle ); }
+
+    const RigidBody & GetBody( BodyHandle handle ) const { assert( bodies.IsValid( handle ) ); return *bodies.Get( handle ); }
+
+    BodyHandle GetHandle( int index ) const { return bodies.GetHandle( index ); }
+
+    bool IsValid( BodyHandle handle ) const { return bodies.IsValid( handle ); }
+
+    int GetNumContacts() const { return numContacts; }
+
+    // direct access to the bodies and their slot tables, for saving and restoring the whole world at once (see Rollback.h)
+
+    BodyPool & GetBodyPool() { return bodies; }
+
+    const BodyPool & GetBodyPool() const { return bodies; }
+
+    // call after writing bodies directly, to count how many are awake again
+
+    void UpdateNumActive()
+    {
+        const RigidBody * rigidBodies = bodies.GetBodies();
+        const int numBodies = bodies.GetNumBodies();
+        numActive = 0;
+        for ( int i = 0; i < numBodies; ++i )
+            numActive += rigidBodies[i].active ? 1 : 0;
+    }
+
+    const StaticContact * GetContacts() const { return contacts; }
+
+private:
+
+    World( const World & other );
+    World & operator = ( const World & other );
+
+    WorldParams params;
+
+    Board board;
+    Stone stone;
+
+    int numActive;
+    BodyPool bodies;
+
+    Arena scratch;
+
+    // IMPORTANT: contacts from the last step live in scratch and are only valid until the next step
+    int numContacts;
+    StaticContact * contacts;
+};
+
+#endif
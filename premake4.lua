@@ -21,32 +21,52 @@ project "UnitTest++"
 
 project "Support"
     kind "ConsoleApp"
-    files { "Source/*.h", "Source/Support.cpp", "Source/Platform.cpp" }
+    files { "Source/*.h", "Source/Support.cpp", "Source/Platform.cpp", "Source/Allocator.cpp" }
     configuration { "macosx" }
         links { "OpenGL.framework", "AGL.framework", "Carbon.framework" }
+    configuration { "linux" }
+        defines { "HEADLESS" }
+        links { "EGL", "GL", "GLU", "pthread" }
 
 project "Tessellation"
     kind "ConsoleApp"
-    files { "Source/*.h", "Source/Tessellation.cpp", "Source/Platform.cpp" }
+    files { "Source/*.h", "Source/Tessellation.cpp", "Source/Platform.cpp", "Source/Allocator.cpp" }
     configuration { "macosx" }
         links { "OpenGL.framework", "AGL.framework", "Carbon.framework" }
+    configuration { "linux" }
+        defines { "HEADLESS" }
+        links { "EGL", "GL", "GLU", "pthread" }
 
 project "Dynamics"
     kind "ConsoleApp"
-    files { "Source/*.h", "Source/Dynamics.cpp", "Source/Platform.cpp" }
+    files { "Source/*.h", "Source/Dynamics.cpp", "Source/Platform.cpp", "Source/Allocator.cpp" }
     configuration { "macosx" }
         links { "OpenGL.framework", "AGL.framework", "Carbon.framework" }
+    configuration { "linux" }
+        defines { "HEADLESS" }
+        links { "EGL", "GL", "GLU", "pthread" }
 
 project "Collision"
     kind "ConsoleApp"
-    files { "Source/*.h", "Source/Collision.cpp", "Source/Platform.cpp", "Source/stb_image.c" }
+    files { "Source/*.h", "Source/Collision.cpp", "Source/Platform.cpp", "Source/Allocator.cpp", "Source/stb_image.c" }
     configuration { "macosx" }
         links { "OpenGL.framework", "AGL.framework", "Carbon.framework" }
+    configuration { "linux" }
+        defines { "HEADLESS" }
+        links { "EGL", "GL", "GLU", "pthread" }
+
+project "Benchmark"
+    kind "ConsoleApp"
+    files { "Source/*.h", "Source/Benchmark.cpp", "Source/Platform.cpp", "Source/Allocator.cpp" }
+    configuration { "linux" }
+        links { "pthread" }
 
 project "UnitTest"
     kind "ConsoleApp"
-    files { "UnitTest.cpp" }
+    files { "Source/UnitTest.cpp", "Source/Platform.cpp", "Source/Allocator.cpp" }
     links { "UnitTest++" }
+    configuration { "linux" }
+        links { "pthread" }
 
 if _ACTION == "clean" then
     os.rmdir "obj"
@@ -121,6 +141,21 @@ if not os.is "windows" then
         end
     }
 
+    newaction
+    {
+        trigger     = "benchmark",
+        description = "Build and run benchmarks",
+        valid_kinds = premake.action.get("gmake").valid_kinds,
+        valid_languages = premake.action.get("gmake").valid_languages,
+        valid_tools = premake.action.get("gmake").valid_tools,
+     
+        execute = function ()
+            if os.execute "make -j32 Benchmark config=release" == 0 then
+                os.execute "./Benchmark"
+            end
+        end
+    }
+
     newaction
     {
         trigger     = "test",
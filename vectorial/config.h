@@ -31,6 +31,14 @@
 
 
 
+// 8-wide packets use AVX when available on top of SSE, otherwise they fall
+// back to a pair of simd4f (see simd8f.h). define VECTORIAL_NO_AVX to force that
+
+#if defined(VECTORIAL_SSE) && defined(__AVX__) && !defined(VECTORIAL_NO_AVX)
+    #define VECTORIAL_AVX
+#endif
+
+
 #ifdef VECTORIAL_SCALAR
     #define VECTORIAL_SIMD_TYPE "scalar"
 #endif
@@ -0,0 +1,122 @@
+/*
+  Vectorial
+  Copyright (c) 2010 Mikko Lehtonen
+  Licensed under the terms of the two-clause BSD License (see LICENSE)
+*/
+#ifndef VECTORIAL_QUAT4X4F_H
+#define VECTORIAL_QUAT4X4F_H
+
+#ifndef VECTORIAL_VEC3X4F_H
+  #include "vectorial/vec3x4f.h"
+#endif
+
+
+
+namespace vectorial {
+
+    // four quaternions in structure of arrays form. in memory a single
+    // quaternion is four floats x,y,z,w, which is what load and store expect
+
+    class quat4x4f {
+    public:
+
+        simd4f x, y, z, w;
+
+        inline quat4x4f() {}
+        inline quat4x4f(const simd4f& x, const simd4f& y, const simd4f& z, const simd4f& w) : x(x), y(y), z(z), w(w) {}
+        inline quat4x4f(const float *a, const float *b, const float *c, const float *d) { load(a, b, c, d); }
+        inline quat4x4f(const float *q, int stride) { load(q, stride); }
+
+        inline void load(const float *a, const float *b, const float *c, const float *d) {
+            simd4x4f m = simd4x4f_create(simd4f_uload4(a), simd4f_uload4(b), simd4f_uload4(c), simd4f_uload4(d));
+            simd4x4f_transpose_inplace(&m);
+            x = m.x;
+            y = m.y;
+            z = m.z;
+            w = m.w;
+        }
+
+        inline void store(float *a, float *b, float *c, float *d) const {
+            simd4x4f m = simd4x4f_create(x, y, z, w);
+            simd4x4f_transpose_inplace(&m);
+            simd4f_ustore4(m.x, a);
+            simd4f_ustore4(m.y, b);
+            simd4f_ustore4(m.z, c);
+            simd4f_ustore4(m.w, d);
+        }
+
+        // stride is in floats between consecutive quaternions
+
+        inline void load(const float *q, int stride) { load(q, q + stride, q + stride*2, q + stride*3); }
+        inline void store(float *q, int stride) const { store(q, q + stride, q + stride*2, q + stride*3); }
+
+        inline vec3x4f xyz() const { return vec3x4f(x, y, z); }
+
+        enum { lanes = 4 };
+
+        static quat4x4f identity() { return quat4x4f(simd4f_zero(), simd4f_zero(), simd4f_zero(), simd4f_splat(1.0f)); }
+
+    };
+
+
+    vectorial_inline quat4x4f operator+(const quat4x4f& lhs, const quat4x4f& rhs) {
+        return quat4x4f( simd4f_add(lhs.x, rhs.x), simd4f_add(lhs.y, rhs.y), simd4f_add(lhs.z, rhs.z), simd4f_add(lhs.w, rhs.w) );
+    }
+
+    vectorial_inline quat4x4f operator*(const quat4x4f& lhs, const simd4f& rhs) {
+        return quat4x4f( simd4f_mul(lhs.x, rhs), simd4f_mul(lhs.y, rhs), simd4f_mul(lhs.z, rhs), simd4f_mul(lhs.w, rhs) );
+    }
+
+    vectorial_inline quat4x4f operator*(const quat4x4f& lhs, float rhs) {
+        return lhs * simd4f_splat(rhs);
+    }
+
+    vectorial_inline quat4x4f operator*(float lhs, const quat4x4f& rhs) {
+        return rhs * simd4f_splat(lhs);
+    }
+
+
+    vectorial_inline simd4f dot(const quat4x4f& lhs, const quat4x4f& rhs) {
+        return simd4f_add( simd4f_add( simd4f_mul(lhs.x, rhs.x), simd4f_mul(lhs.y, rhs.y) ),
+                           simd4f_add( simd4f_mul(lhs.z, rhs.z), simd4f_mul(lhs.w, rhs.w) ) );
+    }
+
+    vectorial_inline quat4x4f conjugate(const quat4x4f& q) {
+        const simd4f zero = simd4f_zero();
+        return quat4x4f( simd4f_sub(zero, q.x), simd4f_sub(zero, q.y), simd4f_sub(zero, q.z), q.w );
+    }
+
+    vectorial_inline quat4x4f normalize(const quat4x4f& q) {
+        // rsqrt estimate plus one newton-raphson step: ~23 bits on sse
+        const simd4f lengthSquared = dot(q, q);
+        const simd4f estimate = simd4f_rsqrt(lengthSquared);
+        const simd4f halfLengthSquared = simd4f_mul(lengthSquared, simd4f_splat(0.5f));
+        const simd4f invlen = simd4f_mul(estimate, simd4f_sub(simd4f_splat(1.5f), simd4f_mul(halfLengthSquared, simd4f_mul(estimate, estimate))));
+        return q * invlen;
+    }
+
+    vectorial_inline quat4x4f multiply(const quat4x4f& q1, const quat4x4f& q2) {
+        const simd4f w = simd4f_sub( simd4f_sub( simd4f_mul(q1.w, q2.w), simd4f_mul(q1.x, q2.x) ), simd4f_add( simd4f_mul(q1.y, q2.y), simd4f_mul(q1.z, q2.z) ) );
+        const simd4f x = simd4f_add( simd4f_add( simd4f_mul(q1.w, q2.x), simd4f_mul(q1.x, q2.w) ), simd4f_sub( simd4f_mul(q1.y, q2.z), simd4f_mul(q1.z, q2.y) ) );
+        const simd4f y = simd4f_add( simd4f_sub( simd4f_mul(q1.w, q2.y), simd4f_mul(q1.x, q2.z) ), simd4f_add( simd4f_mul(q1.y, q2.w), simd4f_mul(q1.z, q2.x) ) );
+        const simd4f z = simd4f_add( simd4f_add( simd4f_mul(q1.w, q2.z), simd4f_mul(q1.x, q2.y) ), simd4f_sub( simd4f_mul(q1.z, q2.w), simd4f_mul(q1.y, q2.x) ) );
+        return quat4x4f( x, y, z, w );
+    }
+
+    vectorial_inline quat4x4f operator*(const quat4x4f& q1, const quat4x4f& q2) {
+        return multiply(q1, q2);
+    }
+
+    // rotate vectors by unit quaternions: v' = v + w * t + cross( q.xyz, t ) where t = 2 * cross( q.xyz, v )
+
+    vectorial_inline vec3x4f transformVector(const quat4x4f& q, const vec3x4f& v) {
+        const vec3x4f u = q.xyz();
+        const vec3x4f t = cross(u, v) * 2.0f;
+        return v + t * q.w + cross(u, t);
+    }
+
+}
+
+
+
+#endif
@@ -0,0 +1,125 @@
+/*
+  Vectorial
+  Copyright (c) 2010 Mikko Lehtonen
+  Licensed under the terms of the two-clause BSD License (see LICENSE)
+*/
+#ifndef VECTORIAL_QUAT4X8F_H
+#define VECTORIAL_QUAT4X8F_H
+
+#ifndef VECTORIAL_VEC3X8F_H
+  #include "vectorial/vec3x8f.h"
+#endif
+
+
+
+namespace vectorial {
+
+    // eight quaternions in structure of arrays form, see quat4x4f
+
+    class quat4x8f {
+    public:
+
+        simd8f x, y, z, w;
+
+        inline quat4x8f() {}
+        inline quat4x8f(const simd8f& x, const simd8f& y, const simd8f& z, const simd8f& w) : x(x), y(y), z(z), w(w) {}
+        inline quat4x8f(const float *q, int stride) { load(q, stride); }
+
+        // stride is in floats between consecutive quaternions
+
+        inline void load(const float *q, int stride) {
+            simd4x4f lo = simd4x4f_create(simd4f_uload4(q), simd4f_uload4(q + stride), simd4f_uload4(q + stride*2), simd4f_uload4(q + stride*3));
+            simd4x4f hi = simd4x4f_create(simd4f_uload4(q + stride*4), simd4f_uload4(q + stride*5), simd4f_uload4(q + stride*6), simd4f_uload4(q + stride*7));
+            simd4x4f_transpose_inplace(&lo);
+            simd4x4f_transpose_inplace(&hi);
+            x = simd8f_combine(lo.x, hi.x);
+            y = simd8f_combine(lo.y, hi.y);
+            z = simd8f_combine(lo.z, hi.z);
+            w = simd8f_combine(lo.w, hi.w);
+        }
+
+        inline void store(float *q, int stride) const {
+            simd4x4f lo = simd4x4f_create(simd8f_get_low(x), simd8f_get_low(y), simd8f_get_low(z), simd8f_get_low(w));
+            simd4x4f hi = simd4x4f_create(simd8f_get_high(x), simd8f_get_high(y), simd8f_get_high(z), simd8f_get_high(w));
+            simd4x4f_transpose_inplace(&lo);
+            simd4x4f_transpose_inplace(&hi);
+            simd4f_ustore4(lo.x, q);
+            simd4f_ustore4(lo.y, q + stride);
+            simd4f_ustore4(lo.z, q + stride*2);
+            simd4f_ustore4(lo.w, q + stride*3);
+            simd4f_ustore4(hi.x, q + stride*4);
+            simd4f_ustore4(hi.y, q + stride*5);
+            simd4f_ustore4(hi.z, q + stride*6);
+            simd4f_ustore4(hi.w, q + stride*7);
+        }
+
+        inline vec3x8f xyz() const { return vec3x8f(x, y, z); }
+
+        enum { lanes = 8 };
+
+        static quat4x8f identity() { return quat4x8f(simd8f_zero(), simd8f_zero(), simd8f_zero(), simd8f_splat(1.0f)); }
+
+    };
+
+
+    vectorial_inline quat4x8f operator+(const quat4x8f& lhs, const quat4x8f& rhs) {
+        return quat4x8f( simd8f_add(lhs.x, rhs.x), simd8f_add(lhs.y, rhs.y), simd8f_add(lhs.z, rhs.z), simd8f_add(lhs.w, rhs.w) );
+    }
+
+    vectorial_inline quat4x8f operator*(const quat4x8f& lhs, const simd8f& rhs) {
+        return quat4x8f( simd8f_mul(lhs.x, rhs), simd8f_mul(lhs.y, rhs), simd8f_mul(lhs.z, rhs), simd8f_mul(lhs.w, rhs) );
+    }
+
+    vectorial_inline quat4x8f operator*(const quat4x8f& lhs, float rhs) {
+        return lhs * simd8f_splat(rhs);
+    }
+
+    vectorial_inline quat4x8f operator*(float lhs, const quat4x8f& rhs) {
+        return rhs * simd8f_splat(lhs);
+    }
+
+
+    vectorial_inline simd8f dot(const quat4x8f& lhs, const quat4x8f& rhs) {
+        return simd8f_add( simd8f_add( simd8f_mul(lhs.x, rhs.x), simd8f_mul(lhs.y, rhs.y) ),
+                           simd8f_add( simd8f_mul(lhs.z, rhs.z), simd8f_mul(lhs.w, rhs.w) ) );
+    }
+
+    vectorial_inline quat4x8f conjugate(const quat4x8f& q) {
+        const simd8f zero = simd8f_zero();
+        return quat4x8f( simd8f_sub(zero, q.x), simd8f_sub(zero, q.y), simd8f_sub(zero, q.z), q.w );
+    }
+
+    vectorial_inline quat4x8f normalize(const quat4x8f& q) {
+        // rsqrt estimate plus one newton-raphson step: ~23 bits on avx
+        const simd8f lengthSquared = dot(q, q);
+        const simd8f estimate = simd8f_rsqrt(lengthSquared);
+        const simd8f halfLengthSquared = simd8f_mul(lengthSquared, simd8f_splat(0.5f));
+        const simd8f invlen = simd8f_mul(estimate, simd8f_sub(simd8f_splat(1.5f), simd8f_mul(halfLengthSquared, simd8f_mul(estimate, estimate))));
+        return q * invlen;
+    }
+
+    vectorial_inline quat4x8f multiply(const quat4x8f& q1, const quat4x8f& q2) {
+        const simd8f w = simd8f_sub( simd8f_sub( simd8f_mul(q1.w, q2.w), simd8f_mul(q1.x, q2.x) ), simd8f_add( simd8f_mul(q1.y, q2.y), simd8f_mul(q1.z, q2.z) ) );
+        const simd8f x = simd8f_add( simd8f_add( simd8f_mul(q1.w, q2.x), simd8f_mul(q1.x, q2.w) ), simd8f_sub( simd8f_mul(q1.y, q2.z), simd8f_mul(q1.z, q2.y) ) );
+        const simd8f y = simd8f_add( simd8f_sub( simd8f_mul(q1.w, q2.y), simd8f_mul(q1.x, q2.z) ), simd8f_add( simd8f_mul(q1.y, q2.w), simd8f_mul(q1.z, q2.x) ) );
+        const simd8f z = simd8f_add( simd8f_add( simd8f_mul(q1.w, q2.z), simd8f_mul(q1.x, q2.y) ), simd8f_sub( simd8f_mul(q1.z, q2.w), simd8f_mul(q1.y, q2.x) ) );
+        return quat4x8f( x, y, z, w );
+    }
+
+    vectorial_inline quat4x8f operator*(const quat4x8f& q1, const quat4x8f& q2) {
+        return multiply(q1, q2);
+    }
+
+    // rotate vectors by unit quaternions: v' = v + w * t + cross( q.xyz, t ) where t = 2 * cross( q.xyz, v )
+
+    vectorial_inline vec3x8f transformVector(const quat4x8f& q, const vec3x8f& v) {
+        const vec3x8f u = q.xyz();
+        const vec3x8f t = cross(u, v) * 2.0f;
+        return v + t * q.w + cross(u, t);
+    }
+
+}
+
+
+
+#endif
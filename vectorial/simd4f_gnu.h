@@ -140,6 +140,52 @@ vectorial_inline simd4f simd4f_cross3(simd4f l, simd4f r) {
 
 
 
+// comparison and selection. masks are all ones / all zeros per lane
+
+typedef int _simd4f_mask __attribute__ ((vector_size (16)));
+
+vectorial_inline simd4f simd4f_abs(simd4f v) {
+    const _simd4f_mask m = { 0x7fffffff, 0x7fffffff, 0x7fffffff, 0x7fffffff };
+    return (simd4f) ( (_simd4f_mask) v & m );
+}
+
+vectorial_inline simd4f simd4f_cmplt(simd4f lhs, simd4f rhs) {
+    return (simd4f) ( lhs < rhs );
+}
+
+vectorial_inline simd4f simd4f_select(simd4f mask, simd4f a, simd4f b) {
+    const _simd4f_mask m = (_simd4f_mask) mask;
+    return (simd4f) ( ( m & (_simd4f_mask) a ) | ( ~m & (_simd4f_mask) b ) );
+}
+
+vectorial_inline simd4f simd4f_cmple(simd4f lhs, simd4f rhs) {
+    return (simd4f) ( lhs <= rhs );
+}
+
+vectorial_inline simd4f simd4f_and(simd4f lhs, simd4f rhs) {
+    return (simd4f) ( (_simd4f_mask) lhs & (_simd4f_mask) rhs );
+}
+
+vectorial_inline simd4f simd4f_or(simd4f lhs, simd4f rhs) {
+    return (simd4f) ( (_simd4f_mask) lhs | (_simd4f_mask) rhs );
+}
+
+// one bit per lane, lane 0 in bit 0
+
+vectorial_inline int simd4f_movemask(simd4f mask) {
+    const _simd4f_mask m = (_simd4f_mask) mask;
+    return ( m[0] < 0 ) | ( ( m[1] < 0 ) << 1 ) | ( ( m[2] < 0 ) << 2 ) | ( ( m[3] < 0 ) << 3 );
+}
+
+vectorial_inline simd4f simd4f_min(simd4f lhs, simd4f rhs) {
+    return simd4f_select(simd4f_cmplt(lhs, rhs), lhs, rhs);
+}
+
+vectorial_inline simd4f simd4f_max(simd4f lhs, simd4f rhs) {
+    return simd4f_select(simd4f_cmplt(lhs, rhs), rhs, lhs);
+}
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -169,6 +169,48 @@ vectorial_inline simd4f simd4f_cross3(simd4f lhs, simd4f rhs) {
 
 
 
+// comparison and selection. masks are all ones / all zeros per lane
+
+vectorial_inline simd4f simd4f_abs(simd4f v) {
+    return vabsq_f32(v);
+}
+
+vectorial_inline simd4f simd4f_min(simd4f lhs, simd4f rhs) {
+    return vminq_f32(lhs, rhs);
+}
+
+vectorial_inline simd4f simd4f_max(simd4f lhs, simd4f rhs) {
+    return vmaxq_f32(lhs, rhs);
+}
+
+vectorial_inline simd4f simd4f_cmplt(simd4f lhs, simd4f rhs) {
+    return vreinterpretq_f32_u32(vcltq_f32(lhs, rhs));
+}
+
+vectorial_inline simd4f simd4f_select(simd4f mask, simd4f a, simd4f b) {
+    return vbslq_f32(vreinterpretq_u32_f32(mask), a, b);
+}
+
+vectorial_inline simd4f simd4f_cmple(simd4f lhs, simd4f rhs) {
+    return vreinterpretq_f32_u32(vcleq_f32(lhs, rhs));
+}
+
+vectorial_inline simd4f simd4f_and(simd4f lhs, simd4f rhs) {
+    return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(lhs), vreinterpretq_u32_f32(rhs)));
+}
+
+vectorial_inline simd4f simd4f_or(simd4f lhs, simd4f rhs) {
+    return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(lhs), vreinterpretq_u32_f32(rhs)));
+}
+
+// one bit per lane, lane 0 in bit 0
+
+vectorial_inline int simd4f_movemask(simd4f mask) {
+    const uint32x4_t m = vshrq_n_u32(vreinterpretq_u32_f32(mask), 31);
+    return vgetq_lane_u32(m, 0) | ( vgetq_lane_u32(m, 1) << 1 ) | ( vgetq_lane_u32(m, 2) << 2 ) | ( vgetq_lane_u32(m, 3) << 3 );
+}
+
+
 #ifdef __cplusplus
 }
 #endif
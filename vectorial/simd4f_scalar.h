@@ -8,6 +8,7 @@
 
 #include <math.h>
 #include <string.h>  // memcpy
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -138,6 +139,79 @@ vectorial_inline float simd4f_get_z(simd4f s) { return s.z; }
 vectorial_inline float simd4f_get_w(simd4f s) { return s.w; }
 
 
+// comparison and selection. masks are all ones / all zeros per lane
+
+typedef union {
+    float f;
+    uint32_t u;
+} _simd4f_lane;
+
+vectorial_inline float _simd4f_mask_lane(int condition) {
+    _simd4f_lane l;
+    l.u = condition ? 0xffffffff : 0;
+    return l.f;
+}
+
+vectorial_inline float _simd4f_select_lane(float mask, float a, float b) {
+    _simd4f_lane m, x, y;
+    m.f = mask; x.f = a; y.f = b;
+    x.u = ( m.u & x.u ) | ( ~m.u & y.u );
+    return x.f;
+}
+
+vectorial_inline simd4f simd4f_abs(simd4f v) {
+    simd4f s = { fabsf(v.x), fabsf(v.y), fabsf(v.z), fabsf(v.w) };
+    return s;
+}
+
+vectorial_inline simd4f simd4f_min(simd4f lhs, simd4f rhs) {
+    simd4f s = { lhs.x < rhs.x ? lhs.x : rhs.x, lhs.y < rhs.y ? lhs.y : rhs.y, lhs.z < rhs.z ? lhs.z : rhs.z, lhs.w < rhs.w ? lhs.w : rhs.w };
+    return s;
+}
+
+vectorial_inline simd4f simd4f_max(simd4f lhs, simd4f rhs) {
+    simd4f s = { lhs.x > rhs.x ? lhs.x : rhs.x, lhs.y > rhs.y ? lhs.y : rhs.y, lhs.z > rhs.z ? lhs.z : rhs.z, lhs.w > rhs.w ? lhs.w : rhs.w };
+    return s;
+}
+
+vectorial_inline simd4f simd4f_cmplt(simd4f lhs, simd4f rhs) {
+    simd4f s = { _simd4f_mask_lane(lhs.x < rhs.x), _simd4f_mask_lane(lhs.y < rhs.y), _simd4f_mask_lane(lhs.z < rhs.z), _simd4f_mask_lane(lhs.w < rhs.w) };
+    return s;
+}
+
+vectorial_inline simd4f simd4f_select(simd4f mask, simd4f a, simd4f b) {
+    simd4f s = { _simd4f_select_lane(mask.x, a.x, b.x), _simd4f_select_lane(mask.y, a.y, b.y), _simd4f_select_lane(mask.z, a.z, b.z), _simd4f_select_lane(mask.w, a.w, b.w) };
+    return s;
+}
+
+vectorial_inline simd4f simd4f_cmple(simd4f lhs, simd4f rhs) {
+    simd4f s = { _simd4f_mask_lane(lhs.x <= rhs.x), _simd4f_mask_lane(lhs.y <= rhs.y), _simd4f_mask_lane(lhs.z <= rhs.z), _simd4f_mask_lane(lhs.w <= rhs.w) };
+    return s;
+}
+
+vectorial_inline simd4f simd4f_and(simd4f lhs, simd4f rhs) {
+    simd4f s = { _simd4f_select_lane(lhs.x, rhs.x, 0.0f), _simd4f_select_lane(lhs.y, rhs.y, 0.0f), _simd4f_select_lane(lhs.z, rhs.z, 0.0f), _simd4f_select_lane(lhs.w, rhs.w, 0.0f) };
+    return s;
+}
+
+vectorial_inline simd4f simd4f_or(simd4f lhs, simd4f rhs) {
+    simd4f s = { _simd4f_select_lane(lhs.x, lhs.x, rhs.x), _simd4f_select_lane(lhs.y, lhs.y, rhs.y), _simd4f_select_lane(lhs.z, lhs.z, rhs.z), _simd4f_select_lane(lhs.w, lhs.w, rhs.w) };
+    return s;
+}
+
+// one bit per lane, lane 0 in bit 0
+
+vectorial_inline int _simd4f_sign_lane(float f) {
+    _simd4f_lane l;
+    l.f = f;
+    return l.u >> 31;
+}
+
+vectorial_inline int simd4f_movemask(simd4f mask) {
+    return _simd4f_sign_lane(mask.x) | ( _simd4f_sign_lane(mask.y) << 1 ) | ( _simd4f_sign_lane(mask.z) << 2 ) | ( _simd4f_sign_lane(mask.w) << 3 );
+}
+
+
 #ifdef __cplusplus
 }
 #endif
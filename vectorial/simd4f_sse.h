@@ -145,6 +145,47 @@ vectorial_inline float simd4f_get_z(simd4f s) { _simd4f_union u={s}; return u.f[
 vectorial_inline float simd4f_get_w(simd4f s) { _simd4f_union u={s}; return u.f[3]; }
 
 
+// comparison and selection. masks are all ones / all zeros per lane
+
+vectorial_inline simd4f simd4f_abs(simd4f v) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+vectorial_inline simd4f simd4f_min(simd4f lhs, simd4f rhs) {
+    return _mm_min_ps(lhs, rhs);
+}
+
+vectorial_inline simd4f simd4f_max(simd4f lhs, simd4f rhs) {
+    return _mm_max_ps(lhs, rhs);
+}
+
+vectorial_inline simd4f simd4f_cmplt(simd4f lhs, simd4f rhs) {
+    return _mm_cmplt_ps(lhs, rhs);
+}
+
+vectorial_inline simd4f simd4f_select(simd4f mask, simd4f a, simd4f b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+vectorial_inline simd4f simd4f_cmple(simd4f lhs, simd4f rhs) {
+    return _mm_cmple_ps(lhs, rhs);
+}
+
+vectorial_inline simd4f simd4f_and(simd4f lhs, simd4f rhs) {
+    return _mm_and_ps(lhs, rhs);
+}
+
+vectorial_inline simd4f simd4f_or(simd4f lhs, simd4f rhs) {
+    return _mm_or_ps(lhs, rhs);
+}
+
+// one bit per lane, lane 0 in bit 0
+
+vectorial_inline int simd4f_movemask(simd4f mask) {
+    return _mm_movemask_ps(mask);
+}
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,24 @@
+/*
+  Vectorial
+  Copyright (c) 2010 Mikko Lehtonen
+  Licensed under the terms of the two-clause BSD License (see LICENSE)
+*/
+
+#ifndef VECTORIAL_SIMD8F_H
+#define VECTORIAL_SIMD8F_H
+
+#ifndef VECTORIAL_SIMD4F_H
+  #include "simd4f.h"
+#endif
+
+
+#ifdef VECTORIAL_AVX
+    #include "simd8f_avx.h"
+    #define VECTORIAL_SIMD8_TYPE "avx"
+#else
+    #include "simd8f_simd4f.h"
+    #define VECTORIAL_SIMD8_TYPE "simd4f x 2"
+#endif
+
+
+#endif
@@ -0,0 +1,149 @@
+/*
+  Vectorial
+  Copyright (c) 2010 Mikko Lehtonen
+  Licensed under the terms of the two-clause BSD License (see LICENSE)
+*/
+#ifndef VECTORIAL_SIMD8F_AVX_H
+#define VECTORIAL_SIMD8F_AVX_H
+
+#include <immintrin.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef __m256 simd8f;
+
+typedef union {
+    simd8f s ;
+    float f[8];
+} _simd8f_union;
+
+// creating
+
+vectorial_inline simd8f simd8f_create(float a, float b, float c, float d, float e, float f, float g, float h) {
+    simd8f s = { a, b, c, d, e, f, g, h };
+    return s;
+}
+
+vectorial_inline simd8f simd8f_combine(simd4f lo, simd4f hi) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+vectorial_inline simd8f simd8f_zero() { return _mm256_setzero_ps(); }
+
+vectorial_inline simd8f simd8f_uload8(const float *ary) {
+    return _mm256_loadu_ps(ary);
+}
+
+vectorial_inline void simd8f_ustore8(const simd8f val, float *ary) {
+    _mm256_storeu_ps(ary, val);
+}
+
+
+// utilities
+
+vectorial_inline simd8f simd8f_splat(float v) { 
+    return _mm256_set1_ps(v);
+}
+
+vectorial_inline simd4f simd8f_get_low(simd8f v) {
+    return _mm256_castps256_ps128(v);
+}
+
+vectorial_inline simd4f simd8f_get_high(simd8f v) {
+    return _mm256_extractf128_ps(v, 1);
+}
+
+vectorial_inline float simd8f_get(simd8f s, int i) { _simd8f_union u={s}; return u.f[i]; }
+
+vectorial_inline simd8f simd8f_reciprocal(simd8f v) { 
+    return _mm256_rcp_ps(v);
+}
+
+vectorial_inline simd8f simd8f_sqrt(simd8f v) { 
+    return _mm256_sqrt_ps(v);
+}
+
+vectorial_inline simd8f simd8f_rsqrt(simd8f v) { 
+    return _mm256_rsqrt_ps(v);
+}
+
+
+// arithmetic
+
+vectorial_inline simd8f simd8f_add(simd8f lhs, simd8f rhs) {
+    return _mm256_add_ps(lhs, rhs);
+}
+
+vectorial_inline simd8f simd8f_sub(simd8f lhs, simd8f rhs) {
+    return _mm256_sub_ps(lhs, rhs);
+}
+
+vectorial_inline simd8f simd8f_mul(simd8f lhs, simd8f rhs) {
+    return _mm256_mul_ps(lhs, rhs);
+}
+
+vectorial_inline simd8f simd8f_div(simd8f lhs, simd8f rhs) {
+    return _mm256_div_ps(lhs, rhs);
+}
+
+// a * b + c
+
+vectorial_inline simd8f simd8f_madd(simd8f a, simd8f b, simd8f c) {
+#ifdef __FMA__
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+
+// comparison and selection. masks are all ones / all zeros per lane
+
+vectorial_inline simd8f simd8f_abs(simd8f v) {
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v);
+}
+
+vectorial_inline simd8f simd8f_min(simd8f lhs, simd8f rhs) {
+    return _mm256_min_ps(lhs, rhs);
+}
+
+vectorial_inline simd8f simd8f_max(simd8f lhs, simd8f rhs) {
+    return _mm256_max_ps(lhs, rhs);
+}
+
+vectorial_inline simd8f simd8f_cmplt(simd8f lhs, simd8f rhs) {
+    return _mm256_cmp_ps(lhs, rhs, _CMP_LT_OQ);
+}
+
+vectorial_inline simd8f simd8f_select(simd8f mask, simd8f a, simd8f b) {
+    return _mm256_blendv_ps(b, a, mask);
+}
+
+vectorial_inline simd8f simd8f_cmple(simd8f lhs, simd8f rhs) {
+    return _mm256_cmp_ps(lhs, rhs, _CMP_LE_OQ);
+}
+
+vectorial_inline simd8f simd8f_and(simd8f lhs, simd8f rhs) {
+    return _mm256_and_ps(lhs, rhs);
+}
+
+vectorial_inline simd8f simd8f_or(simd8f lhs, simd8f rhs) {
+    return _mm256_or_ps(lhs, rhs);
+}
+
+// one bit per lane, lane 0 in bit 0
+
+vectorial_inline int simd8f_movemask(simd8f mask) {
+    return _mm256_movemask_ps(mask);
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -0,0 +1,146 @@
+/*
+  Vectorial
+  Copyright (c) 2010 Mikko Lehtonen
+  Licensed under the terms of the two-clause BSD License (see LICENSE)
+*/
+#ifndef VECTORIAL_SIMD8F_SIMD4F_H
+#define VECTORIAL_SIMD8F_SIMD4F_H
+
+// portable 8-wide fallback: two simd4f of whatever backend is selected
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct {
+    simd4f lo;
+    simd4f hi;
+} simd8f;
+
+// creating
+
+vectorial_inline simd8f simd8f_create(float a, float b, float c, float d, float e, float f, float g, float h) {
+    simd8f s = { simd4f_create(a, b, c, d), simd4f_create(e, f, g, h) };
+    return s;
+}
+
+vectorial_inline simd8f simd8f_combine(simd4f lo, simd4f hi) {
+    simd8f s = { lo, hi };
+    return s;
+}
+
+vectorial_inline simd8f simd8f_zero() { return simd8f_combine(simd4f_zero(), simd4f_zero()); }
+
+vectorial_inline simd8f simd8f_uload8(const float *ary) {
+    return simd8f_combine(simd4f_uload4(ary), simd4f_uload4(ary + 4));
+}
+
+vectorial_inline void simd8f_ustore8(const simd8f val, float *ary) {
+    simd4f_ustore4(val.lo, ary);
+    simd4f_ustore4(val.hi, ary + 4);
+}
+
+
+// utilities
+
+vectorial_inline simd8f simd8f_splat(float v) { 
+    const simd4f s = simd4f_splat(v);
+    return simd8f_combine(s, s);
+}
+
+vectorial_inline simd4f simd8f_get_low(simd8f v) { return v.lo; }
+
+vectorial_inline simd4f simd8f_get_high(simd8f v) { return v.hi; }
+
+vectorial_inline float simd8f_get(simd8f s, int i) { 
+    float f[4];
+    simd4f_ustore4(i < 4 ? s.lo : s.hi, f);
+    return f[i&3];
+}
+
+vectorial_inline simd8f simd8f_reciprocal(simd8f v) { 
+    return simd8f_combine(simd4f_reciprocal(v.lo), simd4f_reciprocal(v.hi));
+}
+
+vectorial_inline simd8f simd8f_sqrt(simd8f v) { 
+    return simd8f_combine(simd4f_sqrt(v.lo), simd4f_sqrt(v.hi));
+}
+
+vectorial_inline simd8f simd8f_rsqrt(simd8f v) { 
+    return simd8f_combine(simd4f_rsqrt(v.lo), simd4f_rsqrt(v.hi));
+}
+
+
+// arithmetic
+
+vectorial_inline simd8f simd8f_add(simd8f lhs, simd8f rhs) {
+    return simd8f_combine(simd4f_add(lhs.lo, rhs.lo), simd4f_add(lhs.hi, rhs.hi));
+}
+
+vectorial_inline simd8f simd8f_sub(simd8f lhs, simd8f rhs) {
+    return simd8f_combine(simd4f_sub(lhs.lo, rhs.lo), simd4f_sub(lhs.hi, rhs.hi));
+}
+
+vectorial_inline simd8f simd8f_mul(simd8f lhs, simd8f rhs) {
+    return simd8f_combine(simd4f_mul(lhs.lo, rhs.lo), simd4f_mul(lhs.hi, rhs.hi));
+}
+
+vectorial_inline simd8f simd8f_div(simd8f lhs, simd8f rhs) {
+    return simd8f_combine(simd4f_div(lhs.lo, rhs.lo), simd4f_div(lhs.hi, rhs.hi));
+}
+
+// a * b + c
+
+vectorial_inline simd8f simd8f_madd(simd8f a, simd8f b, simd8f c) {
+    return simd8f_add(simd8f_mul(a, b), c);
+}
+
+
+// comparison and selection. masks are all ones / all zeros per lane
+
+vectorial_inline simd8f simd8f_abs(simd8f v) {
+    return simd8f_combine(simd4f_abs(v.lo), simd4f_abs(v.hi));
+}
+
+vectorial_inline simd8f simd8f_min(simd8f lhs, simd8f rhs) {
+    return simd8f_combine(simd4f_min(lhs.lo, rhs.lo), simd4f_min(lhs.hi, rhs.hi));
+}
+
+vectorial_inline simd8f simd8f_max(simd8f lhs, simd8f rhs) {
+    return simd8f_combine(simd4f_max(lhs.lo, rhs.lo), simd4f_max(lhs.hi, rhs.hi));
+}
+
+vectorial_inline simd8f simd8f_cmplt(simd8f lhs, simd8f rhs) {
+    return simd8f_combine(simd4f_cmplt(lhs.lo, rhs.lo), simd4f_cmplt(lhs.hi, rhs.hi));
+}
+
+vectorial_inline simd8f simd8f_select(simd8f mask, simd8f a, simd8f b) {
+    return simd8f_combine(simd4f_select(mask.lo, a.lo, b.lo), simd4f_select(mask.hi, a.hi, b.hi));
+}
+
+vectorial_inline simd8f simd8f_cmple(simd8f lhs, simd8f rhs) {
+    return simd8f_combine(simd4f_cmple(lhs.lo, rhs.lo), simd4f_cmple(lhs.hi, rhs.hi));
+}
+
+vectorial_inline simd8f simd8f_and(simd8f lhs, simd8f rhs) {
+    return simd8f_combine(simd4f_and(lhs.lo, rhs.lo), simd4f_and(lhs.hi, rhs.hi));
+}
+
+vectorial_inline simd8f simd8f_or(simd8f lhs, simd8f rhs) {
+    return simd8f_combine(simd4f_or(lhs.lo, rhs.lo), simd4f_or(lhs.hi, rhs.hi));
+}
+
+// one bit per lane, lane 0 in bit 0
+
+vectorial_inline int simd8f_movemask(simd8f mask) {
+    return simd4f_movemask(mask.lo) | ( simd4f_movemask(mask.hi) << 4 );
+}
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -4,6 +4,7 @@
   Licensed under the terms of the two-clause BSD License (see LICENSE)
 */
 #ifndef VECTORIAL_VEC2F_H
+#define VECTORIAL_VEC2F_H
 
 #ifndef VECTORIAL_SIMD4F_H
   #include "simd4f.h"
@@ -0,0 +1,147 @@
+/*
+  Vectorial
+  Copyright (c) 2010 Mikko Lehtonen
+  Licensed under the terms of the two-clause BSD License (see LICENSE)
+*/
+#ifndef VECTORIAL_VEC3X4F_H
+#define VECTORIAL_VEC3X4F_H
+
+#ifndef VECTORIAL_SIMD4X4F_H
+  #include "vectorial/simd4x4f.h"
+#endif
+
+#ifndef VECTORIAL_VEC3F_H
+  #include "vectorial/vec3f.h"
+#endif
+
+
+
+namespace vectorial {
+
+    // four vec3f in structure of arrays form: x, y and z for all four
+    // lanes each live in their own register, so dot and cross are plain
+    // multiplies and adds with no horizontal shuffles
+
+    class vec3x4f {
+    public:
+
+        simd4f x, y, z;
+
+        inline vec3x4f() {}
+        inline vec3x4f(const simd4f& x, const simd4f& y, const simd4f& z) : x(x), y(y), z(z) {}
+        inline explicit vec3x4f(const vec3f& v) : x( simd4f_splat_x(v.value) ), y( simd4f_splat_y(v.value) ), z( simd4f_splat_z(v.value) ) {}
+        inline vec3x4f(const vec3f& a, const vec3f& b, const vec3f& c, const vec3f& d) { load(a, b, c, d); }
+        inline vec3x4f(const vec3f * v) { load(v[0], v[1], v[2], v[3]); }
+
+        inline void load(const vec3f& a, const vec3f& b, const vec3f& c, const vec3f& d) {
+            simd4x4f m = simd4x4f_create(a.value, b.value, c.value, d.value);
+            simd4x4f_transpose_inplace(&m);
+            x = m.x;
+            y = m.y;
+            z = m.z;
+        }
+
+        inline void store(vec3f& a, vec3f& b, vec3f& c, vec3f& d) const {
+            simd4x4f m = simd4x4f_create(x, y, z, simd4f_zero());
+            simd4x4f_transpose_inplace(&m);
+            a = vec3f(m.x);
+            b = vec3f(m.y);
+            c = vec3f(m.z);
+            d = vec3f(m.w);
+        }
+
+        inline void load(const vec3f * v) { load(v[0], v[1], v[2], v[3]); }
+        inline void store(vec3f * v) const { store(v[0], v[1], v[2], v[3]); }
+
+        inline vec3f get(int i) const {
+            float fx[4], fy[4], fz[4];
+            simd4f_ustore4(x, fx);
+            simd4f_ustore4(y, fy);
+            simd4f_ustore4(z, fz);
+            return vec3f(fx[i], fy[i], fz[i]);
+        }
+
+        enum { lanes = 4 };
+
+        static vec3x4f zero() { return vec3x4f(simd4f_zero(), simd4f_zero(), simd4f_zero()); }
+
+    };
+
+
+    vectorial_inline vec3x4f operator-(const vec3x4f& lhs) {
+        const simd4f zero = simd4f_zero();
+        return vec3x4f( simd4f_sub(zero, lhs.x), simd4f_sub(zero, lhs.y), simd4f_sub(zero, lhs.z) );
+    }
+
+    vectorial_inline vec3x4f operator+(const vec3x4f& lhs, const vec3x4f& rhs) {
+        return vec3x4f( simd4f_add(lhs.x, rhs.x), simd4f_add(lhs.y, rhs.y), simd4f_add(lhs.z, rhs.z) );
+    }
+
+    vectorial_inline vec3x4f operator-(const vec3x4f& lhs, const vec3x4f& rhs) {
+        return vec3x4f( simd4f_sub(lhs.x, rhs.x), simd4f_sub(lhs.y, rhs.y), simd4f_sub(lhs.z, rhs.z) );
+    }
+
+    vectorial_inline vec3x4f operator*(const vec3x4f& lhs, const vec3x4f& rhs) {
+        return vec3x4f( simd4f_mul(lhs.x, rhs.x), simd4f_mul(lhs.y, rhs.y), simd4f_mul(lhs.z, rhs.z) );
+    }
+
+    vectorial_inline vec3x4f operator+=(vec3x4f& lhs, const vec3x4f& rhs) {
+        return lhs = lhs + rhs;
+    }
+
+    vectorial_inline vec3x4f operator-=(vec3x4f& lhs, const vec3x4f& rhs) {
+        return lhs = lhs - rhs;
+    }
+
+
+    // per lane scale
+
+    vectorial_inline vec3x4f operator*(const vec3x4f& lhs, const simd4f& rhs) {
+        return vec3x4f( simd4f_mul(lhs.x, rhs), simd4f_mul(lhs.y, rhs), simd4f_mul(lhs.z, rhs) );
+    }
+
+    vectorial_inline vec3x4f operator*(const simd4f& lhs, const vec3x4f& rhs) {
+        return rhs * lhs;
+    }
+
+    vectorial_inline vec3x4f operator*(const vec3x4f& lhs, float rhs) {
+        return lhs * simd4f_splat(rhs);
+    }
+
+    vectorial_inline vec3x4f operator*(float lhs, const vec3x4f& rhs) {
+        return rhs * simd4f_splat(lhs);
+    }
+
+
+    vectorial_inline simd4f dot(const vec3x4f& lhs, const vec3x4f& rhs) {
+        return simd4f_add( simd4f_add( simd4f_mul(lhs.x, rhs.x), simd4f_mul(lhs.y, rhs.y) ), simd4f_mul(lhs.z, rhs.z) );
+    }
+
+    vectorial_inline vec3x4f cross(const vec3x4f& lhs, const vec3x4f& rhs) {
+        return vec3x4f( simd4f_sub( simd4f_mul(lhs.y, rhs.z), simd4f_mul(lhs.z, rhs.y) ),
+                        simd4f_sub( simd4f_mul(lhs.z, rhs.x), simd4f_mul(lhs.x, rhs.z) ),
+                        simd4f_sub( simd4f_mul(lhs.x, rhs.y), simd4f_mul(lhs.y, rhs.x) ) );
+    }
+
+    vectorial_inline simd4f length_squared(const vec3x4f& v) {
+        return dot(v, v);
+    }
+
+    vectorial_inline simd4f length(const vec3x4f& v) {
+        return simd4f_sqrt( dot(v, v) );
+    }
+
+    vectorial_inline vec3x4f normalize(const vec3x4f& v) {
+        // rsqrt estimate plus one newton-raphson step: ~23 bits on sse
+        const simd4f lengthSquared = dot(v, v);
+        const simd4f estimate = simd4f_rsqrt(lengthSquared);
+        const simd4f halfLengthSquared = simd4f_mul(lengthSquared, simd4f_splat(0.5f));
+        const simd4f invlen = simd4f_mul(estimate, simd4f_sub(simd4f_splat(1.5f), simd4f_mul(halfLengthSquared, simd4f_mul(estimate, estimate))));
+        return v * invlen;
+    }
+
+}
+
+
+
+#endif
@@ -0,0 +1,151 @@
+/*
+  Vectorial
+  Copyright (c) 2010 Mikko Lehtonen
+  Licensed under the terms of the two-clause BSD License (see LICENSE)
+*/
+#ifndef VECTORIAL_VEC3X8F_H
+#define VECTORIAL_VEC3X8F_H
+
+#ifndef VECTORIAL_SIMD4X4F_H
+  #include "vectorial/simd4x4f.h"
+#endif
+
+#ifndef VECTORIAL_SIMD8F_H
+  #include "vectorial/simd8f.h"
+#endif
+
+#ifndef VECTORIAL_VEC3F_H
+  #include "vectorial/vec3f.h"
+#endif
+
+
+
+namespace vectorial {
+
+    // eight vec3f in structure of arrays form. same as vec3x4f but eight
+    // lanes wide: one avx register per component, or two simd4f without avx
+
+    class vec3x8f {
+    public:
+
+        simd8f x, y, z;
+
+        inline vec3x8f() {}
+        inline vec3x8f(const simd8f& x, const simd8f& y, const simd8f& z) : x(x), y(y), z(z) {}
+        inline explicit vec3x8f(const vec3f& v) : x( simd8f_splat(v.x()) ), y( simd8f_splat(v.y()) ), z( simd8f_splat(v.z()) ) {}
+        inline vec3x8f(const vec3f * v) { load(v); }
+
+        inline void load(const vec3f * v) {
+            simd4x4f lo = simd4x4f_create(v[0].value, v[1].value, v[2].value, v[3].value);
+            simd4x4f hi = simd4x4f_create(v[4].value, v[5].value, v[6].value, v[7].value);
+            simd4x4f_transpose_inplace(&lo);
+            simd4x4f_transpose_inplace(&hi);
+            x = simd8f_combine(lo.x, hi.x);
+            y = simd8f_combine(lo.y, hi.y);
+            z = simd8f_combine(lo.z, hi.z);
+        }
+
+        inline void store(vec3f * v) const {
+            simd4x4f lo = simd4x4f_create(simd8f_get_low(x), simd8f_get_low(y), simd8f_get_low(z), simd4f_zero());
+            simd4x4f hi = simd4x4f_create(simd8f_get_high(x), simd8f_get_high(y), simd8f_get_high(z), simd4f_zero());
+            simd4x4f_transpose_inplace(&lo);
+            simd4x4f_transpose_inplace(&hi);
+            v[0] = vec3f(lo.x);
+            v[1] = vec3f(lo.y);
+            v[2] = vec3f(lo.z);
+            v[3] = vec3f(lo.w);
+            v[4] = vec3f(hi.x);
+            v[5] = vec3f(hi.y);
+            v[6] = vec3f(hi.z);
+            v[7] = vec3f(hi.w);
+        }
+
+        inline vec3f get(int i) const {
+            return vec3f(simd8f_get(x, i), simd8f_get(y, i), simd8f_get(z, i));
+        }
+
+        enum { lanes = 8 };
+
+        static vec3x8f zero() { return vec3x8f(simd8f_zero(), simd8f_zero(), simd8f_zero()); }
+
+    };
+
+
+    vectorial_inline vec3x8f operator-(const vec3x8f& lhs) {
+        const simd8f zero = simd8f_zero();
+        return vec3x8f( simd8f_sub(zero, lhs.x), simd8f_sub(zero, lhs.y), simd8f_sub(zero, lhs.z) );
+    }
+
+    vectorial_inline vec3x8f operator+(const vec3x8f& lhs, const vec3x8f& rhs) {
+        return vec3x8f( simd8f_add(lhs.x, rhs.x), simd8f_add(lhs.y, rhs.y), simd8f_add(lhs.z, rhs.z) );
+    }
+
+    vectorial_inline vec3x8f operator-(const vec3x8f& lhs, const vec3x8f& rhs) {
+        return vec3x8f( simd8f_sub(lhs.x, rhs.x), simd8f_sub(lhs.y, rhs.y), simd8f_sub(lhs.z, rhs.z) );
+    }
+
+    vectorial_inline vec3x8f operator*(const vec3x8f& lhs, const vec3x8f& rhs) {
+        return vec3x8f( simd8f_mul(lhs.x, rhs.x), simd8f_mul(lhs.y, rhs.y), simd8f_mul(lhs.z, rhs.z) );
+    }
+
+    vectorial_inline vec3x8f operator+=(vec3x8f& lhs, const vec3x8f& rhs) {
+        return lhs = lhs + rhs;
+    }
+
+    vectorial_inline vec3x8f operator-=(vec3x8f& lhs, const vec3x8f& rhs) {
+        return lhs = lhs - rhs;
+    }
+
+
+    // per lane scale
+
+    vectorial_inline vec3x8f operator*(const vec3x8f& lhs, const simd8f& rhs) {
+        return vec3x8f( simd8f_mul(lhs.x, rhs), simd8f_mul(lhs.y, rhs), simd8f_mul(lhs.z, rhs) );
+    }
+
+    vectorial_inline vec3x8f operator*(const simd8f& lhs, const vec3x8f& rhs) {
+        return rhs * lhs;
+    }
+
+    vectorial_inline vec3x8f operator*(const vec3x8f& lhs, float rhs) {
+        return lhs * simd8f_splat(rhs);
+    }
+
+    vectorial_inline vec3x8f operator*(float lhs, const vec3x8f& rhs) {
+        return rhs * simd8f_splat(lhs);
+    }
+
+
+    vectorial_inline simd8f dot(const vec3x8f& lhs, const vec3x8f& rhs) {
+        // IMPORTANT: same operations in the same order as vec3x4f, so both widths give the same bits
+        return simd8f_add( simd8f_add( simd8f_mul(lhs.x, rhs.x), simd8f_mul(lhs.y, rhs.y) ), simd8f_mul(lhs.z, rhs.z) );
+    }
+
+    vectorial_inline vec3x8f cross(const vec3x8f& lhs, const vec3x8f& rhs) {
+        return vec3x8f( simd8f_sub( simd8f_mul(lhs.y, rhs.z), simd8f_mul(lhs.z, rhs.y) ),
+                        simd8f_sub( simd8f_mul(lhs.z, rhs.x), simd8f_mul(lhs.x, rhs.z) ),
+                        simd8f_sub( simd8f_mul(lhs.x, rhs.y), simd8f_mul(lhs.y, rhs.x) ) );
+    }
+
+    vectorial_inline simd8f length_squared(const vec3x8f& v) {
+        return dot(v, v);
+    }
+
+    vectorial_inline simd8f length(const vec3x8f& v) {
+        return simd8f_sqrt( dot(v, v) );
+    }
+
+    vectorial_inline vec3x8f normalize(const vec3x8f& v) {
+        // rsqrt estimate plus one newton-raphson step: ~23 bits on avx
+        const simd8f lengthSquared = dot(v, v);
+        const simd8f estimate = simd8f_rsqrt(lengthSquared);
+        const simd8f halfLengthSquared = simd8f_mul(lengthSquared, simd8f_splat(0.5f));
+        const simd8f invlen = simd8f_mul(estimate, simd8f_sub(simd8f_splat(1.5f), simd8f_mul(halfLengthSquared, simd8f_mul(estimate, estimate))));
+        return v * invlen;
+    }
+
+}
+
+
+
+#endif